@@ -0,0 +1,542 @@
+#include <algorithm>
+#include <array>
+#include <format>
+#include <ranges>
+#include <set>
+#include <stdexcept>
+#include <utility>
+
+#include "elaborate/attrs.hpp"
+
+namespace elaborate {
+
+namespace {
+
+constexpr std::array<std::string_view, 6> hints {
+    "inline",
+    "noinline",
+    "hot",
+    "cold",
+    "pure",
+    "noalloc",
+};
+
+const std::string* attr_ident(const Expr& attr) {
+    const auto* name = &attr;
+    if (attr.get_kind() == Expr::Kind::App) {
+        name = static_cast<const AppExpr&>(attr).func.get();
+    }
+    if (name->get_kind() != Expr::Kind::Var) {
+        return nullptr;
+    }
+    return &static_cast<const VarExpr&>(*name).ident;
+}
+
+// binary operators that build a new vector from SIMD operands
+const std::set<BinaryExpr::Op> lane_wise_ops {
+    BinaryExpr::Op::Add,
+    BinaryExpr::Op::Sub,
+    BinaryExpr::Op::Mul,
+    BinaryExpr::Op::Lt,
+    BinaryExpr::Op::Gt,
+    BinaryExpr::Op::Lte,
+    BinaryExpr::Op::Gte,
+};
+
+bool destructures_pair(const Pat& pat) {
+    return pat.get_kind() == Pat::Kind::Tuple
+        && static_cast<const TuplePat&>(pat).elems.size() == 2;
+}
+
+} // namespace
+
+void check_hints(const std::vector<std::shared_ptr<Expr>>& attrs, const Decl* decl, Span span) {
+    for (const auto& attr: attrs) {
+        const auto* ident = attr_ident(*attr);
+        if (!ident || std::ranges::find(hints, *ident) == hints.end()) {
+            continue;
+        }
+        if (attr->get_kind() != Expr::Kind::Var) {
+            throw std::runtime_error(
+                std::format("Attribute @{} takes no arguments at {}", *ident, attr->get_span())
+            );
+        }
+        if (!decl || decl->get_kind() != Decl::Kind::Func) {
+            throw std::runtime_error(
+                std::format("Attribute @{} only applies to functions at {}", *ident, span)
+            );
+        }
+        if (*ident == "inline" && !static_cast<const FuncDecl&>(*decl).body.has_value()) {
+            throw std::runtime_error(
+                std::format("Function without a body cannot be @inline at {}", span)
+            );
+        }
+    }
+    for (auto [first, second]: {std::pair {"inline", "noinline"}, std::pair {"hot", "cold"}}) {
+        if (has_attr(attrs, first) && has_attr(attrs, second)) {
+            throw std::runtime_error(
+                std::format("Attributes @{} and @{} conflict at {}", first, second, span)
+            );
+        }
+    }
+}
+
+void check_layout(const std::vector<std::shared_ptr<Expr>>& attrs, const Decl* decl, Span span) {
+    bool is_extern = find_attr_arg(attrs, "extern").has_value();
+    bool repr_c = false;
+    for (const auto& attr: attrs) {
+        const auto* ident = attr_ident(*attr);
+        if (!ident || *ident != "repr") {
+            continue;
+        }
+        if (find_attr_arg(attrs, "repr") != "C") {
+            throw std::runtime_error(
+                std::format("Attribute @repr takes the argument C at {}", attr->get_span())
+            );
+        }
+        if (!decl
+            || (decl->get_kind() != Decl::Kind::Class && decl->get_kind() != Decl::Kind::Enum)) {
+            throw std::runtime_error(
+                std::format("Attribute @repr only applies to classes and enums at {}", span)
+            );
+        }
+        repr_c = true;
+    }
+    // a native class shares its layout with C, so its fields may not be reordered
+    if (is_extern && !repr_c && decl && decl->get_kind() == Decl::Kind::Class) {
+        const auto& class_decl = static_cast<const ClassDecl&>(*decl);
+        if (!class_fields(class_decl).empty()) {
+            throw std::runtime_error(std::format(
+                "Native class {} with fields must be @repr(C) at {}",
+                class_decl.ident,
+                span
+            ));
+        }
+    }
+    for (const auto& attr: attrs) {
+        const auto* ident = attr_ident(*attr);
+        if (!ident || *ident != "soa") {
+            continue;
+        }
+        if (attr->get_kind() != Expr::Kind::Var) {
+            throw std::runtime_error(
+                std::format("Attribute @soa takes no arguments at {}", attr->get_span())
+            );
+        }
+        if (!decl || decl->get_kind() != Decl::Kind::Class) {
+            throw std::runtime_error(
+                std::format("Attribute @soa only applies to classes at {}", span)
+            );
+        }
+        const auto& class_decl = static_cast<const ClassDecl&>(*decl);
+        if (is_extern) {
+            throw std::runtime_error(std::format("Native class cannot be @soa at {}", span));
+        }
+        if (class_fields(class_decl).empty()) {
+            throw std::runtime_error(
+                std::format("Class {} without fields cannot be @soa at {}", class_decl.ident, span)
+            );
+        }
+    }
+}
+
+void NoallocChecker::run(const Package& pkg) {
+    funcs.clear();
+    soa_classes.clear();
+    checked = 0;
+    collect_soa(pkg.body);
+    collect(pkg.body, pkg.ident);
+
+    // an allocation reached through a callee propagates until nothing changes
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (auto& [path, summary]: funcs) {
+            if (summary.reason || summary.via) {
+                continue;
+            }
+            for (const auto& callee: summary.callees) {
+                auto it = funcs.find(callee);
+                if (it == funcs.end() || it->second.reason || it->second.via) {
+                    summary.via = callee;
+                    changed = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (const auto& [path, summary]: funcs) {
+        if (!summary.noalloc) {
+            continue;
+        }
+        ++checked;
+        if (!summary.reason && !summary.via) {
+            continue;
+        }
+        std::string chain = path;
+        const auto* current = &summary;
+        while (current->via) {
+            chain += " -> " + *current->via;
+            auto it = funcs.find(*current->via);
+            if (it == funcs.end()) {
+                current = nullptr;
+                break;
+            }
+            current = &it->second;
+        }
+        throw std::runtime_error(std::format(
+            "Function {} is @noalloc but may allocate: {}{}",
+            path,
+            current ? *current->reason : "unknown function",
+            current == &summary ? "" : std::format(" (through {})", chain)
+        ));
+    }
+}
+
+void NoallocChecker::collect_soa(const std::vector<std::shared_ptr<Decl>>& decls) {
+    for (const auto& decl: decls) {
+        if (decl->get_kind() == Decl::Kind::Module) {
+            collect_soa(static_cast<const ModuleDecl&>(*decl).body);
+        } else if (decl->get_kind() == Decl::Kind::Class && has_attr(decl->attrs, "soa")) {
+            soa_classes.insert(static_cast<const ClassDecl&>(*decl).ident);
+        }
+    }
+}
+
+bool NoallocChecker::is_soa_array(const Type& type) const {
+    if (type.get_kind() != Type::Kind::Class) {
+        return false;
+    }
+    const auto& class_type = static_cast<const ClassType&>(type);
+    if (!class_type.type_args.has_value() || class_type.type_args->size() != 1) {
+        return false;
+    }
+    const auto& elem = *class_type.type_args->front();
+    return elem.get_kind() == Type::Kind::Class
+        && soa_classes.contains(static_cast<const ClassType&>(elem).ident);
+}
+
+void NoallocChecker::bind_var(const Pat& pat) {
+    if (pat.get_kind() != Pat::Kind::Var) {
+        return;
+    }
+    const auto& var_pat = static_cast<const VarPat&>(pat);
+    if (var_pat.hint && !var_pat.is_mut && is_soa_array(*var_pat.hint)) {
+        soa_vars.insert(var_pat.ident);
+    } else {
+        soa_vars.erase(var_pat.ident);
+    }
+    if (var_pat.hint && var_pat.hint->get_kind() == Type::Kind::Simd) {
+        simd_vars.insert(var_pat.ident);
+    } else {
+        simd_vars.erase(var_pat.ident);
+    }
+}
+
+bool NoallocChecker::is_simd_var(const Expr& expr) const {
+    return expr.get_kind() == Expr::Kind::Var
+        && simd_vars.contains(static_cast<const VarExpr&>(expr).ident);
+}
+
+void NoallocChecker::collect(
+    const std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    for (const auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                const auto& module_decl = static_cast<const ModuleDecl&>(*decl);
+                collect(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Extension: {
+                const auto& extension_decl = static_cast<const ExtensionDecl&>(*decl);
+                collect(extension_decl.body, prefix + "." + extension_decl.ident);
+                break;
+            }
+            case Decl::Kind::Func: {
+                const auto& func_decl = static_cast<const FuncDecl&>(*decl);
+                auto& summary = funcs[prefix + "." + func_decl.ident];
+                summary.noalloc = has_attr(func_decl.attrs, "noalloc");
+                soa_vars.clear();
+                simd_vars.clear();
+                for (const auto& param: func_decl.params) {
+                    bind_var(*param);
+                }
+                if (func_decl.body.has_value()) {
+                    visit_expr(**func_decl.body, summary);
+                } else if (!summary.noalloc) {
+                    allocates(summary, "native function not declared @noalloc");
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void NoallocChecker::allocates(Summary& summary, std::string reason) {
+    if (!summary.reason) {
+        summary.reason = std::move(reason);
+    }
+}
+
+void NoallocChecker::visit_expr(const Expr& expr, Summary& summary) {
+    auto span = expr.get_span();
+    switch (expr.get_kind()) {
+        case Expr::Kind::Unary: {
+            const auto& unary_expr = static_cast<const UnaryExpr&>(expr);
+            if (unary_expr.get_op() == UnaryExpr::Op::New) {
+                allocates(summary, std::format("new at {}", span));
+            } else if (unary_expr.get_op() == UnaryExpr::Op::Index) {
+                const auto& index_expr = static_cast<const IndexExpr&>(unary_expr);
+                if (index_expr.expr->get_kind() == Expr::Kind::Var
+                    && soa_vars.contains(static_cast<const VarExpr&>(*index_expr.expr).ident)) {
+                    allocates(summary, std::format("element of a @soa array at {}", span));
+                }
+                for (const auto& index: index_expr.indices) {
+                    visit_expr(*index, summary);
+                }
+            } else if (unary_expr.get_op() == UnaryExpr::Op::Field
+                       && unary_expr.expr->get_kind() == Expr::Kind::Unary
+                       && static_cast<const UnaryExpr&>(*unary_expr.expr).get_op()
+                           == UnaryExpr::Op::Index) {
+                // a field of an element is read straight from its column
+                const auto& index_expr = static_cast<const IndexExpr&>(*unary_expr.expr);
+                visit_expr(*index_expr.expr, summary);
+                for (const auto& index: index_expr.indices) {
+                    visit_expr(*index, summary);
+                }
+                break;
+            }
+            visit_expr(*unary_expr.expr, summary);
+            break;
+        }
+        case Expr::Kind::Binary: {
+            const auto& binary_expr = static_cast<const BinaryExpr&>(expr);
+            const auto& left = *binary_expr.left;
+            if (binary_expr.get_op() == BinaryExpr::Op::Assign
+                && left.get_kind() == Expr::Kind::Unary
+                && static_cast<const UnaryExpr&>(left).get_op() == UnaryExpr::Op::Index) {
+                // storing an element scatters it without building anything
+                const auto& index_expr = static_cast<const IndexExpr&>(left);
+                visit_expr(*index_expr.expr, summary);
+                for (const auto& index: index_expr.indices) {
+                    visit_expr(*index, summary);
+                }
+            } else {
+                visit_expr(left, summary);
+            }
+            auto op = binary_expr.get_op();
+            if (op == BinaryExpr::Op::Assign) {
+                op = static_cast<const AssignExpr&>(binary_expr).mode;
+            }
+            if (lane_wise_ops.contains(op)
+                && (is_simd_var(left) || is_simd_var(*binary_expr.right))) {
+                allocates(summary, std::format("SIMD vector at {}", span));
+            }
+            visit_expr(*binary_expr.right, summary);
+            break;
+        }
+        case Expr::Kind::Tuple:
+            allocates(summary, std::format("tuple at {}", span));
+            for (const auto& elem: static_cast<const TupleExpr&>(expr).elems) {
+                visit_expr(*elem, summary);
+            }
+            break;
+        case Expr::Kind::Hint:
+            visit_expr(*static_cast<const HintExpr&>(expr).expr, summary);
+            break;
+        case Expr::Kind::Func:
+            // a function used as a value becomes a closure
+            allocates(summary, std::format("closure at {}", span));
+            break;
+        case Expr::Kind::Ctor:
+            allocates(summary, std::format("constructor at {}", span));
+            break;
+        case Expr::Kind::Init:
+            allocates(summary, std::format("class instance at {}", span));
+            break;
+        case Expr::Kind::Lam:
+            allocates(summary, std::format("closure at {}", span));
+            visit_expr(*static_cast<const LamExpr&>(expr).body, summary);
+            break;
+        case Expr::Kind::App: {
+            const auto& app_expr = static_cast<const AppExpr&>(expr);
+            const auto& func = *app_expr.func;
+            if (func.get_kind() == Expr::Kind::Func) {
+                summary.callees.push_back(static_cast<const FuncExpr&>(func).ident);
+            } else if (func.get_kind() == Expr::Kind::Ctor) {
+                allocates(summary, std::format("constructor at {}", span));
+            } else if (func.get_kind() == Expr::Kind::Unary
+                       && static_cast<const UnaryExpr&>(func).get_op() == UnaryExpr::Op::Field) {
+                allocates(summary, std::format("dynamically dispatched method call at {}", span));
+                visit_expr(*static_cast<const UnaryExpr&>(func).expr, summary);
+            } else {
+                allocates(summary, std::format("call through a closure at {}", span));
+                visit_expr(func, summary);
+            }
+            for (const auto& arg: app_expr.args) {
+                visit_expr(*arg, summary);
+            }
+            break;
+        }
+        case Expr::Kind::Block: {
+            const auto& block_expr = static_cast<const BlockExpr&>(expr);
+            for (const auto& stmt: block_expr.stmts) {
+                visit_stmt(*stmt, summary);
+            }
+            if (block_expr.body.has_value()) {
+                visit_expr(**block_expr.body, summary);
+            }
+            break;
+        }
+        case Expr::Kind::Ite: {
+            const auto& ite_expr = static_cast<const IteExpr&>(expr);
+            for (const auto& then: ite_expr.then_branches) {
+                visit_cond(*then.cond, summary);
+                visit_expr(*then.then_branch, summary);
+            }
+            if (ite_expr.else_branch.has_value()) {
+                visit_expr(**ite_expr.else_branch, summary);
+            }
+            break;
+        }
+        case Expr::Kind::Switch: {
+            const auto& switch_expr = static_cast<const SwitchExpr&>(expr);
+            visit_expr(*switch_expr.expr, summary);
+            for (const auto& clause: switch_expr.clauses) {
+                if (clause->get_kind() == Clause::Kind::Default) {
+                    visit_expr(*static_cast<const DefaultClause&>(*clause).expr, summary);
+                    continue;
+                }
+                const auto& case_clause = static_cast<const CaseClause&>(*clause);
+                if (case_clause.guard.has_value()) {
+                    visit_expr(**case_clause.guard, summary);
+                }
+                visit_expr(*case_clause.expr, summary);
+            }
+            break;
+        }
+        case Expr::Kind::For: {
+            const auto& for_expr = static_cast<const ForExpr&>(expr);
+            visit_for(for_expr, summary);
+            visit_expr(*for_expr.body, summary);
+            break;
+        }
+        case Expr::Kind::While: {
+            const auto& while_expr = static_cast<const WhileExpr&>(expr);
+            visit_cond(*while_expr.cond, summary);
+            visit_expr(*while_expr.body, summary);
+            break;
+        }
+        case Expr::Kind::Loop:
+            visit_expr(*static_cast<const LoopExpr&>(expr).body, summary);
+            break;
+        case Expr::Kind::Return: {
+            const auto& return_expr = static_cast<const ReturnExpr&>(expr);
+            if (return_expr.expr.has_value()) {
+                visit_expr(**return_expr.expr, summary);
+            }
+            break;
+        }
+        case Expr::Kind::Yield:
+            visit_expr(*static_cast<const YieldExpr&>(expr).expr, summary);
+            break;
+        default:
+            break;
+    }
+}
+
+void NoallocChecker::visit_stmt(const Stmt& stmt, Summary& summary) {
+    switch (stmt.get_kind()) {
+        case Stmt::Kind::Let: {
+            const auto& let_stmt = static_cast<const LetStmt&>(stmt);
+            visit_expr(*let_stmt.expr, summary);
+            if (let_stmt.else_branch.has_value()) {
+                visit_expr(**let_stmt.else_branch, summary);
+            }
+            bind_var(*let_stmt.pat);
+            break;
+        }
+        case Stmt::Kind::Func:
+            // local functions are closures
+            allocates(summary, std::format("local function at {}", stmt.get_span()));
+            visit_expr(*static_cast<const FuncStmt&>(stmt).body, summary);
+            break;
+        case Stmt::Kind::Bind:
+            visit_expr(*static_cast<const BindStmt&>(stmt).expr, summary);
+            break;
+        case Stmt::Kind::Expr:
+            visit_expr(*static_cast<const ExprStmt&>(stmt).expr, summary);
+            break;
+    }
+}
+
+// Mirrors how the interpreter fuses a for loop: lambda literals run in place and
+// a zipped pair only becomes a tuple when it is not destructured right away.
+void NoallocChecker::visit_for(const ForExpr& expr, Summary& summary) {
+    if (visit_chain(*expr.iter, summary) && !destructures_pair(*expr.pat)) {
+        allocates(summary, std::format("zipped pair at {}", expr.get_span()));
+    }
+}
+
+bool NoallocChecker::visit_chain(const Expr& expr, Summary& summary) {
+    std::vector<const AppExpr*> adapters;
+    const Expr* source = &expr;
+    while (const auto* adapter = as_loop_adapter(*source)) {
+        adapters.push_back(adapter);
+        source = static_cast<const FieldExpr&>(*adapter->func).expr.get();
+    }
+    visit_expr(*source, summary);
+    if (source->get_kind() == Expr::Kind::Var
+        && soa_vars.contains(static_cast<const VarExpr&>(*source).ident)) {
+        allocates(summary, std::format("element of a @soa array at {}", source->get_span()));
+    }
+
+    bool pair = false;
+    for (const auto* adapter: adapters | std::views::reverse) {
+        const auto& name = static_cast<const FieldExpr&>(*adapter->func).path;
+        const auto& func = *adapter->args[0];
+        auto span = adapter->get_span();
+        bool consumes_pair = pair;
+        if (name == "zip") {
+            if (visit_chain(func, summary)) {
+                allocates(summary, std::format("zipped pair at {}", func.get_span()));
+            }
+            pair = true;
+        } else if (func.get_kind() == Expr::Kind::Lam
+                   && (static_cast<const LamExpr&>(func).params.size() == 1
+                       || (pair && static_cast<const LamExpr&>(func).params.size() == 2))) {
+            const auto& lam_expr = static_cast<const LamExpr&>(func);
+            consumes_pair = pair && lam_expr.params.size() == 1
+                && !destructures_pair(*lam_expr.params[0]);
+            visit_expr(*lam_expr.body, summary);
+        } else if (func.get_kind() == Expr::Kind::Func) {
+            summary.callees.push_back(static_cast<const FuncExpr&>(func).ident);
+        } else {
+            allocates(summary, std::format("call through a closure at {}", span));
+            visit_expr(func, summary);
+        }
+        if (consumes_pair) {
+            allocates(summary, std::format("zipped pair at {}", span));
+        }
+        pair = pair && name != "map";
+    }
+    return pair;
+}
+
+void NoallocChecker::visit_cond(const Cond& cond, Summary& summary) {
+    switch (cond.get_kind()) {
+        case Cond::Kind::Expr:
+            visit_expr(*static_cast<const ExprCond&>(cond).expr, summary);
+            break;
+        case Cond::Kind::Case:
+            visit_expr(*static_cast<const PatCond&>(cond).expr, summary);
+            break;
+    }
+}
+
+} // namespace elaborate
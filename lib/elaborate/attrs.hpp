@@ -0,0 +1,71 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+// Checks the optimization hints @inline, @noinline, @hot, @cold, @pure and
+// @noalloc among attrs. They take no arguments, only apply to function
+// declarations and may not contradict each other. decl is null for statements.
+void check_hints(const std::vector<std::shared_ptr<Expr>>& attrs, const Decl* decl, Span span);
+
+// Checks the layout attributes. @soa stores an Array of the class as one column
+// per field and only applies to classes with fields that are not @extern.
+// @repr(C) keeps the declared field order of a class or enum payload, and an
+// @extern class with fields must use it.
+void check_layout(const std::vector<std::shared_ptr<Expr>>& attrs, const Decl* decl, Span span);
+
+// Verifies that no @noalloc function can allocate, directly or through the
+// functions it calls. Natives only count as non-allocating when they are
+// declared @noalloc, and calls whose target is not known statically are
+// assumed to allocate.
+class NoallocChecker {
+public:
+    NoallocChecker() = default;
+
+    void run(const Package& pkg);
+
+    int get_checked() const {
+        return checked;
+    }
+
+private:
+    struct Summary {
+        bool noalloc = false;
+        // the first allocation in the body itself
+        std::optional<std::string> reason;
+        // the callee through which the function may allocate
+        std::optional<std::string> via;
+        std::vector<std::string> callees;
+    };
+
+    std::map<std::string, Summary> funcs;
+    std::set<std::string> soa_classes;
+    // immutable variables of the function being visited annotated as an Array of
+    // a @soa class, whose elements are gathered into a new instance when read whole
+    std::set<std::string> soa_vars;
+    // variables annotated as a SIMD vector, whose lane-wise arithmetic allocates
+    std::set<std::string> simd_vars;
+    int checked = 0;
+
+    void collect_soa(const std::vector<std::shared_ptr<Decl>>& decls);
+    void collect(const std::vector<std::shared_ptr<Decl>>& decls, const std::string& prefix);
+    bool is_soa_array(const Type& type) const;
+    void bind_var(const Pat& pat);
+    bool is_simd_var(const Expr& expr) const;
+    void visit_expr(const Expr& expr, Summary& summary);
+    void visit_stmt(const Stmt& stmt, Summary& summary);
+    void visit_for(const ForExpr& expr, Summary& summary);
+    // returns whether the chain yields a zipped pair
+    bool visit_chain(const Expr& expr, Summary& summary);
+    void visit_cond(const Cond& cond, Summary& summary);
+    void allocates(Summary& summary, std::string reason);
+};
+
+} // namespace elaborate
@@ -0,0 +1,589 @@
+#include <optional>
+
+#include "elaborate/bounds.hpp"
+
+namespace elaborate {
+
+namespace {
+
+const std::string* var_ident(const Expr& expr) {
+    if (expr.get_kind() != Expr::Kind::Var) {
+        return nullptr;
+    }
+    return &static_cast<const VarExpr&>(expr).ident;
+}
+
+std::optional<int> int_lit(const Expr& expr) {
+    if (expr.get_kind() != Expr::Kind::Lit) {
+        return std::nullopt;
+    }
+    const auto& lit = *static_cast<const LitExpr&>(expr).literal;
+    if (lit.get_kind() != Lit::Kind::Int) {
+        return std::nullopt;
+    }
+    return static_cast<const IntLit&>(lit).value;
+}
+
+// i += k and i = i + k with a literal k >= 0 keep i non-negative. Only literals
+// count, so the answer does not depend on facts a loop body may invalidate.
+bool is_increment(const AssignExpr& expr, const std::string& ident) {
+    if (expr.mode == BinaryExpr::Op::Add) {
+        return int_lit(*expr.right).value_or(-1) >= 0;
+    }
+    if (expr.mode != BinaryExpr::Op::Assign || expr.right->get_kind() != Expr::Kind::Binary) {
+        return false;
+    }
+    const auto& binary_expr = static_cast<const BinaryExpr&>(*expr.right);
+    if (binary_expr.get_op() != BinaryExpr::Op::Add) {
+        return false;
+    }
+    const auto* left = var_ident(*binary_expr.left);
+    const auto* right = var_ident(*binary_expr.right);
+    return (left && *left == ident && int_lit(*binary_expr.right).value_or(-1) >= 0)
+        || (right && *right == ident && int_lit(*binary_expr.left).value_or(-1) >= 0);
+}
+
+} // namespace
+
+void BoundsChecker::Facts::kill(const std::string& ident, bool keep_sign) {
+    killed.insert(ident);
+    if (!keep_sign) {
+        reassigned.insert(ident);
+        non_negative.erase(ident);
+    }
+    std::erase_if(in_bounds, [&](const auto& fact) {
+        return fact.first == ident || fact.second == ident;
+    });
+    std::erase_if(lengths, [&](const auto& fact) {
+        return fact.first == ident || fact.second == ident;
+    });
+}
+
+void BoundsChecker::Facts::kill_globals() {
+    // locals are bare identifiers, anything with a path may change in a call
+    std::set<std::string> globals;
+    for (const auto& ident: non_negative) {
+        if (ident.contains('.')) {
+            globals.insert(ident);
+        }
+    }
+    for (const auto& [index, array]: in_bounds) {
+        for (const auto* ident: {&index, &array}) {
+            if (ident->contains('.')) {
+                globals.insert(*ident);
+            }
+        }
+    }
+    for (const auto& [length, array]: lengths) {
+        if (array.contains('.')) {
+            globals.insert(array);
+        }
+    }
+    for (const auto& ident: globals) {
+        kill(ident);
+    }
+}
+
+BoundsChecker::Facts BoundsChecker::Facts::fork() const {
+    Facts result = *this;
+    result.killed.clear();
+    result.reassigned.clear();
+    return result;
+}
+
+void BoundsChecker::Facts::merge_kills(const Facts& other) {
+    for (const auto& ident: other.killed) {
+        kill(ident, !other.reassigned.contains(ident));
+    }
+}
+
+void BoundsChecker::run(Package& pkg) {
+    collect_len_funcs(pkg.body, pkg.ident);
+    visit_decls(pkg.body);
+}
+
+void BoundsChecker::collect_len_funcs(
+    const std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    for (const auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                const auto& module_decl = static_cast<const ModuleDecl&>(*decl);
+                collect_len_funcs(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Extension: {
+                const auto& extension_decl = static_cast<const ExtensionDecl&>(*decl);
+                collect_len_funcs(extension_decl.body, prefix + "." + extension_decl.ident);
+                break;
+            }
+            case Decl::Kind::Func: {
+                const auto& func_decl = static_cast<const FuncDecl&>(*decl);
+                if (find_attr_arg(func_decl.attrs, "extern") == "fy_array_len") {
+                    len_funcs.insert(prefix + "." + func_decl.ident);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void BoundsChecker::visit_decls(std::vector<std::shared_ptr<Decl>>& decls) {
+    for (auto& decl: decls) {
+        Facts facts;
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module:
+                visit_decls(static_cast<ModuleDecl&>(*decl).body);
+                break;
+            case Decl::Kind::Class:
+                visit_decls(static_cast<ClassDecl&>(*decl).body);
+                break;
+            case Decl::Kind::Extension:
+                visit_decls(static_cast<ExtensionDecl&>(*decl).body);
+                break;
+            case Decl::Kind::Let: {
+                auto& let_decl = static_cast<LetDecl&>(*decl);
+                if (let_decl.expr.has_value()) {
+                    visit_expr(**let_decl.expr, facts);
+                }
+                break;
+            }
+            case Decl::Kind::Func: {
+                auto& func_decl = static_cast<FuncDecl&>(*decl);
+                if (func_decl.body.has_value()) {
+                    visit_expr(**func_decl.body, facts);
+                }
+                break;
+            }
+            case Decl::Kind::Init: {
+                auto& init_decl = static_cast<InitDecl&>(*decl);
+                if (init_decl.body.has_value()) {
+                    visit_expr(**init_decl.body, facts);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void BoundsChecker::visit_loop(Facts& facts, const std::function<void(Facts&)>& iteration) {
+    // facts at the loop head must survive every write made by the body
+    Facts probe = facts.fork();
+    bool saved = dry_run;
+    dry_run = true;
+    iteration(probe);
+    dry_run = saved;
+    facts.merge_kills(probe);
+    iteration(facts);
+}
+
+void BoundsChecker::visit_expr(Expr& expr, Facts& facts) {
+    switch (expr.get_kind()) {
+        case Expr::Kind::Unary: {
+            auto& unary_expr = static_cast<UnaryExpr&>(expr);
+            if (unary_expr.get_op() == UnaryExpr::Op::Index) {
+                visit_index(static_cast<IndexExpr&>(unary_expr), facts);
+            } else {
+                visit_expr(*unary_expr.expr, facts);
+            }
+            break;
+        }
+        case Expr::Kind::Binary: {
+            auto& binary_expr = static_cast<BinaryExpr&>(expr);
+            switch (binary_expr.get_op()) {
+                case BinaryExpr::Op::Assign:
+                    visit_assign(static_cast<AssignExpr&>(binary_expr), facts);
+                    break;
+                case BinaryExpr::Op::And: {
+                    Facts branch = facts.fork();
+                    visit_assumed(*binary_expr.left, branch);
+                    visit_expr(*binary_expr.right, branch);
+                    facts.merge_kills(branch);
+                    break;
+                }
+                case BinaryExpr::Op::Or: {
+                    visit_expr(*binary_expr.left, facts);
+                    Facts branch = facts.fork();
+                    visit_expr(*binary_expr.right, branch);
+                    facts.merge_kills(branch);
+                    break;
+                }
+                default:
+                    visit_expr(*binary_expr.left, facts);
+                    visit_expr(*binary_expr.right, facts);
+                    break;
+            }
+            break;
+        }
+        case Expr::Kind::Tuple:
+            for (auto& elem: static_cast<TupleExpr&>(expr).elems) {
+                visit_expr(*elem, facts);
+            }
+            break;
+        case Expr::Kind::Hint:
+            visit_expr(*static_cast<HintExpr&>(expr).expr, facts);
+            break;
+        case Expr::Kind::Lam: {
+            // closures run at unknown times, so they start without facts
+            Facts inner;
+            visit_expr(*static_cast<LamExpr&>(expr).body, inner);
+            break;
+        }
+        case Expr::Kind::App: {
+            auto& app_expr = static_cast<AppExpr&>(expr);
+            visit_expr(*app_expr.func, facts);
+            for (auto& arg: app_expr.args) {
+                visit_expr(*arg, facts);
+            }
+            if (!length_of(app_expr, facts).has_value()) {
+                facts.kill_globals();
+            }
+            break;
+        }
+        case Expr::Kind::Block: {
+            auto& block_expr = static_cast<BlockExpr&>(expr);
+            std::vector<std::string> bound;
+            for (auto& stmt: block_expr.stmts) {
+                visit_stmt(*stmt, facts);
+                if (stmt->get_kind() == Stmt::Kind::Let) {
+                    collect_pat_vars(*static_cast<LetStmt&>(*stmt).pat, bound);
+                } else if (stmt->get_kind() == Stmt::Kind::Func) {
+                    bound.push_back(static_cast<FuncStmt&>(*stmt).ident);
+                }
+            }
+            if (block_expr.body.has_value()) {
+                visit_expr(**block_expr.body, facts);
+            }
+            // facts about block locals must not leak onto shadowed outer names
+            for (const auto& ident: bound) {
+                facts.kill(ident);
+            }
+            break;
+        }
+        case Expr::Kind::Ite: {
+            auto& ite_expr = static_cast<IteExpr&>(expr);
+            // chain follows the path on which every earlier condition failed
+            Facts chain = facts.fork();
+            for (auto& then: ite_expr.then_branches) {
+                Facts branch = chain.fork();
+                visit_cond(*then.cond, branch);
+                // the condition writes the same variables when it fails
+                chain.merge_kills(branch);
+                visit_expr(*then.then_branch, branch);
+                facts.merge_kills(branch);
+            }
+            if (ite_expr.else_branch.has_value()) {
+                Facts branch = chain.fork();
+                visit_expr(**ite_expr.else_branch, branch);
+                facts.merge_kills(branch);
+            }
+            facts.merge_kills(chain);
+            break;
+        }
+        case Expr::Kind::Switch: {
+            auto& switch_expr = static_cast<SwitchExpr&>(expr);
+            visit_expr(*switch_expr.expr, facts);
+            for (auto& clause: switch_expr.clauses) {
+                Facts branch = facts.fork();
+                if (clause->get_kind() == Clause::Kind::Case) {
+                    auto& case_clause = static_cast<CaseClause&>(*clause);
+                    bind_pat(*case_clause.pat, branch);
+                    if (case_clause.guard.has_value()) {
+                        visit_assumed(**case_clause.guard, branch);
+                    }
+                    visit_expr(*case_clause.expr, branch);
+                } else {
+                    visit_expr(*static_cast<DefaultClause&>(*clause).expr, branch);
+                }
+                facts.merge_kills(branch);
+            }
+            break;
+        }
+        case Expr::Kind::For: {
+            auto& for_expr = static_cast<ForExpr&>(expr);
+            visit_expr(*for_expr.iter, facts);
+            // for i in lo..len(a) keeps lo <= i < len(a), as long as the body leaves a alone
+            const std::string* index = nullptr;
+            bool from_non_negative = false;
+            std::optional<std::string> array;
+            // learnt by the dry run of the body, which comes first
+            bool writes_array = false;
+            if (for_expr.pat->get_kind() == Pat::Kind::Var
+                && for_expr.iter->get_kind() == Expr::Kind::Binary) {
+                const auto& range = static_cast<const BinaryExpr&>(*for_expr.iter);
+                if (range.get_op() == BinaryExpr::Op::Range) {
+                    index = &static_cast<const VarPat&>(*for_expr.pat).ident;
+                    from_non_negative = is_non_negative(*range.left, facts);
+                    array = length_of(*range.right, facts);
+                }
+            }
+            visit_loop(facts, [&](Facts& loop_facts) {
+                Facts body = loop_facts.fork();
+                bind_pat(*for_expr.pat, body);
+                if (index && from_non_negative) {
+                    body.non_negative.insert(*index);
+                }
+                if (index && array && !writes_array) {
+                    body.in_bounds.insert({*index, *array});
+                }
+                visit_expr(*for_expr.body, body);
+                if (dry_run && array && body.killed.contains(*array)) {
+                    writes_array = true;
+                }
+                loop_facts.merge_kills(body);
+            });
+            break;
+        }
+        case Expr::Kind::While: {
+            auto& while_expr = static_cast<WhileExpr&>(expr);
+            visit_loop(facts, [&](Facts& loop_facts) {
+                Facts body = loop_facts.fork();
+                visit_cond(*while_expr.cond, body);
+                visit_expr(*while_expr.body, body);
+                loop_facts.merge_kills(body);
+            });
+            break;
+        }
+        case Expr::Kind::Loop: {
+            auto& loop_expr = static_cast<LoopExpr&>(expr);
+            visit_loop(facts, [&](Facts& loop_facts) {
+                Facts body = loop_facts.fork();
+                visit_expr(*loop_expr.body, body);
+                loop_facts.merge_kills(body);
+            });
+            break;
+        }
+        case Expr::Kind::Return: {
+            auto& return_expr = static_cast<ReturnExpr&>(expr);
+            if (return_expr.expr.has_value()) {
+                visit_expr(**return_expr.expr, facts);
+            }
+            break;
+        }
+        case Expr::Kind::Yield:
+            visit_expr(*static_cast<YieldExpr&>(expr).expr, facts);
+            break;
+        default:
+            break;
+    }
+}
+
+void BoundsChecker::visit_index(IndexExpr& expr, Facts& facts) {
+    visit_expr(*expr.expr, facts);
+    for (auto& index: expr.indices) {
+        visit_expr(*index, facts);
+    }
+    if (dry_run) {
+        return;
+    }
+    ++total;
+    if (expr.indices.size() != 1) {
+        return;
+    }
+    const auto* array = var_ident(*expr.expr);
+    const auto* index = var_ident(*expr.indices[0]);
+    if (array && index && facts.non_negative.contains(*index)
+        && facts.in_bounds.contains({*index, *array})) {
+        expr.checked = false;
+        ++eliminated;
+    }
+}
+
+void BoundsChecker::visit_assign(AssignExpr& expr, Facts& facts) {
+    if (expr.left->get_kind() == Expr::Kind::Unary
+        && static_cast<UnaryExpr&>(*expr.left).get_op() == UnaryExpr::Op::Index) {
+        // the index is evaluated before the value, matching the interpreter
+        auto& index_expr = static_cast<IndexExpr&>(*expr.left);
+        visit_index(index_expr, facts);
+        visit_expr(*expr.right, facts);
+        return;
+    }
+    visit_expr(*expr.right, facts);
+    if (const auto* ident = var_ident(*expr.left)) {
+        facts.kill(*ident, is_increment(expr, *ident));
+    } else {
+        visit_expr(*expr.left, facts);
+    }
+}
+
+void BoundsChecker::visit_stmt(Stmt& stmt, Facts& facts) {
+    switch (stmt.get_kind()) {
+        case Stmt::Kind::Let: {
+            auto& let_stmt = static_cast<LetStmt&>(stmt);
+            visit_expr(*let_stmt.expr, facts);
+            if (let_stmt.else_branch.has_value()) {
+                Facts branch = facts.fork();
+                visit_expr(**let_stmt.else_branch, branch);
+                facts.merge_kills(branch);
+            }
+            bool non_negative = is_non_negative(*let_stmt.expr, facts);
+            auto length = length_of(*let_stmt.expr, facts);
+            bind_pat(*let_stmt.pat, facts);
+            if (let_stmt.pat->get_kind() == Pat::Kind::Var) {
+                const auto& var_pat = static_cast<const VarPat&>(*let_stmt.pat);
+                if (non_negative) {
+                    facts.non_negative.insert(var_pat.ident);
+                }
+                if (length.has_value() && !var_pat.is_mut) {
+                    facts.lengths[var_pat.ident] = *length;
+                }
+            }
+            break;
+        }
+        case Stmt::Kind::Func: {
+            auto& func_stmt = static_cast<FuncStmt&>(stmt);
+            facts.kill(func_stmt.ident);
+            Facts inner;
+            visit_expr(*func_stmt.body, inner);
+            break;
+        }
+        case Stmt::Kind::Bind: {
+            auto& bind_stmt = static_cast<BindStmt&>(stmt);
+            visit_expr(*bind_stmt.expr, facts);
+            bind_pat(*bind_stmt.pat, facts);
+            break;
+        }
+        case Stmt::Kind::Expr:
+            visit_expr(*static_cast<ExprStmt&>(stmt).expr, facts);
+            break;
+    }
+}
+
+// Leaves facts as they are once cond has held.
+void BoundsChecker::visit_cond(Cond& cond, Facts& facts) {
+    switch (cond.get_kind()) {
+        case Cond::Kind::Expr:
+            visit_assumed(*static_cast<ExprCond&>(cond).expr, facts);
+            break;
+        case Cond::Kind::Case: {
+            auto& pat_cond = static_cast<PatCond&>(cond);
+            visit_expr(*pat_cond.expr, facts);
+            bind_pat(*pat_cond.pat, facts);
+            break;
+        }
+    }
+}
+
+// Evaluates expr and assumes it held. Facts are taken one && conjunct at a time,
+// so a later conjunct writing a variable drops what an earlier one said about it.
+void BoundsChecker::visit_assumed(Expr& expr, Facts& facts) {
+    if (expr.get_kind() == Expr::Kind::Binary
+        && static_cast<BinaryExpr&>(expr).get_op() == BinaryExpr::Op::And) {
+        auto& binary_expr = static_cast<BinaryExpr&>(expr);
+        visit_assumed(*binary_expr.left, facts);
+        visit_assumed(*binary_expr.right, facts);
+        return;
+    }
+    Facts eval = facts.fork();
+    visit_expr(expr, eval);
+    facts.merge_kills(eval);
+    // a comparison says nothing about a variable its own evaluation wrote
+    Facts learnt = facts.fork();
+    assume(expr, learnt);
+    for (const auto& ident: learnt.non_negative) {
+        if (!eval.killed.contains(ident)) {
+            facts.non_negative.insert(ident);
+        }
+    }
+    for (const auto& fact: learnt.in_bounds) {
+        if (!eval.killed.contains(fact.first) && !eval.killed.contains(fact.second)) {
+            facts.in_bounds.insert(fact);
+        }
+    }
+}
+
+void BoundsChecker::bind_pat(const Pat& pat, Facts& facts) {
+    std::vector<std::string> vars;
+    collect_pat_vars(pat, vars);
+    for (const auto& ident: vars) {
+        facts.kill(ident);
+    }
+}
+
+void BoundsChecker::assume(const Expr& expr, Facts& facts) {
+    if (expr.get_kind() != Expr::Kind::Binary) {
+        return;
+    }
+    const auto& binary_expr = static_cast<const BinaryExpr&>(expr);
+    const auto& left = *binary_expr.left;
+    const auto& right = *binary_expr.right;
+    switch (binary_expr.get_op()) {
+        case BinaryExpr::Op::Lt:
+            // i < len(a)
+            if (const auto* index = var_ident(left)) {
+                if (auto array = length_of(right, facts)) {
+                    facts.in_bounds.insert({*index, *array});
+                }
+            }
+            // 0 < i
+            if (const auto* index = var_ident(right); index && int_lit(left) >= -1) {
+                facts.non_negative.insert(*index);
+            }
+            break;
+        case BinaryExpr::Op::Gt:
+            // len(a) > i
+            if (const auto* index = var_ident(right)) {
+                if (auto array = length_of(left, facts)) {
+                    facts.in_bounds.insert({*index, *array});
+                }
+            }
+            // i > 0
+            if (const auto* index = var_ident(left); index && int_lit(right) >= -1) {
+                facts.non_negative.insert(*index);
+            }
+            break;
+        case BinaryExpr::Op::Gte:
+            // i >= 0
+            if (const auto* index = var_ident(left); index && int_lit(right) >= 0) {
+                facts.non_negative.insert(*index);
+            }
+            break;
+        case BinaryExpr::Op::Lte:
+            // 0 <= i
+            if (const auto* index = var_ident(right); index && int_lit(left) >= 0) {
+                facts.non_negative.insert(*index);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+std::optional<std::string> BoundsChecker::length_of(const Expr& expr, const Facts& facts) {
+    if (const auto* ident = var_ident(expr)) {
+        auto it = facts.lengths.find(*ident);
+        if (it != facts.lengths.end()) {
+            return it->second;
+        }
+        return std::nullopt;
+    }
+    if (expr.get_kind() != Expr::Kind::App) {
+        return std::nullopt;
+    }
+    const auto& app_expr = static_cast<const AppExpr&>(expr);
+    if (app_expr.func->get_kind() != Expr::Kind::Func || app_expr.args.size() != 1
+        || !len_funcs.contains(static_cast<const FuncExpr&>(*app_expr.func).ident)) {
+        return std::nullopt;
+    }
+    if (const auto* array = var_ident(*app_expr.args[0])) {
+        return *array;
+    }
+    return std::nullopt;
+}
+
+bool BoundsChecker::is_non_negative(const Expr& expr, const Facts& facts) {
+    if (auto value = int_lit(expr)) {
+        return *value >= 0;
+    }
+    if (const auto* ident = var_ident(expr)) {
+        return facts.non_negative.contains(*ident);
+    }
+    return length_of(expr, facts).has_value();
+}
+
+} // namespace elaborate
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+// Range analysis over the elaborated IR. An array access a[i] is proven in
+// bounds when i is known non-negative and a dominating loop condition or
+// comparison established i < len(a); its IndexExpr::checked flag is cleared.
+class BoundsChecker {
+public:
+    BoundsChecker() = default;
+
+    void run(Package& pkg);
+
+    int get_total() const {
+        return total;
+    }
+
+    int get_eliminated() const {
+        return eliminated;
+    }
+
+private:
+    struct Facts {
+        std::set<std::string> non_negative;
+        // immutable variables holding the length of an array variable
+        std::map<std::string, std::string> lengths;
+        // (index, array) pairs with index < len(array)
+        std::set<std::pair<std::string, std::string>> in_bounds;
+        // variables written since the fork, and those not just incremented
+        std::set<std::string> killed;
+        std::set<std::string> reassigned;
+
+        // copy whose kill sets only record writes made after the fork
+        Facts fork() const;
+        void kill(const std::string& ident, bool keep_sign = false);
+        void kill_globals();
+        void merge_kills(const Facts& other);
+    };
+
+    // paths of the @extern("fy_array_len") functions
+    std::set<std::string> len_funcs;
+    // loop bodies are walked once without marking to learn what they write
+    bool dry_run = false;
+    int total = 0;
+    int eliminated = 0;
+
+    void collect_len_funcs(
+        const std::vector<std::shared_ptr<Decl>>& decls,
+        const std::string& prefix
+    );
+    void visit_decls(std::vector<std::shared_ptr<Decl>>& decls);
+    void visit_loop(Facts& facts, const std::function<void(Facts&)>& iteration);
+    void visit_expr(Expr& expr, Facts& facts);
+    void visit_index(IndexExpr& expr, Facts& facts);
+    void visit_assign(AssignExpr& expr, Facts& facts);
+    void visit_stmt(Stmt& stmt, Facts& facts);
+    void visit_cond(Cond& cond, Facts& facts);
+    void visit_assumed(Expr& expr, Facts& facts);
+    void bind_pat(const Pat& pat, Facts& facts);
+    void assume(const Expr& expr, Facts& facts);
+    std::optional<std::string> length_of(const Expr& expr, const Facts& facts);
+    bool is_non_negative(const Expr& expr, const Facts& facts);
+};
+
+} // namespace elaborate
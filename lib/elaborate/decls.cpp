@@ -0,0 +1,66 @@
+#include "elaborate/decls.hpp"
+
+namespace elaborate {
+
+namespace {
+
+// the symbol a named type resolved to, null for type variables and builtins
+const Symbol* type_symbol(const Type& type) {
+    switch (type.get_kind()) {
+        case Type::Kind::Enum:
+            return static_cast<const EnumType&>(type).ref.symbol;
+        case Type::Kind::Class:
+            return static_cast<const ClassType&>(type).ref.symbol;
+        case Type::Kind::Typealias:
+            return static_cast<const TypealiasType&>(type).ref.symbol;
+        case Type::Kind::Interface:
+            return static_cast<const InterfaceType&>(type).ref.symbol;
+        default:
+            return nullptr;
+    }
+}
+
+} // namespace
+
+void DeclStore::add(const Symbol& symbol, std::shared_ptr<Decl> decl) {
+    auto id = static_cast<std::size_t>(symbol.get_id());
+    if (id >= slots.size()) {
+        slots.resize(id + 1, -1);
+    }
+    // a class or a let with several variables is added once per symbol
+    if (decls.empty() || decls.back() != decl) {
+        decls.push_back(std::move(decl));
+        if (decls.back()->get_kind() == Decl::Kind::Extension) {
+            index_extension(static_cast<const ExtensionDecl&>(*decls.back()));
+        }
+    }
+    slots[id] = static_cast<int>(decls.size()) - 1;
+}
+
+const std::vector<const ExtensionDecl*>& DeclStore::at(
+    const std::vector<std::vector<const ExtensionDecl*>>& index,
+    const Symbol& symbol
+) {
+    static const std::vector<const ExtensionDecl*> none;
+    auto id = static_cast<std::size_t>(symbol.get_id());
+    return id < index.size() ? index[id] : none;
+}
+
+void DeclStore::index_extension(const ExtensionDecl& decl) {
+    for (auto [type, index]: {
+             std::pair {decl.interface.get(), &by_interface},
+             std::pair {decl.base_type.get(), &by_base_type},
+         }) {
+        const auto* symbol = type ? type_symbol(*type) : nullptr;
+        if (!symbol) {
+            continue;
+        }
+        auto id = static_cast<std::size_t>(symbol->get_id());
+        if (id >= index->size()) {
+            index->resize(id + 1);
+        }
+        (*index)[id].push_back(&decl);
+    }
+}
+
+} // namespace elaborate
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+#include "elaborate/table.hpp"
+
+namespace elaborate {
+
+// Elaborated declarations indexed by the dense ids of their symbols. A class
+// is found through both its type and its constructor symbol, a let through
+// each variable it binds. Extensions are also indexed by the symbols of their
+// interface and base type, so the implementations of an interface or the
+// extensions of a type are found without walking the package.
+class DeclStore {
+public:
+    explicit DeclStore(int symbol_count = 0):
+        slots(symbol_count, -1),
+        by_interface(symbol_count),
+        by_base_type(symbol_count) {}
+
+    void add(const Symbol& symbol, std::shared_ptr<Decl> decl);
+
+    // null when the symbol has no elaborated declaration, like an imported module
+    const Decl* find(const Symbol& symbol) const {
+        auto id = static_cast<std::size_t>(symbol.get_id());
+        return id < slots.size() && slots[id] >= 0 ? decls[slots[id]].get() : nullptr;
+    }
+
+    const std::vector<const ExtensionDecl*>& find_implementations(const Symbol& interface) const {
+        return at(by_interface, interface);
+    }
+
+    const std::vector<const ExtensionDecl*>& find_extensions(const Symbol& base_type) const {
+        return at(by_base_type, base_type);
+    }
+
+    // every declaration once, in the order it was elaborated
+    const std::vector<std::shared_ptr<Decl>>& get_decls() const {
+        return decls;
+    }
+
+private:
+    std::vector<std::shared_ptr<Decl>> decls;
+    // index into decls by symbol id, -1 for none
+    std::vector<int> slots;
+    std::vector<std::vector<const ExtensionDecl*>> by_interface;
+    std::vector<std::vector<const ExtensionDecl*>> by_base_type;
+
+    static const std::vector<const ExtensionDecl*>&
+    at(const std::vector<std::vector<const ExtensionDecl*>>& index, const Symbol& symbol);
+    void index_extension(const ExtensionDecl& decl);
+};
+
+} // namespace elaborate
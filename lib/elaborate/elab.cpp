@@ -1,15 +1,27 @@
+#include <map>
 #include <memory>
 #include <optional>
 #include <ranges>
+#include <utility>
 #include <variant>
 
 #include "elab.hpp"
+#include "elaborate/attrs.hpp"
+#include "elaborate/parallel.hpp"
 #include "elaborate/syntax.hpp"
 #include "elaborate/table.hpp"
 #include "parsing/syntax.hpp"
 
 namespace elaborate {
 
+// lane counts of the built-in vector types
+static const std::map<std::string, int> simd_types = {
+    {"Simd2", 2},
+    {"Simd4", 4},
+    {"Simd8", 8},
+    {"Simd16", 16},
+};
+
 void Context::push_scope() {
     scopes.emplace_back();
 }
@@ -120,8 +132,23 @@ std::shared_ptr<Type> Elaborator::elab_type(parsing::Type& type) {
                 // type variable
                 return std::make_shared<VarType>(name_type.name.ident, span);
             }
+            if (auto simd = simd_types.find(name_type.name.ident);
+                path.empty() && simd != simd_types.end()) {
+                if (!name_type.type_args.has_value() || name_type.type_args->size() != 1) {
+                    throw std::runtime_error(
+                        std::format("{} takes one type argument at {}", simd->first, span)
+                    );
+                }
+                auto elem = elab_type(*name_type.type_args->front());
+                if (elem->get_kind() != Type::Kind::Int && elem->get_kind() != Type::Kind::Bool) {
+                    throw std::runtime_error(
+                        std::format("SIMD lanes must be Int or Bool at {}", span)
+                    );
+                }
+                return std::make_shared<SimdType>(std::move(elem), simd->second, span);
+            }
             // otherwise, resolve as type constant
-            auto symbol = table.find_type_symbol(name_type.name.ident, path);
+            const auto& symbol = table.find_type_symbol(name_type.name.ident, path);
             std::optional<std::vector<std::shared_ptr<Type>>> type_args;
             if (name_type.type_args.has_value()) {
                 type_args = std::vector<std::shared_ptr<Type>> {};
@@ -130,13 +157,23 @@ std::shared_ptr<Type> Elaborator::elab_type(parsing::Type& type) {
                 }
             }
             if (symbol.get_kind() == Symbol::Kind::Enum) {
-                return std::make_shared<EnumType>(name_type.name.ident, type_args, span);
+                auto result = std::make_shared<EnumType>(name_type.name.ident, type_args, span);
+                bind(std::shared_ptr<Ref>(result, &result->ref), symbol);
+                return result;
             } else if (symbol.get_kind() == Symbol::Kind::Class) {
-                return std::make_shared<ClassType>(name_type.name.ident, type_args, span);
+                auto result = std::make_shared<ClassType>(name_type.name.ident, type_args, span);
+                bind(std::shared_ptr<Ref>(result, &result->ref), symbol);
+                return result;
             } else if (symbol.get_kind() == Symbol::Kind::Typealias) {
-                return std::make_shared<TypealiasType>(name_type.name.ident, type_args, span);
+                auto result =
+                    std::make_shared<TypealiasType>(name_type.name.ident, type_args, span);
+                bind(std::shared_ptr<Ref>(result, &result->ref), symbol);
+                return result;
             } else if (symbol.get_kind() == Symbol::Kind::Interface) {
-                return std::make_shared<InterfaceType>(name_type.name.ident, type_args, span);
+                auto result =
+                    std::make_shared<InterfaceType>(name_type.name.ident, type_args, span);
+                bind(std::shared_ptr<Ref>(result, &result->ref), symbol);
+                return result;
             } else {
                 throw std::runtime_error(std::format("Invalid type: {}", name_type.name));
             }
@@ -210,7 +247,7 @@ std::shared_ptr<Pat> Elaborator::elab_pat(parsing::Pat& pat) {
                     std::format("Invalid constructor pattern: {}", ctor_pat.name)
                 );
             }
-            auto symbol = table.find_expr_symbol(ctor_pat.name.ident, path);
+            const auto& symbol = table.find_expr_symbol(ctor_pat.name.ident, path);
             if (symbol.get_kind() != Symbol::Kind::Ctor) {
                 throw std::runtime_error(
                     std::format("Invalid constructor pattern: {}", ctor_pat.name)
@@ -229,12 +266,14 @@ std::shared_ptr<Pat> Elaborator::elab_pat(parsing::Pat& pat) {
                     args->push_back(elab_pat(*arg));
                 }
             }
-            return std::make_shared<CtorPat>(
+            auto result = std::make_shared<CtorPat>(
                 symbol.get_path(),
                 std::move(type_args),
                 std::move(args),
                 span
             );
+            bind(std::shared_ptr<Ref>(result, &result->ref), symbol);
+            return result;
         }
         case parsing::Pat::Kind::Name: {
             auto& name_pat = static_cast<parsing::NamePat&>(pat);
@@ -288,8 +327,8 @@ std::shared_ptr<Cond> Elaborator::elab_cond(parsing::Cond& cond) {
         }
         case parsing::Cond::Kind::Case: {
             auto& pat_cond = static_cast<parsing::PatCond&>(cond);
-            auto elab_pat_ptr = elab_pat(*pat_cond.pat);
             auto elab_expr_ptr = elab_expr(*pat_cond.expr);
+            auto elab_pat_ptr = elab_bind_pat(pat_cond.pat);
             return std::make_shared<PatCond>(
                 std::move(elab_pat_ptr),
                 std::move(elab_expr_ptr),
@@ -349,6 +388,10 @@ std::shared_ptr<Expr> Elaborator::elab_expr(parsing::Expr& expr) {
                 case parsing::UnaryExpr::Op::Deref:
                     return std::make_shared<DerefExpr>(std::move(operand), span);
                 case parsing::UnaryExpr::Op::Try:
+                    // propagating a failure returns it
+                    if (func_body && !func_body->value_return) {
+                        func_body->value_return = span;
+                    }
                     return std::make_shared<TryExpr>(std::move(operand), span);
                 case parsing::UnaryExpr::Op::New:
                     return std::make_shared<NewExpr>(std::move(operand), span);
@@ -413,6 +456,8 @@ std::shared_ptr<Expr> Elaborator::elab_expr(parsing::Expr& expr) {
                     return std::make_shared<GtExpr>(std::move(left), std::move(right), span);
                 case parsing::BinaryExpr::Op::Gte:
                     return std::make_shared<GteExpr>(std::move(left), std::move(right), span);
+                case parsing::BinaryExpr::Op::Range:
+                    return std::make_shared<RangeExpr>(std::move(left), std::move(right), span);
                 case parsing::BinaryExpr::Op::Assign: {
                     auto& assign_expr = static_cast<parsing::AssignExpr&>(binary_expr);
                     switch (assign_expr.mode) {
@@ -499,40 +544,645 @@ std::shared_ptr<Expr> Elaborator::elab_expr(parsing::Expr& expr) {
                 return fold_dot_expr(result, name_expr.name.path, type_args, span);
             }
             auto [path, rest] = name_expr.name.slice();
-            auto symbol = table.find_expr_symbol(name_expr.name.ident, path);
+            const auto& symbol = table.find_expr_symbol(name_expr.name.ident, path);
             switch (symbol.get_kind()) {
-                case Symbol::Kind::Var:
-                    result = std::make_shared<VarExpr>(symbol.get_path(), span);
+                case Symbol::Kind::Var: {
+                    auto var_expr = std::make_shared<VarExpr>(symbol.get_path(), span);
+                    bind(std::shared_ptr<Ref>(var_expr, &var_expr->ref), symbol);
+                    result = std::move(var_expr);
                     break;
-                case Symbol::Kind::Ctor:
-                    result = std::make_shared<CtorExpr>(symbol.get_path(), type_args, span);
+                }
+                case Symbol::Kind::Ctor: {
+                    auto ctor_expr = std::make_shared<CtorExpr>(symbol.get_path(), type_args, span);
+                    bind(std::shared_ptr<Ref>(ctor_expr, &ctor_expr->ref), symbol);
+                    result = std::move(ctor_expr);
                     break;
-                case Symbol::Kind::Func:
-                    result = std::make_shared<FuncExpr>(symbol.get_path(), type_args, span);
+                }
+                case Symbol::Kind::Func: {
+                    auto func_expr = std::make_shared<FuncExpr>(symbol.get_path(), type_args, span);
+                    bind(std::shared_ptr<Ref>(func_expr, &func_expr->ref), symbol);
+                    result = std::move(func_expr);
                     break;
+                }
                 case Symbol::Kind::Class:
-                case Symbol::Kind::Init:
-                    result = std::make_shared<InitExpr>(symbol.get_path(), type_args, span);
+                case Symbol::Kind::Init: {
+                    auto init_expr = std::make_shared<InitExpr>(symbol.get_path(), type_args, span);
+                    bind(std::shared_ptr<Ref>(init_expr, &init_expr->ref), symbol);
+                    result = std::move(init_expr);
                     break;
+                }
                 default: {
                     throw std::runtime_error(std::format("Invalid expression {} at", expr, span));
                 }
             }
+            return fold_dot_expr(result, rest, std::nullopt, span);
         }
         case parsing::Expr::Kind::Hole:
-        case parsing::Expr::Kind::Lam:
-        case parsing::Expr::Kind::App:
-        case parsing::Expr::Kind::Block:
-        case parsing::Expr::Kind::Ite:
-        case parsing::Expr::Kind::Switch:
-        case parsing::Expr::Kind::For:
-        case parsing::Expr::Kind::While:
-        case parsing::Expr::Kind::Loop:
+            throw std::runtime_error(std::format("Unsolved hole at {}", span));
+        case parsing::Expr::Kind::Lam: {
+            auto& lam_expr = static_cast<parsing::LamExpr&>(expr);
+            ctx.push_scope();
+            std::vector<std::shared_ptr<Pat>> params;
+            for (auto& param: lam_expr.params) {
+                params.push_back(elab_bind_pat(param));
+            }
+            auto* saved = std::exchange(func_body, nullptr);
+            auto body = elab_expr(*lam_expr.body);
+            func_body = saved;
+            ctx.pop_scope();
+            return std::make_shared<LamExpr>(std::move(params), std::move(body), span);
+        }
+        case parsing::Expr::Kind::App: {
+            auto& app_expr = static_cast<parsing::AppExpr&>(expr);
+            auto func = elab_expr(*app_expr.func);
+            std::vector<std::shared_ptr<Expr>> args;
+            for (auto& arg: app_expr.args) {
+                args.push_back(elab_expr(*arg));
+            }
+            return std::make_shared<AppExpr>(std::move(func), std::move(args), span);
+        }
+        case parsing::Expr::Kind::Block: {
+            auto& block_expr = static_cast<parsing::BlockExpr&>(expr);
+            ctx.push_scope();
+            std::vector<std::shared_ptr<Stmt>> stmts;
+            for (auto& stmt: block_expr.stmts) {
+                if (auto elab_stmt_ptr = elab_stmt(*stmt)) {
+                    stmts.push_back(std::move(elab_stmt_ptr));
+                }
+            }
+            if (block_expr.body.has_value()) {
+                auto body = elab_expr(**block_expr.body);
+                auto body_span = body->get_span();
+                stmts.push_back(std::make_shared<ExprStmt>(std::move(body), true, body_span));
+            }
+            ctx.pop_scope();
+            return std::make_shared<BlockExpr>(std::move(stmts), span);
+        }
+        case parsing::Expr::Kind::Ite: {
+            auto& ite_expr = static_cast<parsing::IteExpr&>(expr);
+            std::vector<IteThen> then_branches;
+            for (auto& [cond, then_branch]: ite_expr.then_branches) {
+                ctx.push_scope();
+                auto elab_cond_ptr = elab_cond(*cond);
+                auto elab_then_ptr = elab_expr(*then_branch);
+                ctx.pop_scope();
+                then_branches.push_back(
+                    IteThen { std::move(elab_cond_ptr), std::move(elab_then_ptr) }
+                );
+            }
+            std::optional<std::shared_ptr<Expr>> else_branch;
+            if (ite_expr.else_branch.has_value()) {
+                else_branch = elab_expr(**ite_expr.else_branch);
+            }
+            return std::make_shared<IteExpr>(
+                std::move(then_branches),
+                std::move(else_branch),
+                span
+            );
+        }
+        case parsing::Expr::Kind::Switch: {
+            auto& switch_expr = static_cast<parsing::SwitchExpr&>(expr);
+            auto scrutinee = elab_expr(*switch_expr.expr);
+            std::vector<std::shared_ptr<Clause>> clauses;
+            for (auto& clause: switch_expr.clauses) {
+                auto clause_span = clause->get_span();
+                if (clause->get_kind() == parsing::Clause::Kind::Default) {
+                    auto& default_clause = static_cast<parsing::DefaultClause&>(*clause);
+                    auto body = elab_expr(*default_clause.expr);
+                    clauses.push_back(
+                        std::make_shared<DefaultClause>(std::move(body), clause_span)
+                    );
+                    continue;
+                }
+                auto& case_clause = static_cast<parsing::CaseClause&>(*clause);
+                ctx.push_scope();
+                auto pat = elab_bind_pat(case_clause.pat);
+                std::optional<std::shared_ptr<Expr>> guard;
+                if (case_clause.guard.has_value()) {
+                    guard = elab_expr(**case_clause.guard);
+                }
+                auto body = elab_expr(*case_clause.expr);
+                ctx.pop_scope();
+                clauses.push_back(std::make_shared<CaseClause>(
+                    std::move(pat),
+                    std::move(guard),
+                    std::move(body),
+                    clause_span
+                ));
+            }
+            return std::make_shared<SwitchExpr>(std::move(scrutinee), std::move(clauses), span);
+        }
+        case parsing::Expr::Kind::For: {
+            auto& for_expr = static_cast<parsing::ForExpr&>(expr);
+            auto iter = elab_expr(*for_expr.iter);
+            ctx.push_scope();
+            auto pat = elab_bind_pat(for_expr.pat);
+            auto body = elab_expr(*for_expr.body);
+            ctx.pop_scope();
+            return std::make_shared<ForExpr>(
+                std::move(pat),
+                std::move(iter),
+                std::move(body),
+                span
+            );
+        }
+        case parsing::Expr::Kind::While: {
+            auto& while_expr = static_cast<parsing::WhileExpr&>(expr);
+            ctx.push_scope();
+            auto cond = elab_cond(*while_expr.cond);
+            auto body = elab_expr(*while_expr.body);
+            ctx.pop_scope();
+            return std::make_shared<WhileExpr>(std::move(cond), std::move(body), span);
+        }
+        case parsing::Expr::Kind::Loop: {
+            auto& loop_expr = static_cast<parsing::LoopExpr&>(expr);
+            return std::make_shared<LoopExpr>(elab_expr(*loop_expr.body), span);
+        }
         case parsing::Expr::Kind::Break:
+            return std::make_shared<BreakExpr>(span);
         case parsing::Expr::Kind::Continue:
-        case parsing::Expr::Kind::Return:
+            return std::make_shared<ContinueExpr>(span);
+        case parsing::Expr::Kind::Return: {
+            auto& return_expr = static_cast<parsing::ReturnExpr&>(expr);
+            std::optional<std::shared_ptr<Expr>> value;
+            if (return_expr.expr.has_value()) {
+                value = elab_expr(**return_expr.expr);
+                if (func_body && !func_body->value_return) {
+                    func_body->value_return = span;
+                }
+            }
+            return std::make_shared<ReturnExpr>(std::move(value), span);
+        }
+        case parsing::Expr::Kind::Yield: {
+            if (!func_body) {
+                throw std::runtime_error(
+                    std::format("Yield outside of a function declaration at {}", span)
+                );
+            }
+            ++func_body->yields;
+            auto& yield_expr = static_cast<parsing::YieldExpr&>(expr);
+            return std::make_shared<YieldExpr>(elab_expr(*yield_expr.expr), span);
+        }
+    }
+    throw std::runtime_error(std::format("Invalid expression {} at {}", expr, span));
+}
+
+std::shared_ptr<Stmt> Elaborator::elab_stmt(parsing::Stmt& stmt) {
+    auto span = stmt.get_span();
+    std::shared_ptr<Stmt> result;
+    switch (stmt.get_kind()) {
+        case parsing::Stmt::Kind::Open: {
+            auto& open_stmt = static_cast<parsing::OpenStmt&>(stmt);
+            table.import(*open_stmt.import);
+            return nullptr;
+        }
+        case parsing::Stmt::Kind::Let: {
+            auto& let_stmt = static_cast<parsing::LetStmt&>(stmt);
+            // the initializer and else branch cannot see the bound variables
+            auto elab_expr_ptr = elab_expr(*let_stmt.expr);
+            std::optional<std::shared_ptr<Expr>> else_branch;
+            if (let_stmt.else_branch.has_value()) {
+                else_branch = elab_expr(**let_stmt.else_branch);
+            }
+            auto pat = elab_bind_pat(let_stmt.pat);
+            result = std::make_shared<LetStmt>(
+                std::move(pat),
+                std::move(elab_expr_ptr),
+                std::move(else_branch),
+                span
+            );
+            break;
+        }
+        case parsing::Stmt::Kind::Func: {
+            auto& func_stmt = static_cast<parsing::FuncStmt&>(stmt);
+            // bind the name first so the body can recurse
+            ctx.add_expr_var(func_stmt.ident, std::make_shared<MetaType>(span));
+            ctx.push_scope();
+            std::vector<std::shared_ptr<Pat>> params;
+            for (auto& param: func_stmt.params) {
+                params.push_back(elab_bind_pat(param));
+            }
+            auto ret_type = elab_type(*func_stmt.ret_type);
+            auto* saved = std::exchange(func_body, nullptr);
+            auto body = elab_expr(*func_stmt.body);
+            func_body = saved;
+            ctx.pop_scope();
+            result = std::make_shared<FuncStmt>(
+                func_stmt.ident,
+                std::move(params),
+                std::move(ret_type),
+                std::move(body),
+                span
+            );
+            break;
+        }
+        case parsing::Stmt::Kind::Bind: {
+            auto& bind_stmt = static_cast<parsing::BindStmt&>(stmt);
+            auto elab_expr_ptr = elab_expr(*bind_stmt.expr);
+            auto pat = elab_bind_pat(bind_stmt.pat);
+            result = std::make_shared<BindStmt>(std::move(pat), std::move(elab_expr_ptr), span);
+            break;
+        }
+        case parsing::Stmt::Kind::Expr: {
+            auto& expr_stmt = static_cast<parsing::ExprStmt&>(stmt);
+            result = std::make_shared<ExprStmt>(elab_expr(*expr_stmt.expr), expr_stmt.is_val, span);
+            break;
+        }
+    }
+    result->attrs = elab_attrs(stmt.attrs);
+    check_hints(result->attrs, nullptr, span);
+    check_layout(result->attrs, nullptr, span);
+    check_parallel(result->attrs, result.get(), span);
+    return result;
+}
+
+std::shared_ptr<Import> Elaborator::elab_import(parsing::Import& import) {
+    auto span = import.get_span();
+    switch (import.get_kind()) {
+        case parsing::Import::Kind::Node: {
+            auto& node_import = static_cast<parsing::NodeImport&>(import);
+            std::vector<std::shared_ptr<Import>> nested;
+            for (auto& nested_import: node_import.nested) {
+                nested.push_back(elab_import(*nested_import));
+            }
+            return std::make_shared<NodeImport>(node_import.name, std::move(nested), span);
+        }
+        case parsing::Import::Kind::Alias: {
+            auto& alias_import = static_cast<parsing::AliasImport&>(import);
+            return std::make_shared<AliasImport>(alias_import.name, alias_import.alias, span);
+        }
+        case parsing::Import::Kind::Wild:
+            return std::make_shared<WildImport>(span);
+    }
+    throw std::runtime_error(std::format("Invalid import at {}", span));
+}
+
+std::shared_ptr<Expr> Elaborator::elab_attr(parsing::Expr& attr) {
+    // attributes are not resolved against the table, they name compiler builtins
+    auto span = attr.get_span();
+    if (attr.get_kind() == parsing::Expr::Kind::Name) {
+        auto& name_expr = static_cast<parsing::NameExpr&>(attr);
+        return std::make_shared<VarExpr>(std::format("{}", name_expr.name), span);
+    }
+    if (attr.get_kind() == parsing::Expr::Kind::App) {
+        auto& app_expr = static_cast<parsing::AppExpr&>(attr);
+        auto func = elab_attr(*app_expr.func);
+        std::vector<std::shared_ptr<Expr>> args;
+        for (auto& arg: app_expr.args) {
+            if (arg->get_kind() == parsing::Expr::Kind::Name) {
+                args.push_back(elab_attr(*arg));
+                continue;
+            }
+            if (arg->get_kind() != parsing::Expr::Kind::Lit) {
+                throw std::runtime_error(std::format(
+                    "Attribute arguments must be names or literals at {}",
+                    arg->get_span()
+                ));
+            }
+            auto& lit_expr = static_cast<parsing::LitExpr&>(*arg);
+            args.push_back(std::make_shared<LitExpr>(elab_lit(*lit_expr.literal), arg->get_span()));
+        }
+        return std::make_shared<AppExpr>(std::move(func), std::move(args), span);
+    }
+    throw std::runtime_error(std::format("Invalid attribute {} at {}", attr, span));
+}
+
+std::vector<std::shared_ptr<Expr>>
+Elaborator::elab_attrs(std::vector<std::unique_ptr<parsing::Expr>>& attrs) {
+    std::vector<std::shared_ptr<Expr>> result;
+    for (auto& attr: attrs) {
+        result.push_back(elab_attr(*attr));
+    }
+    return result;
+}
+
+void Elaborator::add_type_params(const std::optional<std::vector<std::string>>& type_params) {
+    if (type_params.has_value()) {
+        for (const auto& type_param: *type_params) {
+            ctx.add_type_var(type_param);
+        }
+    }
+}
+
+std::vector<TypeBound> Elaborator::elab_type_bounds(std::vector<parsing::TypeBound>& type_bounds) {
+    std::vector<TypeBound> result;
+    for (auto& type_bound: type_bounds) {
+        std::vector<std::shared_ptr<Type>> bounds;
+        for (auto& bound: type_bound.bounds) {
+            bounds.push_back(elab_type(*bound));
+        }
+        result.push_back(TypeBound { elab_type(*type_bound.type), std::move(bounds) });
+    }
+    return result;
+}
+
+std::shared_ptr<Pat> Elaborator::elab_bind_pat(std::unique_ptr<parsing::Pat>& pat) {
+    table.pat_rewrite(pat);
+    auto result = elab_pat(*pat);
+    ctx.pat_add_vars(*result);
+    return result;
+}
+
+std::vector<std::shared_ptr<Decl>>
+Elaborator::elab_decls(std::vector<std::unique_ptr<parsing::Decl>>& decls) {
+    std::vector<std::shared_ptr<Decl>> result;
+    for (auto& decl: decls) {
+        if (auto elab_decl_ptr = elab_decl(*decl)) {
+            result.push_back(std::move(elab_decl_ptr));
+        }
+    }
+    return result;
+}
+
+std::shared_ptr<Decl> Elaborator::elab_decl(parsing::Decl& decl) {
+    auto span = decl.get_span();
+    std::shared_ptr<Decl> result;
+    switch (decl.get_kind()) {
+        case parsing::Decl::Kind::Module: {
+            auto& module_decl = static_cast<parsing::ModuleDecl&>(decl);
+            table.enter_node(module_decl.ident);
+            auto body = elab_decls(module_decl.body);
+            table.exit_node();
+            result = std::make_shared<ModuleDecl>(module_decl.ident, std::move(body), span);
+            break;
+        }
+        case parsing::Decl::Kind::Open:
+            // imports were merged into the table by the TableBuilder
+            return nullptr;
+        case parsing::Decl::Kind::Class: {
+            auto& class_decl = static_cast<parsing::ClassDecl&>(decl);
+            table.enter_node(class_decl.ident);
+            ctx.push_scope();
+            add_type_params(class_decl.type_params);
+            auto type_bounds = elab_type_bounds(class_decl.type_bounds);
+            auto body = elab_decls(class_decl.body);
+            ctx.pop_scope();
+            table.exit_node();
+            result = std::make_shared<ClassDecl>(
+                class_decl.ident,
+                class_decl.type_params,
+                std::move(type_bounds),
+                std::move(body),
+                span
+            );
+            break;
+        }
+        case parsing::Decl::Kind::Enum: {
+            auto& enum_decl = static_cast<parsing::EnumDecl&>(decl);
+            table.enter_node(enum_decl.ident);
+            ctx.push_scope();
+            add_type_params(enum_decl.type_params);
+            auto type_bounds = elab_type_bounds(enum_decl.type_bounds);
+            auto body = elab_decls(enum_decl.body);
+            ctx.pop_scope();
+            table.exit_node();
+            result = std::make_shared<EnumDecl>(
+                enum_decl.ident,
+                enum_decl.type_params,
+                std::move(type_bounds),
+                std::move(body),
+                span
+            );
+            break;
+        }
+        case parsing::Decl::Kind::Typealias: {
+            auto& typealias_decl = static_cast<parsing::TypealiasDecl&>(decl);
+            ctx.push_scope();
+            add_type_params(typealias_decl.type_params);
+            auto type_bounds = elab_type_bounds(typealias_decl.type_bounds);
+            std::vector<std::shared_ptr<Type>> hint;
+            for (auto& type: typealias_decl.hint) {
+                hint.push_back(elab_type(*type));
+            }
+            std::optional<std::shared_ptr<Type>> aliased;
+            if (typealias_decl.aliased.has_value()) {
+                aliased = elab_type(**typealias_decl.aliased);
+            }
+            ctx.pop_scope();
+            result = std::make_shared<TypealiasDecl>(
+                typealias_decl.ident,
+                typealias_decl.type_params,
+                std::move(type_bounds),
+                std::move(hint),
+                std::move(aliased),
+                span
+            );
+            break;
+        }
+        case parsing::Decl::Kind::Interface: {
+            auto& interface_decl = static_cast<parsing::InterfaceDecl&>(decl);
+            table.enter_node(interface_decl.ident);
+            ctx.push_scope();
+            add_type_params(interface_decl.type_params);
+            auto type_bounds = elab_type_bounds(interface_decl.type_bounds);
+            auto body = elab_decls(interface_decl.body);
+            ctx.pop_scope();
+            table.exit_node();
+            result = std::make_shared<InterfaceDecl>(
+                interface_decl.ident,
+                interface_decl.type_params,
+                std::move(type_bounds),
+                std::move(body),
+                span
+            );
+            break;
+        }
+        case parsing::Decl::Kind::Extension: {
+            auto& extension_decl = static_cast<parsing::ExtensionDecl&>(decl);
+            table.enter_node(extension_decl.ident);
+            ctx.push_scope();
+            add_type_params(extension_decl.type_params);
+            auto type_bounds = elab_type_bounds(extension_decl.type_bounds);
+            auto base_type = elab_type(*extension_decl.base_type);
+            auto interface = elab_type(*extension_decl.interface);
+            auto body = elab_decls(extension_decl.body);
+            ctx.pop_scope();
+            table.exit_node();
+            auto extension = std::make_shared<ExtensionDecl>(
+                extension_decl.type_params,
+                std::move(type_bounds),
+                std::move(base_type),
+                std::move(interface),
+                std::move(body),
+                span
+            );
+            extension->ident = extension_decl.ident;
+            result = std::move(extension);
+            break;
+        }
+        case parsing::Decl::Kind::Let: {
+            auto& let_decl = static_cast<parsing::LetDecl&>(decl);
+            // patterns were rewritten and registered by the TableBuilder
+            auto pat = elab_pat(*let_decl.pat);
+            std::optional<std::shared_ptr<Expr>> elab_expr_ptr;
+            if (let_decl.expr.has_value()) {
+                elab_expr_ptr = elab_expr(**let_decl.expr);
+            }
+            result = std::make_shared<LetDecl>(std::move(pat), std::move(elab_expr_ptr), span);
+            break;
+        }
+        case parsing::Decl::Kind::Func: {
+            auto& func_decl = static_cast<parsing::FuncDecl&>(decl);
+            ctx.push_scope();
+            add_type_params(func_decl.type_params);
+            auto type_bounds = elab_type_bounds(func_decl.type_bounds);
+            std::vector<std::shared_ptr<Pat>> params;
+            for (auto& param: func_decl.params) {
+                params.push_back(elab_bind_pat(param));
+            }
+            auto ret_type = elab_type(*func_decl.ret_type);
+            std::optional<std::shared_ptr<Expr>> body;
+            FuncBody func_facts;
+            if (func_decl.body.has_value()) {
+                auto* saved = std::exchange(func_body, &func_facts);
+                body = elab_expr(**func_decl.body);
+                func_body = saved;
+            }
+            // a generator ends by returning, its values are the ones it yields
+            if (func_facts.yields > 0 && func_facts.value_return) {
+                throw std::runtime_error(std::format(
+                    "Generator {} cannot return a value at {}",
+                    func_decl.ident,
+                    *func_facts.value_return
+                ));
+            }
+            ctx.pop_scope();
+            auto func_decl_elab = std::make_shared<FuncDecl>(
+                func_decl.ident,
+                func_decl.type_params,
+                std::move(type_bounds),
+                std::move(params),
+                std::move(ret_type),
+                std::move(body),
+                span
+            );
+            func_decl_elab->generator = func_facts.yields > 0;
+            result = std::move(func_decl_elab);
+            break;
+        }
+        case parsing::Decl::Kind::Init: {
+            auto& init_decl = static_cast<parsing::InitDecl&>(decl);
+            ctx.push_scope();
+            add_type_params(init_decl.type_params);
+            auto type_bounds = elab_type_bounds(init_decl.type_bounds);
+            std::vector<std::shared_ptr<Pat>> params;
+            for (auto& param: init_decl.params) {
+                params.push_back(elab_bind_pat(param));
+            }
+            auto ret_type = elab_type(*init_decl.ret_type);
+            std::optional<std::shared_ptr<Expr>> body;
+            if (init_decl.body.has_value()) {
+                body = elab_expr(**init_decl.body);
+            }
+            ctx.pop_scope();
+            result = std::make_shared<InitDecl>(
+                init_decl.ident,
+                init_decl.type_params,
+                std::move(type_bounds),
+                std::move(params),
+                std::move(ret_type),
+                std::move(body),
+                span
+            );
             break;
+        }
+        case parsing::Decl::Kind::Ctor: {
+            auto& ctor_decl = static_cast<parsing::CtorDecl&>(decl);
+            std::optional<std::vector<std::shared_ptr<Type>>> params;
+            if (ctor_decl.params.has_value()) {
+                params = std::vector<std::shared_ptr<Type>> {};
+                for (auto& param: *ctor_decl.params) {
+                    params->push_back(elab_type(*param));
+                }
+            }
+            result = std::make_shared<CtorDecl>(ctor_decl.ident, std::move(params), span);
+            break;
+        }
+    }
+    declare(result);
+    result->attrs = elab_attrs(decl.attrs);
+    check_hints(result->attrs, result.get(), span);
+    check_layout(result->attrs, result.get(), span);
+    check_parallel(result->attrs, nullptr, span);
+    result->access = decl.access;
+    return result;
+}
+
+void Elaborator::bind(const std::shared_ptr<Ref>& ref, const Symbol& symbol) {
+    ref->symbol = &symbol;
+    ref->node = table.find_symbol_node(symbol);
+    unlinked.push_back(ref);
+}
+
+void Elaborator::declare(const std::shared_ptr<Decl>& decl) {
+    const auto* scope = table.get_active();
+    auto add = [&](const Symbol* symbol) {
+        if (symbol) {
+            decls->add(*symbol, decl);
+        }
+    };
+    switch (decl->get_kind()) {
+        case Decl::Kind::Module:
+            return;
+        case Decl::Kind::Class: {
+            // the name is both the type and the function building an instance
+            const auto& ident = static_cast<const ClassDecl&>(*decl).ident;
+            add(scope->find_own_type_symbol(ident));
+            add(scope->find_own_expr_symbol(ident));
+            return;
+        }
+        case Decl::Kind::Enum:
+            add(scope->find_own_type_symbol(static_cast<const EnumDecl&>(*decl).ident));
+            return;
+        case Decl::Kind::Typealias:
+            add(scope->find_own_type_symbol(static_cast<const TypealiasDecl&>(*decl).ident));
+            return;
+        case Decl::Kind::Interface:
+            add(scope->find_own_type_symbol(static_cast<const InterfaceDecl&>(*decl).ident));
+            return;
+        case Decl::Kind::Extension:
+            add(scope->find_own_expr_symbol(static_cast<const ExtensionDecl&>(*decl).ident));
+            return;
+        case Decl::Kind::Let: {
+            std::vector<std::string> vars;
+            collect_pat_vars(*static_cast<const LetDecl&>(*decl).pat, vars);
+            for (const auto& var: vars) {
+                add(scope->find_own_expr_symbol(var));
+            }
+            return;
+        }
+        case Decl::Kind::Func:
+            add(scope->find_own_expr_symbol(static_cast<const FuncDecl&>(*decl).ident));
+            return;
+        case Decl::Kind::Init:
+            add(scope->find_own_expr_symbol(static_cast<const InitDecl&>(*decl).ident));
+            return;
+        case Decl::Kind::Ctor:
+            add(scope->find_own_expr_symbol(static_cast<const CtorDecl&>(*decl).ident));
+            return;
+    }
+}
+
+Package Elaborator::elab(parsing::Package& pkg) {
+    std::vector<std::shared_ptr<Import>> header;
+    for (auto& import: pkg.header) {
+        header.push_back(elab_import(*import));
+    }
+    auto body = elab_decls(pkg.body);
+    // a name may refer to a declaration elaborated after it
+    for (const auto& weak: unlinked) {
+        // nodes elaborated only to be dropped again have nothing to link
+        auto ref = weak.lock();
+        if (!ref) {
+            continue;
+        }
+        ref->decl = decls->find(*ref->symbol);
     }
+    unlinked.clear();
+    Package result(pkg.ident, std::move(header), std::move(body), pkg.get_span());
+    result.table = table.share_root();
+    result.decls = decls;
+    return result;
 }
 
 } // namespace elaborate
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "elaborate/decls.hpp"
 #include "elaborate/syntax.hpp"
 #include "elaborate/table.hpp"
 #include "parsing/syntax.hpp"
@@ -36,14 +37,40 @@ private:
 
 class Elaborator {
 public:
-    explicit Elaborator(Table table): table(table) {}
+    explicit Elaborator(Table table):
+        decls(std::make_shared<DeclStore>(table.get_symbol_count())),
+        table(table) {}
 
     Package elab(parsing::Package& pkg);
 
 private:
-    std::map<std::string, std::shared_ptr<Decl>> decl_map;
+    // elaborated declarations by symbol
+    std::shared_ptr<DeclStore> decls;
+    // Refs whose declaration is looked up once the whole package is elaborated,
+    // aliasing the node holding each
+    std::vector<std::weak_ptr<Ref>> unlinked;
     Table table;
     Context ctx;
+    // what the body of the function declaration being elaborated does, null
+    // where a yield is not allowed
+    struct FuncBody {
+        int yields = 0;
+        std::optional<Span> value_return;
+    };
+    FuncBody* func_body = nullptr;
+
+    void bind(const std::shared_ptr<Ref>& ref, const Symbol& symbol);
+    void declare(const std::shared_ptr<Decl>& decl);
+
+    std::shared_ptr<Import> elab_import(parsing::Import& import);
+    std::shared_ptr<Expr> elab_attr(parsing::Expr& attr);
+    std::vector<std::shared_ptr<Expr>>
+    elab_attrs(std::vector<std::unique_ptr<parsing::Expr>>& attrs);
+    void add_type_params(const std::optional<std::vector<std::string>>& type_params);
+    std::vector<TypeBound> elab_type_bounds(std::vector<parsing::TypeBound>& type_bounds);
+    std::shared_ptr<Pat> elab_bind_pat(std::unique_ptr<parsing::Pat>& pat);
+    std::vector<std::shared_ptr<Decl>>
+    elab_decls(std::vector<std::unique_ptr<parsing::Decl>>& decls);
 
     std::shared_ptr<Type> elab_type(parsing::Type& type);
     std::shared_ptr<Lit> elab_lit(parsing::Lit& lit);
@@ -0,0 +1,512 @@
+#include <format>
+
+#include "elaborate/escape.hpp"
+
+namespace elaborate {
+
+void EscapeAnalysis::run(Package& pkg) {
+    params.clear();
+    collect(pkg.body, pkg.ident);
+    // parameters start out not escaping and only ever flip, so this terminates
+    bool changed = true;
+    while (changed) {
+        sites.clear();
+        changed = visit_decls(pkg.body, pkg.ident);
+    }
+
+    // a node reached twice is only promoted if no visit lets it escape
+    for (const auto& site: sites) {
+        if (site.stack) {
+            *site.stack = true;
+        }
+    }
+    promoted = 0;
+    total = 0;
+    for (const auto& site: sites) {
+        if (!site.stack) {
+            continue;
+        }
+        ++total;
+        if (site.reason) {
+            *site.stack = false;
+        } else {
+            ++promoted;
+        }
+    }
+}
+
+std::string EscapeAnalysis::report() const {
+    std::string result;
+    for (const auto& site: sites) {
+        if (site.stack && site.reason) {
+            result += std::format("{} at {}: {}\n", site.what, site.span, *site.reason);
+        }
+    }
+    return result;
+}
+
+void EscapeAnalysis::collect(
+    const std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    for (const auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                const auto& module_decl = static_cast<const ModuleDecl&>(*decl);
+                collect(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Class: {
+                const auto& class_decl = static_cast<const ClassDecl&>(*decl);
+                collect(class_decl.body, prefix + "." + class_decl.ident);
+                break;
+            }
+            case Decl::Kind::Extension: {
+                const auto& extension_decl = static_cast<const ExtensionDecl&>(*decl);
+                collect(extension_decl.body, prefix + "." + extension_decl.ident);
+                break;
+            }
+            case Decl::Kind::Func: {
+                // natives are left out, so arguments to them escape
+                const auto& func_decl = static_cast<const FuncDecl&>(*decl);
+                if (func_decl.body.has_value()) {
+                    params[prefix + "." + func_decl.ident].assign(func_decl.params.size(), false);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+bool EscapeAnalysis::visit_decls(
+    std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    bool changed = false;
+    for (auto& decl: decls) {
+        vars.clear();
+        depth = 0;
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                auto& module_decl = static_cast<ModuleDecl&>(*decl);
+                changed |= visit_decls(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Class: {
+                auto& class_decl = static_cast<ClassDecl&>(*decl);
+                changed |= visit_decls(class_decl.body, prefix + "." + class_decl.ident);
+                break;
+            }
+            case Decl::Kind::Extension: {
+                auto& extension_decl = static_cast<ExtensionDecl&>(*decl);
+                changed |= visit_decls(extension_decl.body, prefix + "." + extension_decl.ident);
+                break;
+            }
+            case Decl::Kind::Let: {
+                auto& let_decl = static_cast<LetDecl&>(*decl);
+                if (let_decl.expr.has_value()) {
+                    visit_expr(**let_decl.expr, Use {Use::Kind::Escape, "stored in a global"});
+                }
+                break;
+            }
+            case Decl::Kind::Init: {
+                auto& init_decl = static_cast<InitDecl&>(*decl);
+                if (init_decl.body.has_value()) {
+                    visit_function(
+                        init_decl.params,
+                        **init_decl.body,
+                        std::format("returned from {}", init_decl.ident)
+                    );
+                }
+                break;
+            }
+            case Decl::Kind::Func: {
+                auto& func_decl = static_cast<FuncDecl&>(*decl);
+                if (!func_decl.body.has_value()) {
+                    break;
+                }
+                std::vector<int> param_sites;
+                for (const auto& param: func_decl.params) {
+                    int site = add_site("parameter", param->get_span(), nullptr);
+                    param_sites.push_back(site);
+                    const auto* var_pat = param->get_kind() == Pat::Kind::Var
+                        ? static_cast<const VarPat*>(param.get())
+                        : nullptr;
+                    if (var_pat && !var_pat->is_mut) {
+                        vars[var_pat->ident] = Var {{site}, depth};
+                    } else {
+                        escape(site, "destructured or mutable");
+                        shadow(*param);
+                    }
+                }
+                visit_expr(
+                    **func_decl.body,
+                    Use {Use::Kind::Escape, std::format("returned from {}", func_decl.ident)}
+                );
+                auto& escapes = params.at(prefix + "." + func_decl.ident);
+                for (std::size_t i = 0; i < param_sites.size(); ++i) {
+                    if (sites[param_sites[i]].reason && !escapes[i]) {
+                        escapes[i] = true;
+                        changed = true;
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return changed;
+}
+
+void EscapeAnalysis::visit_expr(Expr& expr, const Use& use) {
+    auto span = expr.get_span();
+    auto ignore = Use {Use::Kind::Ignore};
+    switch (expr.get_kind()) {
+        case Expr::Kind::Var: {
+            auto it = vars.find(static_cast<const VarExpr&>(expr).ident);
+            if (it == vars.end()) {
+                break;
+            }
+            for (int site: it->second.sites) {
+                if (it->second.depth < depth) {
+                    escape(site, std::format("captured by a closure at {}", span));
+                } else {
+                    flow(site, use);
+                }
+            }
+            break;
+        }
+        case Expr::Kind::Unary: {
+            auto& unary_expr = static_cast<UnaryExpr&>(expr);
+            switch (unary_expr.get_op()) {
+                case UnaryExpr::Op::New: {
+                    int site = add_site("new instance", span, &static_cast<NewExpr&>(expr).stack);
+                    visit_expr(*unary_expr.expr, ignore);
+                    flow(site, use);
+                    break;
+                }
+                case UnaryExpr::Op::Try:
+                    visit_expr(
+                        *unary_expr.expr,
+                        Use {Use::Kind::Escape, std::format("unwrapped by ? at {}", span)}
+                    );
+                    break;
+                case UnaryExpr::Op::Addr:
+                    visit_expr(
+                        *unary_expr.expr,
+                        Use {Use::Kind::Escape, std::format("address taken at {}", span)}
+                    );
+                    break;
+                case UnaryExpr::Op::Index:
+                    visit_expr(*unary_expr.expr, ignore);
+                    for (auto& index: static_cast<IndexExpr&>(expr).indices) {
+                        visit_expr(*index, ignore);
+                    }
+                    break;
+                default:
+                    // reading through a value does not let it out
+                    visit_expr(*unary_expr.expr, ignore);
+                    break;
+            }
+            break;
+        }
+        case Expr::Kind::Binary: {
+            auto& binary_expr = static_cast<BinaryExpr&>(expr);
+            visit_expr(*binary_expr.left, ignore);
+            if (binary_expr.get_op() == BinaryExpr::Op::Assign) {
+                visit_expr(
+                    *binary_expr.right,
+                    Use {Use::Kind::Escape, std::format("assigned at {}", span)}
+                );
+            } else {
+                visit_expr(*binary_expr.right, ignore);
+            }
+            break;
+        }
+        case Expr::Kind::Tuple:
+            for (auto& elem: static_cast<TupleExpr&>(expr).elems) {
+                visit_expr(
+                    *elem,
+                    Use {Use::Kind::Escape, std::format("stored in a tuple at {}", span)}
+                );
+            }
+            break;
+        case Expr::Kind::Hint:
+            visit_expr(*static_cast<HintExpr&>(expr).expr, use);
+            break;
+        case Expr::Kind::Lam: {
+            auto& lam_expr = static_cast<LamExpr&>(expr);
+            int site = add_site("closure", span, &lam_expr.stack);
+            visit_function(
+                lam_expr.params,
+                *lam_expr.body,
+                std::format("returned from the closure at {}", span)
+            );
+            flow(site, use);
+            break;
+        }
+        case Expr::Kind::App:
+            visit_app(static_cast<AppExpr&>(expr));
+            break;
+        case Expr::Kind::Block: {
+            auto& block_expr = static_cast<BlockExpr&>(expr);
+            auto saved = vars;
+            for (auto& stmt: block_expr.stmts) {
+                visit_stmt(*stmt);
+            }
+            if (block_expr.body.has_value()) {
+                visit_expr(**block_expr.body, use);
+            }
+            vars = std::move(saved);
+            break;
+        }
+        case Expr::Kind::Ite: {
+            auto& ite_expr = static_cast<IteExpr&>(expr);
+            for (auto& then: ite_expr.then_branches) {
+                auto saved = vars;
+                visit_cond(*then.cond);
+                visit_expr(*then.then_branch, use);
+                vars = std::move(saved);
+            }
+            if (ite_expr.else_branch.has_value()) {
+                visit_expr(**ite_expr.else_branch, use);
+            }
+            break;
+        }
+        case Expr::Kind::Switch: {
+            auto& switch_expr = static_cast<SwitchExpr&>(expr);
+            visit_expr(
+                *switch_expr.expr,
+                Use {Use::Kind::Escape, std::format("matched at {}", span)}
+            );
+            for (auto& clause: switch_expr.clauses) {
+                if (clause->get_kind() == Clause::Kind::Default) {
+                    visit_expr(*static_cast<DefaultClause&>(*clause).expr, use);
+                    continue;
+                }
+                auto& case_clause = static_cast<CaseClause&>(*clause);
+                auto saved = vars;
+                shadow(*case_clause.pat);
+                if (case_clause.guard.has_value()) {
+                    visit_expr(**case_clause.guard, ignore);
+                }
+                visit_expr(*case_clause.expr, use);
+                vars = std::move(saved);
+            }
+            break;
+        }
+        case Expr::Kind::For: {
+            auto& for_expr = static_cast<ForExpr&>(expr);
+            visit_expr(*for_expr.iter, ignore);
+            auto saved = vars;
+            shadow(*for_expr.pat);
+            visit_expr(*for_expr.body, ignore);
+            vars = std::move(saved);
+            break;
+        }
+        case Expr::Kind::While: {
+            auto& while_expr = static_cast<WhileExpr&>(expr);
+            auto saved = vars;
+            visit_cond(*while_expr.cond);
+            visit_expr(*while_expr.body, ignore);
+            vars = std::move(saved);
+            break;
+        }
+        case Expr::Kind::Loop:
+            visit_expr(*static_cast<LoopExpr&>(expr).body, ignore);
+            break;
+        case Expr::Kind::Return: {
+            auto& return_expr = static_cast<ReturnExpr&>(expr);
+            if (return_expr.expr.has_value()) {
+                visit_expr(
+                    **return_expr.expr,
+                    Use {Use::Kind::Escape, std::format("returned at {}", span)}
+                );
+            }
+            break;
+        }
+        case Expr::Kind::Yield:
+            visit_expr(
+                *static_cast<YieldExpr&>(expr).expr,
+                Use {Use::Kind::Escape, std::format("yielded at {}", span)}
+            );
+            break;
+        default:
+            break;
+    }
+}
+
+// The result of a call needs no flow. It can only be a site of this function if
+// one was an argument, and a callee returning its parameter marks it escaping.
+void EscapeAnalysis::visit_app(AppExpr& expr) {
+    auto span = expr.get_span();
+    auto& func = *expr.func;
+    std::string reason;
+    switch (func.get_kind()) {
+        case Expr::Kind::Func: {
+            const auto& ident = static_cast<const FuncExpr&>(func).ident;
+            reason = std::format("passed to {} at {}", ident, span);
+            auto it = params.find(ident);
+            for (std::size_t i = 0; i < expr.args.size(); ++i) {
+                if (it != params.end() && i < it->second.size()) {
+                    visit_expr(*expr.args[i], Use {Use::Kind::Param, reason, nullptr, ident, i});
+                } else {
+                    visit_expr(*expr.args[i], Use {Use::Kind::Escape, reason});
+                }
+            }
+            return;
+        }
+        case Expr::Kind::Ctor:
+            reason = std::format("stored in {} at {}", static_cast<CtorExpr&>(func).ident, span);
+            break;
+        case Expr::Kind::Init:
+            reason = std::format("stored in {} at {}", static_cast<InitExpr&>(func).ident, span);
+            break;
+        case Expr::Kind::Unary:
+            if (static_cast<UnaryExpr&>(func).get_op() == UnaryExpr::Op::Field) {
+                // the method is only known at runtime, so the receiver escapes with the arguments
+                auto& field_expr = static_cast<FieldExpr&>(func);
+                reason = std::format("passed to method {} at {}", field_expr.path, span);
+                visit_expr(*field_expr.expr, Use {Use::Kind::Escape, reason});
+                break;
+            }
+            [[fallthrough]];
+        default:
+            // calling a closure does not let it out, but its body is unknown
+            reason = std::format("passed to a closure at {}", span);
+            visit_expr(func, Use {Use::Kind::Ignore});
+            break;
+    }
+    for (auto& arg: expr.args) {
+        visit_expr(*arg, Use {Use::Kind::Escape, reason});
+    }
+}
+
+void EscapeAnalysis::visit_stmt(Stmt& stmt) {
+    auto span = stmt.get_span();
+    switch (stmt.get_kind()) {
+        case Stmt::Kind::Let: {
+            auto& let_stmt = static_cast<LetStmt&>(stmt);
+            if (let_stmt.else_branch.has_value()) {
+                visit_expr(**let_stmt.else_branch, Use {Use::Kind::Ignore});
+            }
+            const auto* var_pat = let_stmt.pat->get_kind() == Pat::Kind::Var
+                ? static_cast<const VarPat*>(let_stmt.pat.get())
+                : nullptr;
+            if (var_pat && !var_pat->is_mut) {
+                std::vector<int> held;
+                visit_expr(*let_stmt.expr, Use {Use::Kind::Bind, "", &held});
+                vars[var_pat->ident] = Var {std::move(held), depth};
+                break;
+            }
+            auto reason = var_pat ? std::format("bound to a mutable variable at {}", span)
+                                  : std::format("bound by a pattern at {}", span);
+            visit_expr(*let_stmt.expr, Use {Use::Kind::Escape, reason});
+            shadow(*let_stmt.pat);
+            break;
+        }
+        case Stmt::Kind::Func: {
+            auto& func_stmt = static_cast<FuncStmt&>(stmt);
+            int site = add_site(
+                std::format("local function {}", func_stmt.ident),
+                span,
+                &func_stmt.stack
+            );
+            // the body calls itself through its own closure, which is no capture
+            vars[func_stmt.ident] = Var {{site}, depth + 1};
+            visit_function(
+                func_stmt.params,
+                *func_stmt.body,
+                std::format("returned from {}", func_stmt.ident)
+            );
+            vars[func_stmt.ident] = Var {{site}, depth};
+            break;
+        }
+        case Stmt::Kind::Bind: {
+            auto& bind_stmt = static_cast<BindStmt&>(stmt);
+            visit_expr(
+                *bind_stmt.expr,
+                Use {Use::Kind::Escape, std::format("bound by a pattern at {}", span)}
+            );
+            shadow(*bind_stmt.pat);
+            break;
+        }
+        case Stmt::Kind::Expr:
+            visit_expr(*static_cast<ExprStmt&>(stmt).expr, Use {Use::Kind::Ignore});
+            break;
+    }
+}
+
+void EscapeAnalysis::visit_cond(Cond& cond) {
+    switch (cond.get_kind()) {
+        case Cond::Kind::Expr:
+            visit_expr(*static_cast<ExprCond&>(cond).expr, Use {Use::Kind::Ignore});
+            break;
+        case Cond::Kind::Case: {
+            auto& pat_cond = static_cast<PatCond&>(cond);
+            visit_expr(
+                *pat_cond.expr,
+                Use {Use::Kind::Escape, std::format("matched at {}", cond.get_span())}
+            );
+            shadow(*pat_cond.pat);
+            break;
+        }
+    }
+}
+
+void EscapeAnalysis::visit_function(
+    const std::vector<std::shared_ptr<Pat>>& params,
+    Expr& body,
+    const std::string& reason
+) {
+    auto saved = vars;
+    ++depth;
+    for (const auto& param: params) {
+        shadow(*param);
+    }
+    visit_expr(body, Use {Use::Kind::Escape, reason});
+    --depth;
+    vars = std::move(saved);
+}
+
+int EscapeAnalysis::add_site(std::string what, Span span, bool* stack) {
+    sites.push_back(Site {std::move(what), span, std::nullopt, stack});
+    return static_cast<int>(sites.size()) - 1;
+}
+
+void EscapeAnalysis::flow(int site, const Use& use) {
+    switch (use.kind) {
+        case Use::Kind::Ignore:
+            break;
+        case Use::Kind::Bind:
+            use.into->push_back(site);
+            break;
+        case Use::Kind::Param:
+            if (params.at(use.func)[use.index]) {
+                escape(site, use.reason);
+            }
+            break;
+        case Use::Kind::Escape:
+            escape(site, use.reason);
+            break;
+    }
+}
+
+void EscapeAnalysis::escape(int site, const std::string& reason) {
+    if (!sites[site].reason) {
+        sites[site].reason = reason;
+    }
+}
+
+void EscapeAnalysis::shadow(const Pat& pat) {
+    std::vector<std::string> names;
+    collect_pat_vars(pat, names);
+    for (auto& name: names) {
+        vars[name] = Var {{}, depth};
+    }
+}
+
+} // namespace elaborate
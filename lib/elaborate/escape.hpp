@@ -0,0 +1,95 @@
+#pragma once
+
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+// Interprocedural escape analysis over the elaborated IR. Closures and `new`
+// instances that provably die with the function creating them are marked to
+// live in a stack slot of its frame. Such a value may only be called, read,
+// bound to immutable variables and passed to parameters of known functions
+// that do not let it escape in turn. Returning it, storing it, capturing it in
+// another closure or handing it to an unknown callee keeps it on the heap.
+class EscapeAnalysis {
+public:
+    EscapeAnalysis() = default;
+
+    void run(Package& pkg);
+
+    int get_promoted() const {
+        return promoted;
+    }
+
+    int get_total() const {
+        return total;
+    }
+
+    // the allocation sites left on the heap, one per line with the first reason found
+    std::string report() const;
+
+private:
+    // A closure, `new` instance or parameter whose value is being followed.
+    struct Site {
+        std::string what;
+        Span span;
+        std::optional<std::string> reason;
+        // the flag promoting an allocation, null for parameters
+        bool* stack;
+    };
+
+    // Where the value of an expression goes. Bound values are followed through
+    // the variable, and an argument escapes if the parameter it lands in does.
+    struct Use {
+        enum class Kind {
+            Ignore,
+            Bind,
+            Param,
+            Escape,
+        };
+
+        Kind kind;
+        std::string reason;
+        std::vector<int>* into = nullptr;
+        std::string func;
+        std::size_t index = 0;
+    };
+
+    // sites a variable may hold and the function nesting depth it is bound at
+    struct Var {
+        std::vector<int> sites;
+        int depth;
+    };
+
+    // whether each parameter of a function declaration escapes, by path
+    std::map<std::string, std::vector<bool>> params;
+    std::vector<Site> sites;
+    std::map<std::string, Var> vars;
+    int depth = 0;
+    int promoted = 0;
+    int total = 0;
+
+    void collect(const std::vector<std::shared_ptr<Decl>>& decls, const std::string& prefix);
+    // returns whether a parameter summary changed
+    bool visit_decls(std::vector<std::shared_ptr<Decl>>& decls, const std::string& prefix);
+    void visit_expr(Expr& expr, const Use& use);
+    void visit_stmt(Stmt& stmt);
+    void visit_cond(Cond& cond);
+    void visit_app(AppExpr& expr);
+    // params and body of a closure, local function or initializer nested in the current one
+    void visit_function(
+        const std::vector<std::shared_ptr<Pat>>& params,
+        Expr& body,
+        const std::string& reason
+    );
+    int add_site(std::string what, Span span, bool* stack);
+    void flow(int site, const Use& use);
+    void escape(int site, const std::string& reason);
+    void shadow(const Pat& pat);
+};
+
+} // namespace elaborate
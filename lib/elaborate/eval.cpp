@@ -0,0 +1,623 @@
+#include <format>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <ranges>
+
+#include "elaborate/eval.hpp"
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+namespace {
+
+struct LocalScope {
+    std::vector<std::map<std::string, std::shared_ptr<Value>>>& locals;
+
+    explicit LocalScope(std::vector<std::map<std::string, std::shared_ptr<Value>>>& locals):
+        locals(locals) {
+        locals.emplace_back();
+    }
+
+    ~LocalScope() {
+        locals.pop_back();
+    }
+};
+
+// Int is 64 bits wide, as in the interpreter. Overflow is left to the runtime,
+// which reports it.
+std::optional<std::shared_ptr<Value>> make_int(bool overflow, std::int64_t value) {
+    if (overflow) {
+        return std::nullopt;
+    }
+    return std::make_shared<IntValue>(value);
+}
+
+bool pat_is_mut(const Pat& pat) {
+    switch (pat.get_kind()) {
+        case Pat::Kind::Var:
+            return static_cast<const VarPat&>(pat).is_mut;
+        case Pat::Kind::Tuple: {
+            const auto& tuple_pat = static_cast<const TuplePat&>(pat);
+            for (const auto& elem: tuple_pat.elems) {
+                if (pat_is_mut(*elem)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        case Pat::Kind::Ctor: {
+            const auto& ctor_pat = static_cast<const CtorPat&>(pat);
+            if (ctor_pat.args.has_value()) {
+                for (const auto& arg: *ctor_pat.args) {
+                    if (pat_is_mut(*arg)) {
+                        return true;
+                    }
+                }
+            }
+            return false;
+        }
+        case Pat::Kind::Or: {
+            const auto& or_pat = static_cast<const OrPat&>(pat);
+            for (const auto& option: or_pat.options) {
+                if (pat_is_mut(*option)) {
+                    return true;
+                }
+            }
+            return false;
+        }
+        case Pat::Kind::At: {
+            const auto& at_pat = static_cast<const AtPat&>(pat);
+            return at_pat.is_mut || pat_is_mut(*at_pat.pat);
+        }
+        default:
+            return false;
+    }
+}
+
+} // namespace
+
+bool value_equal(const Value& left, const Value& right) {
+    if (left.get_kind() != right.get_kind()) {
+        return false;
+    }
+    switch (left.get_kind()) {
+        case Value::Kind::Unit:
+            return true;
+        case Value::Kind::Int:
+            return static_cast<const IntValue&>(left).value
+                == static_cast<const IntValue&>(right).value;
+        case Value::Kind::Bool:
+            return static_cast<const BoolValue&>(left).value
+                == static_cast<const BoolValue&>(right).value;
+        case Value::Kind::Char:
+            return static_cast<const CharValue&>(left).value
+                == static_cast<const CharValue&>(right).value;
+        case Value::Kind::String:
+            return static_cast<const StringValue&>(left).value
+                == static_cast<const StringValue&>(right).value;
+        case Value::Kind::Tuple: {
+            const auto& l = static_cast<const TupleValue&>(left);
+            const auto& r = static_cast<const TupleValue&>(right);
+            if (l.elems.size() != r.elems.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < l.elems.size(); ++i) {
+                if (!value_equal(*l.elems[i], *r.elems[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case Value::Kind::Ctor: {
+            const auto& l = static_cast<const CtorValue&>(left);
+            const auto& r = static_cast<const CtorValue&>(right);
+            if (l.ident != r.ident || l.args.has_value() != r.args.has_value()) {
+                return false;
+            }
+            if (!l.args.has_value()) {
+                return true;
+            }
+            if (l.args->size() != r.args->size()) {
+                return false;
+            }
+            for (size_t i = 0; i < l.args->size(); ++i) {
+                if (!value_equal(*(*l.args)[i], *(*r.args)[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void Evaluator::eval_package(Package& pkg) {
+    eval_decls(pkg.body, pkg.ident);
+}
+
+void Evaluator::eval_decls(std::vector<std::shared_ptr<Decl>>& decls, const std::string& prefix) {
+    for (auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                auto& module_decl = static_cast<ModuleDecl&>(*decl);
+                eval_decls(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Let: {
+                auto& let_decl = static_cast<LetDecl&>(*decl);
+                if (!let_decl.expr.has_value()) {
+                    break;
+                }
+                auto value = eval(**let_decl.expr);
+                if (!value.has_value()) {
+                    break;
+                }
+                LocalScope scope(locals);
+                if (match(*let_decl.pat, *value) != true) {
+                    break;
+                }
+                let_decl.value = *value;
+                // mutable globals get static storage but are never propagated
+                if (!pat_is_mut(*let_decl.pat)) {
+                    for (auto& [ident, bound]: locals.back()) {
+                        globals[prefix + "." + ident] = bound;
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_lit(const Lit& lit) {
+    switch (lit.get_kind()) {
+        case Lit::Kind::Unit:
+            return std::make_shared<UnitValue>();
+        case Lit::Kind::Int:
+            return std::make_shared<IntValue>(static_cast<const IntLit&>(lit).value);
+        case Lit::Kind::Bool:
+            return std::make_shared<BoolValue>(static_cast<const BoolLit&>(lit).value);
+        case Lit::Kind::Char:
+            return std::make_shared<CharValue>(static_cast<const CharLit&>(lit).value);
+        case Lit::Kind::String:
+            return std::make_shared<StringValue>(static_cast<const StringLit&>(lit).value);
+    }
+    return std::nullopt;
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_var(const std::string& ident) {
+    for (auto& scope: std::views::reverse(locals)) {
+        auto it = scope.find(ident);
+        if (it != scope.end()) {
+            return it->second;
+        }
+    }
+    auto it = globals.find(ident);
+    if (it != globals.end()) {
+        return it->second;
+    }
+    return std::nullopt;
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_unary(const UnaryExpr& expr) {
+    auto operand = eval(*expr.expr);
+    if (!operand.has_value()) {
+        return std::nullopt;
+    }
+    auto kind = (*operand)->get_kind();
+    switch (expr.get_op()) {
+        case UnaryExpr::Op::Pos:
+            if (kind == Value::Kind::Int) {
+                return operand;
+            }
+            return std::nullopt;
+        case UnaryExpr::Op::Neg:
+            if (kind == Value::Kind::Int) {
+                auto value = static_cast<IntValue&>(**operand).value;
+                if (value == std::numeric_limits<std::int64_t>::min()) {
+                    return std::nullopt;
+                }
+                return std::make_shared<IntValue>(-value);
+            }
+            return std::nullopt;
+        case UnaryExpr::Op::Not:
+            if (kind == Value::Kind::Bool) {
+                return std::make_shared<BoolValue>(!static_cast<BoolValue&>(**operand).value);
+            }
+            return std::nullopt;
+        case UnaryExpr::Op::Proj: {
+            const auto& proj_expr = static_cast<const ProjExpr&>(expr);
+            if (kind != Value::Kind::Tuple) {
+                return std::nullopt;
+            }
+            auto& tuple = static_cast<TupleValue&>(**operand);
+            if (proj_expr.index < 0 || proj_expr.index >= static_cast<int>(tuple.elems.size())) {
+                return std::nullopt;
+            }
+            return tuple.elems[proj_expr.index];
+        }
+        default:
+            // &, *, ?, new, [] and fields touch memory or control flow
+            return std::nullopt;
+    }
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_binary(const BinaryExpr& expr) {
+    if (expr.get_op() == BinaryExpr::Op::Assign) {
+        return std::nullopt;
+    }
+    auto left = eval(*expr.left);
+    if (!left.has_value()) {
+        return std::nullopt;
+    }
+    // short-circuit before evaluating the right operand
+    if (expr.get_op() == BinaryExpr::Op::And || expr.get_op() == BinaryExpr::Op::Or) {
+        if ((*left)->get_kind() != Value::Kind::Bool) {
+            return std::nullopt;
+        }
+        bool l = static_cast<BoolValue&>(**left).value;
+        if (expr.get_op() == BinaryExpr::Op::And ? !l : l) {
+            return left;
+        }
+        auto right = eval(*expr.right);
+        if (!right.has_value() || (*right)->get_kind() != Value::Kind::Bool) {
+            return std::nullopt;
+        }
+        return right;
+    }
+    auto right = eval(*expr.right);
+    if (!right.has_value()) {
+        return std::nullopt;
+    }
+    if (expr.get_op() == BinaryExpr::Op::Eq) {
+        return std::make_shared<BoolValue>(value_equal(**left, **right));
+    }
+    if (expr.get_op() == BinaryExpr::Op::Neq) {
+        return std::make_shared<BoolValue>(!value_equal(**left, **right));
+    }
+    std::int64_t l = 0;
+    std::int64_t r = 0;
+    std::int64_t result = 0;
+    if ((*left)->get_kind() == Value::Kind::Int && (*right)->get_kind() == Value::Kind::Int) {
+        l = static_cast<IntValue&>(**left).value;
+        r = static_cast<IntValue&>(**right).value;
+    } else if (
+        (*left)->get_kind() == Value::Kind::Char && (*right)->get_kind() == Value::Kind::Char
+    ) {
+        l = static_cast<CharValue&>(**left).value;
+        r = static_cast<CharValue&>(**right).value;
+        switch (expr.get_op()) {
+            case BinaryExpr::Op::Lt:
+            case BinaryExpr::Op::Gt:
+            case BinaryExpr::Op::Lte:
+            case BinaryExpr::Op::Gte:
+                break;
+            default:
+                return std::nullopt;
+        }
+    } else {
+        return std::nullopt;
+    }
+    switch (expr.get_op()) {
+        case BinaryExpr::Op::Add: {
+            bool overflow = __builtin_add_overflow(l, r, &result);
+            return make_int(overflow, result);
+        }
+        case BinaryExpr::Op::Sub: {
+            bool overflow = __builtin_sub_overflow(l, r, &result);
+            return make_int(overflow, result);
+        }
+        case BinaryExpr::Op::Mul: {
+            bool overflow = __builtin_mul_overflow(l, r, &result);
+            return make_int(overflow, result);
+        }
+        case BinaryExpr::Op::Div:
+            if (r == 0 || (r == -1 && l == std::numeric_limits<std::int64_t>::min())) {
+                return std::nullopt;
+            }
+            return std::make_shared<IntValue>(l / r);
+        case BinaryExpr::Op::Mod:
+            if (r == 0) {
+                return std::nullopt;
+            }
+            return std::make_shared<IntValue>(r == -1 ? 0 : l % r);
+        case BinaryExpr::Op::Lt:
+            return std::make_shared<BoolValue>(l < r);
+        case BinaryExpr::Op::Gt:
+            return std::make_shared<BoolValue>(l > r);
+        case BinaryExpr::Op::Lte:
+            return std::make_shared<BoolValue>(l <= r);
+        case BinaryExpr::Op::Gte:
+            return std::make_shared<BoolValue>(l >= r);
+        default:
+            return std::nullopt;
+    }
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_block(const BlockExpr& expr) {
+    LocalScope scope(locals);
+    for (const auto& stmt: expr.stmts) {
+        switch (stmt->get_kind()) {
+            case Stmt::Kind::Let: {
+                const auto& let_stmt = static_cast<const LetStmt&>(*stmt);
+                auto value = eval(*let_stmt.expr);
+                if (!value.has_value() || match(*let_stmt.pat, *value) != true) {
+                    // a refuted let diverges through its else branch
+                    return std::nullopt;
+                }
+                break;
+            }
+            case Stmt::Kind::Expr: {
+                const auto& expr_stmt = static_cast<const ExprStmt&>(*stmt);
+                if (!eval(*expr_stmt.expr).has_value()) {
+                    return std::nullopt;
+                }
+                break;
+            }
+            default:
+                return std::nullopt;
+        }
+    }
+    if (expr.body.has_value()) {
+        return eval(**expr.body);
+    }
+    return std::make_shared<UnitValue>();
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_ite(const IteExpr& expr) {
+    for (const auto& [cond, then_branch]: expr.then_branches) {
+        LocalScope scope(locals);
+        if (cond->get_kind() == Cond::Kind::Expr) {
+            auto value = eval(*static_cast<const ExprCond&>(*cond).expr);
+            if (!value.has_value() || (*value)->get_kind() != Value::Kind::Bool) {
+                return std::nullopt;
+            }
+            if (static_cast<BoolValue&>(**value).value) {
+                return eval(*then_branch);
+            }
+        } else {
+            const auto& pat_cond = static_cast<const PatCond&>(*cond);
+            auto value = eval(*pat_cond.expr);
+            if (!value.has_value()) {
+                return std::nullopt;
+            }
+            auto matched = match(*pat_cond.pat, *value);
+            if (!matched.has_value()) {
+                return std::nullopt;
+            }
+            if (*matched) {
+                return eval(*then_branch);
+            }
+        }
+    }
+    if (expr.else_branch.has_value()) {
+        return eval(**expr.else_branch);
+    }
+    return std::make_shared<UnitValue>();
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval_switch(const SwitchExpr& expr) {
+    auto value = eval(*expr.expr);
+    if (!value.has_value()) {
+        return std::nullopt;
+    }
+    for (const auto& clause: expr.clauses) {
+        if (clause->get_kind() == Clause::Kind::Default) {
+            return eval(*static_cast<const DefaultClause&>(*clause).expr);
+        }
+        const auto& case_clause = static_cast<const CaseClause&>(*clause);
+        LocalScope scope(locals);
+        auto matched = match(*case_clause.pat, *value);
+        if (!matched.has_value()) {
+            return std::nullopt;
+        }
+        if (!*matched) {
+            continue;
+        }
+        if (case_clause.guard.has_value()) {
+            auto guard = eval(**case_clause.guard);
+            if (!guard.has_value() || (*guard)->get_kind() != Value::Kind::Bool) {
+                return std::nullopt;
+            }
+            if (!static_cast<BoolValue&>(**guard).value) {
+                continue;
+            }
+        }
+        return eval(*case_clause.expr);
+    }
+    // non-exhaustive switch, keep the runtime failure
+    return std::nullopt;
+}
+
+std::optional<bool> Evaluator::match(const Pat& pat, const std::shared_ptr<Value>& value) {
+    switch (pat.get_kind()) {
+        case Pat::Kind::Lit: {
+            auto lit = eval_lit(*static_cast<const LitPat&>(pat).literal);
+            if (!lit.has_value() || (*lit)->get_kind() != value->get_kind()) {
+                return std::nullopt;
+            }
+            return value_equal(**lit, *value);
+        }
+        case Pat::Kind::Var: {
+            locals.back()[static_cast<const VarPat&>(pat).ident] = value;
+            return true;
+        }
+        case Pat::Kind::Wild:
+            return true;
+        case Pat::Kind::Tuple: {
+            const auto& tuple_pat = static_cast<const TuplePat&>(pat);
+            if (value->get_kind() != Value::Kind::Tuple) {
+                return std::nullopt;
+            }
+            const auto& tuple = static_cast<const TupleValue&>(*value);
+            if (tuple.elems.size() != tuple_pat.elems.size()) {
+                return std::nullopt;
+            }
+            for (size_t i = 0; i < tuple.elems.size(); ++i) {
+                auto matched = match(*tuple_pat.elems[i], tuple.elems[i]);
+                if (matched != true) {
+                    return matched;
+                }
+            }
+            return true;
+        }
+        case Pat::Kind::Ctor: {
+            const auto& ctor_pat = static_cast<const CtorPat&>(pat);
+            if (value->get_kind() != Value::Kind::Ctor) {
+                return std::nullopt;
+            }
+            const auto& ctor = static_cast<const CtorValue&>(*value);
+            if (ctor.ident != ctor_pat.ident) {
+                return false;
+            }
+            if (ctor.args.has_value() != ctor_pat.args.has_value()) {
+                return std::nullopt;
+            }
+            if (!ctor.args.has_value()) {
+                return true;
+            }
+            if (ctor.args->size() != ctor_pat.args->size()) {
+                return std::nullopt;
+            }
+            for (size_t i = 0; i < ctor.args->size(); ++i) {
+                auto matched = match(*(*ctor_pat.args)[i], (*ctor.args)[i]);
+                if (matched != true) {
+                    return matched;
+                }
+            }
+            return true;
+        }
+        case Pat::Kind::Or: {
+            const auto& or_pat = static_cast<const OrPat&>(pat);
+            for (const auto& option: or_pat.options) {
+                auto matched = match(*option, value);
+                if (matched != false) {
+                    return matched;
+                }
+            }
+            return false;
+        }
+        case Pat::Kind::At: {
+            const auto& at_pat = static_cast<const AtPat&>(pat);
+            locals.back()[at_pat.ident] = value;
+            return match(*at_pat.pat, value);
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<std::shared_ptr<Value>> Evaluator::eval(const Expr& expr) {
+    switch (expr.get_kind()) {
+        case Expr::Kind::Lit:
+            return eval_lit(*static_cast<const LitExpr&>(expr).literal);
+        case Expr::Kind::Unary:
+            return eval_unary(static_cast<const UnaryExpr&>(expr));
+        case Expr::Kind::Binary:
+            return eval_binary(static_cast<const BinaryExpr&>(expr));
+        case Expr::Kind::Tuple: {
+            const auto& tuple_expr = static_cast<const TupleExpr&>(expr);
+            std::vector<std::shared_ptr<Value>> elems;
+            for (const auto& elem: tuple_expr.elems) {
+                auto value = eval(*elem);
+                if (!value.has_value()) {
+                    return std::nullopt;
+                }
+                elems.push_back(std::move(*value));
+            }
+            return std::make_shared<TupleValue>(std::move(elems));
+        }
+        case Expr::Kind::Hint:
+            return eval(*static_cast<const HintExpr&>(expr).expr);
+        case Expr::Kind::Var:
+            return eval_var(static_cast<const VarExpr&>(expr).ident);
+        case Expr::Kind::Ctor: {
+            const auto& ctor_expr = static_cast<const CtorExpr&>(expr);
+            return std::make_shared<CtorValue>(ctor_expr.ident, std::nullopt);
+        }
+        case Expr::Kind::App: {
+            const auto& app_expr = static_cast<const AppExpr&>(expr);
+            // only constructor applications are known to be pure
+            if (app_expr.func->get_kind() != Expr::Kind::Ctor) {
+                return std::nullopt;
+            }
+            std::vector<std::shared_ptr<Value>> args;
+            for (const auto& arg: app_expr.args) {
+                auto value = eval(*arg);
+                if (!value.has_value()) {
+                    return std::nullopt;
+                }
+                args.push_back(std::move(*value));
+            }
+            const auto& ctor_expr = static_cast<const CtorExpr&>(*app_expr.func);
+            return std::make_shared<CtorValue>(ctor_expr.ident, std::move(args));
+        }
+        case Expr::Kind::Block:
+            return eval_block(static_cast<const BlockExpr&>(expr));
+        case Expr::Kind::Ite:
+            return eval_ite(static_cast<const IteExpr&>(expr));
+        case Expr::Kind::Switch:
+            return eval_switch(static_cast<const SwitchExpr&>(expr));
+        default:
+            return std::nullopt;
+    }
+}
+
+std::string format_value(const Value& value) {
+    switch (value.get_kind()) {
+        case Value::Kind::Unit:
+            return "()";
+        case Value::Kind::Int:
+            return std::to_string(static_cast<const IntValue&>(value).value);
+        case Value::Kind::Bool:
+            return static_cast<const BoolValue&>(value).value ? "true" : "false";
+        case Value::Kind::Char: {
+            CharLit lit(static_cast<const CharValue&>(value).value, Span {});
+            return std::format("{}", static_cast<const Lit&>(lit));
+        }
+        case Value::Kind::String: {
+            StringLit lit(static_cast<const StringValue&>(value).value, Span {});
+            return std::format("{}", static_cast<const Lit&>(lit));
+        }
+        case Value::Kind::Tuple: {
+            const auto& v = static_cast<const TupleValue&>(value);
+            std::string result = "(";
+            for (size_t i = 0; i < v.elems.size(); ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                result += format_value(*v.elems[i]);
+            }
+            result += ")";
+            return result;
+        }
+        case Value::Kind::Ctor: {
+            const auto& v = static_cast<const CtorValue&>(value);
+            std::string result = v.ident;
+            if (!v.args.has_value()) {
+                return result;
+            }
+            result += "(";
+            for (size_t i = 0; i < v.args->size(); ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                result += format_value(*(*v.args)[i]);
+            }
+            result += ")";
+            return result;
+        }
+    }
+    return "<?value>";
+}
+
+} // namespace elaborate
+
+std::format_context::iterator std::formatter<elaborate::Value>::format(
+    const elaborate::Value& value,
+    std::format_context& ctx
+) const {
+    return std::formatter<std::string>::format(elaborate::format_value(value), ctx);
+}
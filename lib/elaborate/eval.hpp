@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstdint>
+#include <format>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+struct Value {
+    enum class Kind {
+        Unit,
+        Int,
+        Bool,
+        Char,
+        String,
+        Tuple,
+        Ctor,
+    };
+
+    explicit Value(Kind kind): kind(kind) {}
+    virtual ~Value() = default;
+
+    Kind get_kind() const {
+        return kind;
+    }
+
+private:
+    Kind kind;
+};
+
+struct UnitValue: public Value {
+    UnitValue(): Value(Kind::Unit) {}
+};
+
+struct IntValue: public Value {
+    std::int64_t value;
+
+    explicit IntValue(std::int64_t value): Value(Kind::Int), value(value) {}
+};
+
+struct BoolValue: public Value {
+    bool value;
+
+    explicit BoolValue(bool value): Value(Kind::Bool), value(value) {}
+};
+
+struct CharValue: public Value {
+    char value;
+
+    explicit CharValue(char value): Value(Kind::Char), value(value) {}
+};
+
+struct StringValue: public Value {
+    std::string value;
+
+    explicit StringValue(std::string value): Value(Kind::String), value(std::move(value)) {}
+};
+
+struct TupleValue: public Value {
+    std::vector<std::shared_ptr<Value>> elems;
+
+    explicit TupleValue(std::vector<std::shared_ptr<Value>> elems):
+        Value(Kind::Tuple),
+        elems(std::move(elems)) {}
+};
+
+struct CtorValue: public Value {
+    std::string ident;
+    std::optional<std::vector<std::shared_ptr<Value>>> args;
+
+    CtorValue(std::string ident, std::optional<std::vector<std::shared_ptr<Value>>> args):
+        Value(Kind::Ctor),
+        ident(std::move(ident)),
+        args(std::move(args)) {}
+};
+
+bool value_equal(const Value& left, const Value& right);
+
+// Compile-time interpreter for pure initializers. Evaluation gives up (returns
+// std::nullopt) on anything with effects or that would fail at runtime, so the
+// initializer is left for program startup instead.
+class Evaluator {
+public:
+    Evaluator() = default;
+
+    std::optional<std::shared_ptr<Value>> eval(const Expr& expr);
+
+    // Folds module level let declarations into LetDecl::value.
+    void eval_package(Package& pkg);
+
+private:
+    std::map<std::string, std::shared_ptr<Value>> globals;
+    std::vector<std::map<std::string, std::shared_ptr<Value>>> locals;
+
+    void eval_decls(std::vector<std::shared_ptr<Decl>>& decls, const std::string& prefix);
+    std::optional<std::shared_ptr<Value>> eval_lit(const Lit& lit);
+    std::optional<std::shared_ptr<Value>> eval_var(const std::string& ident);
+    std::optional<std::shared_ptr<Value>> eval_unary(const UnaryExpr& expr);
+    std::optional<std::shared_ptr<Value>> eval_binary(const BinaryExpr& expr);
+    std::optional<std::shared_ptr<Value>> eval_block(const BlockExpr& expr);
+    std::optional<std::shared_ptr<Value>> eval_ite(const IteExpr& expr);
+    std::optional<std::shared_ptr<Value>> eval_switch(const SwitchExpr& expr);
+
+    // Returns std::nullopt when the match cannot be decided at compile time.
+    std::optional<bool> match(const Pat& pat, const std::shared_ptr<Value>& value);
+};
+
+} // namespace elaborate
+
+template<>
+struct std::formatter<elaborate::Value>: std::formatter<std::string> {
+    std::format_context::iterator
+    format(const elaborate::Value& value, std::format_context& ctx) const;
+};
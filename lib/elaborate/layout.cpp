@@ -0,0 +1,200 @@
+#include <algorithm>
+#include <format>
+#include <numeric>
+#include <utility>
+
+#include "elaborate/layout.hpp"
+
+namespace elaborate {
+
+namespace {
+
+// Values without a static size are boxed, so they take a pointer.
+std::pair<int, int> size_align(const Type* type) {
+    if (!type) {
+        return {8, 8};
+    }
+    switch (type->get_kind()) {
+        case Type::Kind::Unit:
+            return {0, 1};
+        case Type::Kind::Bool:
+        case Type::Kind::Char:
+            return {1, 1};
+        case Type::Kind::Simd: {
+            // vectors are aligned to their size, up to a cache line
+            const auto& simd_type = static_cast<const SimdType&>(*type);
+            int lane = simd_type.elem->get_kind() == Type::Kind::Bool ? 1 : 8;
+            return {simd_type.lanes * lane, std::min(simd_type.lanes * lane, 64)};
+        }
+        default:
+            return {8, 8};
+    }
+}
+
+int align_up(int offset, int align) {
+    return (offset + align - 1) / align * align;
+}
+
+bool is_bool(const FieldLayout& field) {
+    return field.type == "Bool";
+}
+
+} // namespace
+
+void LayoutPass::run(const Package& pkg) {
+    layouts.clear();
+    collect(pkg.body, pkg.ident);
+}
+
+int LayoutPass::get_saved() const {
+    return std::accumulate(
+        layouts.begin(),
+        layouts.end(),
+        0,
+        [](int saved, const RecordLayout& layout) {
+            return saved + layout.declared_size - layout.size;
+        }
+    );
+}
+
+std::string LayoutPass::dump() const {
+    std::string result;
+    for (const auto& layout: layouts) {
+        result += std::format(
+            "layout {}{}: {} bytes, align {}, declared {}\n",
+            layout.path,
+            layout.repr_c ? " @repr(C)" : "",
+            layout.size,
+            layout.align,
+            layout.declared_size
+        );
+        for (const auto& field: layout.fields) {
+            auto offset = field.bit < 0 ? std::format("{}", field.offset)
+                                        : std::format("{}.{}", field.offset, field.bit);
+            result += std::format("    {:>6} {}: {}\n", offset, field.ident, field.type);
+        }
+    }
+    return result;
+}
+
+void LayoutPass::collect(
+    const std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    for (const auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                const auto& module_decl = static_cast<const ModuleDecl&>(*decl);
+                collect(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Class: {
+                const auto& class_decl = static_cast<const ClassDecl&>(*decl);
+                std::vector<Field> fields;
+                for (const auto* field: class_fields(class_decl)) {
+                    fields.push_back({field->ident, field->hint.get()});
+                }
+                if (!fields.empty()) {
+                    add_record(
+                        prefix + "." + class_decl.ident,
+                        fields,
+                        find_attr_arg(decl->attrs, "repr") == "C",
+                        true
+                    );
+                }
+                break;
+            }
+            case Decl::Kind::Enum: {
+                const auto& enum_decl = static_cast<const EnumDecl&>(*decl);
+                bool repr_c = find_attr_arg(decl->attrs, "repr") == "C";
+                for (const auto& member: enum_decl.body) {
+                    if (member->get_kind() != Decl::Kind::Ctor) {
+                        continue;
+                    }
+                    const auto& ctor_decl = static_cast<const CtorDecl&>(*member);
+                    if (!ctor_decl.params.has_value() || ctor_decl.params->empty()) {
+                        continue;
+                    }
+                    std::vector<Field> fields;
+                    for (size_t i = 0; i < ctor_decl.params->size(); ++i) {
+                        fields.push_back({std::format("{}", i), (*ctor_decl.params)[i].get()});
+                    }
+                    add_record(
+                        std::format("{}.{}.{}", prefix, enum_decl.ident, ctor_decl.ident),
+                        fields,
+                        repr_c,
+                        false
+                    );
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void LayoutPass::add_record(
+    std::string path,
+    const std::vector<Field>& fields,
+    bool repr_c,
+    bool named
+) {
+    RecordLayout layout;
+    layout.path = std::move(path);
+    layout.repr_c = repr_c;
+    for (const auto& field: fields) {
+        auto [size, align] = size_align(field.type);
+        auto type = field.type ? std::format("{}", *field.type) : std::string("_");
+        layout.fields.push_back({field.ident, std::move(type), 0, size, align});
+        layout.align = std::max(layout.align, align);
+    }
+
+    int offset = 0;
+    for (auto& field: layout.fields) {
+        field.offset = align_up(offset, field.align);
+        offset = field.offset + field.size;
+    }
+    layout.declared_size = align_up(offset, layout.align);
+    if (repr_c) {
+        layout.size = layout.declared_size;
+        layouts.push_back(std::move(layout));
+        return;
+    }
+
+    // only class fields have names that profile counters can refer to
+    auto heat = [&](const FieldLayout& field) -> std::uint64_t {
+        if (!named || !hotness) {
+            return 0;
+        }
+        auto it = hotness->find(field.ident);
+        return it == hotness->end() ? 0 : it->second;
+    };
+    std::ranges::stable_sort(layout.fields, [&](const auto& left, const auto& right) {
+        if (is_bool(left) != is_bool(right)) {
+            return is_bool(right);
+        }
+        if (left.align != right.align) {
+            return left.align > right.align;
+        }
+        return heat(left) > heat(right);
+    });
+
+    offset = 0;
+    int bools = 0;
+    for (auto& field: layout.fields) {
+        if (is_bool(field)) {
+            // eight Bools share a byte
+            field.offset = offset + bools / 8;
+            field.bit = bools % 8;
+            ++bools;
+            continue;
+        }
+        field.offset = align_up(offset, field.align);
+        offset = field.offset + field.size;
+    }
+    layout.size = align_up(offset + (bools + 7) / 8, layout.align);
+    layouts.push_back(std::move(layout));
+}
+
+} // namespace elaborate
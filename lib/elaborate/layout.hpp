@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+struct FieldLayout {
+    std::string ident;
+    std::string type;
+    int offset = 0;
+    int size = 0;
+    int align = 1;
+    // bit of a packed Bool within the byte at offset, or -1
+    int bit = -1;
+};
+
+struct RecordLayout {
+    // a class path, or the path of an enum constructor whose fields are numbered
+    std::string path;
+    bool repr_c = false;
+    std::vector<FieldLayout> fields;
+    int size = 0;
+    int align = 1;
+    // size in declaration order with C padding and one byte per Bool
+    int declared_size = 0;
+};
+
+// Native layout of class instances and enum constructor payloads. Fields are
+// sorted by decreasing alignment, hotter fields first among equals, and Bool
+// fields are packed into trailing bits. @repr(C) records keep the declared order
+// and padding of the C ABI. hotness maps a field name to its access count.
+class LayoutPass {
+public:
+    explicit LayoutPass(const std::map<std::string, std::uint64_t>* hotness = nullptr):
+        hotness(hotness) {}
+
+    void run(const Package& pkg);
+
+    const std::vector<RecordLayout>& get_layouts() const {
+        return layouts;
+    }
+
+    // bytes saved over the declared layouts, summed over every record
+    int get_saved() const;
+
+    std::string dump() const;
+
+private:
+    struct Field {
+        std::string ident;
+        const Type* type;
+    };
+
+    const std::map<std::string, std::uint64_t>* hotness;
+    std::vector<RecordLayout> layouts;
+
+    void collect(const std::vector<std::shared_ptr<Decl>>& decls, const std::string& prefix);
+    void add_record(std::string path, const std::vector<Field>& fields, bool repr_c, bool named);
+};
+
+} // namespace elaborate
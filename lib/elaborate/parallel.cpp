@@ -0,0 +1,321 @@
+#include <format>
+#include <map>
+#include <optional>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "elaborate/parallel.hpp"
+
+namespace elaborate {
+
+namespace {
+
+// What a loop body does to the variables around it. A name refers to one of
+// those only where no binding of the body is in scope for it.
+class LoopEffects {
+public:
+    struct Write {
+        std::string ident;
+        BinaryExpr::Op mode;
+        Span span;
+    };
+
+    // names bound by the body at the point being visited
+    std::set<std::string> bound;
+    std::map<std::string, int> reads;
+    std::vector<Write> writes;
+    // break or return leaving the parallel loop
+    std::optional<Span> escape;
+
+    void visit_expr(const Expr& expr);
+
+private:
+    // depth of the loops and functions nested in the body, a break or return
+    // inside them stays local
+    int loops = 0;
+    int functions = 0;
+
+    void visit_stmt(const Stmt& stmt);
+    void visit_cond(const Cond& cond);
+    void bind(const Pat& pat);
+};
+
+void LoopEffects::bind(const Pat& pat) {
+    std::vector<std::string> vars;
+    collect_pat_vars(pat, vars);
+    bound.insert(vars.begin(), vars.end());
+}
+
+void LoopEffects::visit_expr(const Expr& expr) {
+    switch (expr.get_kind()) {
+        case Expr::Kind::Var:
+            if (!bound.contains(static_cast<const VarExpr&>(expr).ident)) {
+                ++reads[static_cast<const VarExpr&>(expr).ident];
+            }
+            break;
+        case Expr::Kind::Unary:
+            visit_expr(*static_cast<const UnaryExpr&>(expr).expr);
+            // ? returns on failure
+            if (static_cast<const UnaryExpr&>(expr).get_op() == UnaryExpr::Op::Try && functions == 0
+                && !escape) {
+                escape = expr.get_span();
+            }
+            if (static_cast<const UnaryExpr&>(expr).get_op() == UnaryExpr::Op::Index) {
+                for (const auto& index: static_cast<const IndexExpr&>(expr).indices) {
+                    visit_expr(*index);
+                }
+            }
+            break;
+        case Expr::Kind::Binary: {
+            const auto& binary_expr = static_cast<const BinaryExpr&>(expr);
+            if (binary_expr.get_op() == BinaryExpr::Op::Assign
+                && binary_expr.left->get_kind() == Expr::Kind::Var) {
+                const auto& ident = static_cast<const VarExpr&>(*binary_expr.left).ident;
+                if (!bound.contains(ident)) {
+                    writes.push_back(Write {
+                        ident,
+                        static_cast<const AssignExpr&>(binary_expr).mode,
+                        expr.get_span(),
+                    });
+                }
+            } else {
+                visit_expr(*binary_expr.left);
+            }
+            visit_expr(*binary_expr.right);
+            break;
+        }
+        case Expr::Kind::Tuple:
+            for (const auto& elem: static_cast<const TupleExpr&>(expr).elems) {
+                visit_expr(*elem);
+            }
+            break;
+        case Expr::Kind::Hint:
+            visit_expr(*static_cast<const HintExpr&>(expr).expr);
+            break;
+        case Expr::Kind::Lam: {
+            const auto& lam_expr = static_cast<const LamExpr&>(expr);
+            auto saved = bound;
+            for (const auto& param: lam_expr.params) {
+                bind(*param);
+            }
+            ++functions;
+            visit_expr(*lam_expr.body);
+            --functions;
+            bound = std::move(saved);
+            break;
+        }
+        case Expr::Kind::App: {
+            const auto& app_expr = static_cast<const AppExpr&>(expr);
+            visit_expr(*app_expr.func);
+            for (const auto& arg: app_expr.args) {
+                visit_expr(*arg);
+            }
+            break;
+        }
+        case Expr::Kind::Block: {
+            const auto& block_expr = static_cast<const BlockExpr&>(expr);
+            auto saved = bound;
+            for (const auto& stmt: block_expr.stmts) {
+                visit_stmt(*stmt);
+            }
+            if (block_expr.body.has_value()) {
+                visit_expr(**block_expr.body);
+            }
+            bound = std::move(saved);
+            break;
+        }
+        case Expr::Kind::Ite: {
+            const auto& ite_expr = static_cast<const IteExpr&>(expr);
+            for (const auto& then: ite_expr.then_branches) {
+                auto saved = bound;
+                visit_cond(*then.cond);
+                visit_expr(*then.then_branch);
+                bound = std::move(saved);
+            }
+            if (ite_expr.else_branch.has_value()) {
+                visit_expr(**ite_expr.else_branch);
+            }
+            break;
+        }
+        case Expr::Kind::Switch: {
+            const auto& switch_expr = static_cast<const SwitchExpr&>(expr);
+            visit_expr(*switch_expr.expr);
+            for (const auto& clause: switch_expr.clauses) {
+                if (clause->get_kind() == Clause::Kind::Default) {
+                    visit_expr(*static_cast<const DefaultClause&>(*clause).expr);
+                    continue;
+                }
+                const auto& case_clause = static_cast<const CaseClause&>(*clause);
+                auto saved = bound;
+                bind(*case_clause.pat);
+                if (case_clause.guard.has_value()) {
+                    visit_expr(**case_clause.guard);
+                }
+                visit_expr(*case_clause.expr);
+                bound = std::move(saved);
+            }
+            break;
+        }
+        case Expr::Kind::For: {
+            const auto& for_expr = static_cast<const ForExpr&>(expr);
+            visit_expr(*for_expr.iter);
+            auto saved = bound;
+            bind(*for_expr.pat);
+            ++loops;
+            visit_expr(*for_expr.body);
+            --loops;
+            bound = std::move(saved);
+            break;
+        }
+        case Expr::Kind::While: {
+            const auto& while_expr = static_cast<const WhileExpr&>(expr);
+            auto saved = bound;
+            ++loops;
+            visit_cond(*while_expr.cond);
+            visit_expr(*while_expr.body);
+            --loops;
+            bound = std::move(saved);
+            break;
+        }
+        case Expr::Kind::Loop:
+            ++loops;
+            visit_expr(*static_cast<const LoopExpr&>(expr).body);
+            --loops;
+            break;
+        case Expr::Kind::Break:
+            if (loops == 0 && functions == 0 && !escape) {
+                escape = expr.get_span();
+            }
+            break;
+        case Expr::Kind::Return: {
+            const auto& return_expr = static_cast<const ReturnExpr&>(expr);
+            if (functions == 0 && !escape) {
+                escape = expr.get_span();
+            }
+            if (return_expr.expr.has_value()) {
+                visit_expr(**return_expr.expr);
+            }
+            break;
+        }
+        case Expr::Kind::Yield:
+            // the values would reach the consumer out of order
+            if (functions == 0 && !escape) {
+                escape = expr.get_span();
+            }
+            visit_expr(*static_cast<const YieldExpr&>(expr).expr);
+            break;
+        default:
+            break;
+    }
+}
+
+void LoopEffects::visit_stmt(const Stmt& stmt) {
+    switch (stmt.get_kind()) {
+        case Stmt::Kind::Let: {
+            const auto& let_stmt = static_cast<const LetStmt&>(stmt);
+            visit_expr(*let_stmt.expr);
+            if (let_stmt.else_branch.has_value()) {
+                visit_expr(**let_stmt.else_branch);
+            }
+            bind(*let_stmt.pat);
+            break;
+        }
+        case Stmt::Kind::Func: {
+            const auto& func_stmt = static_cast<const FuncStmt&>(stmt);
+            bound.insert(func_stmt.ident);
+            auto saved = bound;
+            for (const auto& param: func_stmt.params) {
+                bind(*param);
+            }
+            ++functions;
+            visit_expr(*func_stmt.body);
+            --functions;
+            bound = std::move(saved);
+            break;
+        }
+        case Stmt::Kind::Bind: {
+            const auto& bind_stmt = static_cast<const BindStmt&>(stmt);
+            visit_expr(*bind_stmt.expr);
+            bind(*bind_stmt.pat);
+            break;
+        }
+        case Stmt::Kind::Expr:
+            visit_expr(*static_cast<const ExprStmt&>(stmt).expr);
+            break;
+    }
+}
+
+void LoopEffects::visit_cond(const Cond& cond) {
+    switch (cond.get_kind()) {
+        case Cond::Kind::Expr:
+            visit_expr(*static_cast<const ExprCond&>(cond).expr);
+            break;
+        case Cond::Kind::Case: {
+            const auto& pat_cond = static_cast<const PatCond&>(cond);
+            visit_expr(*pat_cond.expr);
+            bind(*pat_cond.pat);
+            break;
+        }
+    }
+}
+
+void check_loop(const ForExpr& expr) {
+    if (as_loop_adapter(*expr.iter)) {
+        throw std::runtime_error(
+            std::format("A @parallel loop runs over a range or an array at {}", expr.get_span())
+        );
+    }
+    LoopEffects effects;
+    std::vector<std::string> loop_vars;
+    collect_pat_vars(*expr.pat, loop_vars);
+    effects.bound.insert(loop_vars.begin(), loop_vars.end());
+    effects.visit_expr(*expr.body);
+    if (effects.escape) {
+        throw std::runtime_error(
+            std::format("Cannot leave a @parallel loop at {}", *effects.escape)
+        );
+    }
+    for (const auto& write: effects.writes) {
+        // partial results of each worker are combined once the loop finishes
+        bool reduction = write.mode == BinaryExpr::Op::Add || write.mode == BinaryExpr::Op::Mul;
+        if (reduction && !write.ident.contains('.') && !effects.reads.contains(write.ident)) {
+            continue;
+        }
+        throw std::runtime_error(std::format(
+            "@parallel loop body assigns {} declared outside the loop at {}",
+            write.ident,
+            write.span
+        ));
+    }
+}
+
+} // namespace
+
+void check_parallel(const std::vector<std::shared_ptr<Expr>>& attrs, const Stmt* stmt, Span span) {
+    for (const auto& attr: attrs) {
+        const auto* name = attr.get();
+        if (attr->get_kind() == Expr::Kind::App) {
+            name = static_cast<const AppExpr&>(*attr).func.get();
+        }
+        if (name->get_kind() != Expr::Kind::Var
+            || static_cast<const VarExpr&>(*name).ident != "parallel") {
+            continue;
+        }
+        if (attr->get_kind() != Expr::Kind::Var) {
+            throw std::runtime_error(
+                std::format("Attribute @parallel takes no arguments at {}", attr->get_span())
+            );
+        }
+        if (!stmt || stmt->get_kind() != Stmt::Kind::Expr
+            || static_cast<const ExprStmt&>(*stmt).expr->get_kind() != Expr::Kind::For) {
+            throw std::runtime_error(
+                std::format("Attribute @parallel only applies to for loops at {}", span)
+            );
+        }
+        check_loop(static_cast<const ForExpr&>(*static_cast<const ExprStmt&>(*stmt).expr));
+    }
+}
+
+} // namespace elaborate
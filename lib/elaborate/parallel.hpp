@@ -0,0 +1,15 @@
+#pragma once
+
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+// Checks @parallel, which lets the iterations of a for loop over a range or an
+// array run on every core. The body may not break out of the loop, return,
+// yield, or assign a variable declared outside it, except for `+=` and `*=`
+// reductions into a variable the body never reads. stmt is null for declarations.
+void check_parallel(const std::vector<std::shared_ptr<Expr>>& attrs, const Stmt* stmt, Span span);
+
+} // namespace elaborate
@@ -0,0 +1,364 @@
+#include <ranges>
+
+#include "elaborate/reuse.hpp"
+
+namespace elaborate {
+
+namespace {
+
+bool is_local(const std::string& ident) {
+    // globals are referenced by their full path
+    return !ident.contains('.');
+}
+
+bool builds(const Expr& expr, Expr::Kind kind) {
+    if (expr.get_kind() != kind) {
+        return false;
+    }
+    if (kind == Expr::Kind::Tuple) {
+        return !static_cast<const TupleExpr&>(expr).elems.empty();
+    }
+    const auto& app_expr = static_cast<const AppExpr&>(expr);
+    return app_expr.func->get_kind() == Expr::Kind::Ctor && !app_expr.args.empty();
+}
+
+std::set<std::string> merge(std::set<std::string> left, const std::set<std::string>& right) {
+    left.insert(right.begin(), right.end());
+    return left;
+}
+
+} // namespace
+
+void ReuseAnalysis::run(Package& pkg) {
+    visit_decls(pkg.body);
+}
+
+void ReuseAnalysis::visit_decls(std::vector<std::shared_ptr<Decl>>& decls) {
+    for (auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module:
+                visit_decls(static_cast<ModuleDecl&>(*decl).body);
+                break;
+            case Decl::Kind::Class:
+                visit_decls(static_cast<ClassDecl&>(*decl).body);
+                break;
+            case Decl::Kind::Extension:
+                visit_decls(static_cast<ExtensionDecl&>(*decl).body);
+                break;
+            case Decl::Kind::Let: {
+                auto& let_decl = static_cast<LetDecl&>(*decl);
+                if (let_decl.expr.has_value()) {
+                    visit_expr(**let_decl.expr, {});
+                }
+                break;
+            }
+            case Decl::Kind::Func: {
+                auto& func_decl = static_cast<FuncDecl&>(*decl);
+                if (func_decl.body.has_value()) {
+                    visit_expr(**func_decl.body, {});
+                }
+                break;
+            }
+            case Decl::Kind::Init: {
+                auto& init_decl = static_cast<InitDecl&>(*decl);
+                if (init_decl.body.has_value()) {
+                    visit_expr(**init_decl.body, {});
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+// Children are visited in reverse of the interpreter's evaluation order.
+ReuseAnalysis::Live ReuseAnalysis::visit_expr(Expr& expr, Live live) {
+    switch (expr.get_kind()) {
+        case Expr::Kind::Unary: {
+            auto& unary_expr = static_cast<UnaryExpr&>(expr);
+            if (unary_expr.get_op() == UnaryExpr::Op::Index) {
+                auto& index_expr = static_cast<IndexExpr&>(unary_expr);
+                for (auto& index: std::views::reverse(index_expr.indices)) {
+                    live = visit_expr(*index, std::move(live));
+                }
+            }
+            return visit_expr(*unary_expr.expr, std::move(live));
+        }
+        case Expr::Kind::Binary: {
+            auto& binary_expr = static_cast<BinaryExpr&>(expr);
+            if (binary_expr.get_op() == BinaryExpr::Op::Assign
+                && binary_expr.left->get_kind() == Expr::Kind::Var) {
+                // a compound assignment reads the variable after the value
+                const auto& ident = static_cast<VarExpr&>(*binary_expr.left).ident;
+                live.insert(ident);
+                return visit_expr(*binary_expr.right, std::move(live));
+            }
+            // the left operand, or the target of a[i] = v, is evaluated first
+            live = visit_expr(*binary_expr.right, std::move(live));
+            return visit_expr(*binary_expr.left, std::move(live));
+        }
+        case Expr::Kind::Tuple:
+            for (auto& elem: std::views::reverse(static_cast<TupleExpr&>(expr).elems)) {
+                live = visit_expr(*elem, std::move(live));
+            }
+            return live;
+        case Expr::Kind::Hint:
+            return visit_expr(*static_cast<HintExpr&>(expr).expr, std::move(live));
+        case Expr::Kind::Var: {
+            auto& var_expr = static_cast<VarExpr&>(expr);
+            if (is_local(var_expr.ident)) {
+                var_expr.last_use = !live.contains(var_expr.ident);
+                live.insert(var_expr.ident);
+            }
+            return live;
+        }
+        case Expr::Kind::Lam:
+            // creating the closure reads everything its body reads
+            return merge(std::move(live), visit_expr(*static_cast<LamExpr&>(expr).body, {}));
+        case Expr::Kind::App: {
+            auto& app_expr = static_cast<AppExpr&>(expr);
+            for (auto& arg: std::views::reverse(app_expr.args)) {
+                live = visit_expr(*arg, std::move(live));
+            }
+            return visit_expr(*app_expr.func, std::move(live));
+        }
+        case Expr::Kind::Block: {
+            auto& block_expr = static_cast<BlockExpr&>(expr);
+            if (block_expr.body.has_value()) {
+                live = visit_expr(**block_expr.body, std::move(live));
+            }
+            for (auto& stmt: std::views::reverse(block_expr.stmts)) {
+                live = visit_stmt(*stmt, std::move(live));
+            }
+            return live;
+        }
+        case Expr::Kind::Ite: {
+            auto& ite_expr = static_cast<IteExpr&>(expr);
+            Live next = live;
+            if (ite_expr.else_branch.has_value()) {
+                next = visit_expr(**ite_expr.else_branch, live);
+            }
+            for (auto& then: std::views::reverse(ite_expr.then_branches)) {
+                Live taken_branch = visit_expr(*then.then_branch, live);
+                next = visit_cond(*then.cond, merge(std::move(taken_branch), next));
+            }
+            return next;
+        }
+        case Expr::Kind::Switch:
+            return visit_switch(static_cast<SwitchExpr&>(expr), std::move(live));
+        case Expr::Kind::For: {
+            auto& for_expr = static_cast<ForExpr&>(expr);
+            // everything read in the body is live throughout the loop
+            Live head = merge(std::move(live), visit_expr(*for_expr.body, {}));
+            visit_expr(*for_expr.body, head);
+            return visit_expr(*for_expr.iter, std::move(head));
+        }
+        case Expr::Kind::While: {
+            auto& while_expr = static_cast<WhileExpr&>(expr);
+            Live reads = visit_cond(*while_expr.cond, visit_expr(*while_expr.body, {}));
+            Live head = merge(std::move(live), reads);
+            visit_cond(*while_expr.cond, visit_expr(*while_expr.body, head));
+            return head;
+        }
+        case Expr::Kind::Loop: {
+            auto& loop_expr = static_cast<LoopExpr&>(expr);
+            Live head = merge(std::move(live), visit_expr(*loop_expr.body, {}));
+            visit_expr(*loop_expr.body, head);
+            return head;
+        }
+        case Expr::Kind::Return: {
+            // what follows a return is still treated as reachable, which only adds liveness
+            auto& return_expr = static_cast<ReturnExpr&>(expr);
+            if (return_expr.expr.has_value()) {
+                return visit_expr(**return_expr.expr, std::move(live));
+            }
+            return live;
+        }
+        case Expr::Kind::Yield:
+            return visit_expr(*static_cast<YieldExpr&>(expr).expr, std::move(live));
+        default:
+            return live;
+    }
+}
+
+ReuseAnalysis::Live ReuseAnalysis::visit_stmt(Stmt& stmt, Live live) {
+    switch (stmt.get_kind()) {
+        case Stmt::Kind::Let: {
+            auto& let_stmt = static_cast<LetStmt&>(stmt);
+            if (let_stmt.else_branch.has_value()) {
+                live = merge(live, visit_expr(**let_stmt.else_branch, live));
+            }
+            return visit_expr(*let_stmt.expr, std::move(live));
+        }
+        case Stmt::Kind::Func:
+            return merge(std::move(live), visit_expr(*static_cast<FuncStmt&>(stmt).body, {}));
+        case Stmt::Kind::Bind:
+            return visit_expr(*static_cast<BindStmt&>(stmt).expr, std::move(live));
+        case Stmt::Kind::Expr:
+            return visit_expr(*static_cast<ExprStmt&>(stmt).expr, std::move(live));
+    }
+    return live;
+}
+
+ReuseAnalysis::Live ReuseAnalysis::visit_cond(Cond& cond, Live live) {
+    switch (cond.get_kind()) {
+        case Cond::Kind::Expr:
+            return visit_expr(*static_cast<ExprCond&>(cond).expr, std::move(live));
+        case Cond::Kind::Case:
+            return visit_expr(*static_cast<PatCond&>(cond).expr, std::move(live));
+    }
+    return live;
+}
+
+ReuseAnalysis::Live ReuseAnalysis::visit_switch(SwitchExpr& expr, Live live) {
+    // clauses are tried in order, so a failed guard continues with the later ones
+    Live later = live;
+    bool guarded = false;
+    for (auto& clause: std::views::reverse(expr.clauses)) {
+        if (clause->get_kind() == Clause::Kind::Default) {
+            auto& default_clause = static_cast<DefaultClause&>(*clause);
+            later = merge(std::move(later), visit_expr(*default_clause.expr, live));
+            continue;
+        }
+        auto& case_clause = static_cast<CaseClause&>(*clause);
+        Live clause_live = visit_expr(*case_clause.expr, live);
+        if (case_clause.guard.has_value()) {
+            guarded = true;
+            clause_live = visit_expr(**case_clause.guard, merge(std::move(clause_live), later));
+        }
+        later = merge(std::move(later), clause_live);
+    }
+    Live result = visit_expr(*expr.expr, std::move(later));
+
+    // a guard may run user code on the fields of a clause that then fails
+    const auto& scrutinee = *expr.expr;
+    expr.consumes = !guarded
+        && (scrutinee.get_kind() != Expr::Kind::Var
+            || !is_local(static_cast<const VarExpr&>(scrutinee).ident)
+            || static_cast<const VarExpr&>(scrutinee).last_use);
+    for (auto& clause: expr.clauses) {
+        if (clause->get_kind() != Clause::Kind::Case) {
+            continue;
+        }
+        auto& case_clause = static_cast<CaseClause&>(*clause);
+        // loops visit their bodies twice, so drop the previous choice first
+        if (case_clause.reuse) {
+            taken.erase(case_clause.reuse);
+            case_clause.reuse = nullptr;
+            --candidates;
+        }
+        if (!expr.consumes) {
+            continue;
+        }
+        Expr::Kind kind;
+        if (case_clause.pat->get_kind() == Pat::Kind::Ctor) {
+            const auto& ctor_pat = static_cast<const CtorPat&>(*case_clause.pat);
+            if (!ctor_pat.args.has_value() || ctor_pat.args->empty()) {
+                continue;
+            }
+            kind = Expr::Kind::App;
+        } else if (case_clause.pat->get_kind() == Pat::Kind::Tuple) {
+            kind = Expr::Kind::Tuple;
+        } else {
+            continue;
+        }
+        case_clause.reuse = find_candidate(*case_clause.expr, kind);
+        if (case_clause.reuse) {
+            taken.insert(case_clause.reuse);
+            ++candidates;
+        }
+    }
+    return result;
+}
+
+// Pre-order search that stays out of loops and closures, where a cell
+// consumed once could be rebuilt many times.
+const Expr* ReuseAnalysis::find_candidate(const Expr& expr, Expr::Kind kind) {
+    if (builds(expr, kind) && !taken.contains(&expr)) {
+        return &expr;
+    }
+    auto search = [&](const Expr& child) {
+        return find_candidate(child, kind);
+    };
+    switch (expr.get_kind()) {
+        case Expr::Kind::Unary: {
+            const auto& unary_expr = static_cast<const UnaryExpr&>(expr);
+            return search(*unary_expr.expr);
+        }
+        case Expr::Kind::Binary: {
+            const auto& binary_expr = static_cast<const BinaryExpr&>(expr);
+            if (const auto* found = search(*binary_expr.left)) {
+                return found;
+            }
+            return search(*binary_expr.right);
+        }
+        case Expr::Kind::Tuple:
+            for (const auto& elem: static_cast<const TupleExpr&>(expr).elems) {
+                if (const auto* found = search(*elem)) {
+                    return found;
+                }
+            }
+            return nullptr;
+        case Expr::Kind::Hint:
+            return search(*static_cast<const HintExpr&>(expr).expr);
+        case Expr::Kind::App: {
+            const auto& app_expr = static_cast<const AppExpr&>(expr);
+            for (const auto& arg: app_expr.args) {
+                if (const auto* found = search(*arg)) {
+                    return found;
+                }
+            }
+            return nullptr;
+        }
+        case Expr::Kind::Block: {
+            const auto& block_expr = static_cast<const BlockExpr&>(expr);
+            for (const auto& stmt: block_expr.stmts) {
+                const Expr* child = nullptr;
+                if (stmt->get_kind() == Stmt::Kind::Let) {
+                    child = static_cast<const LetStmt&>(*stmt).expr.get();
+                } else if (stmt->get_kind() == Stmt::Kind::Bind) {
+                    child = static_cast<const BindStmt&>(*stmt).expr.get();
+                } else if (stmt->get_kind() == Stmt::Kind::Expr) {
+                    child = static_cast<const ExprStmt&>(*stmt).expr.get();
+                }
+                if (const auto* found = child ? search(*child) : nullptr) {
+                    return found;
+                }
+            }
+            return block_expr.body.has_value() ? search(**block_expr.body) : nullptr;
+        }
+        case Expr::Kind::Ite: {
+            const auto& ite_expr = static_cast<const IteExpr&>(expr);
+            for (const auto& then: ite_expr.then_branches) {
+                if (const auto* found = search(*then.then_branch)) {
+                    return found;
+                }
+            }
+            return ite_expr.else_branch.has_value() ? search(**ite_expr.else_branch) : nullptr;
+        }
+        case Expr::Kind::Switch: {
+            const auto& switch_expr = static_cast<const SwitchExpr&>(expr);
+            if (const auto* found = search(*switch_expr.expr)) {
+                return found;
+            }
+            for (const auto& clause: switch_expr.clauses) {
+                const auto& body = clause->get_kind() == Clause::Kind::Case
+                    ? *static_cast<const CaseClause&>(*clause).expr
+                    : *static_cast<const DefaultClause&>(*clause).expr;
+                if (const auto* found = search(body)) {
+                    return found;
+                }
+            }
+            return nullptr;
+        }
+        case Expr::Kind::Return: {
+            const auto& return_expr = static_cast<const ReturnExpr&>(expr);
+            return return_expr.expr.has_value() ? search(**return_expr.expr) : nullptr;
+        }
+        default:
+            return nullptr;
+    }
+}
+
+} // namespace elaborate
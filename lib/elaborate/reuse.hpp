@@ -0,0 +1,43 @@
+#pragma once
+
+#include <set>
+#include <string>
+#include <vector>
+
+#include "elaborate/syntax.hpp"
+
+namespace elaborate {
+
+// Reuse analysis over the elaborated IR. Marks the last read of each local
+// variable, and for every switch whose scrutinee dies in the match picks a
+// constructor or tuple per clause that may be built in the matched cell. The
+// cell is only taken at runtime when nothing else ever shared it.
+class ReuseAnalysis {
+public:
+    ReuseAnalysis() = default;
+
+    void run(Package& pkg);
+
+    int get_candidates() const {
+        return candidates;
+    }
+
+private:
+    // Variables are never killed, so a variable stays live until its last
+    // read on any path. This over-approximates liveness, which keeps
+    // VarExpr::last_use safe to act on.
+    using Live = std::set<std::string>;
+
+    std::set<const Expr*> taken;
+    int candidates = 0;
+
+    void visit_decls(std::vector<std::shared_ptr<Decl>>& decls);
+    // these return the variables live before the node
+    Live visit_expr(Expr& expr, Live live);
+    Live visit_stmt(Stmt& stmt, Live live);
+    Live visit_cond(Cond& cond, Live live);
+    Live visit_switch(SwitchExpr& expr, Live live);
+    const Expr* find_candidate(const Expr& expr, Expr::Kind kind);
+};
+
+} // namespace elaborate
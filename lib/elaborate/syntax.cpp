@@ -1,3 +1,4 @@
+#include "eval.hpp"
 #include "syntax.hpp"
 
 namespace elaborate {
@@ -99,6 +100,10 @@ std::string format_type(const Type& type) {
             result += " -> " + format_type(*t.output);
             return result;
         }
+        case Type::Kind::Simd: {
+            const auto& t = static_cast<const SimdType&>(type);
+            return std::format("Simd{}<{}>", t.lanes, format_type(*t.elem));
+        }
     }
     return "<?type>";
 }
@@ -398,6 +403,9 @@ std::string format_expr(const Expr& expr, int indent) {
                 case BinaryExpr::Op::Gte:
                     op = " >= ";
                     break;
+                case BinaryExpr::Op::Range:
+                    op = "..";
+                    break;
                 case BinaryExpr::Op::Assign: {
                     const auto& e = static_cast<const AssignExpr&>(expr);
                     switch (e.mode) {
@@ -569,6 +577,10 @@ std::string format_expr(const Expr& expr, int indent) {
             }
             return result;
         }
+        case Expr::Kind::Yield: {
+            const auto& s = static_cast<const YieldExpr&>(expr);
+            return "yield " + format_expr(*s.expr, indent);
+        }
     }
     return "<?expr>";
 }
@@ -798,6 +810,9 @@ std::string format_decl(const Decl& decl, int indent) {
                 result += " = " + format_expr(**d.expr, indent);
             }
             result += ";";
+            if (d.value) {
+                result += std::format(" // static {}", *d.value);
+            }
             break;
         }
         case Decl::Kind::Func: {
@@ -872,6 +887,108 @@ std::string format_package(const Package& pkg) {
     return result;
 }
 
+void collect_pat_vars(const Pat& pat, std::vector<std::string>& vars) {
+    switch (pat.get_kind()) {
+        case Pat::Kind::Var:
+            vars.push_back(static_cast<const VarPat&>(pat).ident);
+            break;
+        case Pat::Kind::Tuple:
+            for (const auto& elem: static_cast<const TuplePat&>(pat).elems) {
+                collect_pat_vars(*elem, vars);
+            }
+            break;
+        case Pat::Kind::Ctor: {
+            const auto& ctor_pat = static_cast<const CtorPat&>(pat);
+            if (ctor_pat.args.has_value()) {
+                for (const auto& arg: *ctor_pat.args) {
+                    collect_pat_vars(*arg, vars);
+                }
+            }
+            break;
+        }
+        case Pat::Kind::Or:
+            for (const auto& option: static_cast<const OrPat&>(pat).options) {
+                collect_pat_vars(*option, vars);
+            }
+            break;
+        case Pat::Kind::At: {
+            const auto& at_pat = static_cast<const AtPat&>(pat);
+            vars.push_back(at_pat.ident);
+            collect_pat_vars(*at_pat.pat, vars);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void collect_fields(const Pat& pat, std::vector<const VarPat*>& fields) {
+    if (pat.get_kind() == Pat::Kind::Var) {
+        fields.push_back(&static_cast<const VarPat&>(pat));
+    } else if (pat.get_kind() == Pat::Kind::Tuple) {
+        for (const auto& elem: static_cast<const TuplePat&>(pat).elems) {
+            collect_fields(*elem, fields);
+        }
+    }
+}
+
+std::vector<const VarPat*> class_fields(const ClassDecl& decl) {
+    std::vector<const VarPat*> fields;
+    for (const auto& member: decl.body) {
+        if (member->get_kind() == Decl::Kind::Let) {
+            collect_fields(*static_cast<const LetDecl&>(*member).pat, fields);
+        }
+    }
+    return fields;
+}
+
+const AppExpr* as_loop_adapter(const Expr& expr) {
+    if (expr.get_kind() != Expr::Kind::App) {
+        return nullptr;
+    }
+    const auto& app_expr = static_cast<const AppExpr&>(expr);
+    if (app_expr.func->get_kind() != Expr::Kind::Unary
+        || static_cast<const UnaryExpr&>(*app_expr.func).get_op() != UnaryExpr::Op::Field
+        || app_expr.args.size() != 1) {
+        return nullptr;
+    }
+    const auto& name = static_cast<const FieldExpr&>(*app_expr.func).path;
+    return name == "map" || name == "filter" || name == "zip" ? &app_expr : nullptr;
+}
+
+bool has_attr(const std::vector<std::shared_ptr<Expr>>& attrs, const std::string& ident) {
+    for (const auto& attr: attrs) {
+        if (attr->get_kind() == Expr::Kind::Var
+            && static_cast<const VarExpr&>(*attr).ident == ident) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::optional<std::string>
+find_attr_arg(const std::vector<std::shared_ptr<Expr>>& attrs, const std::string& ident) {
+    for (const auto& attr: attrs) {
+        if (attr->get_kind() != Expr::Kind::App) {
+            continue;
+        }
+        const auto& app_expr = static_cast<const AppExpr&>(*attr);
+        if (app_expr.func->get_kind() != Expr::Kind::Var
+            || static_cast<const VarExpr&>(*app_expr.func).ident != ident
+            || app_expr.args.size() != 1) {
+            continue;
+        }
+        if (app_expr.args[0]->get_kind() == Expr::Kind::Var) {
+            return static_cast<const VarExpr&>(*app_expr.args[0]).ident;
+        }
+        const auto& lit = *static_cast<const LitExpr&>(*app_expr.args[0]).literal;
+        if (lit.get_kind() == Lit::Kind::String) {
+            return static_cast<const StringLit&>(lit).value;
+        }
+    }
+    return std::nullopt;
+}
+
 } // namespace elaborate
 
 // std::formatter specializations
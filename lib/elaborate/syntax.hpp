@@ -17,6 +17,22 @@ struct Expr;
 struct Stmt;
 struct Decl;
 struct Package;
+struct Value;
+struct Symbol;
+struct TableNode;
+class DeclStore;
+
+// What a name of the elaborated tree resolved to, so later passes never look it
+// up again. The elaborator sets symbol and node while resolving the name, and
+// decl once every declaration of the package is elaborated. Names bound by a
+// local variable or type parameter resolve to no symbol.
+struct Ref {
+    const Symbol* symbol = nullptr;
+    // the members of a class, enum, interface or extension, otherwise the node
+    // declaring the symbol
+    const TableNode* node = nullptr;
+    const Decl* decl = nullptr;
+};
 
 struct Import {
     enum class Kind {
@@ -56,6 +72,7 @@ struct Type {
         Interface,
         Tuple,
         Arrow,
+        Simd,
     };
 
     Type(Kind kind, Span span): kind(kind), span(span) {}
@@ -192,6 +209,7 @@ struct Expr {
         Break,
         Continue,
         Return,
+        Yield,
     };
 
     Expr(Kind kind, Span span): kind(kind), span(span) {}
@@ -334,6 +352,7 @@ struct VarType: public Type {
 struct EnumType: public Type {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     EnumType(
         std::string ident,
@@ -348,6 +367,7 @@ struct EnumType: public Type {
 struct ClassType: public Type {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     ClassType(
         std::string ident,
@@ -362,6 +382,7 @@ struct ClassType: public Type {
 struct TypealiasType: public Type {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     TypealiasType(
         std::string ident,
@@ -376,6 +397,7 @@ struct TypealiasType: public Type {
 struct InterfaceType: public Type {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     InterfaceType(
         std::string ident,
@@ -411,6 +433,18 @@ struct ArrowType: public Type {
         output(std::move(output)) {}
 };
 
+// Built-in fixed-width vector Simd2<T> to Simd16<T> of Int or Bool lanes, a
+// Bool vector being the mask of a lane-wise comparison.
+struct SimdType: public Type {
+    std::shared_ptr<Type> elem;
+    int lanes;
+
+    SimdType(std::shared_ptr<Type> elem, int lanes, Span span):
+        Type(Kind::Simd, span),
+        elem(std::move(elem)),
+        lanes(lanes) {}
+};
+
 // Literals
 struct UnitLit: public Lit {
     explicit UnitLit(Span span): Lit(Kind::Unit, span) {}
@@ -473,6 +507,7 @@ struct CtorPat: public Pat {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
     std::optional<std::vector<std::shared_ptr<Pat>>> args;
+    Ref ref;
 
     CtorPat(
         std::string ident,
@@ -541,6 +576,8 @@ struct FuncStmt: public Stmt {
     std::vector<std::shared_ptr<Pat>> params;
     std::shared_ptr<Type> ret_type;
     std::shared_ptr<Expr> body;
+    // the closure never outlives the function declaring it, set by EscapeAnalysis
+    bool stack = false;
 
     FuncStmt(
         std::string ident,
@@ -641,11 +678,16 @@ struct TryExpr: public UnaryExpr {
 };
 
 struct NewExpr: public UnaryExpr {
+    // the instance never outlives the function creating it, set by EscapeAnalysis
+    bool stack = false;
+
     NewExpr(std::shared_ptr<Expr> expr, Span span): UnaryExpr(Op::New, std::move(expr), span) {}
 };
 
 struct IndexExpr: public UnaryExpr {
     std::vector<std::shared_ptr<Expr>> indices;
+    // cleared when the index is proven in bounds
+    bool checked = true;
 
     IndexExpr(std::shared_ptr<Expr> base, std::vector<std::shared_ptr<Expr>> indices, Span span):
         UnaryExpr(Op::Index, std::move(base), span),
@@ -690,6 +732,7 @@ struct BinaryExpr: public Expr {
         Gt,     // >
         Lte,    // <=
         Gte,    // >=
+        Range,  // ..
         Assign, // =
     };
 
@@ -775,6 +818,12 @@ struct GteExpr: public BinaryExpr {
         BinaryExpr(Op::Gte, std::move(left), std::move(right), span) {}
 };
 
+// lo..hi, the integers from lo up to but excluding hi
+struct RangeExpr: public BinaryExpr {
+    RangeExpr(std::shared_ptr<Expr> left, std::shared_ptr<Expr> right, Span span):
+        BinaryExpr(Op::Range, std::move(left), std::move(right), span) {}
+};
+
 struct AssignExpr: public BinaryExpr {
     BinaryExpr::Op mode;
 
@@ -807,6 +856,10 @@ struct HintExpr: public Expr {
 
 struct VarExpr: public Expr {
     std::string ident;
+    // unset for local variables
+    Ref ref;
+    // no later read of the variable can follow, set by ReuseAnalysis
+    bool last_use = false;
 
     VarExpr(std::string ident, Span span): Expr(Kind::Var, span), ident(std::move(ident)) {}
 };
@@ -814,6 +867,7 @@ struct VarExpr: public Expr {
 struct FuncExpr: public Expr {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     FuncExpr(
         std::string ident,
@@ -828,6 +882,7 @@ struct FuncExpr: public Expr {
 struct CtorExpr: public Expr {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     CtorExpr(
         std::string ident,
@@ -842,6 +897,7 @@ struct CtorExpr: public Expr {
 struct InitExpr: public Expr {
     std::string ident;
     std::optional<std::vector<std::shared_ptr<Type>>> type_args;
+    Ref ref;
 
     InitExpr(
         std::string ident,
@@ -856,6 +912,8 @@ struct InitExpr: public Expr {
 struct LamExpr: public Expr {
     std::vector<std::shared_ptr<Pat>> params;
     std::shared_ptr<Expr> body;
+    // the closure never outlives the function creating it, set by EscapeAnalysis
+    bool stack = false;
 
     LamExpr(std::vector<std::shared_ptr<Pat>> params, std::shared_ptr<Expr> body, Span span):
         Expr(Kind::Lam, span),
@@ -908,6 +966,14 @@ struct ReturnExpr: public Expr {
         expr(std::move(expr)) {}
 };
 
+struct YieldExpr: public Expr {
+    std::shared_ptr<Expr> expr;
+
+    explicit YieldExpr(std::shared_ptr<Expr> expr, Span span):
+        Expr(Kind::Yield, span),
+        expr(std::move(expr)) {}
+};
+
 struct IteThen {
     std::shared_ptr<Cond> cond;
     std::shared_ptr<Expr> then_branch;
@@ -949,6 +1015,8 @@ struct CaseClause: public Clause {
     std::shared_ptr<Pat> pat;
     std::optional<std::shared_ptr<Expr>> guard;
     std::shared_ptr<Expr> expr;
+    // constructor or tuple in expr that may take over the matched cell
+    const Expr* reuse = nullptr;
 
     CaseClause(
         std::shared_ptr<Pat> pat,
@@ -973,6 +1041,8 @@ struct DefaultClause: public Clause {
 struct SwitchExpr: public Expr {
     std::shared_ptr<Expr> expr;
     std::vector<std::shared_ptr<Clause>> clauses;
+    // the scrutinee is dead once matched, so its fields can be moved out
+    bool consumes = false;
 
     SwitchExpr(std::shared_ptr<Expr> expr, std::vector<std::shared_ptr<Clause>> clauses, Span span):
         Expr(Kind::Switch, span),
@@ -1141,6 +1211,8 @@ struct ExtensionDecl: public Decl {
 struct LetDecl: public Decl {
     std::shared_ptr<Pat> pat;
     std::optional<std::shared_ptr<Expr>> expr;
+    // compile-time value of expr, emitted as static data when set
+    std::shared_ptr<Value> value;
 
     LetDecl(std::shared_ptr<Pat> pat, std::optional<std::shared_ptr<Expr>> expr, Span span):
         Decl(Kind::Let, span),
@@ -1155,6 +1227,8 @@ struct FuncDecl: public Decl {
     std::vector<std::shared_ptr<Pat>> params;
     std::shared_ptr<Type> ret_type;
     std::optional<std::shared_ptr<Expr>> body;
+    // the body yields, so a call produces its values one at a time
+    bool generator = false;
 
     FuncDecl(
         std::string ident,
@@ -1218,6 +1292,10 @@ struct Package {
     std::string ident;
     std::vector<std::shared_ptr<Import>> header;
     std::vector<std::shared_ptr<Decl>> body;
+    // the symbol table the Refs of body point into
+    std::shared_ptr<TableNode> table;
+    // the declarations of body by symbol
+    std::shared_ptr<const DeclStore> decls;
 
     Package(
         std::string ident,
@@ -1230,10 +1308,31 @@ struct Package {
         body(std::move(body)),
         span(span) {}
 
+    Span get_span() const {
+        return span;
+    }
+
 private:
     Span span;
 };
 
+// Appends the variables bound by pat, in order.
+void collect_pat_vars(const Pat& pat, std::vector<std::string>& vars);
+// The fields of a class are the variables of its let declarations, in order.
+std::vector<const VarPat*> class_fields(const ClassDecl& decl);
+
+// Returns the call when expr is a map, filter or zip adapter on a for loop
+// source, which fuses into the loop instead of dispatching to a method.
+const AppExpr* as_loop_adapter(const Expr& expr);
+
+// Attributes are elaborated to `name` or `name(args...)` expressions whose
+// arguments are literals or bare names.
+bool has_attr(const std::vector<std::shared_ptr<Expr>>& attrs, const std::string& ident);
+// Returns the string or name argument of an attribute such as @extern("name")
+// or @repr(C).
+std::optional<std::string>
+find_attr_arg(const std::vector<std::shared_ptr<Expr>>& attrs, const std::string& ident);
+
 } // namespace elaborate
 
 // std::formatter specializations
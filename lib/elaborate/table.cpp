@@ -8,30 +8,55 @@
 
 namespace elaborate {
 
-Symbol TableNode::find_type_symbol(const std::string& ident) {
+const Symbol& TableNode::find_type_symbol(const std::string& ident) {
     auto it = types.find(ident);
     if (it == types.end()) {
         throw std::runtime_error("Type symbol not found: " + ident);
     }
-    auto symbols = it->second;
+    const auto& symbols = it->second;
     if (symbols.size() != 1) {
         throw std::runtime_error("Ambiguous type symbol: " + ident);
     }
     return *symbols.begin();
 }
 
-Symbol TableNode::find_expr_symbol(const std::string& ident) {
+const Symbol& TableNode::find_expr_symbol(const std::string& ident) {
     auto it = exprs.find(ident);
     if (it == exprs.end()) {
         throw std::runtime_error("Expr symbol not found: " + ident);
     }
-    auto symbols = it->second;
+    const auto& symbols = it->second;
     if (symbols.size() != 1) {
         throw std::runtime_error("Ambiguous expr symbol: " + ident);
     }
     return *symbols.begin();
 }
 
+static const Symbol* find_own_symbol(
+    const std::map<std::string, std::set<Symbol>>& symbols,
+    const TableNode* scope,
+    const std::string& ident
+) {
+    auto it = symbols.find(ident);
+    if (it == symbols.end()) {
+        return nullptr;
+    }
+    for (const auto& symbol: it->second) {
+        if (symbol.get_scope() == scope) {
+            return &symbol;
+        }
+    }
+    return nullptr;
+}
+
+const Symbol* TableNode::find_own_type_symbol(const std::string& ident) const {
+    return find_own_symbol(types, this, ident);
+}
+
+const Symbol* TableNode::find_own_expr_symbol(const std::string& ident) const {
+    return find_own_symbol(exprs, this, ident);
+}
+
 TableNode* TableNode::find_node(const std::string& ident) {
     auto it = nested.find(ident);
     if (it == nested.end()) {
@@ -65,15 +90,20 @@ void Table::exit_node() {
 
 void Table::add_type_symbol(const std::string& ident, Symbol symbol) {
     symbol.path = active->path + "." + ident;
+    symbol.id = symbol_count++;
+    symbol.scope = active;
     active->types[ident].insert(symbol);
 }
 
 void Table::add_expr_symbol(const std::string& ident, Symbol symbol) {
     symbol.path = active->path + "." + ident;
+    symbol.id = symbol_count++;
+    symbol.scope = active;
     active->exprs[ident].insert(symbol);
 }
 
-Symbol Table::find_type_symbol(const std::string& ident, const std::vector<std::string>& path) {
+const Symbol&
+Table::find_type_symbol(const std::string& ident, const std::vector<std::string>& path) {
     TableNode* current = active;
     // If path is empty, search upwards for the symbol
     if (path.empty()) {
@@ -101,7 +131,8 @@ Symbol Table::find_type_symbol(const std::string& ident, const std::vector<std::
     return current->find_type_symbol(path.back());
 }
 
-Symbol Table::find_expr_symbol(const std::string& ident, const std::vector<std::string>& path) {
+const Symbol&
+Table::find_expr_symbol(const std::string& ident, const std::vector<std::string>& path) {
     TableNode* current = active;
     // If path is empty, search upwards for the symbol
     if (path.empty()) {
@@ -129,6 +160,28 @@ Symbol Table::find_expr_symbol(const std::string& ident, const std::vector<std::
     return current->find_expr_symbol(path.back());
 }
 
+TableNode* Table::find_symbol_node(const Symbol& symbol) const {
+    switch (symbol.get_kind()) {
+        case Symbol::Kind::Class:
+        case Symbol::Kind::Enum:
+        case Symbol::Kind::Interface:
+        case Symbol::Kind::Extension:
+            break;
+        default:
+            return symbol.scope;
+    }
+    // imports may have put same-named nodes next to the declared one
+    auto it = symbol.scope->nested.find(symbol.path.substr(symbol.path.rfind('.') + 1));
+    if (it != symbol.scope->nested.end()) {
+        for (const auto& node: it->second) {
+            if (node->path == symbol.path) {
+                return node.get();
+            }
+        }
+    }
+    throw std::runtime_error("Node not found: " + symbol.path);
+}
+
 void Table::import_helper(
     TableNode& current,
     const parsing::Import& import,
@@ -327,6 +380,11 @@ void TableBuilder::build_constants() {
                     class_decl.ident,
                     Symbol(Symbol::Kind::Class, class_decl.access)
                 );
+                // the class name also constructs an instance from its fields
+                table.add_expr_symbol(
+                    class_decl.ident,
+                    Symbol(Symbol::Kind::Class, class_decl.access)
+                );
                 table.add_node(class_decl.ident, TableNode::Kind::Class);
                 visit_class(class_decl, [this]() { build_constants(); });
                 break;
@@ -13,6 +13,8 @@
 
 namespace elaborate {
 
+struct TableNode;
+
 struct Symbol {
     enum class Kind {
         Class,
@@ -41,6 +43,16 @@ struct Symbol {
         return path;
     }
 
+    // dense over the symbols of a table, shared by the copies imports make
+    int get_id() const {
+        return id;
+    }
+
+    // the node the symbol is declared in
+    TableNode* get_scope() const {
+        return scope;
+    }
+
     bool operator<(const Symbol& other) const {
         if (kind != other.kind) {
             return kind < other.kind;
@@ -52,6 +64,8 @@ private:
     Access access;
     Kind kind;
     std::string path;
+    int id = -1;
+    TableNode* scope = nullptr;
 
     friend class Table;
 };
@@ -73,9 +87,15 @@ struct TableNode {
     std::string get_ident() const {
         return ident;
     }
+    std::string get_path() const {
+        return path;
+    }
     TableNode* find_node(const std::string& ident);
-    Symbol find_type_symbol(const std::string& ident);
-    Symbol find_expr_symbol(const std::string& ident);
+    const Symbol& find_type_symbol(const std::string& ident);
+    const Symbol& find_expr_symbol(const std::string& ident);
+    // the symbol declared in this node, not one an import added next to it
+    const Symbol* find_own_type_symbol(const std::string& ident) const;
+    const Symbol* find_own_expr_symbol(const std::string& ident) const;
 
 private:
     Kind kind;
@@ -102,6 +122,15 @@ struct Table {
         return root.get();
     }
 
+    // keeps the nodes alive for handles into them that outlive the table
+    std::shared_ptr<TableNode> share_root() const {
+        return root;
+    }
+
+    int get_symbol_count() const {
+        return symbol_count;
+    }
+
     TableNode* get_active() const {
         return active;
     }
@@ -117,8 +146,12 @@ struct Table {
     void add_type_symbol(const std::string& ident, Symbol symbol);
     void add_expr_symbol(const std::string& ident, Symbol symbol);
 
-    Symbol find_type_symbol(const std::string& ident, const std::vector<std::string>& path);
-    Symbol find_expr_symbol(const std::string& ident, const std::vector<std::string>& path);
+    const Symbol& find_type_symbol(const std::string& ident, const std::vector<std::string>& path);
+    const Symbol& find_expr_symbol(const std::string& ident, const std::vector<std::string>& path);
+
+    // the node holding the members of a class, enum, interface or extension
+    // symbol, otherwise the node declaring it
+    TableNode* find_symbol_node(const Symbol& symbol) const;
 
     void import(const parsing::Import& import);
 
@@ -128,6 +161,7 @@ struct Table {
 private:
     std::shared_ptr<TableNode> root;
     TableNode* active;
+    int symbol_count = 0;
     void import_helper(
         TableNode& current,
         const parsing::Import& import,
@@ -0,0 +1,470 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "fy_array.h"
+
+namespace interp {
+
+// a = destination register unless noted, b and c = operands. Dup is a Move whose
+// source stays live. LoadLabel loads like LoadInt, marked as the address of
+// instruction b.
+#define SF_OPCODES_LOADS(X) \
+    X(Nop)                  \
+    X(LoadUnit)             \
+    X(LoadInt)              \
+    X(LoadLabel)            \
+    X(LoadBool)             \
+    X(LoadChar)             \
+    X(LoadConst)            \
+    X(Move)                 \
+    X(Dup)                  \
+    X(LoadGlobal)           \
+    X(StoreGlobal)
+
+// Add, Sub, Mul and the ordering comparisons also work lane by lane on SIMD vectors.
+#define SF_OPCODES_ARITH(X) \
+    X(Add)                  \
+    X(Sub)                  \
+    X(Mul)                  \
+    X(Div)                  \
+    X(Mod)                  \
+    X(Neg)                  \
+    X(Not)                  \
+    X(Eq)                   \
+    X(Neq)                  \
+    X(Lt)                   \
+    X(Gt)                   \
+    X(Lte)                  \
+    X(Gte)
+
+// JumpReg jumps to the instruction whose index is in register a. Fail raises the
+// message in constant b.
+#define SF_OPCODES_JUMPS(X) \
+    X(Jump)                 \
+    X(JumpIf)               \
+    X(JumpIfNot)            \
+    X(JumpReg)              \
+    X(Fail)
+
+// IsOk tests whether b was built by a constructor `?` unwraps, and fails on an
+// enum `?` does not apply to. ReuseTuple and ReuseCtor find the cell they may
+// take over in the register after their arguments.
+#define SF_OPCODES_CELLS(X) \
+    X(MakeTuple)            \
+    X(MakeCtor)             \
+    X(IsCtor)               \
+    X(IsOk)                 \
+    X(GetElem)              \
+    X(TakeElem)             \
+    X(ReuseTuple)           \
+    X(ReuseCtor)
+
+// The Fast accesses were proven in bounds. ArrayPush appends b to the array a.
+#define SF_OPCODES_ARRAYS(X) \
+    X(ArrayNew)              \
+    X(ArrayLen)              \
+    X(ArrayGet)              \
+    X(ArraySet)              \
+    X(ArrayGetFast)          \
+    X(ArraySetFast)          \
+    X(ArrayPush)
+
+// GetField and SetField name the field by its slot in Program::field_slots.
+// SoaNew makes a @soa array of constructor b and length c. SoaGet reads column
+// c at the index in the register after the array b, SoaSet writes value c to
+// column b at the index in the register after a.
+#define SF_OPCODES_FIELDS(X) \
+    X(GetField)              \
+    X(SetField)              \
+    X(SoaNew)                \
+    X(SoaGet)                \
+    X(SoaSet)
+
+// SimdSplat and SimdLoad build a vector of c lanes, SimdLoad reading from the
+// array b at the index in the register after it. SimdStore writes vector c to
+// array a at index b, SimdSelect picks lanes of the two registers after the mask
+// b and SimdReduce folds vector b with the SimdReduction c.
+#define SF_OPCODES_SIMD(X) \
+    X(SimdSplat)           \
+    X(SimdLoad)            \
+    X(SimdStore)           \
+    X(SimdShuffle)         \
+    X(SimdSelect)          \
+    X(SimdReduce)
+
+// StackClosure builds closure b like MakeClosure, but in a stack slot of the
+// frame that the collector never frees.
+#define SF_OPCODES_CLOSURES(X) \
+    X(MakeClosure)             \
+    X(StackClosure)            \
+    X(LoadCapture)             \
+    X(LoadSelf)
+
+// Calls take their arguments in consecutive registers; CallClosure expects them
+// right after the closure register and carries the argument count in c.
+// CallTuple calls b with the arguments after the c registers from a, which
+// receive the elements of the tuple it returns. ReturnTuple returns the c
+// registers from b as a tuple without building it for such a caller, or builds
+// it like ReuseTuple when a is set.
+#define SF_OPCODES_CALLS(X) \
+    X(Call)                 \
+    X(CallClosure)          \
+    X(CallMethod)           \
+    X(CallNative)           \
+    X(CallTuple)            \
+    X(Return)               \
+    X(ReturnTuple)
+
+// Count increments profile counter b. Probe starts timing the call of the
+// current frame, which returning stops. Site charges the next object allocated
+// to allocation site b.
+#define SF_OPCODES_PROFILE(X) \
+    X(Count)                  \
+    X(Probe)                  \
+    X(Site)
+
+#define SF_OPCODES(X)      \
+    SF_OPCODES_LOADS(X)    \
+    SF_OPCODES_ARITH(X)    \
+    SF_OPCODES_JUMPS(X)    \
+    SF_OPCODES_CELLS(X)    \
+    SF_OPCODES_ARRAYS(X)   \
+    SF_OPCODES_FIELDS(X)   \
+    SF_OPCODES_SIMD(X)     \
+    SF_OPCODES_CLOSURES(X) \
+    SF_OPCODES_CALLS(X)    \
+    SF_OPCODES_PROFILE(X)
+
+enum class Op : std::uint8_t {
+#define SF_OPCODE_ENUM(name) name,
+    SF_OPCODES(SF_OPCODE_ENUM)
+#undef SF_OPCODE_ENUM
+};
+
+struct Instr {
+    Op op;
+    std::uint16_t a = 0;
+    std::int32_t b = 0;
+    std::int32_t c = 0;
+};
+
+struct Object;
+
+struct Value {
+    enum class Tag : std::uint8_t {
+        Unit,
+        Int,
+        Bool,
+        Char,
+        Object,
+    };
+
+    Tag tag = Tag::Unit;
+
+    union {
+        std::int64_t i = 0;
+        Object* obj;
+    };
+
+    static Value unit() {
+        return Value {};
+    }
+
+    static Value from_int(std::int64_t value) {
+        Value result;
+        result.tag = Tag::Int;
+        result.i = value;
+        return result;
+    }
+
+    static Value from_bool(bool value) {
+        Value result;
+        result.tag = Tag::Bool;
+        result.i = value;
+        return result;
+    }
+
+    static Value from_char(char value) {
+        Value result;
+        result.tag = Tag::Char;
+        result.i = value;
+        return result;
+    }
+
+    static Value from_obj(Object* value) {
+        Value result;
+        result.tag = Tag::Object;
+        result.obj = value;
+        return result;
+    }
+};
+
+struct Object {
+    enum class Kind {
+        String,
+        Tuple,
+        Ctor,
+        Closure,
+        Array,
+        SoaArray,
+        Simd,
+    };
+
+    // where the object lives for the collector, constants stay Static and
+    // closures promoted by escape analysis live in Stack slots of their frame
+    enum class Space : std::uint8_t {
+        Static,
+        Young,
+        Old,
+        Stack,
+    };
+
+    Space space = Space::Static;
+    bool marked = false;
+    bool remembered = false;
+    // set once a second reference may exist, a cell is only reused while clear
+    bool shared = false;
+
+    explicit Object(Kind kind): kind(kind) {}
+    virtual ~Object() = default;
+
+    Kind get_kind() const {
+        return kind;
+    }
+
+private:
+    Kind kind;
+};
+
+struct StringObject: public Object {
+    std::string value;
+
+    explicit StringObject(std::string value): Object(Kind::String), value(std::move(value)) {}
+};
+
+struct TupleObject: public Object {
+    std::vector<Value> elems;
+
+    explicit TupleObject(std::vector<Value> elems):
+        Object(Kind::Tuple),
+        elems(std::move(elems)) {}
+};
+
+struct CtorObject: public Object {
+    int ctor;
+    std::vector<Value> args;
+
+    CtorObject(int ctor, std::vector<Value> args):
+        Object(Kind::Ctor),
+        ctor(ctor),
+        args(std::move(args)) {}
+};
+
+struct ClosureObject: public Object {
+    int func;
+    std::vector<Value> captures;
+
+    ClosureObject(int func, std::vector<Value> captures):
+        Object(Kind::Closure),
+        func(func),
+        captures(std::move(captures)) {}
+};
+
+// Backed by the native runtime so Array<T> has the same layout in compiled code.
+struct ArrayObject: public Object {
+    fy_array_t array;
+
+    explicit ArrayObject(std::size_t len): Object(Kind::Array) {
+        if (fy_array_init(&array, sizeof(Value), len) != 0) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ArrayObject(const ArrayObject&) = delete;
+    ArrayObject& operator=(const ArrayObject&) = delete;
+
+    ~ArrayObject() override {
+        fy_array_free(&array);
+    }
+
+    Value* data() const {
+        return reinterpret_cast<Value*>(array.data);
+    }
+};
+
+// Array of a @soa class, each field stored in its own contiguous column. The
+// elements are values: reading one builds a fresh instance from the columns.
+struct SoaArrayObject: public Object {
+    int ctor;
+    std::size_t len;
+    std::vector<fy_array_t> columns;
+
+    SoaArrayObject(int ctor, int fields, std::size_t len):
+        Object(Kind::SoaArray),
+        ctor(ctor),
+        len(len) {
+        columns.reserve(fields);
+        for (int i = 0; i < fields; ++i) {
+            fy_array_t column;
+            if (fy_array_init(&column, sizeof(Value), len) != 0) {
+                free_columns();
+                throw std::bad_alloc();
+            }
+            columns.push_back(column);
+        }
+    }
+
+    SoaArrayObject(const SoaArrayObject&) = delete;
+    SoaArrayObject& operator=(const SoaArrayObject&) = delete;
+
+    ~SoaArrayObject() override {
+        free_columns();
+    }
+
+    Value* column(int field) const {
+        return reinterpret_cast<Value*>(columns[field].data);
+    }
+
+private:
+    void free_columns() {
+        for (auto& column: columns) {
+            fy_array_free(&column);
+        }
+    }
+};
+
+// Vector of Int or Bool lanes. Lanes past the width stay zero, so lane-wise
+// operations always run over max_lanes and the host compiler vectorizes them.
+struct SimdObject: public Object {
+    static constexpr int max_lanes = 16;
+
+    int lanes;
+    bool mask;
+    alignas(64) std::array<std::int64_t, max_lanes> elems {};
+
+    SimdObject(int lanes, bool mask): Object(Kind::Simd), lanes(lanes), mask(mask) {}
+};
+
+enum class SimdReduction {
+    Add,
+    Mul,
+    Min,
+    Max,
+};
+
+// Type ids below Count are built in, enums and classes are numbered after them.
+enum class BuiltinType {
+    Unit,
+    Int,
+    Bool,
+    Char,
+    String,
+    Tuple,
+    Closure,
+    Array,
+    Simd,
+    Count,
+};
+
+// Method table entry for a type without the method.
+inline constexpr int no_method = std::numeric_limits<int>::min();
+
+// Monomorphic inline cache for a method call site.
+struct MethodCache {
+    std::string name;
+    // arguments including the receiver
+    int argc = 0;
+    // index into the method table of the receiver's type
+    int slot = -1;
+    int type = -1;
+    int func = -1;
+};
+
+// Where an instruction was compiled from, line 0 when it has no source.
+struct SourcePos {
+    int line = 0;
+    int column = 0;
+
+    bool operator==(const SourcePos& other) const = default;
+};
+
+// A row of a line table: the instructions from pc up to the next row share pos.
+struct LineEntry {
+    int pc;
+    SourcePos pos;
+};
+
+struct Function {
+    std::string name;
+    int arity = 0;
+    int num_captures = 0;
+    int num_regs = 0;
+    // stack slots of the frame for the closures it creates without escaping
+    int stack_closures = 0;
+    // the slot of such a closure in the frame of the function creating it
+    int stack_slot = -1;
+    std::vector<Instr> code;
+    // sorted by pc, with a row wherever the source position changes
+    std::vector<LineEntry> lines;
+    std::vector<Value> consts;
+    std::vector<MethodCache> caches;
+};
+
+struct CtorInfo {
+    std::string name;
+    int type;
+    int arity;
+    // the success constructor of an enum `?` applies to, whose payload it unwraps
+    bool unwraps = false;
+    // the failure constructors of such an enum, which `?` returns
+    bool fails = false;
+    // instances of a @soa class, which every array holds by value
+    bool soa = false;
+};
+
+struct NativeInfo {
+    std::string name;
+    int arity;
+};
+
+struct Program {
+    std::vector<Function> functions;
+    std::vector<std::string> types;
+    std::vector<CtorInfo> ctors;
+    std::vector<std::string> globals;
+    std::vector<NativeInfo> natives;
+    // (type id, method name) -> function, type id -1 holds blanket extensions and
+    // negative functions -1 - n name native n
+    std::map<std::pair<int, std::string>, int> methods;
+    // methods flattened into one table per type, indexed by the slot of the method name
+    // with blanket extensions filled in, so dispatch is a single load
+    std::map<std::string, int> method_slots;
+    std::vector<std::vector<int>> method_tables;
+    // class fields by name, with one table per type giving the index of each field
+    // slot in the instance or -1
+    std::map<std::string, int> field_slots;
+    std::vector<std::vector<int>> field_tables;
+    // names of the profile counters of an instrumented program
+    std::vector<std::string> counters;
+    // the function and source position of each allocation site tagged by Site
+    std::vector<std::string> alloc_sites;
+    // string constants referenced from Function::consts
+    std::vector<std::unique_ptr<Object>> statics;
+    int init = -1;
+    int entry = -1;
+};
+
+std::string format_value(const Value& value, const Program& program);
+
+SourcePos source_pos(const Function& func, int pc);
+
+} // namespace interp
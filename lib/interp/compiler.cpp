@@ -0,0 +1,2329 @@
+#include <algorithm>
+#include <format>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <ranges>
+#include <set>
+#include <stdexcept>
+
+#include "interp/compiler.hpp"
+
+namespace interp {
+
+using namespace elaborate;
+
+namespace {
+
+// Runtime functions the interpreter executes inline instead of calling out,
+// with the number of arguments each expects.
+const std::map<std::string, std::pair<Op, int>> intrinsics = {
+    {"fy_array_new", {Op::ArrayNew, 1}},
+    {"fy_array_len", {Op::ArrayLen, 1}},
+    {"fy_array_index", {Op::ArrayGet, 2}},
+    {"fy_array_update", {Op::ArraySet, 3}},
+    {"fy_simd_splat", {Op::SimdSplat, 1}},
+    {"fy_simd_load", {Op::SimdLoad, 2}},
+    {"fy_simd_store", {Op::SimdStore, 3}},
+    {"fy_simd_shuffle", {Op::SimdShuffle, 2}},
+    {"fy_simd_select", {Op::SimdSelect, 3}},
+    {"fy_simd_reduce_add", {Op::SimdReduce, 1}},
+    {"fy_simd_reduce_mul", {Op::SimdReduce, 1}},
+    {"fy_simd_reduce_min", {Op::SimdReduce, 1}},
+    {"fy_simd_reduce_max", {Op::SimdReduce, 1}},
+};
+
+const std::map<std::string, SimdReduction> simd_reductions = {
+    {"fy_simd_reduce_add", SimdReduction::Add},
+    {"fy_simd_reduce_mul", SimdReduction::Mul},
+    {"fy_simd_reduce_min", SimdReduction::Min},
+    {"fy_simd_reduce_max", SimdReduction::Max},
+};
+
+void check_array_index(const IndexExpr& expr) {
+    if (expr.indices.size() != 1) {
+        throw std::runtime_error(
+            std::format("Arrays take exactly one index at {}", expr.get_span())
+        );
+    }
+}
+
+// Instructions that may allocate a heap object, each tagged with an allocation
+// site when profiling allocations. Reading an element of a @soa array builds one,
+// and an ordinary array copies an instance of a @soa class stored into it.
+bool allocates(Op op) {
+    switch (op) {
+        case Op::MakeTuple:
+        case Op::MakeCtor:
+        case Op::ReuseTuple:
+        case Op::ReuseCtor:
+        case Op::ReturnTuple:
+        case Op::ArrayNew:
+        case Op::ArrayGet:
+        case Op::ArrayGetFast:
+        case Op::ArraySet:
+        case Op::ArraySetFast:
+        case Op::ArrayPush:
+        case Op::SoaNew:
+        case Op::SoaGet:
+        case Op::SimdSplat:
+        case Op::SimdLoad:
+        case Op::SimdShuffle:
+        case Op::SimdSelect:
+        case Op::MakeClosure:
+        case Op::CallNative:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Without @inline, a function is inlined when the profile shows it takes at
+// least 1/hot_call_share of all calls and its bytecode is small.
+constexpr std::uint64_t hot_call_share = 100;
+constexpr int hot_size = 32;
+
+// whether a fused loop can expand a lambda literal adapter argument in place
+bool fits_lambda(const Expr& expr, bool pair) {
+    if (expr.get_kind() != Expr::Kind::Lam) {
+        return false;
+    }
+    auto params = static_cast<const LamExpr&>(expr).params.size();
+    return params == 1 || (pair && params == 2);
+}
+
+std::string last_segment(const std::string& path) {
+    auto pos = path.rfind('.');
+    return pos == std::string::npos ? path : path.substr(pos + 1);
+}
+
+Op binary_op(BinaryExpr::Op op) {
+    switch (op) {
+        case BinaryExpr::Op::Add:
+            return Op::Add;
+        case BinaryExpr::Op::Sub:
+            return Op::Sub;
+        case BinaryExpr::Op::Mul:
+            return Op::Mul;
+        case BinaryExpr::Op::Div:
+            return Op::Div;
+        case BinaryExpr::Op::Mod:
+            return Op::Mod;
+        case BinaryExpr::Op::Eq:
+            return Op::Eq;
+        case BinaryExpr::Op::Neq:
+            return Op::Neq;
+        case BinaryExpr::Op::Lt:
+            return Op::Lt;
+        case BinaryExpr::Op::Gt:
+            return Op::Gt;
+        case BinaryExpr::Op::Lte:
+            return Op::Lte;
+        case BinaryExpr::Op::Gte:
+            return Op::Gte;
+        default:
+            throw std::runtime_error("Invalid binary operator");
+    }
+}
+
+} // namespace
+
+Program Compiler::compile(const Package& pkg) {
+    program = Program {};
+    function_ids.clear();
+    native_ids.clear();
+    site_ids.clear();
+    native_lanes.clear();
+    ctor_ids.clear();
+    type_ids.clear();
+    decl_types.clear();
+    global_ids.clear();
+    return_types.clear();
+    inline_funcs.clear();
+    generator_funcs.clear();
+    class_ctors.clear();
+    class_fields.clear();
+    soa_classes.clear();
+    method_calls = 0;
+    devirtualized = 0;
+    inlined_calls = 0;
+    reordered_switches = 0;
+    soa_accesses = 0;
+    generator_loops = 0;
+    unboxed_calls = 0;
+    total_calls = profile ? profile->total_calls() : 0;
+
+    for (auto name:
+         {"Unit", "Int", "Bool", "Char", "String", "Tuple", "Closure", "Array", "Simd"}) {
+        program.types.push_back(name);
+    }
+
+    declare_decls(pkg.body, pkg.ident);
+    // a function is the entry by @main, or by the name main at the top level
+    if (auto it = function_ids.find(pkg.ident + ".main"); it != function_ids.end()) {
+        if (std::ranges::find(entries, it->second) == entries.end()) {
+            entries.push_back(it->second);
+        }
+    }
+    if (entries.size() > 1) {
+        throw std::runtime_error(std::format(
+            "Multiple entry points {} and {}",
+            program.functions[entries[0]].name,
+            program.functions[entries[1]].name
+        ));
+    }
+    if (!entries.empty()) {
+        program.entry = entries.front();
+    }
+
+    // globals are initialized by a synthesized function run before the entry
+    program.init = static_cast<int>(program.functions.size());
+    program.functions.push_back(Function {.name = "<init>"});
+    Builder init_builder {.func = program.init};
+    init_builder.scopes.emplace_back();
+    builder = &init_builder;
+    compile_decls(pkg.body, pkg.ident);
+    int unit = alloc();
+    emit(Op::LoadUnit, unit);
+    emit(Op::Return, unit);
+    builder = nullptr;
+    build_method_tables();
+    build_field_tables();
+    mir_passes = MirPassManager {};
+    mir_passes.run(program);
+
+    return std::move(program);
+}
+
+void Compiler::declare_decls(
+    const std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    for (const auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                const auto& module_decl = static_cast<const ModuleDecl&>(*decl);
+                declare_decls(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Enum: {
+                const auto& enum_decl = static_cast<const EnumDecl&>(*decl);
+                int type = static_cast<int>(program.types.size());
+                program.types.push_back(prefix + "." + enum_decl.ident);
+                type_ids.emplace(enum_decl.ident, type);
+                decl_types.emplace(&enum_decl, type);
+                std::vector<const CtorDecl*> ctor_decls;
+                for (const auto& member: enum_decl.body) {
+                    if (member->get_kind() == Decl::Kind::Ctor) {
+                        ctor_decls.push_back(static_cast<const CtorDecl*>(member.get()));
+                    }
+                }
+                auto arity_of = [](const CtorDecl& ctor_decl) {
+                    return ctor_decl.params.has_value()
+                        ? static_cast<int>(ctor_decl.params->size())
+                        : 0;
+                };
+                auto is_success = [](const CtorDecl* ctor_decl) {
+                    return ctor_decl->ident == "Ok" || ctor_decl->ident == "Some";
+                };
+                // `?` applies to an enum with one success constructor Ok or Some of a single
+                // payload, and failure constructors besides it
+                auto success = std::ranges::find_if(ctor_decls, is_success);
+                bool tries = std::ranges::count_if(ctor_decls, is_success) == 1
+                    && ctor_decls.size() > 1 && arity_of(**success) == 1;
+                for (const auto* ctor_decl: ctor_decls) {
+                    auto path = prefix + "." + enum_decl.ident + "." + ctor_decl->ident;
+                    ctor_ids[path] = static_cast<int>(program.ctors.size());
+                    program.ctors.push_back(CtorInfo {
+                        path,
+                        type,
+                        arity_of(*ctor_decl),
+                        tries && is_success(ctor_decl),
+                        tries && !is_success(ctor_decl),
+                    });
+                }
+                break;
+            }
+            case Decl::Kind::Extension:
+                declare_extension(static_cast<const ExtensionDecl&>(*decl), prefix);
+                break;
+            case Decl::Kind::Let: {
+                const auto& let_decl = static_cast<const LetDecl&>(*decl);
+                std::vector<std::string> vars;
+                collect_pat_vars(*let_decl.pat, vars);
+                for (const auto& var: vars) {
+                    global_ids[prefix + "." + var] = static_cast<int>(program.globals.size());
+                    program.globals.push_back(prefix + "." + var);
+                }
+                break;
+            }
+            case Decl::Kind::Func: {
+                const auto& func_decl = static_cast<const FuncDecl&>(*decl);
+                auto path = prefix + "." + func_decl.ident;
+                int arity = static_cast<int>(func_decl.params.size());
+                if (!func_decl.body.has_value()) {
+                    // bodiless functions are only callable when the runtime provides them
+                    auto native = find_attr_arg(func_decl.attrs, "extern");
+                    if (native.has_value()) {
+                        int id = static_cast<int>(program.natives.size());
+                        native_ids[path] = id;
+                        program.natives.push_back(NativeInfo {*native, arity});
+                        const auto* ret_type = func_decl.ret_type.get();
+                        if (ret_type && ret_type->get_kind() == Type::Kind::Simd) {
+                            native_lanes[id] = static_cast<const SimdType&>(*ret_type).lanes;
+                        }
+                    }
+                    break;
+                }
+                int func = static_cast<int>(program.functions.size());
+                function_ids[path] = func;
+                if (func_decl.ret_type) {
+                    return_types[path] = func_decl.ret_type.get();
+                }
+                if (func_decl.generator) {
+                    generator_funcs[path] = &func_decl;
+                } else if (!probes
+                           && (has_attr(func_decl.attrs, "inline")
+                               || (is_hot(path) && !has_attr(func_decl.attrs, "noinline")))) {
+                    inline_funcs[func] = &func_decl;
+                }
+                program.functions.push_back(Function {.name = path, .arity = arity});
+                if (has_attr(func_decl.attrs, "main")) {
+                    entries.push_back(func);
+                }
+                break;
+            }
+            case Decl::Kind::Class: {
+                // only the runtime array is backed by a native class
+                const auto& class_decl = static_cast<const ClassDecl&>(*decl);
+                auto native = find_attr_arg(class_decl.attrs, "extern");
+                if (native == "fy_array_t") {
+                    type_ids.emplace(class_decl.ident, static_cast<int>(BuiltinType::Array));
+                    decl_types.emplace(&class_decl, static_cast<int>(BuiltinType::Array));
+                    break;
+                }
+                // other native classes still get a type, so extending one extends only it
+                auto path = prefix + "." + class_decl.ident;
+                int type = static_cast<int>(program.types.size());
+                program.types.push_back(path);
+                type_ids.emplace(class_decl.ident, type);
+                decl_types.emplace(&class_decl, type);
+                if (native.has_value()) {
+                    break;
+                }
+                // an instance is built like a constructor taking every field in order
+                auto& fields = class_fields[type];
+                for (const auto* field: elaborate::class_fields(class_decl)) {
+                    fields.push_back(field->ident);
+                }
+                int ctor = static_cast<int>(program.ctors.size());
+                class_ctors[path] = ctor;
+                program.ctors.push_back(CtorInfo {path, type, static_cast<int>(fields.size())});
+                if (has_attr(class_decl.attrs, "soa")) {
+                    soa_classes[type] = ctor;
+                    program.ctors[ctor].soa = true;
+                }
+                break;
+            }
+            default:
+                // interfaces have no runtime representation in the interpreter
+                break;
+        }
+    }
+}
+
+void Compiler::declare_extension(const ExtensionDecl& decl, const std::string& prefix) {
+    int type = resolve_type(*decl.base_type);
+    // only extensions of a type variable or an interface are blanket ones
+    auto kind = decl.base_type->get_kind();
+    if (type < 0 && kind != Type::Kind::Var && kind != Type::Kind::Interface) {
+        throw std::runtime_error(std::format(
+            "Extension of unsupported type {} at {}",
+            *decl.base_type,
+            decl.get_span()
+        ));
+    }
+    auto ext_prefix = prefix + "." + decl.ident;
+    declare_decls(decl.body, ext_prefix);
+    for (const auto& member: decl.body) {
+        if (member->get_kind() != Decl::Kind::Func) {
+            continue;
+        }
+        const auto& func_decl = static_cast<const FuncDecl&>(*member);
+        auto path = ext_prefix + "." + func_decl.ident;
+        if (auto it = function_ids.find(path); it != function_ids.end()) {
+            program.methods.try_emplace({type, func_decl.ident}, it->second);
+        } else if (auto it = native_ids.find(path); it != native_ids.end()) {
+            program.methods.try_emplace({type, func_decl.ident}, -1 - it->second);
+        }
+    }
+}
+
+int Compiler::named_type(const Ref& ref, const std::string& ident) const {
+    // the declaration tells apart same-named types of different modules
+    if (auto it = decl_types.find(ref.decl); it != decl_types.end()) {
+        return it->second;
+    }
+    auto it = type_ids.find(last_segment(ident));
+    return it == type_ids.end() ? -1 : it->second;
+}
+
+int Compiler::resolve_type(const Type& type) {
+    switch (type.get_kind()) {
+        case Type::Kind::Unit:
+            return static_cast<int>(BuiltinType::Unit);
+        case Type::Kind::Int:
+            return static_cast<int>(BuiltinType::Int);
+        case Type::Kind::Bool:
+            return static_cast<int>(BuiltinType::Bool);
+        case Type::Kind::Char:
+            return static_cast<int>(BuiltinType::Char);
+        case Type::Kind::String:
+            return static_cast<int>(BuiltinType::String);
+        case Type::Kind::Tuple:
+            return static_cast<int>(BuiltinType::Tuple);
+        case Type::Kind::Arrow:
+            return static_cast<int>(BuiltinType::Closure);
+        case Type::Kind::Simd:
+            return static_cast<int>(BuiltinType::Simd);
+        case Type::Kind::Enum: {
+            const auto& enum_type = static_cast<const EnumType&>(type);
+            return named_type(enum_type.ref, enum_type.ident);
+        }
+        case Type::Kind::Class: {
+            const auto& class_type = static_cast<const ClassType&>(type);
+            return named_type(class_type.ref, class_type.ident);
+        }
+        case Type::Kind::Typealias: {
+            // an alias is the type it names
+            const auto* decl = static_cast<const TypealiasType&>(type).ref.decl;
+            if (!decl || decl->get_kind() != Decl::Kind::Typealias) {
+                return -1;
+            }
+            const auto& aliased = static_cast<const TypealiasDecl&>(*decl).aliased;
+            return aliased.has_value() ? resolve_type(**aliased) : -1;
+        }
+        default:
+            // type variables and everything else dispatch as blanket extensions
+            return -1;
+    }
+}
+
+int Compiler::method_slot(const std::string& name) {
+    auto [it, inserted] = program.method_slots.try_emplace(
+        name,
+        static_cast<int>(program.method_slots.size())
+    );
+    return it->second;
+}
+
+void Compiler::build_method_tables() {
+    for (const auto& [key, func]: program.methods) {
+        method_slot(key.second);
+    }
+    program.method_tables.assign(
+        program.types.size(),
+        std::vector<int>(program.method_slots.size(), no_method)
+    );
+    for (const auto& [key, func]: program.methods) {
+        if (key.first >= 0) {
+            program.method_tables[key.first][program.method_slots.at(key.second)] = func;
+        }
+    }
+    // blanket extensions only fill slots the type does not define itself
+    for (const auto& [key, func]: program.methods) {
+        if (key.first >= 0) {
+            continue;
+        }
+        int slot = program.method_slots.at(key.second);
+        for (auto& table: program.method_tables) {
+            if (table[slot] == no_method) {
+                table[slot] = func;
+            }
+        }
+    }
+}
+
+int Compiler::field_slot(const std::string& name) {
+    auto [it, inserted] = program.field_slots.try_emplace(
+        name,
+        static_cast<int>(program.field_slots.size())
+    );
+    return it->second;
+}
+
+void Compiler::build_field_tables() {
+    program.field_tables.assign(
+        program.types.size(),
+        std::vector<int>(program.field_slots.size(), -1)
+    );
+    for (const auto& [type, fields]: class_fields) {
+        for (int i = 0; i < static_cast<int>(fields.size()); ++i) {
+            if (auto it = program.field_slots.find(fields[i]); it != program.field_slots.end()) {
+                program.field_tables[type][it->second] = i;
+            }
+        }
+    }
+}
+
+std::optional<int> Compiler::find_method(int type, const std::string& name) const {
+    auto it = program.methods.find({type, name});
+    if (it == program.methods.end()) {
+        it = program.methods.find({-1, name});
+    }
+    if (it == program.methods.end()) {
+        return std::nullopt;
+    }
+    return it->second;
+}
+
+std::optional<int> Compiler::static_type(const Expr& expr) {
+    auto known = [](int type) { return type < 0 ? std::nullopt : std::optional<int>(type); };
+    switch (expr.get_kind()) {
+        case Expr::Kind::Lit:
+            switch (static_cast<const LitExpr&>(expr).literal->get_kind()) {
+                case Lit::Kind::Unit:
+                    return static_cast<int>(BuiltinType::Unit);
+                case Lit::Kind::Int:
+                    return static_cast<int>(BuiltinType::Int);
+                case Lit::Kind::Bool:
+                    return static_cast<int>(BuiltinType::Bool);
+                case Lit::Kind::Char:
+                    return static_cast<int>(BuiltinType::Char);
+                case Lit::Kind::String:
+                    return static_cast<int>(BuiltinType::String);
+            }
+            return std::nullopt;
+        case Expr::Kind::Tuple:
+            return static_cast<int>(BuiltinType::Tuple);
+        case Expr::Kind::Lam:
+            return static_cast<int>(BuiltinType::Closure);
+        case Expr::Kind::Hint:
+            return known(resolve_type(*static_cast<const HintExpr&>(expr).type));
+        case Expr::Kind::Ctor: {
+            auto it = ctor_ids.find(static_cast<const CtorExpr&>(expr).ident);
+            return it == ctor_ids.end() ? std::nullopt : known(program.ctors[it->second].type);
+        }
+        case Expr::Kind::Var: {
+            // only locals of the current function, captures are not tracked
+            const auto& ident = static_cast<const VarExpr&>(expr).ident;
+            for (const auto& scope: std::views::reverse(builder->scopes)) {
+                if (auto it = scope.find(ident); it != scope.end()) {
+                    auto type = builder->reg_types.find(it->second);
+                    if (type == builder->reg_types.end()) {
+                        return std::nullopt;
+                    }
+                    return type->second;
+                }
+            }
+            return std::nullopt;
+        }
+        case Expr::Kind::Unary:
+            switch (static_cast<const UnaryExpr&>(expr).get_op()) {
+                case UnaryExpr::Op::Neg:
+                    return static_cast<int>(BuiltinType::Int);
+                case UnaryExpr::Op::Not:
+                    return static_cast<int>(BuiltinType::Bool);
+                default:
+                    return std::nullopt;
+            }
+        case Expr::Kind::Binary: {
+            const auto& binary_expr = static_cast<const BinaryExpr&>(expr);
+            // + - * and comparisons work lane by lane on SIMD vectors
+            auto scalar = [&] {
+                auto left = static_type(*binary_expr.left);
+                auto right = static_type(*binary_expr.right);
+                int simd = static_cast<int>(BuiltinType::Simd);
+                return left && right && *left != simd && *right != simd;
+            };
+            switch (binary_expr.get_op()) {
+                case BinaryExpr::Op::Add:
+                case BinaryExpr::Op::Sub:
+                case BinaryExpr::Op::Mul:
+                    if (!scalar()) {
+                        return std::nullopt;
+                    }
+                    return static_cast<int>(BuiltinType::Int);
+                case BinaryExpr::Op::Div:
+                case BinaryExpr::Op::Mod:
+                    return static_cast<int>(BuiltinType::Int);
+                case BinaryExpr::Op::Lt:
+                case BinaryExpr::Op::Gt:
+                case BinaryExpr::Op::Lte:
+                case BinaryExpr::Op::Gte:
+                    if (!scalar()) {
+                        return std::nullopt;
+                    }
+                    return static_cast<int>(BuiltinType::Bool);
+                case BinaryExpr::Op::Assign:
+                    return static_cast<int>(BuiltinType::Unit);
+                case BinaryExpr::Op::Range:
+                    return std::nullopt;
+                default:
+                    return static_cast<int>(BuiltinType::Bool);
+            }
+        }
+        case Expr::Kind::App: {
+            const auto& app_expr = static_cast<const AppExpr&>(expr);
+            if (app_expr.func->get_kind() == Expr::Kind::Ctor) {
+                return static_type(*app_expr.func);
+            }
+            if (app_expr.func->get_kind() == Expr::Kind::Init) {
+                auto it = class_ctors.find(static_cast<const InitExpr&>(*app_expr.func).ident);
+                if (it == class_ctors.end()) {
+                    return std::nullopt;
+                }
+                return program.ctors[it->second].type;
+            }
+            if (app_expr.func->get_kind() != Expr::Kind::Func) {
+                return std::nullopt;
+            }
+            auto it = return_types.find(static_cast<const FuncExpr&>(*app_expr.func).ident);
+            return it == return_types.end() ? std::nullopt : known(resolve_type(*it->second));
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+std::optional<int> Compiler::soa_elements(const Expr& expr) {
+    switch (expr.get_kind()) {
+        case Expr::Kind::Var: {
+            const auto& ident = static_cast<const VarExpr&>(expr).ident;
+            for (const auto& scope: std::views::reverse(builder->scopes)) {
+                if (auto it = scope.find(ident); it != scope.end()) {
+                    auto soa = builder->soa_regs.find(it->second);
+                    if (soa == builder->soa_regs.end()) {
+                        return std::nullopt;
+                    }
+                    return soa->second;
+                }
+            }
+            return std::nullopt;
+        }
+        case Expr::Kind::Hint:
+            return soa_elements(*static_cast<const HintExpr&>(expr).type);
+        case Expr::Kind::App: {
+            const auto& app_expr = static_cast<const AppExpr&>(expr);
+            if (app_expr.func->get_kind() != Expr::Kind::Func) {
+                return std::nullopt;
+            }
+            auto it = return_types.find(static_cast<const FuncExpr&>(*app_expr.func).ident);
+            return it == return_types.end() ? std::nullopt : soa_elements(*it->second);
+        }
+        default:
+            return std::nullopt;
+    }
+}
+
+std::optional<int> Compiler::soa_elements(const Type& type) {
+    if (type.get_kind() != Type::Kind::Class
+        || resolve_type(type) != static_cast<int>(BuiltinType::Array)) {
+        return std::nullopt;
+    }
+    const auto& type_args = static_cast<const ClassType&>(type).type_args;
+    if (!type_args.has_value() || type_args->size() != 1) {
+        return std::nullopt;
+    }
+    int elem = resolve_type(*type_args->front());
+    return soa_classes.contains(elem) ? std::optional<int>(elem) : std::nullopt;
+}
+
+const IndexExpr* Compiler::soa_element(const Expr& expr) {
+    if (expr.get_kind() != Expr::Kind::Unary
+        || static_cast<const UnaryExpr&>(expr).get_op() != UnaryExpr::Op::Index) {
+        return nullptr;
+    }
+    const auto& index_expr = static_cast<const IndexExpr&>(expr);
+    return soa_elements(*index_expr.expr) ? &index_expr : nullptr;
+}
+
+void Compiler::compile_decls(
+    const std::vector<std::shared_ptr<Decl>>& decls,
+    const std::string& prefix
+) {
+    for (const auto& decl: decls) {
+        switch (decl->get_kind()) {
+            case Decl::Kind::Module: {
+                const auto& module_decl = static_cast<const ModuleDecl&>(*decl);
+                compile_decls(module_decl.body, prefix + "." + module_decl.ident);
+                break;
+            }
+            case Decl::Kind::Extension: {
+                const auto& extension_decl = static_cast<const ExtensionDecl&>(*decl);
+                compile_decls(extension_decl.body, prefix + "." + extension_decl.ident);
+                break;
+            }
+            case Decl::Kind::Let:
+                compile_global(static_cast<const LetDecl&>(*decl), prefix);
+                break;
+            case Decl::Kind::Func: {
+                const auto& func_decl = static_cast<const FuncDecl&>(*decl);
+                auto it = function_ids.find(prefix + "." + func_decl.ident);
+                if (it != function_ids.end()) {
+                    compile_func(func_decl, it->second);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+}
+
+void Compiler::compile_func(const FuncDecl& decl, int func) {
+    Builder func_builder {.func = func, .decl = &decl};
+    func_builder.scopes.emplace_back();
+    auto* saved = builder;
+    builder = &func_builder;
+    if (instrument) {
+        emit(Op::Count, 0, add_counter("call " + current().name));
+    }
+    if (probes) {
+        emit(Op::Probe);
+    }
+    std::vector<int> params;
+    for (size_t i = 0; i < decl.params.size(); ++i) {
+        params.push_back(alloc());
+    }
+    std::vector<int> fails;
+    for (size_t i = 0; i < decl.params.size(); ++i) {
+        compile_pat(*decl.params[i], params[i], fails);
+    }
+    int result = alloc();
+    if (decl.generator) {
+        // called outside of a for loop, a generator collects what it yields
+        int empty = alloc();
+        emit(Op::LoadInt, empty, 0);
+        emit(Op::ArrayNew, result, empty);
+        builder->generators.push_back(Generator {result});
+        compile_expr(**decl.body, alloc());
+    } else {
+        compile_expr(**decl.body, result);
+    }
+    emit(Op::Return, result);
+    emit_cold_returns();
+    if (!fails.empty()) {
+        int fail = emit(
+            Op::Fail,
+            0,
+            add_string(std::format("Refutable parameter in {}", decl.ident))
+        );
+        for (int jump: fails) {
+            patch(jump, fail);
+        }
+    }
+    builder = saved;
+}
+
+void Compiler::compile_global(const LetDecl& decl, const std::string& prefix) {
+    if (!decl.expr.has_value()) {
+        return;
+    }
+    int mark = builder->next_reg;
+    int reg = alloc();
+    if (decl.value) {
+        compile_value(*decl.value, reg);
+    } else {
+        compile_expr(**decl.expr, reg);
+    }
+    builder->global_prefix = prefix;
+    std::vector<int> fails;
+    compile_pat(*decl.pat, reg, fails);
+    builder->global_prefix.reset();
+    if (!fails.empty()) {
+        int skip = emit(Op::Jump);
+        int fail = emit(
+            Op::Fail,
+            0,
+            add_string(std::format("Refutable pattern in global at {}", decl.get_span()))
+        );
+        for (int jump: fails) {
+            patch(jump, fail);
+        }
+        patch(skip, label());
+    }
+    builder->next_reg = mark;
+}
+
+Function& Compiler::current() {
+    return program.functions[builder->func];
+}
+
+int Compiler::emit(Op op, int a, int b, int c) {
+    return emit_in(*builder, op, a, b, c);
+}
+
+int Compiler::emit_in(Builder& b, Op op, int a, int b_, int c) {
+    auto& func = program.functions[b.func];
+    SourcePos pos {static_cast<int>(b.pos.line), static_cast<int>(b.pos.column)};
+    if (alloc_sites && allocates(op)) {
+        int site = add_site(func, pos);
+        emit_in(b, Op::Site, 0, site);
+    }
+    int pc = static_cast<int>(func.code.size());
+    if (func.lines.empty() || func.lines.back().pos != pos) {
+        func.lines.push_back(LineEntry {pc, pos});
+    }
+    func.code.push_back(Instr {op, static_cast<std::uint16_t>(a), b_, c});
+    return pc;
+}
+
+int Compiler::label() {
+    return static_cast<int>(current().code.size());
+}
+
+void Compiler::patch(int instr, int target) {
+    current().code[instr].b = target;
+}
+
+int Compiler::alloc() {
+    return alloc_in(*builder);
+}
+
+int Compiler::alloc_in(Builder& b) {
+    int reg = b.next_reg++;
+    if (reg > std::numeric_limits<std::uint16_t>::max()) {
+        throw std::runtime_error(
+            std::format("Too many registers in {}", program.functions[b.func].name)
+        );
+    }
+    auto& func = program.functions[b.func];
+    func.num_regs = std::max(func.num_regs, b.next_reg);
+    return reg;
+}
+
+int Compiler::add_const(Value value) {
+    auto& consts = current().consts;
+    consts.push_back(value);
+    return static_cast<int>(consts.size()) - 1;
+}
+
+int Compiler::add_string(std::string value) {
+    auto& object = program.statics.emplace_back(std::make_unique<StringObject>(std::move(value)));
+    return add_const(Value::from_obj(object.get()));
+}
+
+int Compiler::add_counter(std::string name) {
+    program.counters.push_back(std::move(name));
+    return static_cast<int>(program.counters.size()) - 1;
+}
+
+int Compiler::add_site(const Function& func, SourcePos pos) {
+    auto name = std::format("{} at {}:{}", func.name, pos.line, pos.column);
+    auto [it, inserted] = site_ids.emplace(name, static_cast<int>(program.alloc_sites.size()));
+    if (inserted) {
+        program.alloc_sites.push_back(std::move(name));
+    }
+    return it->second;
+}
+
+bool Compiler::is_hot(const std::string& path) const {
+    if (!profile || total_calls == 0) {
+        return false;
+    }
+    auto size = profile->sizes.find(path);
+    return size != profile->sizes.end() && size->second <= hot_size
+        && profile->count("call " + path) * hot_call_share >= total_calls;
+}
+
+void Compiler::bind(const std::string& ident, int reg) {
+    if (builder->global_prefix.has_value()) {
+        auto path = *builder->global_prefix + "." + ident;
+        emit(Op::StoreGlobal, reg, global_ids.at(path));
+        return;
+    }
+    builder->scopes.back()[ident] = reg;
+    builder->reg_types.erase(reg);
+    builder->soa_regs.erase(reg);
+}
+
+std::optional<int> Compiler::lookup_in(Builder& b, const std::string& ident) {
+    for (auto& scope: std::views::reverse(b.scopes)) {
+        auto it = scope.find(ident);
+        if (it != scope.end()) {
+            return it->second;
+        }
+    }
+    if (b.self_name == ident) {
+        int reg = alloc_in(b);
+        emit_in(b, Op::LoadSelf, reg);
+        return reg;
+    }
+    int index;
+    auto it = b.captures.find(ident);
+    if (it != b.captures.end()) {
+        index = it->second;
+    } else {
+        if (!b.parent) {
+            return std::nullopt;
+        }
+        auto source = lookup_in(*b.parent, ident);
+        if (!source.has_value()) {
+            return std::nullopt;
+        }
+        index = static_cast<int>(b.capture_sources.size());
+        b.captures[ident] = index;
+        b.capture_sources.push_back(*source);
+        program.functions[b.func].num_captures = index + 1;
+    }
+    int reg = alloc_in(b);
+    emit_in(b, Op::LoadCapture, reg, index);
+    return reg;
+}
+
+void Compiler::compile_value(const elaborate::Value& value, int dest) {
+    switch (value.get_kind()) {
+        case elaborate::Value::Kind::Unit:
+            emit(Op::LoadUnit, dest);
+            break;
+        case elaborate::Value::Kind::Int: {
+            auto i = static_cast<const IntValue&>(value).value;
+            if (i < std::numeric_limits<std::int32_t>::min()
+                || i > std::numeric_limits<std::int32_t>::max()) {
+                // LoadInt only has room for 32 bits
+                emit(Op::LoadConst, dest, add_const(Value::from_int(i)));
+            } else {
+                emit(Op::LoadInt, dest, static_cast<int>(i));
+            }
+            break;
+        }
+        case elaborate::Value::Kind::Bool:
+            emit(Op::LoadBool, dest, static_cast<const BoolValue&>(value).value);
+            break;
+        case elaborate::Value::Kind::Char:
+            emit(Op::LoadChar, dest, static_cast<const CharValue&>(value).value);
+            break;
+        case elaborate::Value::Kind::String:
+            emit(Op::LoadConst, dest, add_string(static_cast<const StringValue&>(value).value));
+            break;
+        case elaborate::Value::Kind::Tuple: {
+            const auto& tuple_value = static_cast<const TupleValue&>(value);
+            int mark = builder->next_reg;
+            int first = builder->next_reg;
+            for (const auto& elem: tuple_value.elems) {
+                compile_value(*elem, alloc());
+            }
+            emit(Op::MakeTuple, dest, first, static_cast<int>(tuple_value.elems.size()));
+            builder->next_reg = mark;
+            break;
+        }
+        case elaborate::Value::Kind::Ctor: {
+            const auto& ctor_value = static_cast<const CtorValue&>(value);
+            int mark = builder->next_reg;
+            int first = builder->next_reg;
+            if (ctor_value.args.has_value()) {
+                for (const auto& arg: *ctor_value.args) {
+                    compile_value(*arg, alloc());
+                }
+            }
+            emit(Op::MakeCtor, dest, ctor_ids.at(ctor_value.ident), first);
+            builder->next_reg = mark;
+            break;
+        }
+    }
+}
+
+void Compiler::compile_lit(const Lit& lit, int dest) {
+    switch (lit.get_kind()) {
+        case Lit::Kind::Unit:
+            emit(Op::LoadUnit, dest);
+            break;
+        case Lit::Kind::Int:
+            emit(Op::LoadInt, dest, static_cast<const IntLit&>(lit).value);
+            break;
+        case Lit::Kind::Bool:
+            emit(Op::LoadBool, dest, static_cast<const BoolLit&>(lit).value);
+            break;
+        case Lit::Kind::Char:
+            emit(Op::LoadChar, dest, static_cast<const CharLit&>(lit).value);
+            break;
+        case Lit::Kind::String:
+            emit(Op::LoadConst, dest, add_string(static_cast<const StringLit&>(lit).value));
+            break;
+    }
+}
+
+void Compiler::compile_expr(const Expr& expr, int dest) {
+    // temporaries allocated while computing dest are dead afterwards
+    int mark = builder->next_reg;
+    auto pos = builder->pos;
+    builder->pos = expr.get_span().start;
+    switch (expr.get_kind()) {
+        case Expr::Kind::Lit:
+            compile_lit(*static_cast<const LitExpr&>(expr).literal, dest);
+            break;
+        case Expr::Kind::Unary:
+            compile_unary(static_cast<const UnaryExpr&>(expr), dest);
+            break;
+        case Expr::Kind::Binary: {
+            const auto& binary_expr = static_cast<const BinaryExpr&>(expr);
+            if (binary_expr.get_op() == BinaryExpr::Op::Assign) {
+                compile_assign(static_cast<const AssignExpr&>(binary_expr), dest);
+            } else {
+                compile_binary(binary_expr, dest);
+            }
+            break;
+        }
+        case Expr::Kind::Tuple: {
+            const auto& tuple_expr = static_cast<const TupleExpr&>(expr);
+            int first = compile_args(tuple_expr.elems);
+            int count = static_cast<int>(tuple_expr.elems.size());
+            if (auto it = reuse_tokens.find(&expr); it != reuse_tokens.end()) {
+                emit(Op::Move, alloc(), it->second);
+                emit(Op::ReuseTuple, dest, first, count);
+            } else {
+                emit(Op::MakeTuple, dest, first, count);
+            }
+            break;
+        }
+        case Expr::Kind::Hint: {
+            const auto& hint_expr = static_cast<const HintExpr&>(expr);
+            if (!compile_soa_new(*hint_expr.expr, *hint_expr.type, dest)) {
+                compile_expr(*hint_expr.expr, dest);
+            }
+            break;
+        }
+        case Expr::Kind::Var: {
+            const auto& var_expr = static_cast<const VarExpr&>(expr);
+            if (auto reg = lookup_in(*builder, var_expr.ident)) {
+                bool owned = var_expr.last_use;
+                if (owned && builder->lambda_floor > 0) {
+                    owned = std::ranges::any_of(
+                        builder->scopes | std::views::drop(builder->lambda_floor),
+                        [&](const auto& scope) { return scope.contains(var_expr.ident); }
+                    );
+                }
+                emit(owned ? Op::Move : Op::Dup, dest, *reg);
+            } else if (auto it = global_ids.find(var_expr.ident); it != global_ids.end()) {
+                emit(Op::LoadGlobal, dest, it->second);
+            } else {
+                throw std::runtime_error(
+                    std::format("Unknown variable {} at {}", var_expr.ident, expr.get_span())
+                );
+            }
+            break;
+        }
+        case Expr::Kind::Func: {
+            // a function used as a value becomes a closure without captures
+            const auto& func_expr = static_cast<const FuncExpr&>(expr);
+            auto it = function_ids.find(func_expr.ident);
+            if (it == function_ids.end()) {
+                throw std::runtime_error(std::format(
+                    "Function {} cannot be used as a value at {}",
+                    func_expr.ident,
+                    expr.get_span()
+                ));
+            }
+            emit(Op::MakeClosure, dest, it->second, builder->next_reg);
+            break;
+        }
+        case Expr::Kind::Ctor: {
+            const auto& ctor_expr = static_cast<const CtorExpr&>(expr);
+            int ctor = ctor_ids.at(ctor_expr.ident);
+            if (program.ctors[ctor].arity != 0) {
+                throw std::runtime_error(std::format(
+                    "Constructor {} cannot be used as a value at {}",
+                    ctor_expr.ident,
+                    expr.get_span()
+                ));
+            }
+            emit(Op::MakeCtor, dest, ctor, builder->next_reg);
+            break;
+        }
+        case Expr::Kind::Lam:
+            compile_lam(static_cast<const LamExpr&>(expr), dest);
+            break;
+        case Expr::Kind::App:
+            compile_app(static_cast<const AppExpr&>(expr), dest);
+            break;
+        case Expr::Kind::Block:
+            compile_block(static_cast<const BlockExpr&>(expr), dest);
+            break;
+        case Expr::Kind::Ite:
+            compile_ite(static_cast<const IteExpr&>(expr), dest);
+            break;
+        case Expr::Kind::Switch:
+            compile_switch(static_cast<const SwitchExpr&>(expr), dest);
+            break;
+        case Expr::Kind::While: {
+            const auto& while_expr = static_cast<const WhileExpr&>(expr);
+            int start = label();
+            builder->loops.push_back(Loop {start, {}});
+            builder->scopes.emplace_back();
+            std::vector<int> exits;
+            compile_cond(*while_expr.cond, exits);
+            int body = alloc();
+            compile_expr(*while_expr.body, body);
+            builder->scopes.pop_back();
+            emit(Op::Jump, 0, start);
+            int end = label();
+            for (int jump: exits) {
+                patch(jump, end);
+            }
+            for (int jump: builder->loops.back().breaks) {
+                patch(jump, end);
+            }
+            builder->loops.pop_back();
+            emit(Op::LoadUnit, dest);
+            break;
+        }
+        case Expr::Kind::Loop: {
+            const auto& loop_expr = static_cast<const LoopExpr&>(expr);
+            int start = label();
+            builder->loops.push_back(Loop {start, {}});
+            int body = alloc();
+            compile_expr(*loop_expr.body, body);
+            emit(Op::Jump, 0, start);
+            int end = label();
+            for (int jump: builder->loops.back().breaks) {
+                patch(jump, end);
+            }
+            builder->loops.pop_back();
+            emit(Op::LoadUnit, dest);
+            break;
+        }
+        case Expr::Kind::Break:
+            if (builder->loops.empty()) {
+                throw std::runtime_error(
+                    std::format("Break outside of loop at {}", expr.get_span())
+                );
+            }
+            builder->loops.back().breaks.push_back(emit(Op::Jump));
+            break;
+        case Expr::Kind::Continue:
+            if (builder->loops.empty()) {
+                throw std::runtime_error(
+                    std::format("Continue outside of loop at {}", expr.get_span())
+                );
+            }
+            emit(Op::Jump, 0, builder->loops.back().continue_target);
+            break;
+        case Expr::Kind::Return: {
+            const auto& return_expr = static_cast<const ReturnExpr&>(expr);
+            if (!builder->inlined.empty()) {
+                // returning from an inlined body leaves its result at the call site
+                int result = builder->inlined.back().dest;
+                if (return_expr.expr.has_value()) {
+                    compile_expr(**return_expr.expr, result);
+                } else {
+                    emit(Op::LoadUnit, result);
+                }
+                builder->inlined.back().exits.push_back(emit(Op::Jump));
+                break;
+            }
+            if (builder->decl && builder->decl->generator) {
+                emit(Op::Return, builder->generators.front().elem);
+                break;
+            }
+            if (return_expr.expr.has_value()) {
+                compile_expr(**return_expr.expr, dest);
+            } else {
+                emit(Op::LoadUnit, dest);
+            }
+            emit(Op::Return, dest);
+            break;
+        }
+        case Expr::Kind::Yield:
+            compile_yield(static_cast<const YieldExpr&>(expr), dest);
+            break;
+        case Expr::Kind::For:
+            compile_for(static_cast<const ForExpr&>(expr), dest);
+            break;
+        case Expr::Kind::Init:
+            throw std::runtime_error(
+                std::format("Expression at {} is not supported by the interpreter", expr.get_span())
+            );
+    }
+    builder->next_reg = mark;
+    builder->pos = pos;
+}
+
+void Compiler::compile_unary(const UnaryExpr& expr, int dest) {
+    switch (expr.get_op()) {
+        case UnaryExpr::Op::Pos:
+            compile_expr(*expr.expr, dest);
+            break;
+        case UnaryExpr::Op::Neg:
+            compile_expr(*expr.expr, dest);
+            emit(Op::Neg, dest, dest);
+            break;
+        case UnaryExpr::Op::Not:
+            compile_expr(*expr.expr, dest);
+            emit(Op::Not, dest, dest);
+            break;
+        case UnaryExpr::Op::Proj: {
+            const auto& proj_expr = static_cast<const ProjExpr&>(expr);
+            compile_expr(*expr.expr, dest);
+            emit(Op::GetElem, dest, dest, proj_expr.index);
+            break;
+        }
+        case UnaryExpr::Op::Index: {
+            const auto& index_expr = static_cast<const IndexExpr&>(expr);
+            check_array_index(index_expr);
+            int array = alloc();
+            int index = alloc();
+            compile_expr(*expr.expr, array);
+            compile_expr(*index_expr.indices[0], index);
+            emit(index_expr.checked ? Op::ArrayGet : Op::ArrayGetFast, dest, array, index);
+            break;
+        }
+        case UnaryExpr::Op::Try:
+            compile_try(static_cast<const TryExpr&>(expr), dest);
+            break;
+        case UnaryExpr::Op::Field: {
+            const auto& field_expr = static_cast<const FieldExpr&>(expr);
+            int slot = field_slot(field_expr.path);
+            if (instrument) {
+                emit(Op::Count, 0, add_counter("field " + field_expr.path));
+            }
+            if (const auto* elem = soa_element(*expr.expr)) {
+                // read straight from the column, without gathering the element
+                check_array_index(*elem);
+                int array = alloc();
+                int index = alloc();
+                compile_expr(*elem->expr, array);
+                compile_expr(*elem->indices[0], index);
+                emit(Op::SoaGet, dest, array, slot);
+                ++soa_accesses;
+                break;
+            }
+            int object = alloc();
+            compile_expr(*expr.expr, object);
+            emit(Op::GetField, dest, object, slot);
+            break;
+        }
+        default:
+            throw std::runtime_error(
+                std::format("Expression at {} is not supported by the interpreter", expr.get_span())
+            );
+    }
+}
+
+void Compiler::compile_binary(const BinaryExpr& expr, int dest) {
+    switch (expr.get_op()) {
+        case BinaryExpr::Op::And: {
+            compile_expr(*expr.left, dest);
+            int skip = emit(Op::JumpIfNot, dest);
+            compile_expr(*expr.right, dest);
+            patch(skip, label());
+            break;
+        }
+        case BinaryExpr::Op::Or: {
+            compile_expr(*expr.left, dest);
+            int skip = emit(Op::JumpIf, dest);
+            compile_expr(*expr.right, dest);
+            patch(skip, label());
+            break;
+        }
+        case BinaryExpr::Op::Range:
+            throw std::runtime_error(
+                std::format("Ranges are only supported as for loop sources at {}", expr.get_span())
+            );
+        default: {
+            int left = alloc();
+            int right = alloc();
+            compile_expr(*expr.left, left);
+            compile_expr(*expr.right, right);
+            emit(binary_op(expr.get_op()), dest, left, right);
+            break;
+        }
+    }
+}
+
+void Compiler::compile_assign(const AssignExpr& expr, int dest) {
+    if (expr.left->get_kind() == Expr::Kind::Unary
+        && static_cast<const UnaryExpr&>(*expr.left).get_op() == UnaryExpr::Op::Index) {
+        const auto& index_expr = static_cast<const IndexExpr&>(*expr.left);
+        check_array_index(index_expr);
+        int array = alloc();
+        int index = alloc();
+        int value = alloc();
+        compile_expr(*index_expr.expr, array);
+        compile_expr(*index_expr.indices[0], index);
+        compile_expr(*expr.right, value);
+        if (expr.mode != BinaryExpr::Op::Assign) {
+            int old = alloc();
+            emit(index_expr.checked ? Op::ArrayGet : Op::ArrayGetFast, old, array, index);
+            emit(binary_op(expr.mode), value, old, value);
+        }
+        emit(index_expr.checked ? Op::ArraySet : Op::ArraySetFast, array, index, value);
+        emit(Op::LoadUnit, dest);
+        return;
+    }
+    if (expr.left->get_kind() == Expr::Kind::Unary
+        && static_cast<const UnaryExpr&>(*expr.left).get_op() == UnaryExpr::Op::Field) {
+        const auto& field_expr = static_cast<const FieldExpr&>(*expr.left);
+        int slot = field_slot(field_expr.path);
+        if (instrument) {
+            emit(Op::Count, 0, add_counter("field " + field_expr.path));
+        }
+        if (const auto* elem = soa_element(*field_expr.expr)) {
+            check_array_index(*elem);
+            int array = alloc();
+            int index = alloc();
+            int value = alloc();
+            compile_expr(*elem->expr, array);
+            compile_expr(*elem->indices[0], index);
+            compile_expr(*expr.right, value);
+            if (expr.mode != BinaryExpr::Op::Assign) {
+                int old = alloc();
+                emit(Op::SoaGet, old, array, slot);
+                emit(binary_op(expr.mode), value, old, value);
+            }
+            emit(Op::SoaSet, array, slot, value);
+            ++soa_accesses;
+        } else {
+            int object = alloc();
+            int value = alloc();
+            compile_expr(*field_expr.expr, object);
+            compile_expr(*expr.right, value);
+            if (expr.mode != BinaryExpr::Op::Assign) {
+                int old = alloc();
+                emit(Op::GetField, old, object, slot);
+                emit(binary_op(expr.mode), value, old, value);
+            }
+            emit(Op::SetField, object, slot, value);
+        }
+        emit(Op::LoadUnit, dest);
+        return;
+    }
+    if (expr.left->get_kind() != Expr::Kind::Var) {
+        throw std::runtime_error(
+            std::format("Assignment at {} is not supported by the interpreter", expr.get_span())
+        );
+    }
+    const auto& ident = static_cast<const VarExpr&>(*expr.left).ident;
+    int value = alloc();
+    compile_expr(*expr.right, value);
+    std::optional<int> reg;
+    for (auto& scope: std::views::reverse(builder->scopes)) {
+        if (auto it = scope.find(ident); it != scope.end()) {
+            reg = it->second;
+            break;
+        }
+    }
+    if (reg.has_value()) {
+        if (expr.mode != BinaryExpr::Op::Assign) {
+            emit(binary_op(expr.mode), value, *reg, value);
+        }
+        emit(Op::Move, *reg, value);
+    } else if (auto it = global_ids.find(ident); it != global_ids.end()) {
+        if (expr.mode != BinaryExpr::Op::Assign) {
+            int old = alloc();
+            emit(Op::LoadGlobal, old, it->second);
+            emit(binary_op(expr.mode), value, old, value);
+        }
+        emit(Op::StoreGlobal, value, it->second);
+    } else {
+        // captures are copied into the closure, so writing them back would be lost
+        throw std::runtime_error(
+            std::format("Cannot assign to captured variable {} at {}", ident, expr.get_span())
+        );
+    }
+    emit(Op::LoadUnit, dest);
+}
+
+void Compiler::compile_app(const AppExpr& expr, int dest) {
+    int argc = static_cast<int>(expr.args.size());
+    switch (expr.func->get_kind()) {
+        case Expr::Kind::Func: {
+            const auto& func_expr = static_cast<const FuncExpr&>(*expr.func);
+            if (auto it = function_ids.find(func_expr.ident); it != function_ids.end()) {
+                if (program.functions[it->second].arity != argc) {
+                    throw std::runtime_error(std::format(
+                        "Wrong number of arguments to {} at {}",
+                        func_expr.ident,
+                        expr.get_span()
+                    ));
+                }
+                int first = compile_args(expr.args);
+                if (!compile_inline(it->second, first, dest)) {
+                    emit(Op::Call, dest, it->second, first);
+                }
+                return;
+            }
+            if (auto it = native_ids.find(func_expr.ident); it != native_ids.end()) {
+                if (program.natives[it->second].arity != argc) {
+                    throw std::runtime_error(std::format(
+                        "Wrong number of arguments to {} at {}",
+                        func_expr.ident,
+                        expr.get_span()
+                    ));
+                }
+                int first = compile_args(expr.args);
+                auto intrinsic = intrinsics.find(program.natives[it->second].name);
+                if (intrinsic == intrinsics.end()) {
+                    emit(Op::CallNative, dest, it->second, first);
+                    return;
+                }
+                auto [op, arity] = intrinsic->second;
+                if (arity != argc) {
+                    throw std::runtime_error(std::format(
+                        "{} takes {} arguments at {}",
+                        program.natives[it->second].name,
+                        arity,
+                        expr.get_span()
+                    ));
+                }
+                const auto& name = intrinsic->first;
+                switch (op) {
+                    case Op::ArraySet:
+                    case Op::SimdStore:
+                        emit(op, first, first + 1, first + 2);
+                        emit(Op::LoadUnit, dest);
+                        break;
+                    case Op::SimdSplat:
+                    case Op::SimdLoad: {
+                        // the width comes from the declared return type
+                        auto lanes = native_lanes.find(it->second);
+                        if (lanes == native_lanes.end()) {
+                            throw std::runtime_error(std::format(
+                                "{} must be declared to return a SIMD vector at {}",
+                                func_expr.ident,
+                                expr.get_span()
+                            ));
+                        }
+                        emit(op, dest, first, lanes->second);
+                        break;
+                    }
+                    case Op::SimdSelect:
+                        emit(op, dest, first);
+                        break;
+                    case Op::SimdReduce:
+                        emit(op, dest, first, static_cast<int>(simd_reductions.at(name)));
+                        break;
+                    default:
+                        emit(op, dest, first, first + 1);
+                        break;
+                }
+                return;
+            }
+            throw std::runtime_error(
+                std::format("Function {} has no body at {}", func_expr.ident, expr.get_span())
+            );
+        }
+        case Expr::Kind::Ctor: {
+            const auto& ctor_expr = static_cast<const CtorExpr&>(*expr.func);
+            int ctor = ctor_ids.at(ctor_expr.ident);
+            if (program.ctors[ctor].arity != argc) {
+                throw std::runtime_error(std::format(
+                    "Wrong number of arguments to {} at {}",
+                    ctor_expr.ident,
+                    expr.get_span()
+                ));
+            }
+            int first = compile_args(expr.args);
+            if (auto it = reuse_tokens.find(&expr); it != reuse_tokens.end()) {
+                emit(Op::Move, alloc(), it->second);
+                emit(Op::ReuseCtor, dest, ctor, first);
+            } else {
+                emit(Op::MakeCtor, dest, ctor, first);
+            }
+            return;
+        }
+        case Expr::Kind::Init: {
+            // init declarations are not supported, only the implicit one taking every field
+            const auto& init_expr = static_cast<const InitExpr&>(*expr.func);
+            auto it = class_ctors.find(init_expr.ident);
+            if (it == class_ctors.end()) {
+                break;
+            }
+            if (program.ctors[it->second].arity != argc) {
+                throw std::runtime_error(std::format(
+                    "Wrong number of arguments to {} at {}",
+                    init_expr.ident,
+                    expr.get_span()
+                ));
+            }
+            emit(Op::MakeCtor, dest, it->second, compile_args(expr.args));
+            return;
+        }
+        case Expr::Kind::Unary: {
+            const auto& unary_expr = static_cast<const UnaryExpr&>(*expr.func);
+            if (unary_expr.get_op() != UnaryExpr::Op::Field) {
+                break;
+            }
+            // method call, the receiver is passed as the first argument
+            const auto& field_expr = static_cast<const FieldExpr&>(unary_expr);
+            int first = alloc();
+            compile_expr(*field_expr.expr, first);
+            for (const auto& arg: expr.args) {
+                compile_expr(*arg, alloc());
+            }
+            ++method_calls;
+            auto receiver = static_type(*field_expr.expr);
+            auto target = receiver ? find_method(*receiver, field_expr.path) : std::nullopt;
+            // a wrong arity keeps the dynamic call so the error is still raised at runtime
+            if (target && *target >= 0 && program.functions[*target].arity == argc + 1) {
+                ++devirtualized;
+                if (!compile_inline(*target, first, dest)) {
+                    emit(Op::Call, dest, *target, first);
+                }
+                return;
+            }
+            if (target && *target < 0 && program.natives[-1 - *target].arity == argc + 1) {
+                ++devirtualized;
+                emit(Op::CallNative, dest, -1 - *target, first);
+                return;
+            }
+            auto& caches = current().caches;
+            caches.push_back(MethodCache {
+                .name = field_expr.path,
+                .argc = argc + 1,
+                .slot = method_slot(field_expr.path),
+            });
+            emit(Op::CallMethod, dest, static_cast<int>(caches.size()) - 1, first);
+            return;
+        }
+        default:
+            break;
+    }
+    int closure = alloc();
+    compile_expr(*expr.func, closure);
+    compile_args(expr.args);
+    emit(Op::CallClosure, dest, closure, argc);
+}
+
+bool Compiler::compile_soa_new(const Expr& expr, const Type& hint, int dest) {
+    auto elems = soa_elements(hint);
+    if (!elems || expr.get_kind() != Expr::Kind::App) {
+        return false;
+    }
+    const auto& app_expr = static_cast<const AppExpr&>(expr);
+    if (app_expr.func->get_kind() != Expr::Kind::Func || app_expr.args.size() != 1) {
+        return false;
+    }
+    auto native = native_ids.find(static_cast<const FuncExpr&>(*app_expr.func).ident);
+    if (native == native_ids.end() || program.natives[native->second].name != "fy_array_new") {
+        return false;
+    }
+    int len = alloc();
+    compile_expr(*app_expr.args[0], len);
+    emit(Op::SoaNew, dest, soa_classes.at(*elems), len);
+    return true;
+}
+
+void Compiler::compile_lam(const LamExpr& expr, int dest, std::optional<std::string> self_name) {
+    int func = static_cast<int>(program.functions.size());
+    program.functions.push_back(Function {
+        .name = std::format("<lambda at {}>", expr.get_span()),
+        .arity = static_cast<int>(expr.params.size()),
+    });
+    // a named local function refers to itself through LoadSelf rather than a capture
+    Builder lam_builder {.parent = builder, .func = func, .self_name = std::move(self_name)};
+    lam_builder.scopes.emplace_back();
+    auto* saved = builder;
+    builder = &lam_builder;
+    if (probes) {
+        emit(Op::Probe);
+    }
+    std::vector<int> params;
+    for (size_t i = 0; i < expr.params.size(); ++i) {
+        params.push_back(alloc());
+    }
+    std::vector<int> fails;
+    for (size_t i = 0; i < expr.params.size(); ++i) {
+        compile_pat(*expr.params[i], params[i], fails);
+    }
+    if (!fails.empty()) {
+        throw std::runtime_error(std::format("Refutable lambda parameter at {}", expr.get_span()));
+    }
+    int result = alloc();
+    compile_expr(*expr.body, result);
+    emit(Op::Return, result);
+    emit_cold_returns();
+    builder = saved;
+    // captures are copied into consecutive registers for MakeClosure
+    int first = builder->next_reg;
+    for (int source: lam_builder.capture_sources) {
+        emit(Op::Dup, alloc(), source);
+    }
+    if (expr.stack) {
+        program.functions[func].stack_slot = current().stack_closures++;
+        emit(Op::StackClosure, dest, func, first);
+    } else {
+        emit(Op::MakeClosure, dest, func, first);
+    }
+}
+
+void Compiler::compile_block(const BlockExpr& expr, int dest) {
+    builder->scopes.emplace_back();
+    for (const auto& stmt: expr.stmts) {
+        compile_stmt(*stmt);
+    }
+    if (expr.body.has_value()) {
+        compile_expr(**expr.body, dest);
+    } else {
+        emit(Op::LoadUnit, dest);
+    }
+    builder->scopes.pop_back();
+}
+
+void Compiler::compile_stmt(const Stmt& stmt) {
+    switch (stmt.get_kind()) {
+        case Stmt::Kind::Let: {
+            const auto& let_stmt = static_cast<const LetStmt&>(stmt);
+            std::vector<int> fails;
+            if (compile_tuple_call(*let_stmt.pat, *let_stmt.expr, fails)) {
+                compile_let_else(let_stmt, fails);
+                break;
+            }
+            int reg = alloc();
+            const auto* var_pat = let_stmt.pat->get_kind() == Pat::Kind::Var
+                ? static_cast<const VarPat*>(let_stmt.pat.get())
+                : nullptr;
+            bool soa_new = var_pat && var_pat->hint
+                && compile_soa_new(*let_stmt.expr, *var_pat->hint, reg);
+            if (!soa_new) {
+                compile_expr(*let_stmt.expr, reg);
+            }
+            // typed before the pattern binds, which may shadow a variable the initializer reads
+            auto type = static_type(*let_stmt.expr);
+            auto elems = soa_elements(*let_stmt.expr);
+            compile_pat(*let_stmt.pat, reg, fails);
+            if (var_pat && !var_pat->is_mut) {
+                if (type && !builder->reg_types.contains(reg)) {
+                    builder->reg_types[reg] = *type;
+                }
+                if (elems && !builder->soa_regs.contains(reg)) {
+                    builder->soa_regs[reg] = *elems;
+                }
+            }
+            compile_let_else(let_stmt, fails);
+            break;
+        }
+        case Stmt::Kind::Func: {
+            const auto& func_stmt = static_cast<const FuncStmt&>(stmt);
+            int reg = alloc();
+            LamExpr lam(func_stmt.params, func_stmt.body, stmt.get_span());
+            lam.stack = func_stmt.stack;
+            compile_lam(lam, reg, func_stmt.ident);
+            bind(func_stmt.ident, reg);
+            break;
+        }
+        case Stmt::Kind::Bind: {
+            const auto& bind_stmt = static_cast<const BindStmt&>(stmt);
+            std::vector<int> fails;
+            if (!compile_tuple_call(*bind_stmt.pat, *bind_stmt.expr, fails)) {
+                int reg = alloc();
+                compile_expr(*bind_stmt.expr, reg);
+                compile_pat(*bind_stmt.pat, reg, fails);
+            }
+            if (!fails.empty()) {
+                throw std::runtime_error(
+                    std::format("Refutable pattern in bind at {}", stmt.get_span())
+                );
+            }
+            break;
+        }
+        case Stmt::Kind::Expr: {
+            int mark = builder->next_reg;
+            compile_expr(*static_cast<const ExprStmt&>(stmt).expr, alloc());
+            builder->next_reg = mark;
+            break;
+        }
+    }
+}
+
+void Compiler::compile_let_else(const LetStmt& stmt, const std::vector<int>& fails) {
+    if (fails.empty()) {
+        return;
+    }
+    int skip = emit(Op::Jump);
+    int else_start = label();
+    if (stmt.else_branch.has_value()) {
+        // the else branch must diverge, falling through is a runtime failure
+        int scratch = alloc();
+        compile_expr(**stmt.else_branch, scratch);
+    }
+    emit(
+        Op::Fail,
+        0,
+        add_string(std::format("Refutable pattern in let at {}", stmt.get_span()))
+    );
+    for (int jump: fails) {
+        patch(jump, else_start);
+    }
+    patch(skip, label());
+}
+
+bool Compiler::compile_tuple_call(const Pat& pat, const Expr& expr, std::vector<int>& fails) {
+    if (pat.get_kind() != Pat::Kind::Tuple || expr.get_kind() != Expr::Kind::App) {
+        return false;
+    }
+    const auto& tuple_pat = static_cast<const TuplePat&>(pat);
+    const auto& app_expr = static_cast<const AppExpr&>(expr);
+    if (tuple_pat.elems.size() < 2 || app_expr.func->get_kind() != Expr::Kind::Func) {
+        return false;
+    }
+    const auto& ident = static_cast<const FuncExpr&>(*app_expr.func).ident;
+    auto it = function_ids.find(ident);
+    // inlined bodies and generators hand over their result some other way
+    if (it == function_ids.end() || inline_funcs.contains(it->second)
+        || generator_funcs.contains(ident)
+        || program.functions[it->second].arity != static_cast<int>(app_expr.args.size())) {
+        return false;
+    }
+    ++unboxed_calls;
+    int count = static_cast<int>(tuple_pat.elems.size());
+    int first = builder->next_reg;
+    for (int i = 0; i < count; ++i) {
+        alloc();
+    }
+    compile_args(app_expr.args);
+    emit(Op::CallTuple, first, it->second, count);
+    for (int i = 0; i < count; ++i) {
+        compile_pat(*tuple_pat.elems[i], first + i, fails);
+    }
+    return true;
+}
+
+void Compiler::compile_ite(const IteExpr& expr, int dest) {
+    std::vector<int> ends;
+    for (const auto& then: expr.then_branches) {
+        builder->scopes.emplace_back();
+        int mark = builder->next_reg;
+        std::vector<int> fails;
+        compile_cond(*then.cond, fails);
+        compile_expr(*then.then_branch, dest);
+        ends.push_back(emit(Op::Jump));
+        builder->next_reg = mark;
+        builder->scopes.pop_back();
+        int next = label();
+        for (int jump: fails) {
+            patch(jump, next);
+        }
+    }
+    if (expr.else_branch.has_value()) {
+        compile_expr(**expr.else_branch, dest);
+    } else {
+        emit(Op::LoadUnit, dest);
+    }
+    int end = label();
+    for (int jump: ends) {
+        patch(jump, end);
+    }
+}
+
+void Compiler::compile_switch(const SwitchExpr& expr, int dest) {
+    int scrutinee = alloc();
+    compile_expr(*expr.expr, scrutinee);
+    auto counter = std::format("clause {}", expr.get_span());
+    std::vector<size_t> order(expr.clauses.size());
+    std::iota(order.begin(), order.end(), 0);
+    if (profile) {
+        // unguarded clauses matching distinct constructors are mutually exclusive,
+        // so the leading run of them may be tested most frequent first
+        std::set<std::string> ctors;
+        size_t run = 0;
+        for (; run < expr.clauses.size(); ++run) {
+            const auto& clause = *expr.clauses[run];
+            if (clause.get_kind() != Clause::Kind::Case) {
+                break;
+            }
+            const auto& case_clause = static_cast<const CaseClause&>(clause);
+            if (case_clause.guard.has_value() || case_clause.pat->get_kind() != Pat::Kind::Ctor
+                || !ctors.insert(static_cast<const CtorPat&>(*case_clause.pat).ident).second) {
+                break;
+            }
+        }
+        auto taken = [&](size_t i) { return profile->count(std::format("{} {}", counter, i)); };
+        std::stable_sort(order.begin(), order.begin() + run, [&](size_t l, size_t r) {
+            return taken(l) > taken(r);
+        });
+        if (!std::ranges::is_sorted(order)) {
+            ++reordered_switches;
+        }
+    }
+    std::vector<int> ends;
+    bool exhaustive = false;
+    for (size_t index: order) {
+        const auto& clause = expr.clauses[index];
+        builder->scopes.emplace_back();
+        int mark = builder->next_reg;
+        std::vector<int> fails;
+        const Expr* body;
+        const Expr* reuse = nullptr;
+        if (clause->get_kind() == Clause::Kind::Case) {
+            const auto& case_clause = static_cast<const CaseClause&>(*clause);
+            compile_pat(*case_clause.pat, scrutinee, fails, expr.consumes);
+            if (case_clause.guard.has_value()) {
+                int guard = alloc();
+                compile_expr(**case_clause.guard, guard);
+                fails.push_back(emit(Op::JumpIfNot, guard));
+            }
+            body = case_clause.expr.get();
+            reuse = case_clause.reuse;
+        } else {
+            body = static_cast<const DefaultClause&>(*clause).expr.get();
+        }
+        if (reuse) {
+            reuse_tokens[reuse] = scrutinee;
+        }
+        if (instrument) {
+            emit(Op::Count, 0, add_counter(std::format("{} {}", counter, index)));
+        }
+        compile_expr(*body, dest);
+        reuse_tokens.erase(reuse);
+        ends.push_back(emit(Op::Jump));
+        builder->next_reg = mark;
+        builder->scopes.pop_back();
+        int next = label();
+        for (int jump: fails) {
+            patch(jump, next);
+        }
+        if (fails.empty()) {
+            exhaustive = true;
+            break;
+        }
+    }
+    if (!exhaustive) {
+        emit(
+            Op::Fail,
+            0,
+            add_string(std::format("No switch clause matched at {}", expr.get_span()))
+        );
+    }
+    int end = label();
+    for (int jump: ends) {
+        patch(jump, end);
+    }
+}
+
+void Compiler::compile_for(const ForExpr& expr, int dest) {
+    if (compile_generator_for(expr, dest)) {
+        return;
+    }
+    // the sources and the adapter arguments are evaluated once, in order
+    Chain chain = compile_chain(*expr.iter);
+    int one = alloc();
+    emit(Op::LoadInt, one, 1);
+
+    int start = label();
+    builder->loops.push_back(Loop {start, {}});
+    builder->scopes.emplace_back();
+    std::vector<int> exits;
+    Element elem = pull(chain, one, exits);
+    std::vector<int> fails;
+    bind_element(*expr.pat, elem, fails);
+    compile_expr(*expr.body, alloc());
+    emit(Op::Jump, 0, start);
+    if (!fails.empty()) {
+        int fail = emit(
+            Op::Fail,
+            0,
+            add_string(std::format("Refutable pattern in for at {}", expr.get_span()))
+        );
+        for (int jump: fails) {
+            patch(jump, fail);
+        }
+    }
+    int end = label();
+    for (int jump: exits) {
+        patch(jump, end);
+    }
+    for (int jump: builder->loops.back().breaks) {
+        patch(jump, end);
+    }
+    builder->scopes.pop_back();
+    builder->loops.pop_back();
+    emit(Op::LoadUnit, dest);
+}
+
+bool Compiler::compile_generator_for(const ForExpr& expr, int dest) {
+    if (expr.iter->get_kind() != Expr::Kind::App) {
+        return false;
+    }
+    const auto& app_expr = static_cast<const AppExpr&>(*expr.iter);
+    if (app_expr.func->get_kind() != Expr::Kind::Func) {
+        return false;
+    }
+    auto it = generator_funcs.find(static_cast<const FuncExpr&>(*app_expr.func).ident);
+    if (it == generator_funcs.end()) {
+        return false;
+    }
+    const auto& decl = *it->second;
+    // a generator looping over itself would expand forever, so it collects instead
+    if (builder->decl == &decl
+        || std::ranges::any_of(builder->inlined, [&](const auto& i) { return i.decl == &decl; })) {
+        return false;
+    }
+    if (app_expr.args.size() != decl.params.size()) {
+        throw std::runtime_error(std::format(
+            "Wrong number of arguments to {} at {}",
+            it->first,
+            app_expr.get_span()
+        ));
+    }
+    ++generator_loops;
+
+    // the generator runs in this frame
+    int first = compile_args(app_expr.args);
+    int elem = alloc();
+    int resume = alloc();
+    builder->generators.push_back(Generator {elem, resume});
+    builder->inlined.push_back(Inlined {&decl, alloc(), {}});
+    builder->scopes.emplace_back();
+    std::vector<int> fails;
+    for (size_t i = 0; i < decl.params.size(); ++i) {
+        compile_pat(*decl.params[i], first + static_cast<int>(i), fails);
+    }
+    compile_expr(**decl.body, builder->inlined.back().dest);
+    // returning or running off the end finishes the loop
+    std::vector<int> exits = std::move(builder->inlined.back().exits);
+    exits.push_back(emit(Op::Jump));
+    if (!fails.empty()) {
+        int fail = emit(
+            Op::Fail,
+            0,
+            add_string(std::format("Refutable parameter in {}", decl.ident))
+        );
+        for (int jump: fails) {
+            patch(jump, fail);
+        }
+    }
+    builder->scopes.pop_back();
+    builder->inlined.pop_back();
+    auto yields = std::move(builder->generators.back().yields);
+    builder->generators.pop_back();
+
+    // every yield runs the body, which continues by resuming the generator. The
+    // registers of the generator body are freed but its locals live across a
+    // yield, so the loop body allocates above all of them.
+    builder->next_reg = current().num_regs;
+    int next = emit(Op::JumpReg, resume);
+    for (int jump: yields) {
+        patch(jump, label());
+    }
+    builder->loops.push_back(Loop {next, {}});
+    builder->scopes.emplace_back();
+    fails.clear();
+    compile_pat(*expr.pat, elem, fails);
+    compile_expr(*expr.body, alloc());
+    emit(Op::Jump, 0, next);
+    if (!fails.empty()) {
+        int fail = emit(
+            Op::Fail,
+            0,
+            add_string(std::format("Refutable pattern in for at {}", expr.get_span()))
+        );
+        for (int jump: fails) {
+            patch(jump, fail);
+        }
+    }
+    int end = label();
+    for (int jump: exits) {
+        patch(jump, end);
+    }
+    for (int jump: builder->loops.back().breaks) {
+        patch(jump, end);
+    }
+    builder->scopes.pop_back();
+    builder->loops.pop_back();
+    emit(Op::LoadUnit, dest);
+    return true;
+}
+
+void Compiler::compile_yield(const YieldExpr& expr, int dest) {
+    if (builder->generators.empty()) {
+        throw std::runtime_error(
+            std::format("Yield outside of a generator at {}", expr.get_span())
+        );
+    }
+    // the operand may expand generators of its own, so the entry is looked up after it
+    size_t index = builder->generators.size() - 1;
+    if (builder->generators[index].resume < 0) {
+        int value = alloc();
+        compile_expr(*expr.expr, value);
+        emit(Op::ArrayPush, builder->generators[index].elem, value);
+    } else {
+        compile_expr(*expr.expr, builder->generators[index].elem);
+        int resume = emit(Op::LoadLabel, builder->generators[index].resume);
+        builder->generators[index].yields.push_back(emit(Op::Jump));
+        patch(resume, label());
+    }
+    emit(Op::LoadUnit, dest);
+}
+
+void Compiler::compile_try(const TryExpr& expr, int dest) {
+    if (builder->func == program.init) {
+        throw std::runtime_error(
+            std::format("Operator ? outside of a function at {}", expr.get_span())
+        );
+    }
+    // an operand whose type is known must be an enum `?` applies to, IsOk checks the rest
+    auto type = static_type(*expr.expr);
+    bool applies = std::ranges::any_of(program.ctors, [&](const CtorInfo& ctor) {
+        return ctor.unwraps && (!type.has_value() || ctor.type == *type);
+    });
+    if (!applies) {
+        throw std::runtime_error(std::format(
+            "Operator ? needs an enum with one Ok or Some constructor of a single payload and "
+            "failure constructors at {}",
+            expr.get_span()
+        ));
+    }
+    int value = alloc();
+    int ok = alloc();
+    compile_expr(*expr.expr, value);
+    emit(Op::IsOk, ok, value);
+    // any other constructor is returned as it is, so the caller must share the enum
+    if (builder->inlined.empty()) {
+        builder->cold_returns.emplace_back(emit(Op::JumpIfNot, ok), value);
+    } else {
+        int skip = emit(Op::JumpIf, ok);
+        emit(Op::Move, builder->inlined.back().dest, value);
+        builder->inlined.back().exits.push_back(emit(Op::Jump));
+        patch(skip, label());
+    }
+    // an unshared operand dies here, so its payload moves out
+    emit(Op::TakeElem, dest, value, 0);
+}
+
+void Compiler::emit_cold_returns() {
+    for (auto [jump, value]: builder->cold_returns) {
+        patch(jump, label());
+        emit(Op::Return, value);
+    }
+    builder->cold_returns.clear();
+}
+
+Compiler::Chain Compiler::compile_chain(const Expr& expr) {
+    std::vector<Stage> stages;
+    const Expr* source = &expr;
+    while (const auto* adapter = as_loop_adapter(*source)) {
+        const auto& field_expr = static_cast<const FieldExpr&>(*adapter->func);
+        stages.push_back(Stage {&field_expr.path, adapter->args[0].get()});
+        source = field_expr.expr.get();
+    }
+    std::ranges::reverse(stages);
+
+    Chain chain {compile_cursor(*source), std::move(stages)};
+    bool pair = false;
+    for (auto& stage: chain.stages) {
+        const auto& func = *stage.func;
+        if (*stage.name == "zip") {
+            stage.other = std::make_unique<Chain>(compile_chain(func));
+            pair = true;
+            continue;
+        }
+        stage.expand = fits_lambda(func, pair);
+        pair = pair && *stage.name == "filter";
+        if (!stage.expand
+            && (func.get_kind() != Expr::Kind::Func
+                || (!function_ids.contains(static_cast<const FuncExpr&>(func).ident)
+                    && !native_ids.contains(static_cast<const FuncExpr&>(func).ident)))) {
+            stage.closure = alloc();
+            compile_expr(func, stage.closure);
+        }
+    }
+    return chain;
+}
+
+Compiler::Cursor Compiler::compile_cursor(const Expr& expr) {
+    if (expr.get_kind() == Expr::Kind::Binary
+        && static_cast<const BinaryExpr&>(expr).get_op() == BinaryExpr::Op::Range) {
+        const auto& range_expr = static_cast<const BinaryExpr&>(expr);
+        int next = alloc();
+        int bound = alloc();
+        compile_expr(*range_expr.left, next);
+        compile_expr(*range_expr.right, bound);
+        return Cursor {true, next, bound};
+    }
+    // arrays are the only other collection, anything else fails on its first ArrayLen
+    int array = alloc();
+    int index = alloc();
+    compile_expr(expr, array);
+    emit(Op::LoadInt, index, 0);
+    return Cursor {false, index, array};
+}
+
+Compiler::Element Compiler::pull(const Chain& chain, int one, std::vector<int>& exits) {
+    int again = label();
+    Element elem {advance(chain.cursor, one, exits)};
+    for (const auto& stage: chain.stages) {
+        if (*stage.name == "map") {
+            elem = Element {apply_stage(stage, elem, false)};
+        } else if (*stage.name == "filter") {
+            emit(Op::JumpIfNot, apply_stage(stage, elem, true), again);
+        } else {
+            int first = materialize(elem);
+            int second = materialize(pull(*stage.other, one, exits));
+            int pair = alloc();
+            alloc();
+            emit(Op::Move, pair, first);
+            emit(Op::Move, pair + 1, second);
+            elem = Element {pair, true};
+        }
+    }
+    return elem;
+}
+
+int Compiler::advance(const Cursor& cursor, int one, std::vector<int>& exits) {
+    int elem = alloc();
+    int more = alloc();
+    if (cursor.range) {
+        emit(Op::Lt, more, cursor.next, cursor.bound);
+        exits.push_back(emit(Op::JumpIfNot, more));
+        emit(Op::Move, elem, cursor.next);
+    } else {
+        // the length is read every iteration, so the unchecked load is always in bounds
+        emit(Op::ArrayLen, more, cursor.bound);
+        emit(Op::Lt, more, cursor.next, more);
+        exits.push_back(emit(Op::JumpIfNot, more));
+        emit(Op::ArrayGetFast, elem, cursor.bound, cursor.next);
+    }
+    emit(Op::Add, cursor.next, cursor.next, one);
+    return elem;
+}
+
+int Compiler::materialize(Element elem) {
+    if (!elem.pair) {
+        return elem.reg;
+    }
+    int tuple = alloc();
+    emit(Op::MakeTuple, tuple, elem.reg, 2);
+    return tuple;
+}
+
+void Compiler::bind_element(const Pat& pat, Element elem, std::vector<int>& fails) {
+    if (elem.pair && pat.get_kind() == Pat::Kind::Tuple) {
+        const auto& tuple_pat = static_cast<const TuplePat&>(pat);
+        if (tuple_pat.elems.size() == 2) {
+            compile_pat(*tuple_pat.elems[0], elem.reg, fails);
+            compile_pat(*tuple_pat.elems[1], elem.reg + 1, fails);
+            return;
+        }
+    }
+    compile_pat(pat, materialize(elem), fails);
+}
+
+int Compiler::apply_stage(const Stage& stage, Element elem, bool borrow) {
+    if (borrow) {
+        int copy = alloc();
+        if (elem.pair) {
+            alloc();
+            emit(Op::Dup, copy + 1, elem.reg + 1);
+        }
+        emit(Op::Dup, copy, elem.reg);
+        elem.reg = copy;
+    }
+    int result = alloc();
+    const auto& func = *stage.func;
+    if (stage.expand) {
+        // the body is expanded in place, its returns leave the result
+        const auto& lam_expr = static_cast<const LamExpr&>(func);
+        auto saved_floor = builder->lambda_floor;
+        builder->lambda_floor = builder->scopes.size();
+        builder->scopes.emplace_back();
+        builder->inlined.push_back(Inlined {nullptr, result, {}});
+        std::vector<int> fails;
+        if (lam_expr.params.size() == 2) {
+            compile_pat(*lam_expr.params[0], elem.reg, fails);
+            compile_pat(*lam_expr.params[1], elem.reg + 1, fails);
+        } else {
+            bind_element(*lam_expr.params[0], elem, fails);
+        }
+        compile_expr(*lam_expr.body, result);
+        if (!fails.empty()) {
+            builder->inlined.back().exits.push_back(emit(Op::Jump));
+            int fail = emit(
+                Op::Fail,
+                0,
+                add_string(std::format("Refutable parameter in lambda at {}", func.get_span()))
+            );
+            for (int jump: fails) {
+                patch(jump, fail);
+            }
+        }
+        for (int exit: builder->inlined.back().exits) {
+            patch(exit, label());
+        }
+        builder->inlined.pop_back();
+        builder->scopes.pop_back();
+        builder->lambda_floor = saved_floor;
+        return result;
+    }
+    int arg = materialize(elem);
+    if (stage.closure < 0) {
+        const auto& ident = static_cast<const FuncExpr&>(func).ident;
+        auto func_it = function_ids.find(ident);
+        int arity = func_it != function_ids.end()
+            ? program.functions[func_it->second].arity
+            : program.natives[native_ids.at(ident)].arity;
+        if (arity != 1) {
+            throw std::runtime_error(
+                std::format("Wrong number of arguments to {} at {}", ident, func.get_span())
+            );
+        }
+        int args = alloc();
+        emit(Op::Move, args, arg);
+        if (func_it == function_ids.end()) {
+            emit(Op::CallNative, result, native_ids.at(ident), args);
+        } else if (!compile_inline(func_it->second, args, result)) {
+            emit(Op::Call, result, func_it->second, args);
+        }
+        return result;
+    }
+    int callee = alloc();
+    int args = alloc();
+    emit(Op::Dup, callee, stage.closure);
+    emit(Op::Move, args, arg);
+    emit(Op::CallClosure, result, callee, 1);
+    return result;
+}
+
+void Compiler::compile_cond(const Cond& cond, std::vector<int>& fails) {
+    switch (cond.get_kind()) {
+        case Cond::Kind::Expr: {
+            int reg = alloc();
+            compile_expr(*static_cast<const ExprCond&>(cond).expr, reg);
+            fails.push_back(emit(Op::JumpIfNot, reg));
+            break;
+        }
+        case Cond::Kind::Case: {
+            const auto& pat_cond = static_cast<const PatCond&>(cond);
+            int reg = alloc();
+            compile_expr(*pat_cond.expr, reg);
+            compile_pat(*pat_cond.pat, reg, fails);
+            break;
+        }
+    }
+}
+
+void Compiler::compile_pat(const Pat& pat, int reg, std::vector<int>& fails, bool owned) {
+    switch (pat.get_kind()) {
+        case Pat::Kind::Lit: {
+            int lit = alloc();
+            compile_lit(*static_cast<const LitPat&>(pat).literal, lit);
+            emit(Op::Eq, lit, reg, lit);
+            fails.push_back(emit(Op::JumpIfNot, lit));
+            break;
+        }
+        case Pat::Kind::Var: {
+            const auto& var_pat = static_cast<const VarPat&>(pat);
+            bind(var_pat.ident, reg);
+            if (var_pat.hint && !var_pat.is_mut && !builder->global_prefix.has_value()) {
+                if (int type = resolve_type(*var_pat.hint); type >= 0) {
+                    builder->reg_types[reg] = type;
+                }
+                if (auto elems = soa_elements(*var_pat.hint)) {
+                    builder->soa_regs[reg] = *elems;
+                }
+            }
+            break;
+        }
+        case Pat::Kind::Tuple: {
+            const auto& tuple_pat = static_cast<const TuplePat&>(pat);
+            for (size_t i = 0; i < tuple_pat.elems.size(); ++i) {
+                int elem = alloc();
+                emit(owned ? Op::TakeElem : Op::GetElem, elem, reg, static_cast<int>(i));
+                compile_pat(*tuple_pat.elems[i], elem, fails, owned);
+            }
+            break;
+        }
+        case Pat::Kind::Ctor: {
+            const auto& ctor_pat = static_cast<const CtorPat&>(pat);
+            int test = alloc();
+            emit(Op::IsCtor, test, reg, ctor_ids.at(ctor_pat.ident));
+            fails.push_back(emit(Op::JumpIfNot, test));
+            if (ctor_pat.args.has_value()) {
+                for (size_t i = 0; i < ctor_pat.args->size(); ++i) {
+                    int arg = alloc();
+                    emit(owned ? Op::TakeElem : Op::GetElem, arg, reg, static_cast<int>(i));
+                    compile_pat(*(*ctor_pat.args)[i], arg, fails, owned);
+                }
+            }
+            break;
+        }
+        case Pat::Kind::Wild:
+            break;
+        case Pat::Kind::Or: {
+            const auto& or_pat = static_cast<const OrPat&>(pat);
+            std::vector<std::string> vars;
+            collect_pat_vars(or_pat, vars);
+            if (!vars.empty()) {
+                throw std::runtime_error(std::format(
+                    "Or-patterns binding variables are not supported by the interpreter at {}",
+                    pat.get_span()
+                ));
+            }
+            std::vector<int> matched;
+            for (const auto& option: or_pat.options) {
+                std::vector<int> option_fails;
+                compile_pat(*option, reg, option_fails, owned);
+                matched.push_back(emit(Op::Jump));
+                int next = label();
+                for (int jump: option_fails) {
+                    patch(jump, next);
+                }
+            }
+            fails.push_back(emit(Op::Jump));
+            int end = label();
+            for (int jump: matched) {
+                patch(jump, end);
+            }
+            break;
+        }
+        case Pat::Kind::At: {
+            // the name aliases the matched register, so the value counts as shared
+            const auto& at_pat = static_cast<const AtPat&>(pat);
+            emit(Op::Dup, reg, reg);
+            compile_pat(*at_pat.pat, reg, fails);
+            bind(at_pat.ident, reg);
+            break;
+        }
+    }
+}
+
+int Compiler::compile_args(const std::vector<std::shared_ptr<Expr>>& args) {
+    int first = builder->next_reg;
+    for (size_t i = 0; i < args.size(); ++i) {
+        alloc();
+    }
+    for (size_t i = 0; i < args.size(); ++i) {
+        compile_expr(*args[i], first + static_cast<int>(i));
+    }
+    return first;
+}
+
+bool Compiler::compile_inline(int func, int first, int dest) {
+    auto it = inline_funcs.find(func);
+    if (it == inline_funcs.end()) {
+        return false;
+    }
+    const auto& decl = *it->second;
+    // recursive calls stay calls, which bounds the expansion
+    if (builder->decl == &decl
+        || std::ranges::any_of(builder->inlined, [&](const auto& i) { return i.decl == &decl; })) {
+        return false;
+    }
+    ++inlined_calls;
+    builder->inlined.push_back(Inlined {&decl, dest, {}});
+    builder->scopes.emplace_back();
+    std::vector<int> fails;
+    for (size_t i = 0; i < decl.params.size(); ++i) {
+        compile_pat(*decl.params[i], first + static_cast<int>(i), fails);
+    }
+    compile_expr(**decl.body, dest);
+    if (!fails.empty()) {
+        builder->inlined.back().exits.push_back(emit(Op::Jump));
+        int fail = emit(
+            Op::Fail,
+            0,
+            add_string(std::format("Refutable parameter in {}", decl.ident))
+        );
+        for (int jump: fails) {
+            patch(jump, fail);
+        }
+    }
+    for (int exit: builder->inlined.back().exits) {
+        patch(exit, label());
+    }
+    builder->scopes.pop_back();
+    builder->inlined.pop_back();
+    return true;
+}
+
+} // namespace interp
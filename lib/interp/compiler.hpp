@@ -0,0 +1,303 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "elaborate/eval.hpp"
+#include "elaborate/syntax.hpp"
+#include "interp/bytecode.hpp"
+#include "interp/mir.hpp"
+#include "interp/profile.hpp"
+
+namespace interp {
+
+class Compiler {
+public:
+    // instrument adds the profile counters; a profile reorders switch clauses
+    // and inlines small hot functions
+    explicit Compiler(bool instrument = false, const Profile* profile = nullptr):
+        instrument(instrument),
+        profile(profile) {}
+
+    Program compile(const elaborate::Package& pkg);
+
+    // Starts every function and lambda with a Probe, and inlines nothing so
+    // each call is timed on its own.
+    void enable_probes() {
+        probes = true;
+    }
+
+    // Tags each instruction that may allocate with the source position it was
+    // compiled from, see Program::alloc_sites.
+    void enable_alloc_sites() {
+        alloc_sites = true;
+    }
+
+    int get_method_calls() const {
+        return method_calls;
+    }
+
+    // method calls compiled to a direct call because the receiver type was known
+    int get_devirtualized() const {
+        return devirtualized;
+    }
+
+    int get_inlined() const {
+        return inlined_calls;
+    }
+
+    int get_reordered_switches() const {
+        return reordered_switches;
+    }
+
+    int get_soa_accesses() const {
+        return soa_accesses;
+    }
+
+    // for loops over a generator call that run the generator body in place
+    int get_generator_loops() const {
+        return generator_loops;
+    }
+
+    // calls whose tuple result is destructured straight from the callee's registers
+    int get_unboxed_calls() const {
+        return unboxed_calls;
+    }
+
+    // the passes run over the MIR of every function once the program is compiled
+    const MirPassManager& get_mir_passes() const {
+        return mir_passes;
+    }
+
+private:
+    struct Loop {
+        int continue_target;
+        std::vector<int> breaks;
+    };
+
+    // An @inline body expanded at a call site; its returns jump past the body.
+    struct Inlined {
+        const elaborate::FuncDecl* decl;
+        int dest;
+        std::vector<int> exits;
+    };
+
+    // Source of a fused for loop, a range or the elements of an array.
+    struct Cursor {
+        bool range;
+        // the next value of a range, or the next index into the array
+        int next;
+        // the end of a range, or the array
+        int bound;
+    };
+
+    // An element flowing through a fused for loop. zip yields a pair in two
+    // consecutive registers, built into a tuple only when something needs one.
+    struct Element {
+        int reg;
+        bool pair = false;
+    };
+
+    struct Chain;
+
+    // A map, filter or zip adapter of a for loop source.
+    struct Stage {
+        const std::string* name;
+        const elaborate::Expr* func;
+        // a lambda literal taking the element, or both halves of a pair, runs in place
+        bool expand = false;
+        // the evaluated argument when it is neither expanded nor a named function
+        int closure = -1;
+        // the chain zipped with the element
+        std::unique_ptr<Chain> other;
+    };
+
+    // A generator body being compiled. Expanded into a for loop, a yield stores
+    // its value, records where to resume and jumps to the loop body. Compiled as
+    // a function, a yield appends to the array the call returns.
+    struct Generator {
+        // the register the loop takes its element from, or the array
+        int elem;
+        // the register holding the instruction to resume at, -1 for an array
+        int resume = -1;
+        std::vector<int> yields;
+    };
+
+    // A cursor and the adapters applied to each of its elements.
+    struct Chain {
+        Cursor cursor;
+        std::vector<Stage> stages;
+    };
+
+    // Per-function state, nested for lambdas so free variables become captures.
+    struct Builder {
+        Builder* parent = nullptr;
+        int func = -1;
+        int next_reg = 0;
+        std::vector<std::map<std::string, int>> scopes;
+        std::map<std::string, int> captures;
+        std::vector<int> capture_sources;
+        std::vector<Loop> loops;
+        // name of a local function, so its body can refer to itself
+        std::optional<std::string> self_name;
+        // module prefix when pattern variables bind globals
+        std::optional<std::string> global_prefix;
+        // type ids of registers holding immutable variables of a known type
+        std::map<int, int> reg_types;
+        // element class types of registers holding immutable arrays of a @soa class
+        std::map<int, int> soa_regs;
+        // the declaration being compiled, which is never inlined into itself
+        const elaborate::FuncDecl* decl = nullptr;
+        std::vector<Inlined> inlined;
+        // generator bodies being compiled, the innermost last
+        std::vector<Generator> generators;
+        // early returns of `?`, emitted out of line after the function body as
+        // the jump to each and the register it returns
+        std::vector<std::pair<int, int>> cold_returns;
+        // an inlined lambda body must not move variables bound in scopes below this
+        size_t lambda_floor = 0;
+        // start of the innermost expression being compiled, for the line table
+        parsing::Location pos {0, 0};
+    };
+
+    bool instrument;
+    bool probes = false;
+    bool alloc_sites = false;
+    const Profile* profile;
+    Program program;
+    Builder* builder = nullptr;
+    std::map<std::string, int> function_ids;
+    std::map<std::string, int> native_ids;
+    std::map<std::string, int> site_ids;
+    // lanes of the SIMD vector a native is declared to return, by native id
+    std::map<int, int> native_lanes;
+    std::map<std::string, int> ctor_ids;
+    std::map<std::string, int> type_ids;
+    // the same type ids by declaration, for types whose name resolved to one
+    std::map<const elaborate::Decl*, int> decl_types;
+    std::map<std::string, int> global_ids;
+    // constructors chosen by ReuseAnalysis, mapped to the register of the cell they may take
+    std::map<const elaborate::Expr*, int> reuse_tokens;
+    // declared return types of functions with a body, by path
+    std::map<std::string, const elaborate::Type*> return_types;
+    // @inline functions, by function id
+    std::map<int, const elaborate::FuncDecl*> inline_funcs;
+    // generators with a body, by path
+    std::map<std::string, const elaborate::FuncDecl*> generator_funcs;
+    // the constructor building an instance of each class, by path
+    std::map<std::string, int> class_ctors;
+    // field names of each class, by type id
+    std::map<int, std::vector<std::string>> class_fields;
+    // constructors of the @soa classes, by type id
+    std::map<int, int> soa_classes;
+    // functions marked @main, by function id
+    std::vector<int> entries;
+    int method_calls = 0;
+    int devirtualized = 0;
+    int inlined_calls = 0;
+    int reordered_switches = 0;
+    int soa_accesses = 0;
+    int generator_loops = 0;
+    int unboxed_calls = 0;
+    std::uint64_t total_calls = 0;
+    MirPassManager mir_passes;
+
+    void declare_decls(
+        const std::vector<std::shared_ptr<elaborate::Decl>>& decls,
+        const std::string& prefix
+    );
+    void declare_extension(const elaborate::ExtensionDecl& decl, const std::string& prefix);
+    void compile_decls(
+        const std::vector<std::shared_ptr<elaborate::Decl>>& decls,
+        const std::string& prefix
+    );
+    void compile_func(const elaborate::FuncDecl& decl, int func);
+    void compile_global(const elaborate::LetDecl& decl, const std::string& prefix);
+    int named_type(const elaborate::Ref& ref, const std::string& ident) const;
+    int resolve_type(const elaborate::Type& type);
+    int method_slot(const std::string& name);
+    void build_method_tables();
+    int field_slot(const std::string& name);
+    void build_field_tables();
+    std::optional<int> find_method(int type, const std::string& name) const;
+    // the type id every value of the expression has, if it is evident without inference
+    std::optional<int> static_type(const elaborate::Expr& expr);
+    // the element class when the value is evidently an array of a @soa class
+    std::optional<int> soa_elements(const elaborate::Expr& expr);
+    std::optional<int> soa_elements(const elaborate::Type& type);
+    // the indexed element when expr reads one from an array of a @soa class
+    const elaborate::IndexExpr* soa_element(const elaborate::Expr& expr);
+
+    Function& current();
+    int emit(Op op, int a = 0, int b = 0, int c = 0);
+    int emit_in(Builder& b, Op op, int a = 0, int b_ = 0, int c = 0);
+    int label();
+    void patch(int instr, int target);
+    int alloc();
+    int alloc_in(Builder& b);
+    int add_const(Value value);
+    int add_string(std::string value);
+    int add_counter(std::string name);
+    int add_site(const Function& func, SourcePos pos);
+    bool is_hot(const std::string& path) const;
+    void bind(const std::string& ident, int reg);
+    std::optional<int> lookup_in(Builder& b, const std::string& ident);
+
+    void compile_value(const elaborate::Value& value, int dest);
+    void compile_lit(const elaborate::Lit& lit, int dest);
+    void compile_expr(const elaborate::Expr& expr, int dest);
+    void compile_unary(const elaborate::UnaryExpr& expr, int dest);
+    void compile_binary(const elaborate::BinaryExpr& expr, int dest);
+    void compile_assign(const elaborate::AssignExpr& expr, int dest);
+    void compile_app(const elaborate::AppExpr& expr, int dest);
+    // a new array hinted as an array of a @soa class gets its columns, false otherwise
+    bool compile_soa_new(const elaborate::Expr& expr, const elaborate::Type& hint, int dest);
+    void compile_lam(
+        const elaborate::LamExpr& expr,
+        int dest,
+        std::optional<std::string> self_name = std::nullopt
+    );
+    void compile_block(const elaborate::BlockExpr& expr, int dest);
+    void compile_stmt(const elaborate::Stmt& stmt);
+    void compile_let_else(const elaborate::LetStmt& stmt, const std::vector<int>& fails);
+    // calls a function whose tuple result a pattern destructures, false if it may not
+    bool compile_tuple_call(
+        const elaborate::Pat& pat,
+        const elaborate::Expr& expr,
+        std::vector<int>& fails
+    );
+    void compile_ite(const elaborate::IteExpr& expr, int dest);
+    void compile_switch(const elaborate::SwitchExpr& expr, int dest);
+    void compile_for(const elaborate::ForExpr& expr, int dest);
+    // runs the body of a generator called as the loop source, false if it may not be
+    bool compile_generator_for(const elaborate::ForExpr& expr, int dest);
+    void compile_yield(const elaborate::YieldExpr& expr, int dest);
+    void compile_try(const elaborate::TryExpr& expr, int dest);
+    void emit_cold_returns();
+    Chain compile_chain(const elaborate::Expr& expr);
+    Cursor compile_cursor(const elaborate::Expr& expr);
+    // a filtered element is skipped by pulling the next one from the same chain
+    Element pull(const Chain& chain, int one, std::vector<int>& exits);
+    int advance(const Cursor& cursor, int one, std::vector<int>& exits);
+    int materialize(Element elem);
+    void bind_element(const elaborate::Pat& pat, Element elem, std::vector<int>& fails);
+    // borrowed elements stay usable after the stage
+    int apply_stage(const Stage& stage, Element elem, bool borrow);
+    void compile_cond(const elaborate::Cond& cond, std::vector<int>& fails);
+    // owned projections move fields out of a scrutinee that dies in the match
+    void compile_pat(
+        const elaborate::Pat& pat,
+        int reg,
+        std::vector<int>& fails,
+        bool owned = false
+    );
+    int compile_args(const std::vector<std::shared_ptr<elaborate::Expr>>& args);
+    // expands an @inline function over arguments already in place, false if it may not be
+    bool compile_inline(int func, int first, int dest);
+};
+
+} // namespace interp
@@ -0,0 +1,146 @@
+#include <algorithm>
+
+#include "interp/heap.hpp"
+
+namespace interp {
+
+namespace {
+
+template<typename F>
+void for_each_child(Object* object, F&& visit) {
+    switch (object->get_kind()) {
+        case Object::Kind::String:
+        case Object::Kind::Simd:
+            break;
+        case Object::Kind::Tuple:
+            for (const auto& elem: static_cast<TupleObject*>(object)->elems) {
+                visit(elem);
+            }
+            break;
+        case Object::Kind::Ctor:
+            for (const auto& arg: static_cast<CtorObject*>(object)->args) {
+                visit(arg);
+            }
+            break;
+        case Object::Kind::Closure:
+            for (const auto& capture: static_cast<ClosureObject*>(object)->captures) {
+                visit(capture);
+            }
+            break;
+        case Object::Kind::Array: {
+            auto* array = static_cast<ArrayObject*>(object);
+            std::for_each(array->data(), array->data() + array->array.len, visit);
+            break;
+        }
+        case Object::Kind::SoaArray: {
+            auto* array = static_cast<SoaArrayObject*>(object);
+            for (int i = 0; i < static_cast<int>(array->columns.size()); ++i) {
+                std::for_each(array->column(i), array->column(i) + array->len, visit);
+            }
+            break;
+        }
+    }
+}
+
+} // namespace
+
+Heap::Heap(std::size_t nursery_limit): nursery_limit(nursery_limit), old_limit(nursery_limit) {}
+
+Heap::~Heap() {
+    for (auto* object: nursery) {
+        destroy(object);
+    }
+    for (auto* object: old) {
+        destroy(object);
+    }
+}
+
+void Heap::destroy(Object* object) {
+    object->~Object();
+    fy_free(object);
+}
+
+void Heap::begin_collection() {
+    start = std::chrono::steady_clock::now();
+    major = old.size() >= old_limit;
+}
+
+void Heap::mark(const Value& value) {
+    if (value.tag == Value::Tag::Object) {
+        mark(value.obj);
+    }
+}
+
+void Heap::mark(Object* object) {
+    // a minor collection treats the whole old generation as live
+    if (!object || object->marked || object->space == Object::Space::Static
+        || (!major && object->space == Object::Space::Old)) {
+        return;
+    }
+    object->marked = true;
+    if (object->space == Object::Space::Stack) {
+        stack_marked.push_back(object);
+    }
+    gray.push_back(object);
+}
+
+void Heap::finish_collection() {
+    if (!major) {
+        for (auto* object: remembered) {
+            for_each_child(object, [&](const Value& value) { mark(value); });
+        }
+    }
+    while (!gray.empty()) {
+        auto* object = gray.back();
+        gray.pop_back();
+        for_each_child(object, [&](const Value& value) { mark(value); });
+    }
+    for (auto* object: remembered) {
+        object->remembered = false;
+    }
+    remembered.clear();
+    // stack objects are traced but never freed or promoted
+    for (auto* object: stack_marked) {
+        object->marked = false;
+    }
+    stack_marked.clear();
+
+    std::size_t freed = 0;
+    // old survivors are unmarked before promotion adds unmarked objects
+    if (major) {
+        std::erase_if(old, [&](Object* object) {
+            if (object->marked) {
+                object->marked = false;
+                return false;
+            }
+            destroy(object);
+            ++freed;
+            return true;
+        });
+    }
+    for (auto* object: nursery) {
+        if (object->marked) {
+            object->marked = false;
+            object->space = Object::Space::Old;
+            old.push_back(object);
+            ++stats.objects_promoted;
+        } else {
+            destroy(object);
+            ++freed;
+        }
+    }
+    nursery.clear();
+    if (major) {
+        old_limit = std::max(nursery_limit, old.size() * 2);
+        ++stats.major_collections;
+    } else {
+        ++stats.minor_collections;
+    }
+    stats.objects_freed += freed;
+
+    auto pause = std::chrono::steady_clock::now() - start;
+    stats.total_pause += pause;
+    stats.max_pause = std::max(stats.max_pause, std::chrono::nanoseconds(pause));
+}
+
+} // namespace interp
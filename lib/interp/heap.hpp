@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+#include "fy_alloc.h"
+#include "interp/bytecode.hpp"
+
+namespace interp {
+
+struct GcStats {
+    std::size_t minor_collections = 0;
+    std::size_t major_collections = 0;
+    std::size_t objects_allocated = 0;
+    std::size_t bytes_allocated = 0;
+    std::size_t objects_promoted = 0;
+    std::size_t objects_freed = 0;
+    // constructors and tuples built in a cell freed by the same match
+    std::size_t objects_reused = 0;
+    std::chrono::nanoseconds total_pause {0};
+    std::chrono::nanoseconds max_pause {0};
+};
+
+// Precise generational collector for VM objects. New objects start in the
+// nursery; a minor collection promotes the reachable ones and frees the rest,
+// and the old generation is only swept by a major collection. Objects never
+// move because natives hold raw pointers to them.
+class Heap {
+public:
+    explicit Heap(std::size_t nursery_limit = 1 << 16);
+    ~Heap();
+
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    template<typename T, typename... Args>
+    T* allocate(Args&&... args) {
+        // size and alignment are static, so the size class is picked at compile time
+        void* memory = fy_alloc(sizeof(T), alignof(T));
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        std::unique_ptr<void, decltype(&fy_free)> guard(memory, &fy_free);
+        auto* result = new (memory) T(std::forward<Args>(args)...);
+        guard.release();
+        result->space = Object::Space::Young;
+        try {
+            nursery.push_back(result);
+        } catch (...) {
+            destroy(result);
+            throw;
+        }
+        ++stats.objects_allocated;
+        stats.bytes_allocated += sizeof(T);
+        return result;
+    }
+
+    bool nursery_full() const {
+        return nursery.size() >= nursery_limit;
+    }
+
+    // Must follow every store of value into an existing object.
+    void write_barrier(Object* target, const Value& value) {
+        if (target->space == Object::Space::Old && !target->remembered
+            && value.tag == Value::Tag::Object && value.obj->space == Object::Space::Young) {
+            target->remembered = true;
+            remembered.push_back(target);
+        }
+    }
+
+    void record_reuse() {
+        ++stats.objects_reused;
+    }
+
+    // A collection marks every root between begin and finish.
+    void begin_collection();
+    void mark(const Value& value);
+    void mark(Object* object);
+    void finish_collection();
+
+    const GcStats& get_stats() const {
+        return stats;
+    }
+
+private:
+    std::vector<Object*> nursery;
+    std::vector<Object*> old;
+    // old objects that may reference the nursery
+    std::vector<Object*> remembered;
+    std::vector<Object*> gray;
+    std::vector<Object*> stack_marked;
+    std::size_t nursery_limit;
+    // a major collection runs once the old generation reaches this size
+    std::size_t old_limit;
+    bool major = false;
+    std::chrono::steady_clock::time_point start;
+    GcStats stats;
+
+    void destroy(Object* object);
+};
+
+} // namespace interp
@@ -0,0 +1,917 @@
+#include <algorithm>
+#include <format>
+#include <set>
+
+#include "interp/mir.hpp"
+
+namespace interp {
+
+namespace {
+
+#define SF_OPCODE_NAME(name) #name,
+const char* const op_names[] = {SF_OPCODES(SF_OPCODE_NAME)};
+#undef SF_OPCODE_NAME
+
+bool is_branch(Op op) {
+    return op == Op::Jump || op == Op::JumpIf || op == Op::JumpIfNot;
+}
+
+// whether b names an instruction, and so a block in the MIR
+bool targets_code(Op op) {
+    return is_branch(op) || op == Op::LoadLabel;
+}
+
+// whether control never continues after the instruction
+bool leaves(Op op) {
+    switch (op) {
+        case Op::Jump:
+        case Op::JumpReg:
+        case Op::Return:
+        case Op::ReturnTuple:
+        case Op::Fail:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void retarget(MirFunction& mir, const std::vector<int>& target) {
+    for (auto& block: mir.blocks) {
+        if (block.next >= 0) {
+            block.next = target[block.next];
+        }
+        for (auto& instr: block.code) {
+            if (targets_code(instr.op)) {
+                instr.b = target[instr.b];
+            }
+        }
+    }
+}
+
+// An edge into an empty block goes straight on to where that block continues.
+bool thread_jumps(MirFunction& mir, const Function&, const Program&) {
+    int count = static_cast<int>(mir.blocks.size());
+    std::vector<int> target(count);
+    bool changed = false;
+    for (int i = 0; i < count; ++i) {
+        int block = i;
+        // bounded, an empty loop jumps to itself forever
+        for (int steps = 0; steps < count; ++steps) {
+            const auto& next = mir.blocks[block];
+            if (!next.code.empty() || next.next < 0) {
+                break;
+            }
+            block = next.next;
+        }
+        target[i] = block;
+        changed = changed || block != i;
+    }
+    if (changed) {
+        retarget(mir, target);
+    }
+    return changed;
+}
+
+// A tuple built only to be returned is returned from its registers instead, so a
+// caller that destructures it never sees the allocation. Threaded jumps make
+// the branches of a trailing if or switch reach the return directly.
+bool unbox_returns(MirFunction& mir, const Function&, const Program&) {
+    bool changed = false;
+    for (auto& block: mir.blocks) {
+        for (std::size_t i = 0; i < block.code.size(); ++i) {
+            auto instr = block.code[i];
+            if (instr.op != Op::MakeTuple && instr.op != Op::ReuseTuple) {
+                continue;
+            }
+            const Instr* ret = nullptr;
+            if (i + 1 < block.code.size()) {
+                ret = &block.code[i + 1];
+            } else if (block.next >= 0 && !mir.blocks[block.next].code.empty()) {
+                ret = &mir.blocks[block.next].code.front();
+            }
+            if (!ret || ret->op != Op::Return || ret->a != instr.a) {
+                continue;
+            }
+            bool reuse = instr.op == Op::ReuseTuple;
+            block.code.resize(i);
+            block.code.push_back(Instr {Op::ReturnTuple, reuse, instr.b, instr.c});
+            block.positions.resize(i + 1);
+            block.next = -1;
+            changed = true;
+            break;
+        }
+    }
+    return changed;
+}
+
+bool remove_dead_blocks(MirFunction& mir, const Function&, const Program&) {
+    int count = static_cast<int>(mir.blocks.size());
+    std::vector<bool> live(count);
+    std::vector<int> work {0};
+    live[0] = true;
+    auto reach = [&](int block) {
+        if (!live[block]) {
+            live[block] = true;
+            work.push_back(block);
+        }
+    };
+    while (!work.empty()) {
+        int block = work.back();
+        work.pop_back();
+        for (int succ: mir_successors(mir, block)) {
+            reach(succ);
+        }
+        // a loaded address stays valid even while no JumpReg is reachable
+        for (const auto& instr: mir.blocks[block].code) {
+            if (instr.op == Op::LoadLabel) {
+                reach(instr.b);
+            }
+        }
+    }
+    if (std::ranges::all_of(live, [](bool reached) { return reached; })) {
+        return false;
+    }
+    std::vector<int> index(count, -1);
+    std::vector<MirBlock> blocks;
+    for (int i = 0; i < count; ++i) {
+        if (live[i]) {
+            index[i] = static_cast<int>(blocks.size());
+            blocks.push_back(std::move(mir.blocks[i]));
+        }
+    }
+    mir.blocks = std::move(blocks);
+    retarget(mir, index);
+    return true;
+}
+
+bool is_object(MirType type) {
+    switch (type) {
+        case MirType::Tuple:
+        case MirType::Ctor:
+        case MirType::Closure:
+        case MirType::Array:
+        case MirType::Simd:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool allocates(Op op) {
+    switch (op) {
+        case Op::MakeTuple:
+        case Op::MakeCtor:
+        case Op::ReuseTuple:
+        case Op::ReuseCtor:
+        case Op::ArrayNew:
+        case Op::SoaNew:
+        case Op::MakeClosure:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// whether the instruction takes over the reference in register reg, which then
+// dies without a drop
+bool moves(const Instr& instr, int reg) {
+    switch (instr.op) {
+        case Op::Move:
+        case Op::StoreGlobal:
+        case Op::MakeTuple:
+        case Op::MakeCtor:
+        case Op::ReuseTuple:
+        case Op::ReuseCtor:
+        case Op::MakeClosure:
+        case Op::StackClosure:
+        case Op::Call:
+        case Op::CallClosure:
+        case Op::CallMethod:
+        case Op::CallNative:
+        case Op::CallTuple:
+            return true;
+        case Op::ArrayPush:
+            return reg == instr.b;
+        case Op::ArraySet:
+        case Op::ArraySetFast:
+        case Op::SetField:
+        case Op::SoaSet:
+            return reg == instr.c;
+        default:
+            return false;
+    }
+}
+
+std::string type_name(MirType type) {
+    switch (type) {
+        case MirType::Unknown:
+            return "?";
+        case MirType::Unit:
+            return "Unit";
+        case MirType::Int:
+            return "Int";
+        case MirType::Bool:
+            return "Bool";
+        case MirType::Char:
+            return "Char";
+        case MirType::String:
+            return "String";
+        case MirType::Tuple:
+            return "Tuple";
+        case MirType::Ctor:
+            return "Ctor";
+        case MirType::Closure:
+            return "Closure";
+        case MirType::Array:
+            return "Array";
+        case MirType::Simd:
+            return "Simd";
+        case MirType::Any:
+            return "Any";
+    }
+    return "?";
+}
+
+MirType join(MirType a, MirType b) {
+    if (a == MirType::Unknown) {
+        return b;
+    }
+    if (b == MirType::Unknown || a == b) {
+        return a;
+    }
+    return MirType::Any;
+}
+
+MirType const_type(const Value& value) {
+    switch (value.tag) {
+        case Value::Tag::Unit:
+            return MirType::Unit;
+        case Value::Tag::Int:
+            return MirType::Int;
+        case Value::Tag::Bool:
+            return MirType::Bool;
+        case Value::Tag::Char:
+            return MirType::Char;
+        case Value::Tag::Object:
+            break;
+    }
+    switch (value.obj->get_kind()) {
+        case Object::Kind::String:
+            return MirType::String;
+        case Object::Kind::Tuple:
+            return MirType::Tuple;
+        case Object::Kind::Ctor:
+            return MirType::Ctor;
+        default:
+            return MirType::Any;
+    }
+}
+
+// arithmetic and comparisons work lane-wise once an operand is a vector
+MirType lane_type(MirType left, MirType right, MirType scalar) {
+    if (left == MirType::Simd || right == MirType::Simd) {
+        return MirType::Simd;
+    }
+    if (left == MirType::Int && right == MirType::Int) {
+        return scalar;
+    }
+    return MirType::Any;
+}
+
+MirType result_type(const Instr& instr, const Function& func, const std::vector<MirType>& regs) {
+    switch (instr.op) {
+        case Op::LoadUnit:
+            return MirType::Unit;
+        case Op::LoadInt:
+        case Op::LoadLabel:
+        case Op::Div:
+        case Op::Mod:
+        case Op::Neg:
+        case Op::ArrayLen:
+        case Op::SimdReduce:
+            return MirType::Int;
+        case Op::LoadBool:
+        case Op::Not:
+        case Op::Eq:
+        case Op::Neq:
+        case Op::IsCtor:
+        case Op::IsOk:
+            return MirType::Bool;
+        case Op::LoadChar:
+            return MirType::Char;
+        case Op::LoadConst:
+            return const_type(func.consts[instr.b]);
+        case Op::Move:
+        case Op::Dup:
+            return regs[instr.b];
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+            return lane_type(regs[instr.b], regs[instr.c], MirType::Int);
+        case Op::Lt:
+        case Op::Gt:
+        case Op::Lte:
+        case Op::Gte:
+            return lane_type(regs[instr.b], regs[instr.c], MirType::Bool);
+        case Op::MakeTuple:
+        case Op::ReuseTuple:
+            return MirType::Tuple;
+        case Op::MakeCtor:
+        case Op::ReuseCtor:
+            return MirType::Ctor;
+        case Op::ArrayNew:
+        case Op::SoaNew:
+            return MirType::Array;
+        case Op::SimdSplat:
+        case Op::SimdLoad:
+        case Op::SimdShuffle:
+        case Op::SimdSelect:
+            return MirType::Simd;
+        case Op::MakeClosure:
+        case Op::StackClosure:
+        case Op::LoadSelf:
+            return MirType::Closure;
+        default:
+            return MirType::Any;
+    }
+}
+
+void transfer(
+    const Instr& instr,
+    const Function& func,
+    const Program& program,
+    std::vector<MirType>& regs
+) {
+    std::vector<int> uses;
+    std::vector<int> defs;
+    mir_operands(instr, func, program, uses, defs);
+    auto type = result_type(instr, func, regs);
+    for (int def: defs) {
+        regs[def] = type;
+    }
+}
+
+// Types of the registers on entry to each block. Parameters are untyped, the
+// bytecode does not keep the declared types.
+std::vector<std::vector<MirType>>
+infer_types(const MirFunction& mir, const Function& func, const Program& program) {
+    int count = static_cast<int>(mir.blocks.size());
+    std::vector<std::vector<MirType>> types(
+        count,
+        std::vector<MirType>(func.num_regs, MirType::Unknown)
+    );
+    std::fill_n(types[0].begin(), std::min(func.arity, func.num_regs), MirType::Any);
+    std::vector<bool> visited(count);
+    std::vector<int> work {0};
+    while (!work.empty()) {
+        int block = work.back();
+        work.pop_back();
+        visited[block] = true;
+        auto regs = types[block];
+        for (const auto& instr: mir.blocks[block].code) {
+            transfer(instr, func, program, regs);
+        }
+        for (int succ: mir_successors(mir, block)) {
+            bool changed = false;
+            for (int reg = 0; reg < func.num_regs; ++reg) {
+                auto type = join(types[succ][reg], regs[reg]);
+                changed = changed || type != types[succ][reg];
+                types[succ][reg] = type;
+            }
+            if ((changed || !visited[succ]) && std::ranges::find(work, succ) == work.end()) {
+                work.push_back(succ);
+            }
+        }
+    }
+    return types;
+}
+
+// Registers live on entry to each block, by the usual backward fixpoint.
+std::vector<std::set<int>>
+live_in(const MirFunction& mir, const Function& func, const Program& program) {
+    int count = static_cast<int>(mir.blocks.size());
+    std::vector<std::set<int>> live(count);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int block = count - 1; block >= 0; --block) {
+            std::set<int> regs;
+            for (int succ: mir_successors(mir, block)) {
+                regs.insert(live[succ].begin(), live[succ].end());
+            }
+            const auto& code = mir.blocks[block].code;
+            for (auto it = code.rbegin(); it != code.rend(); ++it) {
+                std::vector<int> uses;
+                std::vector<int> defs;
+                mir_operands(*it, func, program, uses, defs);
+                for (int def: defs) {
+                    regs.erase(def);
+                }
+                regs.insert(uses.begin(), uses.end());
+            }
+            if (regs != live[block]) {
+                live[block] = std::move(regs);
+                changed = true;
+            }
+        }
+    }
+    return live;
+}
+
+class MirPrinter {
+public:
+    explicit MirPrinter(const Program& program): program(program) {
+        field_names.resize(program.field_slots.size());
+        for (const auto& [name, slot]: program.field_slots) {
+            field_names[slot] = name;
+        }
+    }
+
+    void print_function(const Function& func, std::string& out);
+
+private:
+    const Program& program;
+    std::vector<std::string> field_names;
+
+    std::string immediate(const Instr& instr, const Function& func) const;
+    std::string instruction(const Instr& instr, const Function& func, MirType type) const;
+    void print_drops(
+        const std::vector<int>& regs,
+        const std::vector<MirType>& types,
+        std::string& out
+    ) const;
+};
+
+std::string MirPrinter::immediate(const Instr& instr, const Function& func) const {
+    switch (instr.op) {
+        case Op::LoadInt:
+            return std::format("{}", instr.b);
+        case Op::LoadBool:
+        case Op::LoadChar:
+            return format_value(
+                instr.op == Op::LoadBool ? Value::from_bool(instr.b != 0)
+                                         : Value::from_char(static_cast<char>(instr.b)),
+                program
+            );
+        case Op::LoadConst:
+        case Op::Fail:
+            return format_value(func.consts[instr.b], program);
+        case Op::LoadLabel:
+        case Op::JumpIf:
+        case Op::JumpIfNot:
+            return std::format("bb{}", instr.b);
+        case Op::LoadGlobal:
+        case Op::StoreGlobal:
+            return "@" + program.globals[instr.b];
+        case Op::MakeCtor:
+        case Op::ReuseCtor:
+        case Op::SoaNew:
+            return program.ctors[instr.b].name;
+        case Op::IsCtor:
+            return program.ctors[instr.c].name;
+        case Op::GetElem:
+        case Op::TakeElem:
+        case Op::LoadCapture:
+            return std::format(".{}", instr.op == Op::LoadCapture ? instr.b : instr.c);
+        case Op::GetField:
+        case Op::SoaGet:
+            return "." + field_names[instr.c];
+        case Op::SetField:
+        case Op::SoaSet:
+            return "." + field_names[instr.b];
+        case Op::SimdSplat:
+        case Op::SimdLoad:
+            return std::format("x{}", instr.c);
+        case Op::SimdReduce: {
+            const char* const reductions[] = {"add", "mul", "min", "max"};
+            return reductions[instr.c];
+        }
+        case Op::MakeClosure:
+        case Op::StackClosure:
+        case Op::Call:
+        case Op::CallTuple:
+            return program.functions[instr.b].name;
+        case Op::CallNative:
+            return program.natives[instr.b].name;
+        case Op::CallMethod:
+            return "." + func.caches[instr.b].name;
+        case Op::ReturnTuple:
+            return instr.a ? "reuse" : "";
+        case Op::Count:
+            return static_cast<std::size_t>(instr.b) < program.counters.size()
+                ? std::format("\"{}\"", program.counters[instr.b])
+                : std::format("#{}", instr.b);
+        case Op::Site:
+            return std::format("\"{}\"", program.alloc_sites[instr.b]);
+        default:
+            return "";
+    }
+}
+
+std::string
+MirPrinter::instruction(const Instr& instr, const Function& func, MirType type) const {
+    std::vector<int> uses;
+    std::vector<int> defs;
+    mir_operands(instr, func, program, uses, defs);
+    std::string result;
+    for (std::size_t i = 0; i < defs.size(); ++i) {
+        result += std::format("{}r{}", i > 0 ? ", " : "", defs[i]);
+    }
+    if (!defs.empty()) {
+        result += std::format(": {} = ", type_name(type));
+    }
+    if (allocates(instr.op)) {
+        result += "alloc ";
+    }
+    result += op_names[static_cast<int>(instr.op)];
+    std::vector<std::string> operands;
+    auto imm = immediate(instr, func);
+    if (!imm.empty()) {
+        operands.push_back(std::move(imm));
+    }
+    for (int use: uses) {
+        operands.push_back(std::format("r{}", use));
+    }
+    for (std::size_t i = 0; i < operands.size(); ++i) {
+        result += (i > 0 ? ", " : " ") + operands[i];
+    }
+    return result;
+}
+
+void MirPrinter::print_drops(
+    const std::vector<int>& regs,
+    const std::vector<MirType>& types,
+    std::string& out
+) const {
+    for (int reg: regs) {
+        if (is_object(types[reg])) {
+            out += std::format("    drop r{}\n", reg);
+        }
+    }
+}
+
+void MirPrinter::print_function(const Function& func, std::string& out) {
+    auto mir = build_mir(func);
+    out += std::format(
+        "func {}({} params, {} regs) {{\n",
+        func.name,
+        func.arity,
+        func.num_regs
+    );
+    auto types = infer_types(mir, func, program);
+    auto live = live_in(mir, func, program);
+    int count = static_cast<int>(mir.blocks.size());
+    std::vector<std::set<int>> live_out_preds(count);
+    for (int block = 0; block < count; ++block) {
+        auto succs = mir_successors(mir, block);
+        for (int succ: succs) {
+            for (int other: succs) {
+                live_out_preds[succ].insert(live[other].begin(), live[other].end());
+            }
+        }
+    }
+    for (int block = 0; block < count; ++block) {
+        const auto& code = mir.blocks[block].code;
+        out += std::format("bb{}:\n", block);
+        // live along another edge out of a predecessor, but not into this block
+        std::vector<int> dead;
+        std::ranges::set_difference(live_out_preds[block], live[block], std::back_inserter(dead));
+        auto regs = types[block];
+        print_drops(dead, regs, out);
+
+        // registers live after each instruction, walking back from the block's exit
+        std::vector<std::set<int>> live_after(code.size());
+        std::set<int> current;
+        for (int succ: mir_successors(mir, block)) {
+            current.insert(live[succ].begin(), live[succ].end());
+        }
+        for (std::size_t i = code.size(); i-- > 0;) {
+            live_after[i] = current;
+            std::vector<int> uses;
+            std::vector<int> defs;
+            mir_operands(code[i], func, program, uses, defs);
+            for (int def: defs) {
+                current.erase(def);
+            }
+            current.insert(uses.begin(), uses.end());
+        }
+
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            const auto& instr = code[i];
+            transfer(instr, func, program, regs);
+            std::vector<int> uses;
+            std::vector<int> defs;
+            mir_operands(instr, func, program, uses, defs);
+            auto type = defs.empty() ? MirType::Unknown : regs[defs[0]];
+            out += std::format("    {}\n", instruction(instr, func, type));
+            if (leaves(instr.op)) {
+                continue;
+            }
+            std::set<int> touched(defs.begin(), defs.end());
+            for (int use: uses) {
+                if (!moves(instr, use)) {
+                    touched.insert(use);
+                }
+            }
+            std::vector<int> dying;
+            std::ranges::set_difference(touched, live_after[i], std::back_inserter(dying));
+            print_drops(dying, regs, out);
+        }
+        if (mir.blocks[block].next >= 0) {
+            out += std::format("    Jump bb{}\n", mir.blocks[block].next);
+        }
+    }
+    out += "}\n";
+}
+
+} // namespace
+
+MirFunction build_mir(const Function& func) {
+    MirFunction mir;
+    const auto& code = func.code;
+    int size = static_cast<int>(code.size());
+    if (size == 0) {
+        return mir;
+    }
+    std::vector<bool> leaders(size + 1);
+    leaders[0] = true;
+    bool targets_end = false;
+    for (int i = 0; i < size; ++i) {
+        const auto& instr = code[i];
+        if (targets_code(instr.op)) {
+            leaders[instr.b] = true;
+            targets_end = targets_end || instr.b == size;
+        }
+        if (is_branch(instr.op) || leaves(instr.op)) {
+            leaders[i + 1] = true;
+        }
+    }
+    // a jump past the last instruction lands in an empty block of its own
+    std::vector<int> block_of(size + 1, -1);
+    int count = 0;
+    for (int i = 0; i < size; ++i) {
+        count += leaders[i];
+        block_of[i] = count - 1;
+    }
+    if (targets_end) {
+        block_of[size] = count++;
+    }
+    mir.blocks.resize(count);
+    auto row = func.lines.begin();
+    SourcePos pos;
+    for (int i = 0; i < size; ++i) {
+        for (; row != func.lines.end() && row->pc <= i; ++row) {
+            pos = row->pos;
+        }
+        auto instr = code[i];
+        auto& block = mir.blocks[block_of[i]];
+        if (targets_code(instr.op)) {
+            instr.b = block_of[instr.b];
+        }
+        if (instr.op == Op::Jump) {
+            block.next = instr.b;
+            continue;
+        }
+        block.code.push_back(instr);
+        block.positions.push_back(pos);
+        if (!leaves(instr.op) && leaders[i + 1]) {
+            block.next = block_of[i + 1];
+        }
+    }
+    return mir;
+}
+
+void lower_mir(const MirFunction& mir, Function& func) {
+    int count = static_cast<int>(mir.blocks.size());
+    auto jumps = [&](int block) {
+        int next = mir.blocks[block].next;
+        return next >= 0 && next != block + 1;
+    };
+    std::vector<int> start(count);
+    int size = 0;
+    for (int block = 0; block < count; ++block) {
+        start[block] = size;
+        size += static_cast<int>(mir.blocks[block].code.size()) + jumps(block);
+    }
+    func.code.clear();
+    func.code.reserve(size);
+    func.lines.clear();
+    auto emit = [&](Instr instr, SourcePos pos) {
+        if (func.lines.empty() || func.lines.back().pos != pos) {
+            func.lines.push_back(LineEntry {static_cast<int>(func.code.size()), pos});
+        }
+        func.code.push_back(instr);
+    };
+    SourcePos pos;
+    for (int block = 0; block < count; ++block) {
+        const auto& code = mir.blocks[block].code;
+        for (std::size_t i = 0; i < code.size(); ++i) {
+            auto instr = code[i];
+            if (targets_code(instr.op)) {
+                instr.b = start[instr.b];
+            }
+            pos = mir.blocks[block].positions[i];
+            emit(instr, pos);
+        }
+        // a jump out of a block belongs to its last instruction
+        if (jumps(block)) {
+            emit(Instr {Op::Jump, 0, start[mir.blocks[block].next]}, pos);
+        }
+    }
+}
+
+std::vector<int> mir_successors(const MirFunction& mir, int block) {
+    std::vector<int> result;
+    const auto& code = mir.blocks[block].code;
+    if (!code.empty() && (code.back().op == Op::JumpIf || code.back().op == Op::JumpIfNot)) {
+        result.push_back(code.back().b);
+    } else if (!code.empty() && code.back().op == Op::JumpReg) {
+        for (const auto& other: mir.blocks) {
+            for (const auto& instr: other.code) {
+                bool label = instr.op == Op::LoadLabel;
+                if (label && std::ranges::find(result, instr.b) == result.end()) {
+                    result.push_back(instr.b);
+                }
+            }
+        }
+    }
+    int next = mir.blocks[block].next;
+    if (next >= 0 && std::ranges::find(result, next) == result.end()) {
+        result.push_back(next);
+    }
+    return result;
+}
+
+void mir_operands(
+    const Instr& instr,
+    const Function& func,
+    const Program& program,
+    std::vector<int>& uses,
+    std::vector<int>& defs
+) {
+    auto use_range = [&](int first, int count) {
+        for (int i = 0; i < count; ++i) {
+            uses.push_back(first + i);
+        }
+    };
+    switch (instr.op) {
+        case Op::Nop:
+        case Op::Jump:
+        case Op::Count:
+        case Op::Probe:
+        case Op::Site:
+        case Op::Fail:
+            return;
+        case Op::StoreGlobal:
+        case Op::JumpIf:
+        case Op::JumpIfNot:
+        case Op::JumpReg:
+        case Op::Return:
+            uses.push_back(instr.a);
+            return;
+        case Op::ArrayPush:
+            uses.insert(uses.end(), {instr.a, instr.b});
+            return;
+        case Op::ArraySet:
+        case Op::ArraySetFast:
+        case Op::SimdStore:
+            uses.insert(uses.end(), {instr.a, instr.b, instr.c});
+            return;
+        case Op::SetField:
+            uses.insert(uses.end(), {instr.a, instr.c});
+            return;
+        case Op::SoaSet:
+            uses.insert(uses.end(), {instr.a, instr.a + 1, instr.c});
+            return;
+        case Op::ReturnTuple:
+            use_range(instr.b, instr.c);
+            return;
+        case Op::CallTuple:
+            use_range(instr.a + instr.c, program.functions[instr.b].arity);
+            for (int i = 0; i < instr.c; ++i) {
+                defs.push_back(instr.a + i);
+            }
+            return;
+        default:
+            break;
+    }
+    defs.push_back(instr.a);
+    switch (instr.op) {
+        case Op::Move:
+        case Op::Dup:
+        case Op::Neg:
+        case Op::Not:
+        case Op::IsCtor:
+        case Op::IsOk:
+        case Op::GetElem:
+        case Op::TakeElem:
+        case Op::ArrayNew:
+        case Op::ArrayLen:
+        case Op::GetField:
+        case Op::SimdSplat:
+        case Op::SimdReduce:
+            uses.push_back(instr.b);
+            break;
+        case Op::Add:
+        case Op::Sub:
+        case Op::Mul:
+        case Op::Div:
+        case Op::Mod:
+        case Op::Eq:
+        case Op::Neq:
+        case Op::Lt:
+        case Op::Gt:
+        case Op::Lte:
+        case Op::Gte:
+        case Op::ArrayGet:
+        case Op::ArrayGetFast:
+        case Op::SimdShuffle:
+            uses.insert(uses.end(), {instr.b, instr.c});
+            break;
+        case Op::SoaNew:
+            uses.push_back(instr.c);
+            break;
+        case Op::SoaGet:
+        case Op::SimdLoad:
+            use_range(instr.b, 2);
+            break;
+        case Op::SimdSelect:
+            use_range(instr.b, 3);
+            break;
+        case Op::MakeTuple:
+            use_range(instr.b, instr.c);
+            break;
+        case Op::ReuseTuple:
+            use_range(instr.b, instr.c + 1);
+            break;
+        case Op::MakeCtor:
+            use_range(instr.c, program.ctors[instr.b].arity);
+            break;
+        case Op::ReuseCtor:
+            use_range(instr.c, program.ctors[instr.b].arity + 1);
+            break;
+        case Op::MakeClosure:
+        case Op::StackClosure:
+            use_range(instr.c, program.functions[instr.b].num_captures);
+            break;
+        case Op::Call:
+            use_range(instr.c, program.functions[instr.b].arity);
+            break;
+        case Op::CallClosure:
+            use_range(instr.b, instr.c + 1);
+            break;
+        case Op::CallMethod:
+            use_range(instr.c, func.caches[instr.b].argc);
+            break;
+        case Op::CallNative:
+            use_range(instr.c, program.natives[instr.b].arity);
+            break;
+        default:
+            break;
+    }
+}
+
+std::string dump_mir(const Program& program) {
+    MirPrinter printer(program);
+    std::string out;
+    for (const auto& func: program.functions) {
+        if (!func.code.empty()) {
+            printer.print_function(func, out);
+        }
+    }
+    return out;
+}
+
+MirPassManager::MirPassManager() {
+    add("thread-jumps", thread_jumps);
+    add("unbox-returns", unbox_returns);
+    add("remove-dead-blocks", remove_dead_blocks);
+}
+
+void MirPassManager::add(std::string name, Pass pass) {
+    passes.push_back(Entry {std::move(name), std::move(pass)});
+}
+
+void MirPassManager::run(Program& program) {
+    for (auto& func: program.functions) {
+        if (func.code.empty()) {
+            continue;
+        }
+        auto mir = build_mir(func);
+        for (auto& entry: passes) {
+            entry.changes += entry.pass(mir, func, program);
+        }
+        // laying the blocks out again also drops jumps to the next instruction
+        lower_mir(mir, func);
+    }
+}
+
+std::vector<std::pair<std::string, int>> MirPassManager::get_changes() const {
+    std::vector<std::pair<std::string, int>> result;
+    for (const auto& entry: passes) {
+        result.emplace_back(entry.name, entry.changes);
+    }
+    return result;
+}
+
+} // namespace interp
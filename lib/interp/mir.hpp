@@ -0,0 +1,87 @@
+#pragma once
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "interp/bytecode.hpp"
+
+namespace interp {
+
+// The mid-level IR: the bytecode of a function cut into basic blocks, which
+// the passes below rewrite before it is laid out as bytecode again. Branch
+// targets and the code addresses loaded by LoadLabel name blocks instead of
+// instructions, and an unconditional jump is only the edge to `next`.
+struct MirBlock {
+    std::vector<Instr> code;
+    // the source position of each instruction, for the line table
+    std::vector<SourcePos> positions;
+    // the block control continues in after the last instruction, -1 once it has left
+    int next = -1;
+};
+
+struct MirFunction {
+    // blocks[0] is the entry
+    std::vector<MirBlock> blocks;
+};
+
+// What a register holds, inferred forward from the instructions defining it.
+// Registers are reused, so the type is only that of one definition.
+enum class MirType {
+    Unknown,
+    Unit,
+    Int,
+    Bool,
+    Char,
+    String,
+    Tuple,
+    Ctor,
+    Closure,
+    Array,
+    Simd,
+    Any,
+};
+
+MirFunction build_mir(const Function& func);
+// lays the blocks out in order, with a jump wherever `next` is not the following block
+void lower_mir(const MirFunction& mir, Function& func);
+// JumpReg may continue in any block whose address the function loads
+std::vector<int> mir_successors(const MirFunction& mir, int block);
+// the registers an instruction reads and the ones it writes
+void mir_operands(
+    const Instr& instr,
+    const Function& func,
+    const Program& program,
+    std::vector<int>& uses,
+    std::vector<int>& defs
+);
+// Every function of the program with the type of each definition, the
+// instructions allocating and a drop where an object register dies.
+std::string dump_mir(const Program& program);
+
+class MirPassManager {
+public:
+    // a pass returns whether it changed the function
+    using Pass = std::function<bool(MirFunction&, const Function&, const Program&)>;
+
+    // jump threading, tuple return unboxing and dead block removal
+    MirPassManager();
+
+    void add(std::string name, Pass pass);
+    void run(Program& program);
+
+    // the number of functions each pass changed, in pipeline order
+    std::vector<std::pair<std::string, int>> get_changes() const;
+
+private:
+    struct Entry {
+        std::string name;
+        Pass pass;
+        int changes = 0;
+    };
+
+    std::vector<Entry> passes;
+};
+
+} // namespace interp
@@ -0,0 +1,142 @@
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include "interp/profile.hpp"
+
+namespace interp {
+
+Profile Profile::load(const std::string& filename) {
+    std::ifstream file(filename);
+    if (!file) {
+        throw std::runtime_error(std::format("Could not open profile: {}", filename));
+    }
+    Profile profile;
+    std::string line;
+    int number = 0;
+    while (std::getline(file, line)) {
+        ++number;
+        if (line.empty() || line.starts_with('#')) {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string kind;
+        std::uint64_t value;
+        std::string name;
+        fields >> kind >> value;
+        fields.ignore(1);
+        std::getline(fields, name);
+        if (!fields || name.empty() || (kind != "count" && kind != "size")) {
+            throw std::runtime_error(
+                std::format("Malformed profile line {} in {}", number, filename)
+            );
+        }
+        if (kind == "count") {
+            profile.counts[name] += value;
+        } else {
+            profile.sizes[name] = static_cast<int>(value);
+        }
+    }
+    return profile;
+}
+
+void Profile::save(const std::string& filename) const {
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error(std::format("Could not write profile: {}", filename));
+    }
+    file << "# sf profile\n";
+    for (const auto& [name, count]: counts) {
+        file << std::format("count {} {}\n", count, name);
+    }
+    for (const auto& [name, size]: sizes) {
+        file << std::format("size {} {}\n", size, name);
+    }
+}
+
+std::uint64_t Profile::total_calls() const {
+    std::uint64_t total = 0;
+    for (const auto& [name, count]: counts) {
+        if (name.starts_with("call ")) {
+            total += count;
+        }
+    }
+    return total;
+}
+
+Profile make_profile(const Program& program, const std::vector<std::uint64_t>& counts) {
+    Profile profile;
+    for (size_t i = 0; i < program.counters.size(); ++i) {
+        profile.counts[program.counters[i]] += counts[i];
+    }
+    for (const auto& func: program.functions) {
+        // lambdas and the initializer have no stable name
+        if (!func.name.starts_with('<')) {
+            profile.sizes[func.name] = static_cast<int>(func.code.size());
+        }
+    }
+    return profile;
+}
+
+std::string format_probes(const Program& program, const std::vector<ProbeStats>& stats) {
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        if (stats[i].calls > 0) {
+            order.push_back(i);
+        }
+    }
+    std::ranges::stable_sort(order, std::ranges::greater {}, [&](std::size_t i) {
+        return stats[i].exclusive;
+    });
+    std::string result =
+        std::format("{:>12} {:>16} {:>16}  {}\n", "calls", "inclusive", "exclusive", "function");
+    for (auto i: order) {
+        result += std::format(
+            "{:>12} {:>16} {:>16}  {}\n",
+            stats[i].calls,
+            stats[i].inclusive,
+            stats[i].exclusive,
+            program.functions[i].name
+        );
+    }
+    return result;
+}
+
+std::string format_alloc_sites(const Program& program, const std::vector<AllocStats>& stats) {
+    std::vector<std::size_t> order;
+    for (std::size_t i = 0; i < stats.size(); ++i) {
+        if (stats[i].objects > 0) {
+            order.push_back(i);
+        }
+    }
+    std::ranges::stable_sort(order, std::ranges::greater {}, [&](std::size_t i) {
+        return stats[i].bytes;
+    });
+    std::string result = std::format("{:>14} {:>12}  {}\n", "bytes", "objects", "site");
+    for (auto i: order) {
+        result += std::format(
+            "{:>14} {:>12}  {}\n",
+            stats[i].bytes,
+            stats[i].objects,
+            i < program.alloc_sites.size() ? program.alloc_sites[i] : "<untagged>"
+        );
+    }
+    return result;
+}
+
+void save_samples(
+    const std::map<std::string, std::uint64_t>& samples,
+    const std::string& filename
+) {
+    std::ofstream file(filename);
+    if (!file) {
+        throw std::runtime_error(std::format("Could not write profile: {}", filename));
+    }
+    for (const auto& [stack, count]: samples) {
+        file << std::format("{} {}\n", stack, count);
+    }
+}
+
+} // namespace interp
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "interp/bytecode.hpp"
+
+namespace interp {
+
+// Execution counts of an instrumented run. Counters are named after function
+// paths and source spans, so a profile stays usable as long as the source it
+// was recorded from is unchanged.
+struct Profile {
+    // "call <path>" counts function entries, "clause <span> <i>" counts the
+    // times clause i of the switch at span was taken and "field <name>" counts
+    // reads and writes of class fields with that name
+    std::map<std::string, std::uint64_t> counts;
+    // bytecode size of each named function when it was instrumented
+    std::map<std::string, int> sizes;
+
+    static Profile load(const std::string& filename);
+    void save(const std::string& filename) const;
+
+    std::uint64_t count(const std::string& counter) const {
+        auto it = counts.find(counter);
+        return it == counts.end() ? 0 : it->second;
+    }
+
+    std::uint64_t total_calls() const;
+};
+
+Profile make_profile(const Program& program, const std::vector<std::uint64_t>& counts);
+
+// Totals of one function over a run with probes. Cycles are timestamp counter
+// ticks; inclusive time counts recursive calls once, exclusive time leaves out
+// the probed functions it called.
+struct ProbeStats {
+    std::uint64_t calls = 0;
+    std::uint64_t inclusive = 0;
+    std::uint64_t exclusive = 0;
+};
+
+// A table of the probed functions, most exclusive cycles first.
+std::string format_probes(const Program& program, const std::vector<ProbeStats>& stats);
+
+// Objects allocated at one site. With sampling, each recorded allocation
+// stands for the whole sampling interval.
+struct AllocStats {
+    std::uint64_t objects = 0;
+    std::uint64_t bytes = 0;
+};
+
+// A table of the allocation sites, most bytes first. stats has a last entry for
+// allocations no Site tagged.
+std::string format_alloc_sites(const Program& program, const std::vector<AllocStats>& stats);
+
+// Writes sampled call stacks one per line as "<frame>;<frame> <samples>", the
+// input of flamegraph.pl and similar tools.
+void save_samples(const std::map<std::string, std::uint64_t>& samples, const std::string& filename);
+
+} // namespace interp
@@ -0,0 +1,1521 @@
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "interp/vm.hpp"
+
+namespace interp {
+
+namespace {
+
+Value native_print(VM& vm, const Value* args) {
+    if (args[0].tag == Value::Tag::Object && args[0].obj->get_kind() == Object::Kind::String) {
+        vm.get_out() << static_cast<const StringObject*>(args[0].obj)->value;
+    } else {
+        vm.get_out() << format_value(args[0], vm.get_program());
+    }
+    return Value::unit();
+}
+
+Value native_println(VM& vm, const Value* args) {
+    native_print(vm, args);
+    vm.get_out() << '\n';
+    return Value::unit();
+}
+
+// Marks a value whose reference is being duplicated.
+void share(const Value& value) {
+    if (value.tag == Value::Tag::Object) {
+        value.obj->shared = true;
+    }
+}
+
+std::vector<Value>* fields_of(const Value& value) {
+    if (value.tag != Value::Tag::Object) {
+        return nullptr;
+    }
+    if (value.obj->get_kind() == Object::Kind::Tuple) {
+        return &static_cast<TupleObject*>(value.obj)->elems;
+    }
+    if (value.obj->get_kind() == Object::Kind::Ctor) {
+        return &static_cast<CtorObject*>(value.obj)->args;
+    }
+    return nullptr;
+}
+
+// A cell can be rebuilt in place when no other reference to it was ever made.
+bool reusable(const Value& value, Object::Kind kind) {
+    return value.tag == Value::Tag::Object && value.obj->get_kind() == kind
+        && !value.obj->shared && value.obj->space != Object::Space::Static;
+}
+
+ArrayObject* expect_array(const Value& value) {
+    if (value.tag != Value::Tag::Object || value.obj->get_kind() != Object::Kind::Array) {
+        throw std::runtime_error("Expected an array");
+    }
+    return static_cast<ArrayObject*>(value.obj);
+}
+
+SoaArrayObject* as_soa(const Value& value) {
+    if (value.tag != Value::Tag::Object || value.obj->get_kind() != Object::Kind::SoaArray) {
+        return nullptr;
+    }
+    return static_cast<SoaArrayObject*>(value.obj);
+}
+
+std::size_t checked_index(const Value& index, std::size_t len) {
+    if (index.tag != Value::Tag::Int || index.i < 0 || static_cast<std::size_t>(index.i) >= len) {
+        throw std::runtime_error(
+            std::format("Array index {} out of bounds for length {}", index.i, len)
+        );
+    }
+    return static_cast<std::size_t>(index.i);
+}
+
+Value* checked_elem(const Value& array, const Value& index) {
+    auto* object = expect_array(array);
+    return object->data() + checked_index(index, object->array.len);
+}
+
+SimdObject* as_simd(const Value& value) {
+    if (value.tag != Value::Tag::Object || value.obj->get_kind() != Object::Kind::Simd) {
+        return nullptr;
+    }
+    return static_cast<SimdObject*>(value.obj);
+}
+
+Value simd_lane(const SimdObject* simd, int lane) {
+    return simd->mask ? Value::from_bool(simd->elems[lane] != 0)
+                      : Value::from_int(simd->elems[lane]);
+}
+
+// Instances of a @soa class are values in every array, not only in the @soa
+// arrays storing them in columns, so ordinary arrays copy them in and out.
+bool is_soa_instance(const VM& vm, const Value& value) {
+    return value.tag == Value::Tag::Object && value.obj->get_kind() == Object::Kind::Ctor
+        && vm.get_program().ctors[static_cast<const CtorObject*>(value.obj)->ctor].soa;
+}
+
+Value copy_instance(VM& vm, const Value& value) {
+    const auto* instance = static_cast<const CtorObject*>(value.obj);
+    for (const auto& field: instance->args) {
+        share(field);
+    }
+    return Value::from_obj(vm.allocate<CtorObject>(instance->ctor, instance->args));
+}
+
+// An element of a @soa array is gathered from its columns into a new instance.
+Value array_get(VM& vm, const Value& array, const Value& index) {
+    if (auto* soa = as_soa(array)) {
+        auto i = checked_index(index, soa->len);
+        std::vector<Value> fields;
+        for (int field = 0; field < static_cast<int>(soa->columns.size()); ++field) {
+            fields.push_back(soa->column(field)[i]);
+            share(fields.back());
+        }
+        return Value::from_obj(vm.allocate<CtorObject>(soa->ctor, std::move(fields)));
+    }
+    if (const auto* simd = as_simd(array)) {
+        return simd_lane(simd, static_cast<int>(checked_index(index, simd->lanes)));
+    }
+    Value result = *checked_elem(array, index);
+    if (is_soa_instance(vm, result)) {
+        return copy_instance(vm, result);
+    }
+    share(result);
+    return result;
+}
+
+// Hands the elements of a tuple returned to CallTuple to the caller's registers.
+void unbox_tuple(const Value& tuple, int count, Value* regs, const std::string& callee) {
+    bool is_tuple = tuple.tag == Value::Tag::Object && tuple.obj->get_kind() == Object::Kind::Tuple;
+    const auto* elems = is_tuple ? &static_cast<TupleObject*>(tuple.obj)->elems : nullptr;
+    if (!elems || elems->size() != static_cast<std::size_t>(count)) {
+        throw std::runtime_error(
+            std::format("Expected a tuple of {} values from {}", count, callee)
+        );
+    }
+    for (int i = 0; i < count; ++i) {
+        regs[i] = (*elems)[i];
+        share(regs[i]);
+    }
+}
+
+void array_push(VM& vm, const Value& array, const Value& value) {
+    auto* elems = expect_array(array);
+    Value stored = is_soa_instance(vm, value) ? copy_instance(vm, value) : value;
+    if (fy_array_push(&elems->array, &stored) != 0) {
+        throw std::bad_alloc();
+    }
+    vm.write_barrier(array.obj, stored);
+}
+
+// Storing into a @soa array scatters the fields of the instance over the columns.
+void array_set(VM& vm, const Value& array, const Value& index, const Value& value) {
+    auto* soa = as_soa(array);
+    if (!soa && !is_soa_instance(vm, value)) {
+        *checked_elem(array, index) = value;
+        vm.write_barrier(array.obj, value);
+        return;
+    }
+    if (!soa) {
+        auto* elem = checked_elem(array, index);
+        const auto* instance = static_cast<const CtorObject*>(value.obj);
+        if (!is_soa_instance(vm, *elem)
+            || static_cast<CtorObject*>(elem->obj)->ctor != instance->ctor) {
+            *elem = copy_instance(vm, value);
+            vm.write_barrier(array.obj, *elem);
+            return;
+        }
+        // no one else sees the copy the array holds, so it is overwritten in place
+        auto* owned = static_cast<CtorObject*>(elem->obj);
+        owned->args = instance->args;
+        for (const auto& field: owned->args) {
+            share(field);
+            vm.write_barrier(owned, field);
+        }
+        return;
+    }
+    auto i = checked_index(index, soa->len);
+    if (value.tag != Value::Tag::Object || value.obj->get_kind() != Object::Kind::Ctor
+        || static_cast<const CtorObject*>(value.obj)->ctor != soa->ctor) {
+        throw std::runtime_error(std::format(
+            "Expected a {} to store in a @soa array",
+            vm.get_program().ctors[soa->ctor].name
+        ));
+    }
+    const auto& fields = static_cast<const CtorObject*>(value.obj)->args;
+    for (int field = 0; field < static_cast<int>(fields.size()); ++field) {
+        soa->column(field)[i] = fields[field];
+        share(fields[field]);
+        vm.write_barrier(soa, fields[field]);
+    }
+}
+
+SimdObject* expect_simd(const Value& value) {
+    auto* simd = as_simd(value);
+    if (!simd) {
+        throw std::runtime_error("Expected a SIMD vector");
+    }
+    return simd;
+}
+
+void check_lanes(const SimdObject* left, const SimdObject* right) {
+    if (left->lanes != right->lanes) {
+        throw std::runtime_error(
+            std::format("SIMD vectors of {} and {} lanes do not match", left->lanes, right->lanes)
+        );
+    }
+}
+
+std::int64_t lane_value(const Value& value) {
+    if (value.tag != Value::Tag::Int && value.tag != Value::Tag::Bool) {
+        throw std::runtime_error("SIMD lanes must be Int or Bool");
+    }
+    return value.i;
+}
+
+// The lanes from start on must lie within an array of length len.
+std::size_t checked_range(const Value& start, int lanes, std::size_t len) {
+    if (start.tag != Value::Tag::Int || start.i < 0
+        || static_cast<std::size_t>(start.i) + lanes > len) {
+        throw std::runtime_error(std::format(
+            "Lanes {} to {} out of bounds for length {}",
+            start.i,
+            start.i + lanes - 1,
+            len
+        ));
+    }
+    return static_cast<std::size_t>(start.i);
+}
+
+// Lane-wise arithmetic and comparison, an Int operand is broadcast to every lane.
+Value simd_binary(VM& vm, Op op, const Value& left, const Value& right) {
+    const auto* l = as_simd(left);
+    const auto* r = as_simd(right);
+    if ((!l && !r) || (!l && left.tag != Value::Tag::Int)
+        || (!r && right.tag != Value::Tag::Int)) {
+        throw std::runtime_error("Expected an integer or a SIMD vector");
+    }
+    if (l && r) {
+        check_lanes(l, r);
+    }
+    std::array<std::int64_t, SimdObject::max_lanes> splat;
+    splat.fill(l ? right.i : left.i);
+    const auto& a = l ? l->elems : splat;
+    const auto& b = r ? r->elems : splat;
+    int lanes = l ? l->lanes : r->lanes;
+
+    bool compare = op == Op::Lt || op == Op::Gt || op == Op::Lte || op == Op::Gte;
+    auto* result = vm.allocate<SimdObject>(lanes, compare);
+    auto apply = [&](auto f) {
+        for (int i = 0; i < SimdObject::max_lanes; ++i) {
+            result->elems[i] = f(a[i], b[i]);
+        }
+    };
+    switch (op) {
+        case Op::Add:
+            apply(std::plus<> {});
+            break;
+        case Op::Sub:
+            apply(std::minus<> {});
+            break;
+        case Op::Mul:
+            apply(std::multiplies<> {});
+            break;
+        case Op::Lt:
+            apply(std::less<> {});
+            break;
+        case Op::Gt:
+            apply(std::greater<> {});
+            break;
+        case Op::Lte:
+            apply(std::less_equal<> {});
+            break;
+        case Op::Gte:
+            apply(std::greater_equal<> {});
+            break;
+        default:
+            throw std::runtime_error("Unsupported SIMD operation");
+    }
+    // a broadcast or a comparison of the zero tail must not leave lanes set
+    std::fill(result->elems.begin() + lanes, result->elems.end(), 0);
+    return Value::from_obj(result);
+}
+
+Value simd_splat(VM& vm, const Value& value, int lanes) {
+    auto lane = lane_value(value);
+    auto* result = vm.allocate<SimdObject>(lanes, value.tag == Value::Tag::Bool);
+    std::fill(result->elems.begin(), result->elems.begin() + lanes, lane);
+    return Value::from_obj(result);
+}
+
+Value simd_load(VM& vm, const Value& array, const Value& start, int lanes) {
+    const auto* object = expect_array(array);
+    const auto* elems = object->data() + checked_range(start, lanes, object->array.len);
+    auto* result = vm.allocate<SimdObject>(lanes, elems[0].tag == Value::Tag::Bool);
+    for (int i = 0; i < lanes; ++i) {
+        result->elems[i] = lane_value(elems[i]);
+    }
+    return Value::from_obj(result);
+}
+
+void simd_store(const Value& array, const Value& start, const Value& vector) {
+    auto* object = expect_array(array);
+    const auto* simd = expect_simd(vector);
+    auto* elems = object->data() + checked_range(start, simd->lanes, object->array.len);
+    for (int i = 0; i < simd->lanes; ++i) {
+        elems[i] = simd_lane(simd, i);
+    }
+}
+
+// Lane i of the result is lane indices[i] of vector, as wide as indices.
+Value simd_shuffle(VM& vm, const Value& vector, const Value& indices) {
+    const auto* simd = expect_simd(vector);
+    const auto* index = expect_simd(indices);
+    auto* result = vm.allocate<SimdObject>(index->lanes, simd->mask);
+    for (int i = 0; i < index->lanes; ++i) {
+        auto lane = index->elems[i];
+        if (index->mask || lane < 0 || lane >= simd->lanes) {
+            throw std::runtime_error(
+                std::format("Shuffle lane {} out of range for {} lanes", lane, simd->lanes)
+            );
+        }
+        result->elems[i] = simd->elems[lane];
+    }
+    return Value::from_obj(result);
+}
+
+Value simd_select(VM& vm, const Value* args) {
+    const auto* mask = expect_simd(args[0]);
+    const auto* then = expect_simd(args[1]);
+    const auto* otherwise = expect_simd(args[2]);
+    if (!mask->mask) {
+        throw std::runtime_error("Expected a Bool vector to select with");
+    }
+    check_lanes(mask, then);
+    check_lanes(then, otherwise);
+    auto* result = vm.allocate<SimdObject>(mask->lanes, then->mask && otherwise->mask);
+    for (int i = 0; i < SimdObject::max_lanes; ++i) {
+        result->elems[i] = mask->elems[i] != 0 ? then->elems[i] : otherwise->elems[i];
+    }
+    return Value::from_obj(result);
+}
+
+// Min and Max of a Bool vector tell whether all or any of its lanes are set.
+Value simd_reduce(const Value& vector, SimdReduction reduction) {
+    const auto* simd = expect_simd(vector);
+    const auto& elems = simd->elems;
+    auto lanes = elems.begin() + simd->lanes;
+    switch (reduction) {
+        case SimdReduction::Add:
+            return Value::from_int(std::accumulate(elems.begin(), lanes, std::int64_t {0}));
+        case SimdReduction::Mul:
+            return Value::from_int(
+                std::accumulate(elems.begin(), lanes, std::int64_t {1}, std::multiplies<> {})
+            );
+        case SimdReduction::Min: {
+            auto lane = std::min_element(elems.begin(), lanes) - elems.begin();
+            return simd_lane(simd, static_cast<int>(lane));
+        }
+        case SimdReduction::Max: {
+            auto lane = std::max_element(elems.begin(), lanes) - elems.begin();
+            return simd_lane(simd, static_cast<int>(lane));
+        }
+    }
+    throw std::runtime_error("Invalid SIMD reduction");
+}
+
+// The timestamp counter where there is one, probes only compare its readings.
+std::uint64_t probe_clock() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// Size of an object with the storage it owns, which the heap statistics leave out.
+std::size_t object_bytes(const Object& object) {
+    auto values = [](std::size_t count) { return count * sizeof(Value); };
+    switch (object.get_kind()) {
+        case Object::Kind::String:
+            return sizeof(StringObject) + static_cast<const StringObject&>(object).value.capacity();
+        case Object::Kind::Tuple:
+            return sizeof(TupleObject)
+                + values(static_cast<const TupleObject&>(object).elems.capacity());
+        case Object::Kind::Ctor:
+            return sizeof(CtorObject)
+                + values(static_cast<const CtorObject&>(object).args.capacity());
+        case Object::Kind::Closure:
+            return sizeof(ClosureObject)
+                + values(static_cast<const ClosureObject&>(object).captures.capacity());
+        case Object::Kind::Array:
+            return sizeof(ArrayObject)
+                + values(static_cast<const ArrayObject&>(object).array.cap);
+        case Object::Kind::SoaArray: {
+            const auto& soa = static_cast<const SoaArrayObject&>(object);
+            std::size_t bytes = sizeof(SoaArrayObject);
+            for (const auto& column: soa.columns) {
+                bytes += values(column.cap);
+            }
+            return bytes;
+        }
+        case Object::Kind::Simd:
+            return sizeof(SimdObject);
+    }
+    return 0;
+}
+
+// Array natives are normally compiled to opcodes, these serve method calls.
+Value native_array_new(VM& vm, const Value* args) {
+    if (args[0].tag != Value::Tag::Int || args[0].i < 0) {
+        throw std::runtime_error("Invalid array length");
+    }
+    return Value::from_obj(vm.allocate<ArrayObject>(static_cast<std::size_t>(args[0].i)));
+}
+
+Value native_array_len(VM&, const Value* args) {
+    if (const auto* soa = as_soa(args[0])) {
+        return Value::from_int(static_cast<std::int64_t>(soa->len));
+    }
+    if (const auto* simd = as_simd(args[0])) {
+        return Value::from_int(simd->lanes);
+    }
+    return Value::from_int(static_cast<std::int64_t>(expect_array(args[0])->array.len));
+}
+
+Value native_array_index(VM& vm, const Value* args) {
+    return array_get(vm, args[0], args[1]);
+}
+
+Value native_array_update(VM& vm, const Value* args) {
+    array_set(vm, args[0], args[1], args[2]);
+    return Value::unit();
+}
+
+const std::map<std::string, VM::Native> builtin_natives = {
+    {"sf_print", native_print},
+    {"sf_println", native_println},
+    {"fy_array_new", native_array_new},
+    {"fy_array_len", native_array_len},
+    {"fy_array_index", native_array_index},
+    {"fy_array_update", native_array_update},
+};
+
+} // namespace
+
+bool value_equal(const Value& left, const Value& right) {
+    if (left.tag != right.tag) {
+        return false;
+    }
+    if (left.tag != Value::Tag::Object) {
+        return left.i == right.i;
+    }
+    if (left.obj == right.obj) {
+        return true;
+    }
+    if (left.obj->get_kind() != right.obj->get_kind()) {
+        return false;
+    }
+    switch (left.obj->get_kind()) {
+        case Object::Kind::String:
+            return static_cast<const StringObject*>(left.obj)->value
+                == static_cast<const StringObject*>(right.obj)->value;
+        case Object::Kind::Tuple: {
+            const auto& l = static_cast<const TupleObject*>(left.obj)->elems;
+            const auto& r = static_cast<const TupleObject*>(right.obj)->elems;
+            if (l.size() != r.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < l.size(); ++i) {
+                if (!value_equal(l[i], r[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case Object::Kind::Ctor: {
+            const auto* l = static_cast<const CtorObject*>(left.obj);
+            const auto* r = static_cast<const CtorObject*>(right.obj);
+            if (l->ctor != r->ctor || l->args.size() != r->args.size()) {
+                return false;
+            }
+            for (size_t i = 0; i < l->args.size(); ++i) {
+                if (!value_equal(l->args[i], r->args[i])) {
+                    return false;
+                }
+            }
+            return true;
+        }
+        case Object::Kind::Simd: {
+            const auto* l = static_cast<const SimdObject*>(left.obj);
+            const auto* r = static_cast<const SimdObject*>(right.obj);
+            return l->lanes == r->lanes && l->mask == r->mask && l->elems == r->elems;
+        }
+        case Object::Kind::Closure:
+        case Object::Kind::Array:
+        case Object::Kind::SoaArray:
+            // compared by identity above
+            return false;
+    }
+    return false;
+}
+
+SourcePos source_pos(const Function& func, int pc) {
+    auto it = std::ranges::upper_bound(func.lines, pc, {}, &LineEntry::pc);
+    return it == func.lines.begin() ? SourcePos {} : std::prev(it)->pos;
+}
+
+std::string format_value(const Value& value, const Program& program) {
+    switch (value.tag) {
+        case Value::Tag::Unit:
+            return "()";
+        case Value::Tag::Int:
+            return std::format("{}", value.i);
+        case Value::Tag::Bool:
+            return value.i ? "true" : "false";
+        case Value::Tag::Char:
+            return std::format("'{}'", static_cast<char>(value.i));
+        case Value::Tag::Object:
+            break;
+    }
+    switch (value.obj->get_kind()) {
+        case Object::Kind::String:
+            return std::format("\"{}\"", static_cast<const StringObject*>(value.obj)->value);
+        case Object::Kind::Tuple: {
+            std::string result = "(";
+            const auto& elems = static_cast<const TupleObject*>(value.obj)->elems;
+            for (size_t i = 0; i < elems.size(); ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                result += format_value(elems[i], program);
+            }
+            return result + ")";
+        }
+        case Object::Kind::Ctor: {
+            const auto* ctor = static_cast<const CtorObject*>(value.obj);
+            std::string result = program.ctors[ctor->ctor].name;
+            if (program.ctors[ctor->ctor].arity == 0) {
+                return result;
+            }
+            result += "(";
+            for (size_t i = 0; i < ctor->args.size(); ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                result += format_value(ctor->args[i], program);
+            }
+            return result + ")";
+        }
+        case Object::Kind::Closure: {
+            const auto* closure = static_cast<const ClosureObject*>(value.obj);
+            return std::format("<closure {}>", program.functions[closure->func].name);
+        }
+        case Object::Kind::Array: {
+            const auto* array = static_cast<const ArrayObject*>(value.obj);
+            std::string result = "[";
+            for (std::size_t i = 0; i < array->array.len; ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                result += format_value(array->data()[i], program);
+            }
+            return result + "]";
+        }
+        case Object::Kind::SoaArray: {
+            const auto* array = static_cast<const SoaArrayObject*>(value.obj);
+            std::string result = "[";
+            for (std::size_t i = 0; i < array->len; ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                result += program.ctors[array->ctor].name + "(";
+                for (int field = 0; field < static_cast<int>(array->columns.size()); ++field) {
+                    if (field > 0) {
+                        result += ", ";
+                    }
+                    result += format_value(array->column(field)[i], program);
+                }
+                result += ")";
+            }
+            return result + "]";
+        }
+        case Object::Kind::Simd: {
+            const auto* simd = static_cast<const SimdObject*>(value.obj);
+            std::string result = "<";
+            for (int i = 0; i < simd->lanes; ++i) {
+                if (i > 0) {
+                    result += ", ";
+                }
+                if (simd->mask) {
+                    result += simd->elems[i] != 0 ? "true" : "false";
+                } else {
+                    result += std::format("{}", simd->elems[i]);
+                }
+            }
+            return result + ">";
+        }
+    }
+    return "<unknown>";
+}
+
+VM::VM(Program& program, std::ostream& out, std::size_t stack_size, std::size_t nursery_size):
+    program(program),
+    out(out),
+    stack(stack_size),
+    globals(program.globals.size()),
+    profile_counts(program.counters.size()),
+    probe_stats(program.functions.size()),
+    probe_tree {ProbeNode {-1, -1}},
+    probe_depth(program.functions.size()),
+    heap(nursery_size) {
+    for (const auto& native: program.natives) {
+        auto it = builtin_natives.find(native.name);
+        natives.push_back(it == builtin_natives.end() ? nullptr : it->second);
+    }
+}
+
+Value VM::run() {
+    // the thread only raises a flag, so samples never race the interpreter
+    std::jthread ticker;
+    if (sample_interval.count() > 0) {
+        ticker = std::jthread([this](std::stop_token stop) {
+            while (!stop.stop_requested()) {
+                std::this_thread::sleep_for(sample_interval);
+                sample_due.store(true, std::memory_order_relaxed);
+            }
+        });
+    }
+    if (program.init >= 0) {
+        call(program.init, {});
+    }
+    if (program.entry < 0) {
+        return Value::unit();
+    }
+    return call(program.entry, {});
+}
+
+Value VM::call(int func, const std::vector<Value>& args) {
+    // the caller keeps its own references
+    std::for_each(args.begin(), args.end(), share);
+    return execute(func, nullptr, args.data(), static_cast<int>(args.size()));
+}
+
+void VM::collect() {
+    heap.begin_collection();
+    for (const auto& global: globals) {
+        heap.mark(global);
+    }
+    for (const auto& frame: frames) {
+        const auto* regs = stack.data() + frame.base;
+        for (int i = 0; i < program.functions[frame.func].num_regs; ++i) {
+            heap.mark(regs[i]);
+        }
+        heap.mark(frame.closure);
+    }
+    heap.finish_collection();
+}
+
+void VM::record_sample(const Instr* ip) {
+    sample_due.store(false, std::memory_order_relaxed);
+    std::string stack;
+    for (std::size_t i = 0; i < frames.size(); ++i) {
+        const auto& fn = program.functions[frames[i].func];
+        // a caller waits on the instruction after its call
+        const auto* at = i + 1 < frames.size() ? frames[i].ip - 1 : ip;
+        int line = source_pos(fn, static_cast<int>(at - fn.code.data())).line;
+        stack += std::format("{}{}", stack.empty() ? "" : ";", fn.name);
+        if (line > 0) {
+            stack += std::format(":{}", line);
+        }
+    }
+    ++samples[stack];
+}
+
+void VM::probe_enter(int func) {
+    int parent = probe_stack.empty() ? 0 : probe_stack.back().node;
+    int node = -1;
+    for (int child: probe_tree[parent].children) {
+        if (probe_tree[child].func == func) {
+            node = child;
+            break;
+        }
+    }
+    if (node < 0) {
+        node = static_cast<int>(probe_tree.size());
+        probe_tree.push_back(ProbeNode {func, parent});
+        probe_tree[parent].children.push_back(node);
+    }
+    ++probe_stats[func].calls;
+    ++probe_depth[func];
+    frames.back().probed = true;
+    // read last, so the bookkeeping above is not charged to the call
+    probe_stack.push_back(ActiveProbe {node, probe_clock()});
+}
+
+void VM::probe_exit() {
+    auto now = probe_clock();
+    auto active = probe_stack.back();
+    probe_stack.pop_back();
+    auto elapsed = now - active.start;
+    auto& node = probe_tree[active.node];
+    auto& stats = probe_stats[node.func];
+    node.exclusive += elapsed - active.callees;
+    stats.exclusive += elapsed - active.callees;
+    if (--probe_depth[node.func] == 0) {
+        stats.inclusive += elapsed;
+    }
+    if (!probe_stack.empty()) {
+        probe_stack.back().callees += elapsed;
+    }
+}
+
+std::map<std::string, std::uint64_t> VM::get_probe_stacks() const {
+    std::map<std::string, std::uint64_t> stacks;
+    std::vector<std::string> paths(probe_tree.size());
+    // children are always created after their parent
+    for (std::size_t i = 1; i < probe_tree.size(); ++i) {
+        const auto& node = probe_tree[i];
+        const auto& name = program.functions[node.func].name;
+        paths[i] = node.parent == 0 ? name : paths[node.parent] + ";" + name;
+        if (node.exclusive > 0) {
+            stacks[paths[i]] += node.exclusive;
+        }
+    }
+    return stacks;
+}
+
+void VM::record_alloc(const Object& object) {
+    int site = alloc_site < 0 ? static_cast<int>(program.alloc_sites.size()) : alloc_site;
+    alloc_site = -1;
+    if (--alloc_countdown > 0) {
+        return;
+    }
+    alloc_countdown = alloc_interval;
+    alloc_stats[site].objects += alloc_interval;
+    alloc_stats[site].bytes += alloc_interval * object_bytes(object);
+}
+
+std::size_t VM::push_frame(int func, ClosureObject* closure, std::size_t base, int argc) {
+    const auto& fn = program.functions[func];
+    if (argc != fn.arity) {
+        throw std::runtime_error(
+            std::format("{} expects {} arguments but got {}", fn.name, fn.arity, argc)
+        );
+    }
+    if (base + fn.num_regs > stack.size()) {
+        throw std::runtime_error(std::format("Stack overflow in {}", fn.name));
+    }
+    std::size_t closures = 0;
+    if (!frames.empty()) {
+        closures = frames.back().closures + program.functions[frames.back().func].stack_closures;
+    }
+    frames.push_back(Frame {func, fn.code.data(), base, 0, closure, 0, closures});
+    // registers are roots, so stale values from earlier frames must not survive
+    std::fill(stack.begin() + base + argc, stack.begin() + base + fn.num_regs, Value::unit());
+    return base;
+}
+
+int VM::type_of(const Value& value) const {
+    switch (value.tag) {
+        case Value::Tag::Unit:
+            return static_cast<int>(BuiltinType::Unit);
+        case Value::Tag::Int:
+            return static_cast<int>(BuiltinType::Int);
+        case Value::Tag::Bool:
+            return static_cast<int>(BuiltinType::Bool);
+        case Value::Tag::Char:
+            return static_cast<int>(BuiltinType::Char);
+        case Value::Tag::Object:
+            break;
+    }
+    switch (value.obj->get_kind()) {
+        case Object::Kind::String:
+            return static_cast<int>(BuiltinType::String);
+        case Object::Kind::Tuple:
+            return static_cast<int>(BuiltinType::Tuple);
+        case Object::Kind::Closure:
+            return static_cast<int>(BuiltinType::Closure);
+        case Object::Kind::Array:
+        case Object::Kind::SoaArray:
+            return static_cast<int>(BuiltinType::Array);
+        case Object::Kind::Simd:
+            return static_cast<int>(BuiltinType::Simd);
+        case Object::Kind::Ctor:
+            return program.ctors[static_cast<const CtorObject*>(value.obj)->ctor].type;
+    }
+    return -1;
+}
+
+int VM::resolve_method(MethodCache& cache, const Value& receiver) {
+    int type = type_of(receiver);
+    if (cache.type == type) {
+        return cache.func;
+    }
+    int func = program.method_tables[type][cache.slot];
+    if (func == no_method) {
+        throw std::runtime_error(
+            std::format("No method {} for {}", cache.name, program.types[type])
+        );
+    }
+    cache.type = type;
+    cache.func = func;
+    return cache.func;
+}
+
+int VM::field_index(int type, int slot) const {
+    int index = program.field_tables[type][slot];
+    if (index < 0) {
+        auto it = std::ranges::find(program.field_slots, slot, [](const auto& entry) {
+            return entry.second;
+        });
+        throw std::runtime_error(std::format("No field {} for {}", it->first, program.types[type]));
+    }
+    return index;
+}
+
+Value& VM::field(const Value& object, int slot) {
+    // only class instances have fields
+    int index = field_index(type_of(object), slot);
+    return static_cast<CtorObject*>(object.obj)->args[index];
+}
+
+Value VM::execute(int func, ClosureObject* closure, const Value* args, int argc) {
+    std::size_t base = 0;
+    if (!frames.empty()) {
+        const auto& top = frames.back();
+        base = top.base + program.functions[top.func].num_regs;
+    }
+    std::size_t depth = frames.size();
+    // a runtime error unwinds every frame pushed by this call, and its probes
+    struct Unwind {
+        std::vector<Frame>& frames;
+        std::size_t depth;
+        std::vector<ActiveProbe>& probes;
+        std::size_t probes_size;
+
+        ~Unwind() {
+            frames.resize(depth);
+            probes.resize(probes_size);
+        }
+    } unwind {frames, depth, probe_stack, probe_stack.size()};
+    push_frame(func, closure, base, argc);
+    std::copy(args, args + argc, stack.begin() + base);
+
+    Function* fn = &program.functions[func];
+    const Instr* ip = fn->code.data();
+    Value* regs = stack.data() + base;
+
+    auto expect_int = [&](const Value& value) {
+        if (value.tag != Value::Tag::Int && value.tag != Value::Tag::Char) {
+            throw std::runtime_error(std::format("Expected an integer in {}", fn->name));
+        }
+        return value.i;
+    };
+    // integers are the common case, any object operand takes the lane-wise path
+    auto vector_operands = [&](const Instr* instr) {
+        return regs[instr->b].tag == Value::Tag::Object || regs[instr->c].tag == Value::Tag::Object;
+    };
+    // saves the caller's position and switches to a freshly pushed frame
+    auto enter = [&](int callee, ClosureObject* callee_closure, int first, int count, int ret) {
+        if (sample_due.load(std::memory_order_relaxed)) [[unlikely]] {
+            record_sample(ip);
+        }
+        frames.back().ip = ip + 1;
+        std::size_t callee_base = frames.back().base + fn->num_regs;
+        push_frame(callee, callee_closure, callee_base, count);
+        std::copy(regs + first, regs + first + count, stack.begin() + callee_base);
+        frames.back().ret = ret;
+        fn = &program.functions[callee];
+        ip = fn->code.data();
+        regs = stack.data() + callee_base;
+    };
+
+    // with reuse, the dying tuple in the register after the elements is rebuilt in place
+    auto build_tuple = [&](int first, int count, bool reuse) {
+        const auto& token = regs[first + count];
+        if (!reuse || !reusable(token, Object::Kind::Tuple)) {
+            std::vector<Value> elems(regs + first, regs + first + count);
+            return Value::from_obj(allocate<TupleObject>(std::move(elems)));
+        }
+        auto* tuple = static_cast<TupleObject*>(token.obj);
+        tuple->elems.assign(regs + first, regs + first + count);
+        for (const auto& elem: tuple->elems) {
+            heap.write_barrier(tuple, elem);
+        }
+        heap.record_reuse();
+        return token;
+    };
+
+#if defined(__GNUC__)
+#define SF_OPCODE_LABEL(name) &&op_##name,
+    static void* const labels[] = {SF_OPCODES(SF_OPCODE_LABEL)};
+#undef SF_OPCODE_LABEL
+#define SF_CASE(name) op_##name
+#define SF_DISPATCH() goto* labels[static_cast<int>(ip->op)]
+    SF_DISPATCH();
+#else
+#define SF_CASE(name) case Op::name
+#define SF_DISPATCH() continue
+    for (;;) {
+        switch (ip->op) {
+#endif
+
+    SF_CASE(Nop):
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadUnit):
+        regs[ip->a] = Value::unit();
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadInt):
+    SF_CASE(LoadLabel):
+        regs[ip->a] = Value::from_int(ip->b);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadBool):
+        regs[ip->a] = Value::from_bool(ip->b != 0);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadChar):
+        regs[ip->a] = Value::from_char(static_cast<char>(ip->b));
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadConst):
+        regs[ip->a] = fn->consts[ip->b];
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Move):
+        regs[ip->a] = regs[ip->b];
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Dup):
+        regs[ip->a] = regs[ip->b];
+        share(regs[ip->a]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadGlobal):
+        regs[ip->a] = globals[ip->b];
+        share(regs[ip->a]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(StoreGlobal):
+        globals[ip->b] = regs[ip->a];
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Add):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Add, regs[ip->b], regs[ip->c]);
+        } else {
+            auto left = expect_int(regs[ip->b]);
+            auto right = expect_int(regs[ip->c]);
+            std::int64_t result = 0;
+            if (__builtin_add_overflow(left, right, &result)) {
+                throw std::runtime_error(std::format("Integer overflow in {}", fn->name));
+            }
+            regs[ip->a] = Value::from_int(result);
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Sub):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Sub, regs[ip->b], regs[ip->c]);
+        } else {
+            auto left = expect_int(regs[ip->b]);
+            auto right = expect_int(regs[ip->c]);
+            std::int64_t result = 0;
+            if (__builtin_sub_overflow(left, right, &result)) {
+                throw std::runtime_error(std::format("Integer overflow in {}", fn->name));
+            }
+            regs[ip->a] = Value::from_int(result);
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Mul):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Mul, regs[ip->b], regs[ip->c]);
+        } else {
+            auto left = expect_int(regs[ip->b]);
+            auto right = expect_int(regs[ip->c]);
+            std::int64_t result = 0;
+            if (__builtin_mul_overflow(left, right, &result)) {
+                throw std::runtime_error(std::format("Integer overflow in {}", fn->name));
+            }
+            regs[ip->a] = Value::from_int(result);
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Div): {
+        auto divisor = expect_int(regs[ip->c]);
+        if (divisor == 0) {
+            throw std::runtime_error(std::format("Division by zero in {}", fn->name));
+        }
+        auto dividend = expect_int(regs[ip->b]);
+        if (divisor == -1 && dividend == std::numeric_limits<std::int64_t>::min()) {
+            throw std::runtime_error(std::format("Integer overflow in {}", fn->name));
+        }
+        regs[ip->a] = Value::from_int(dividend / divisor);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(Mod): {
+        auto divisor = expect_int(regs[ip->c]);
+        if (divisor == 0) {
+            throw std::runtime_error(std::format("Division by zero in {}", fn->name));
+        }
+        // x % -1 is 0, and the host traps on the minimum Int
+        regs[ip->a] = Value::from_int(divisor == -1 ? 0 : expect_int(regs[ip->b]) % divisor);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(Neg): {
+        auto operand = expect_int(regs[ip->b]);
+        if (operand == std::numeric_limits<std::int64_t>::min()) {
+            throw std::runtime_error(std::format("Integer overflow in {}", fn->name));
+        }
+        regs[ip->a] = Value::from_int(-operand);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(Not):
+        regs[ip->a] = Value::from_bool(regs[ip->b].i == 0);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Eq):
+        regs[ip->a] = Value::from_bool(value_equal(regs[ip->b], regs[ip->c]));
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Neq):
+        regs[ip->a] = Value::from_bool(!value_equal(regs[ip->b], regs[ip->c]));
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Lt):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Lt, regs[ip->b], regs[ip->c]);
+        } else {
+            regs[ip->a] = Value::from_bool(expect_int(regs[ip->b]) < expect_int(regs[ip->c]));
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Gt):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Gt, regs[ip->b], regs[ip->c]);
+        } else {
+            regs[ip->a] = Value::from_bool(expect_int(regs[ip->b]) > expect_int(regs[ip->c]));
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Lte):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Lte, regs[ip->b], regs[ip->c]);
+        } else {
+            regs[ip->a] = Value::from_bool(expect_int(regs[ip->b]) <= expect_int(regs[ip->c]));
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Gte):
+        if (vector_operands(ip)) {
+            regs[ip->a] = simd_binary(*this, Op::Gte, regs[ip->b], regs[ip->c]);
+        } else {
+            regs[ip->a] = Value::from_bool(expect_int(regs[ip->b]) >= expect_int(regs[ip->c]));
+        }
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Jump):
+        // loops jump back, so a sample is taken even without calls
+        if (sample_due.load(std::memory_order_relaxed)) [[unlikely]] {
+            record_sample(ip);
+        }
+        ip = fn->code.data() + ip->b;
+        SF_DISPATCH();
+
+    SF_CASE(JumpIf):
+        ip = regs[ip->a].i != 0 ? fn->code.data() + ip->b : ip + 1;
+        SF_DISPATCH();
+
+    SF_CASE(JumpIfNot):
+        ip = regs[ip->a].i == 0 ? fn->code.data() + ip->b : ip + 1;
+        SF_DISPATCH();
+
+    SF_CASE(JumpReg):
+        ip = fn->code.data() + regs[ip->a].i;
+        SF_DISPATCH();
+
+    SF_CASE(MakeTuple): {
+        std::vector<Value> elems(regs + ip->b, regs + ip->b + ip->c);
+        regs[ip->a] = Value::from_obj(allocate<TupleObject>(std::move(elems)));
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(MakeCtor): {
+        int arity = program.ctors[ip->b].arity;
+        std::vector<Value> args(regs + ip->c, regs + ip->c + arity);
+        regs[ip->a] = Value::from_obj(allocate<CtorObject>(ip->b, std::move(args)));
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(IsCtor): {
+        const auto& value = regs[ip->b];
+        bool result = value.tag == Value::Tag::Object
+            && value.obj->get_kind() == Object::Kind::Ctor
+            && static_cast<const CtorObject*>(value.obj)->ctor == ip->c;
+        regs[ip->a] = Value::from_bool(result);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(IsOk): {
+        const auto& value = regs[ip->b];
+        if (value.tag != Value::Tag::Object || value.obj->get_kind() != Object::Kind::Ctor) {
+            throw std::runtime_error(std::format("Expected an enum value for ? in {}", fn->name));
+        }
+        const auto& ctor = program.ctors[static_cast<const CtorObject*>(value.obj)->ctor];
+        if (!ctor.unwraps && !ctor.fails) {
+            throw std::runtime_error(std::format(
+                "Operator ? on {}, whose enum has no Ok or Some payload, in {}",
+                ctor.name,
+                fn->name
+            ));
+        }
+        regs[ip->a] = Value::from_bool(ctor.unwraps);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(GetElem):
+    SF_CASE(TakeElem): {
+        const auto& value = regs[ip->b];
+        const auto* elems = fields_of(value);
+        if (!elems || ip->c < 0 || static_cast<std::size_t>(ip->c) >= elems->size()) {
+            throw std::runtime_error(std::format("Invalid projection .{} in {}", ip->c, fn->name));
+        }
+        // taking a field out of a dead, unshared cell leaves it with one owner
+        bool shares = ip->op == Op::GetElem || value.obj->shared;
+        regs[ip->a] = (*elems)[ip->c];
+        if (shares) {
+            share(regs[ip->a]);
+        }
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(ReuseTuple):
+        regs[ip->a] = build_tuple(ip->b, ip->c, true);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(ReuseCtor): {
+        int arity = program.ctors[ip->b].arity;
+        auto& token = regs[ip->c + arity];
+        if (!reusable(token, Object::Kind::Ctor)) {
+            std::vector<Value> args(regs + ip->c, regs + ip->c + arity);
+            regs[ip->a] = Value::from_obj(allocate<CtorObject>(ip->b, std::move(args)));
+            ++ip;
+            SF_DISPATCH();
+        }
+        auto* ctor = static_cast<CtorObject*>(token.obj);
+        ctor->ctor = ip->b;
+        ctor->args.assign(regs + ip->c, regs + ip->c + arity);
+        for (const auto& arg: ctor->args) {
+            heap.write_barrier(ctor, arg);
+        }
+        heap.record_reuse();
+        regs[ip->a] = token;
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(ArrayNew):
+        regs[ip->a] = native_array_new(*this, regs + ip->b);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(ArrayLen):
+        regs[ip->a] = native_array_len(*this, regs + ip->b);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(ArrayGet):
+        regs[ip->a] = array_get(*this, regs[ip->b], regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(ArraySet):
+        array_set(*this, regs[ip->a], regs[ip->b], regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    // proven in bounds by the compiler, debug builds still check and @soa arrays
+    // and instances take the generic path
+    SF_CASE(ArrayGetFast):
+#ifdef NDEBUG
+        if (regs[ip->b].obj->get_kind() == Object::Kind::Array) {
+            const auto& elem = static_cast<ArrayObject*>(regs[ip->b].obj)->data()[regs[ip->c].i];
+            if (!is_soa_instance(*this, elem)) {
+                regs[ip->a] = elem;
+                share(regs[ip->a]);
+                ++ip;
+                SF_DISPATCH();
+            }
+        }
+#endif
+        regs[ip->a] = array_get(*this, regs[ip->b], regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(ArraySetFast):
+#ifdef NDEBUG
+        if (regs[ip->a].obj->get_kind() == Object::Kind::Array
+            && !is_soa_instance(*this, regs[ip->c])) {
+            static_cast<ArrayObject*>(regs[ip->a].obj)->data()[regs[ip->b].i] = regs[ip->c];
+            heap.write_barrier(regs[ip->a].obj, regs[ip->c]);
+            ++ip;
+            SF_DISPATCH();
+        }
+#endif
+        array_set(*this, regs[ip->a], regs[ip->b], regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(ArrayPush):
+        array_push(*this, regs[ip->a], regs[ip->b]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(GetField):
+        regs[ip->a] = field(regs[ip->b], ip->c);
+        share(regs[ip->a]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SetField):
+        field(regs[ip->a], ip->b) = regs[ip->c];
+        heap.write_barrier(regs[ip->a].obj, regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SoaNew): {
+        const auto& len = regs[ip->c];
+        if (len.tag != Value::Tag::Int || len.i < 0) {
+            throw std::runtime_error("Invalid array length");
+        }
+        regs[ip->a] = Value::from_obj(allocate<SoaArrayObject>(
+            ip->b,
+            program.ctors[ip->b].arity,
+            static_cast<std::size_t>(len.i)
+        ));
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    // an array that is not @soa after all holds its own copy of each instance
+    SF_CASE(SoaGet): {
+        const auto& array = regs[ip->b];
+        if (auto* soa = as_soa(array)) {
+            auto i = checked_index(regs[ip->b + 1], soa->len);
+            regs[ip->a] = soa->column(field_index(program.ctors[soa->ctor].type, ip->c))[i];
+        } else {
+            regs[ip->a] = field(*checked_elem(array, regs[ip->b + 1]), ip->c);
+        }
+        share(regs[ip->a]);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(SoaSet): {
+        const auto& array = regs[ip->a];
+        if (auto* soa = as_soa(array)) {
+            auto i = checked_index(regs[ip->a + 1], soa->len);
+            soa->column(field_index(program.ctors[soa->ctor].type, ip->b))[i] = regs[ip->c];
+            heap.write_barrier(soa, regs[ip->c]);
+        } else {
+            const auto& elem = *checked_elem(array, regs[ip->a + 1]);
+            field(elem, ip->b) = regs[ip->c];
+            heap.write_barrier(elem.obj, regs[ip->c]);
+        }
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(SimdSplat):
+        regs[ip->a] = simd_splat(*this, regs[ip->b], ip->c);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SimdLoad):
+        regs[ip->a] = simd_load(*this, regs[ip->b], regs[ip->b + 1], ip->c);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SimdStore):
+        simd_store(regs[ip->a], regs[ip->b], regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SimdShuffle):
+        regs[ip->a] = simd_shuffle(*this, regs[ip->b], regs[ip->c]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SimdSelect):
+        regs[ip->a] = simd_select(*this, regs + ip->b);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(SimdReduce):
+        regs[ip->a] = simd_reduce(regs[ip->b], static_cast<SimdReduction>(ip->c));
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(MakeClosure): {
+        int count = program.functions[ip->b].num_captures;
+        std::vector<Value> captures(regs + ip->c, regs + ip->c + count);
+        regs[ip->a] = Value::from_obj(allocate<ClosureObject>(ip->b, std::move(captures)));
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(StackClosure): {
+        const auto& lam = program.functions[ip->b];
+        std::size_t slot = frames.back().closures + lam.stack_slot;
+        if (slot >= stack_closures.size()) {
+            stack_closures.resize(slot + 1);
+        }
+        auto& closure = stack_closures[slot];
+        if (!closure) {
+            closure = std::make_unique<ClosureObject>(ip->b, std::vector<Value> {});
+            closure->space = Object::Space::Stack;
+        }
+        // the closure last in the slot died with its frame or its loop iteration
+        closure->func = ip->b;
+        closure->captures.assign(regs + ip->c, regs + ip->c + lam.num_captures);
+        regs[ip->a] = Value::from_obj(closure.get());
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(LoadCapture):
+        regs[ip->a] = frames.back().closure->captures[ip->b];
+        share(regs[ip->a]);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(LoadSelf):
+        regs[ip->a] = Value::from_obj(frames.back().closure);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Call):
+        enter(ip->b, nullptr, ip->c, program.functions[ip->b].arity, ip->a);
+        SF_DISPATCH();
+
+    SF_CASE(CallClosure): {
+        const auto& callee = regs[ip->b];
+        if (callee.tag != Value::Tag::Object || callee.obj->get_kind() != Object::Kind::Closure) {
+            throw std::runtime_error(std::format("Called a non-function value in {}", fn->name));
+        }
+        auto* callee_closure = static_cast<ClosureObject*>(callee.obj);
+        enter(callee_closure->func, callee_closure, ip->b + 1, ip->c, ip->a);
+        SF_DISPATCH();
+    }
+
+    SF_CASE(CallMethod): {
+        auto& cache = fn->caches[ip->b];
+        int callee = resolve_method(cache, regs[ip->c]);
+        if (callee < 0) {
+            int native = -1 - callee;
+            if (program.natives[native].arity != cache.argc) {
+                throw std::runtime_error(
+                    std::format("Wrong number of arguments to {}", program.natives[native].name)
+                );
+            }
+            if (!natives[native]) {
+                throw std::runtime_error(
+                    std::format("Native function {} is not available", program.natives[native].name)
+                );
+            }
+            regs[ip->a] = natives[native](*this, regs + ip->c);
+            ++ip;
+            SF_DISPATCH();
+        }
+        enter(callee, nullptr, ip->c, cache.argc, ip->a);
+        SF_DISPATCH();
+    }
+
+    SF_CASE(CallTuple): {
+        int unboxed = ip->c;
+        enter(ip->b, nullptr, ip->a + unboxed, program.functions[ip->b].arity, ip->a);
+        frames.back().unboxed = unboxed;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(CallNative): {
+        auto native = natives[ip->b];
+        if (!native) {
+            throw std::runtime_error(
+                std::format("Native function {} is not available", program.natives[ip->b].name)
+            );
+        }
+        regs[ip->a] = native(*this, regs + ip->c);
+        ++ip;
+        SF_DISPATCH();
+    }
+
+    SF_CASE(Return): {
+        if (frames.back().probed) [[unlikely]] {
+            probe_exit();
+        }
+        Value result = regs[ip->a];
+        int ret = frames.back().ret;
+        int unboxed = frames.back().unboxed;
+        const auto& callee = fn->name;
+        frames.pop_back();
+        if (frames.size() == depth) {
+            return result;
+        }
+        const auto& caller = frames.back();
+        fn = &program.functions[caller.func];
+        ip = caller.ip;
+        regs = stack.data() + caller.base;
+        if (unboxed > 0) {
+            unbox_tuple(result, unboxed, regs + ret, callee);
+        } else {
+            regs[ret] = result;
+        }
+        SF_DISPATCH();
+    }
+
+    SF_CASE(ReturnTuple): {
+        if (frames.back().probed) [[unlikely]] {
+            probe_exit();
+        }
+        const Value* elems = regs + ip->b;
+        int count = ip->c;
+        int ret = frames.back().ret;
+        int unboxed = frames.back().unboxed;
+        if (unboxed > 0 && unboxed != count) {
+            throw std::runtime_error(
+                std::format("Expected a tuple of {} values from {}", unboxed, fn->name)
+            );
+        }
+        // built while the registers of the callee are still roots
+        Value result = unboxed == 0 ? build_tuple(ip->b, count, ip->a != 0) : Value::unit();
+        frames.pop_back();
+        if (frames.size() == depth) {
+            return result;
+        }
+        const auto& caller = frames.back();
+        fn = &program.functions[caller.func];
+        ip = caller.ip;
+        regs = stack.data() + caller.base;
+        if (unboxed > 0) {
+            std::copy(elems, elems + count, regs + ret);
+        } else {
+            regs[ret] = result;
+        }
+        SF_DISPATCH();
+    }
+
+    SF_CASE(Count):
+        ++profile_counts[ip->b];
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Probe):
+        probe_enter(frames.back().func);
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Site):
+        alloc_site = ip->b;
+        ++ip;
+        SF_DISPATCH();
+
+    SF_CASE(Fail): {
+        const auto* message = static_cast<const StringObject*>(fn->consts[ip->b].obj);
+        throw std::runtime_error(message->value);
+    }
+
+#if !defined(__GNUC__)
+        }
+    }
+#endif
+#undef SF_CASE
+#undef SF_DISPATCH
+}
+
+} // namespace interp
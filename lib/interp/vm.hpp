@@ -0,0 +1,175 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "interp/bytecode.hpp"
+#include "interp/heap.hpp"
+#include "interp/profile.hpp"
+
+namespace interp {
+
+class VM {
+public:
+    using Native = Value (*)(VM& vm, const Value* args);
+
+    explicit VM(
+        Program& program,
+        std::ostream& out,
+        std::size_t stack_size = 1 << 18,
+        std::size_t nursery_size = 1 << 16
+    );
+
+    // Runs the global initializers, then the entry function if there is one.
+    Value run();
+
+    Value call(int func, const std::vector<Value>& args);
+
+    const Program& get_program() const {
+        return program;
+    }
+
+    std::ostream& get_out() {
+        return out;
+    }
+
+    template<typename T, typename... Args>
+    T* allocate(Args&&... args) {
+        if (heap.nursery_full()) {
+            collect();
+        }
+        auto* result = heap.allocate<T>(std::forward<Args>(args)...);
+        if (alloc_interval > 0) [[unlikely]] {
+            record_alloc(*result);
+        }
+        return result;
+    }
+
+    void write_barrier(Object* target, const Value& value) {
+        heap.write_barrier(target, value);
+    }
+
+    // Registers and globals are the roots, values held elsewhere may be freed.
+    void collect();
+
+    const GcStats& get_gc_stats() const {
+        return heap.get_stats();
+    }
+
+    // indexed like Program::counters
+    const std::vector<std::uint64_t>& get_profile_counts() const {
+        return profile_counts;
+    }
+
+    // Samples the call stack every interval of wall time while run() executes.
+    // The stack is taken at the next call or jump, by function and source line.
+    void enable_sampling(std::chrono::microseconds interval = std::chrono::milliseconds(1)) {
+        sample_interval = interval;
+    }
+
+    // call stacks in the folded format of flame graph tools, outermost frame
+    // first, with the number of samples that hit each
+    const std::map<std::string, std::uint64_t>& get_samples() const {
+        return samples;
+    }
+
+    // indexed like Program::functions, filled when the program was compiled with probes
+    const std::vector<ProbeStats>& get_probe_stats() const {
+        return probe_stats;
+    }
+
+    // the exclusive cycles spent on each call path between probes, as folded stacks
+    std::map<std::string, std::uint64_t> get_probe_stacks() const;
+
+    // Records one of every interval allocations by the site that made it, for a
+    // program compiled with allocation sites.
+    void enable_alloc_profile(std::uint64_t interval = 1) {
+        alloc_interval = interval;
+        alloc_stats.assign(program.alloc_sites.size() + 1, AllocStats {});
+    }
+
+    // indexed like Program::alloc_sites, then the allocations no site tagged
+    const std::vector<AllocStats>& get_alloc_stats() const {
+        return alloc_stats;
+    }
+
+private:
+    struct Frame {
+        int func;
+        const Instr* ip;
+        std::size_t base;
+        int ret;
+        ClosureObject* closure;
+        // elements the caller takes from a returned tuple into the registers from
+        // ret on, 0 when it takes the tuple
+        int unboxed = 0;
+        // the first of the frame's slots in stack_closures
+        std::size_t closures = 0;
+        // set by Probe, so returning ends the timed call
+        bool probed = false;
+    };
+
+    // A call path of the calling context tree the probes build, node 0 is the root.
+    struct ProbeNode {
+        int func;
+        int parent;
+        std::uint64_t exclusive = 0;
+        std::vector<int> children;
+    };
+
+    // A probed call still running, charged with its callees as they return.
+    struct ActiveProbe {
+        int node;
+        std::uint64_t start;
+        std::uint64_t callees = 0;
+    };
+
+    Program& program;
+    std::ostream& out;
+    std::vector<Value> stack;
+    std::vector<Frame> frames;
+    // closures promoted to stack slots, reused by whichever frame holds the slot next
+    std::vector<std::unique_ptr<ClosureObject>> stack_closures;
+    std::vector<Value> globals;
+    std::vector<Native> natives;
+    std::vector<std::uint64_t> profile_counts;
+    std::chrono::microseconds sample_interval {0};
+    // raised by the sampling thread, cleared once the interpreter took the sample
+    std::atomic<bool> sample_due = false;
+    std::map<std::string, std::uint64_t> samples;
+    std::vector<ProbeStats> probe_stats;
+    std::vector<ProbeNode> probe_tree;
+    std::vector<ActiveProbe> probe_stack;
+    // running probed calls of each function, so a recursive one is inclusive once
+    std::vector<int> probe_depth;
+    std::uint64_t alloc_interval = 0;
+    // allocations left until the next one is recorded
+    std::uint64_t alloc_countdown = 1;
+    // set by Site, cleared by the allocation it tags
+    int alloc_site = -1;
+    std::vector<AllocStats> alloc_stats;
+    Heap heap;
+
+    Value execute(int func, ClosureObject* closure, const Value* args, int argc);
+    void record_sample(const Instr* ip);
+    void probe_enter(int func);
+    void probe_exit();
+    void record_alloc(const Object& object);
+    std::size_t push_frame(int func, ClosureObject* closure, std::size_t base, int argc);
+    int type_of(const Value& value) const;
+    int resolve_method(MethodCache& cache, const Value& receiver);
+    int field_index(int type, int slot) const;
+    Value& field(const Value& object, int slot);
+};
+
+bool value_equal(const Value& left, const Value& right);
+
+} // namespace interp
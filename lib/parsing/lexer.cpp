@@ -40,6 +40,7 @@ static const std::unordered_map<std::string, Token::Kind> KEYWORDS = {
     { "return", Token::Kind::Return },
     { "continue", Token::Kind::Continue },
     { "break", Token::Kind::Break },
+    { "yield", Token::Kind::Yield },
 };
 
 char Lexer::curr_char() const {
@@ -572,6 +573,8 @@ std::string format_token_kind(Token::Kind kind) {
             return "continue";
         case Token::Kind::Break:
             return "break";
+        case Token::Kind::Yield:
+            return "yield";
     }
     return "UNKNOWN";
 }
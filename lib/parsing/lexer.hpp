@@ -100,6 +100,7 @@ struct Token {
         Return,     // return
         Continue,   // continue
         Break,      // break
+        Yield,      // yield
     };
 
     Token(Kind kind, Span span): kind(kind), span(span) {}
@@ -811,9 +811,21 @@ std::unique_ptr<Expr> Parser::parse_expr8() {
     return expr;
 }
 
+// ranges bind looser than || and do not chain
+std::unique_ptr<Expr> Parser::parse_range_expr() {
+    auto start = start_loc();
+    auto expr = parse_expr8();
+    if (peek() == Token::Kind::DotDot) {
+        next();
+        auto right = parse_expr8();
+        expr = std::make_unique<RangeExpr>(std::move(expr), std::move(right), make_span(start));
+    }
+    return expr;
+}
+
 std::unique_ptr<Expr> Parser::parse_expr9() {
     auto start = start_loc();
-    auto rhs = parse_expr8();
+    auto rhs = parse_range_expr();
     std::vector<std::pair<BinaryExpr::Op, std::unique_ptr<Expr>>> exprs;
     while (true) {
         auto token = peek();
@@ -838,7 +850,7 @@ std::unique_ptr<Expr> Parser::parse_expr9() {
             }
             next();
             exprs.emplace_back(mode, std::move(rhs));
-            rhs = parse_expr8();
+            rhs = parse_range_expr();
         } else {
             break;
         }
@@ -886,6 +898,11 @@ std::unique_ptr<Expr> Parser::parse_expr() {
             }
             return std::make_unique<ReturnExpr>(std::move(expr), make_span(start));
         }
+        case Token::Kind::Yield: {
+            next(); // consume 'yield'
+            auto expr = parse_expr();
+            return std::make_unique<YieldExpr>(std::move(expr), make_span(start));
+        }
         default:
             lexer.push_checkpoint();
             try {
@@ -93,6 +93,7 @@ private:
     std::unique_ptr<Expr> parse_expr6();
     std::unique_ptr<Expr> parse_expr7();
     std::unique_ptr<Expr> parse_expr8();
+    std::unique_ptr<Expr> parse_range_expr();
     std::unique_ptr<Expr> parse_expr9();
 
     std::unique_ptr<Expr> parse_tuple_expr();
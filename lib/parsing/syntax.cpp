@@ -412,6 +412,9 @@ std::string format_expr(const Expr& expr, int indent) {
                 case BinaryExpr::Op::Gte:
                     op = " >= ";
                     break;
+                case BinaryExpr::Op::Range:
+                    op = "..";
+                    break;
                 case BinaryExpr::Op::Assign: {
                     const auto& e = static_cast<const AssignExpr&>(expr);
                     switch (e.mode) {
@@ -571,6 +574,10 @@ std::string format_expr(const Expr& expr, int indent) {
             }
             return result;
         }
+        case Expr::Kind::Yield: {
+            const auto& s = static_cast<const YieldExpr&>(expr);
+            return "yield " + format_expr(*s.expr, indent);
+        }
     }
     return "<?expr>";
 }
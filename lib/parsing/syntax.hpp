@@ -211,6 +211,7 @@ struct Expr {
         Break,
         Continue,
         Return,
+        Yield,
     };
 
     Expr(Kind kind, Span span): kind(kind), span(span) {}
@@ -658,6 +659,7 @@ struct BinaryExpr: public Expr {
         Gt,     // >
         Lte,    // <=
         Gte,    // >=
+        Range,  // ..
         Assign, // =
     };
 
@@ -743,6 +745,12 @@ struct GteExpr: public BinaryExpr {
         BinaryExpr(Op::Gte, std::move(left), std::move(right), span) {}
 };
 
+// lo..hi, the integers from lo up to but excluding hi
+struct RangeExpr: public BinaryExpr {
+    RangeExpr(std::unique_ptr<Expr> left, std::unique_ptr<Expr> right, Span span):
+        BinaryExpr(Op::Range, std::move(left), std::move(right), span) {}
+};
+
 struct AssignExpr: public BinaryExpr {
     BinaryExpr::Op mode;
 
@@ -812,7 +820,9 @@ struct BlockExpr: public Expr {
     explicit BlockExpr(std::vector<std::unique_ptr<Stmt>> stmts, Span span):
         Expr(Kind::Block, span) {
         std::optional<std::unique_ptr<Expr>> body = std::nullopt;
-        if (!stmts.empty() && stmts.back()->get_kind() == Stmt::Kind::Expr) {
+        // an attributed statement stays one, so its attributes are not lost
+        if (!stmts.empty() && stmts.back()->get_kind() == Stmt::Kind::Expr
+            && stmts.back()->attrs.empty()) {
             auto* expr = static_cast<ExprStmt*>(stmts.back().get());
             if (expr->is_val) {
                 body = std::move(expr->expr);
@@ -840,6 +850,14 @@ struct ReturnExpr: public Expr {
         expr(std::move(expr)) {}
 };
 
+struct YieldExpr: public Expr {
+    std::unique_ptr<Expr> expr;
+
+    explicit YieldExpr(std::unique_ptr<Expr> expr, Span span):
+        Expr(Kind::Yield, span),
+        expr(std::move(expr)) {}
+};
+
 struct IteThen {
     std::unique_ptr<Cond> cond;
     std::unique_ptr<Expr> then_branch;
@@ -1170,6 +1188,10 @@ struct Package {
         body(std::move(body)),
         span(span) {}
 
+    Span get_span() const {
+        return span;
+    }
+
 private:
     Span span;
 };
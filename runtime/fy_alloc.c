@@ -0,0 +1,241 @@
+#define _DEFAULT_SOURCE
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "fy_alloc.h"
+
+// the chunk header is padded so the first block is cache line aligned
+#define HEADER_SIZE 64
+#define HUGE_CLASS -1
+#define REMOTE_BATCH 32
+
+typedef struct fy_heap fy_heap;
+
+typedef struct block {
+    struct block* next;
+} block;
+
+// Chunks are FY_ALLOC_CHUNK aligned, so masking a pointer finds its header.
+typedef struct chunk_header {
+    fy_heap* owner;
+    int size_class;
+    // length of the mapping, for huge allocations
+    size_t mapped;
+} chunk_header;
+
+struct fy_heap {
+    block* free[FY_ALLOC_CLASSES];
+    unsigned char* bump[FY_ALLOC_CLASSES];
+    unsigned char* bump_end[FY_ALLOC_CLASSES];
+    // pushed to by other threads, taken whole by the owner
+    _Atomic(block*) remote;
+    fy_heap* next_released;
+};
+
+// frees owned by another heap, collected to be pushed with a single CAS
+typedef struct remote_batch {
+    fy_heap* heap;
+    block* head;
+    block* tail;
+    int count;
+} remote_batch;
+
+static _Thread_local fy_heap* local_heap;
+static _Thread_local remote_batch pending;
+
+static atomic_flag released_lock = ATOMIC_FLAG_INIT;
+static fy_heap* released;
+
+static size_t class_size(int size_class) {
+    if (size_class < 8) {
+        return (size_t)(size_class + 1) * 16;
+    }
+    int log = 7 + (size_class - 8) / 4;
+    size_t step = (size_t)1 << (log - 2);
+    return ((size_t)1 << log) + (size_t)((size_class - 8) % 4 + 1) * step;
+}
+
+static chunk_header* chunk_of(const void* ptr) {
+    return (chunk_header*)((uintptr_t)ptr & ~(uintptr_t)(FY_ALLOC_CHUNK - 1));
+}
+
+// bytes must be a multiple of the page size
+static void* map_aligned(size_t bytes) {
+    size_t padded = bytes + FY_ALLOC_CHUNK;
+    unsigned char* raw =
+        mmap(NULL, padded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    uintptr_t start = (uintptr_t)raw;
+    uintptr_t aligned = (start + FY_ALLOC_CHUNK - 1) & ~(uintptr_t)(FY_ALLOC_CHUNK - 1);
+    size_t head = aligned - start;
+    if (head) {
+        munmap(raw, head);
+    }
+    size_t tail = padded - head - bytes;
+    if (tail) {
+        munmap((unsigned char*)aligned + bytes, tail);
+    }
+    return (void*)aligned;
+}
+
+static fy_heap* acquire_heap(void) {
+    while (atomic_flag_test_and_set_explicit(&released_lock, memory_order_acquire)) {
+    }
+    fy_heap* heap = released;
+    if (heap) {
+        released = heap->next_released;
+    }
+    atomic_flag_clear_explicit(&released_lock, memory_order_release);
+    if (!heap) {
+        heap = calloc(1, sizeof(fy_heap));
+        if (!heap) {
+            return NULL;
+        }
+        atomic_init(&heap->remote, NULL);
+    }
+    return heap;
+}
+
+static void drain_remote(fy_heap* heap) {
+    block* list = atomic_exchange_explicit(&heap->remote, NULL, memory_order_acquire);
+    while (list) {
+        block* next = list->next;
+        int size_class = chunk_of(list)->size_class;
+        list->next = heap->free[size_class];
+        heap->free[size_class] = list;
+        list = next;
+    }
+}
+
+static int add_chunk(fy_heap* heap, int size_class) {
+    unsigned char* chunk = map_aligned(FY_ALLOC_CHUNK);
+    if (!chunk) {
+        return -1;
+    }
+    chunk_header* header = (chunk_header*)chunk;
+    header->owner = heap;
+    header->size_class = size_class;
+    header->mapped = FY_ALLOC_CHUNK;
+    size_t size = class_size(size_class);
+    heap->bump[size_class] = chunk + HEADER_SIZE;
+    heap->bump_end[size_class] = chunk + HEADER_SIZE + (FY_ALLOC_CHUNK - HEADER_SIZE) / size * size;
+    return 0;
+}
+
+void* fy_alloc_small(int size_class) {
+    fy_heap* heap = local_heap;
+    if (!heap) {
+        heap = local_heap = acquire_heap();
+        if (!heap) {
+            return NULL;
+        }
+    }
+    block* free_block = heap->free[size_class];
+    if (free_block) {
+        heap->free[size_class] = free_block->next;
+        return free_block;
+    }
+    if (heap->bump[size_class] == heap->bump_end[size_class]) {
+        // reclaim what other threads gave back before mapping more memory
+        if (atomic_load_explicit(&heap->remote, memory_order_relaxed)) {
+            drain_remote(heap);
+            free_block = heap->free[size_class];
+            if (free_block) {
+                heap->free[size_class] = free_block->next;
+                return free_block;
+            }
+        }
+        if (add_chunk(heap, size_class) != 0) {
+            return NULL;
+        }
+    }
+    void* result = heap->bump[size_class];
+    heap->bump[size_class] += class_size(size_class);
+    return result;
+}
+
+void* fy_alloc_huge(size_t size, size_t align) {
+    size_t offset = align > HEADER_SIZE ? align : HEADER_SIZE;
+    if (offset >= FY_ALLOC_CHUNK || size > SIZE_MAX - offset - FY_ALLOC_CHUNK) {
+        return NULL;
+    }
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t bytes = (offset + size + page - 1) / page * page;
+    unsigned char* base = map_aligned(bytes);
+    if (!base) {
+        return NULL;
+    }
+    chunk_header* header = (chunk_header*)base;
+    header->owner = NULL;
+    header->size_class = HUGE_CLASS;
+    header->mapped = bytes;
+    return base + offset;
+}
+
+static void flush_pending(void) {
+    if (pending.count == 0) {
+        return;
+    }
+    _Atomic(block*)* remote = &pending.heap->remote;
+    block* head = atomic_load_explicit(remote, memory_order_relaxed);
+    do {
+        pending.tail->next = head;
+    } while (!atomic_compare_exchange_weak_explicit(
+        remote,
+        &head,
+        pending.head,
+        memory_order_release,
+        memory_order_relaxed
+    ));
+    pending.heap = NULL;
+    pending.head = NULL;
+    pending.tail = NULL;
+    pending.count = 0;
+}
+
+void fy_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    chunk_header* chunk = chunk_of(ptr);
+    if (chunk->size_class == HUGE_CLASS) {
+        munmap(chunk, chunk->mapped);
+        return;
+    }
+    block* freed = ptr;
+    fy_heap* owner = chunk->owner;
+    if (owner == local_heap) {
+        freed->next = owner->free[chunk->size_class];
+        owner->free[chunk->size_class] = freed;
+        return;
+    }
+    if (pending.heap != owner) {
+        flush_pending();
+        pending.heap = owner;
+        pending.tail = freed;
+    }
+    freed->next = pending.head;
+    pending.head = freed;
+    if (++pending.count == REMOTE_BATCH) {
+        flush_pending();
+    }
+}
+
+void fy_heap_release(void) {
+    flush_pending();
+    fy_heap* heap = local_heap;
+    if (!heap) {
+        return;
+    }
+    local_heap = NULL;
+    while (atomic_flag_test_and_set_explicit(&released_lock, memory_order_acquire)) {
+    }
+    heap->next_released = released;
+    released = heap;
+    atomic_flag_clear_explicit(&released_lock, memory_order_release);
+}
@@ -0,0 +1,59 @@
+#ifndef FY_ALLOC_H
+#define FY_ALLOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Small objects are carved from chunks owned by a thread-local heap, one size
+// class per chunk; anything larger is mapped on its own.
+#define FY_ALLOC_CHUNK ((size_t)1 << 16)
+#define FY_ALLOC_SMALL_MAX 8192
+#define FY_ALLOC_MAX_ALIGN 64
+#define FY_ALLOC_CLASSES 32
+
+// Classes are 16-byte steps up to 128, then four steps per doubling. Over-aligned
+// requests round up to a power of two, whose blocks are naturally aligned.
+static inline int fy_size_class(size_t size, size_t align) {
+    if (align > 16) {
+        size_t rounded = 32;
+        while (rounded < size || rounded < align) {
+            rounded <<= 1;
+        }
+        size = rounded;
+    }
+    if (size <= 128) {
+        return size == 0 ? 0 : (int)((size - 1) >> 4);
+    }
+    int log = 63 - __builtin_clzll((unsigned long long)(size - 1));
+    return 8 + (log - 7) * 4 + (int)((size - 1 - ((size_t)1 << log)) >> (log - 2));
+}
+
+// Both return NULL when memory is exhausted.
+void* fy_alloc_small(int size_class);
+void* fy_alloc_huge(size_t size, size_t align);
+
+// With size and align known at compile time only the chosen call remains.
+static inline void* fy_alloc(size_t size, size_t align) {
+    if (size <= FY_ALLOC_SMALL_MAX && align <= FY_ALLOC_MAX_ALIGN) {
+        return fy_alloc_small(fy_size_class(size, align));
+    }
+    return fy_alloc_huge(size, align);
+}
+
+// Any thread may free; blocks owned by another thread's heap are handed back
+// to it in batches.
+void fy_free(void* ptr);
+
+// Called by a runtime thread before it exits: flushes its pending remote frees
+// and leaves its heap to be adopted by the next thread that allocates.
+void fy_heap_release(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "fy_alloc.h"
+#include "fy_array.h"
+
+static size_t round_up(size_t bytes) {
+    return (bytes + FY_CACHE_LINE - 1) / FY_CACHE_LINE * FY_CACHE_LINE;
+}
+
+// cap elements whose byte size, rounded up to a cache line, would wrap size_t
+static int too_large(size_t cap, size_t elem_size) {
+    return cap > (SIZE_MAX - FY_CACHE_LINE) / elem_size;
+}
+
+static int reallocate(fy_array_t* array, size_t cap) {
+    if (too_large(cap, array->elem_size)) {
+        return -1;
+    }
+    size_t bytes = round_up(cap * array->elem_size);
+    if (bytes == 0) {
+        bytes = FY_CACHE_LINE;
+    }
+    unsigned char* data = fy_alloc(bytes, FY_CACHE_LINE);
+    if (!data) {
+        return -1;
+    }
+    if (array->data) {
+        memcpy(data, array->data, array->len * array->elem_size);
+        fy_free(array->data);
+    }
+    array->data = data;
+    // a rounded up allocation may hold a few more elements than asked for
+    array->cap = bytes / array->elem_size;
+    return 0;
+}
+
+int fy_array_init(fy_array_t* array, size_t elem_size, size_t len) {
+    array->data = NULL;
+    array->len = 0;
+    array->cap = 0;
+    array->elem_size = elem_size;
+    // the capacity is counted in elements, which zero sized ones have no room for
+    if (elem_size == 0 || too_large(len, elem_size) || reallocate(array, len) != 0) {
+        return -1;
+    }
+    memset(array->data, 0, len * elem_size);
+    array->len = len;
+    return 0;
+}
+
+void fy_array_free(fy_array_t* array) {
+    fy_free(array->data);
+    array->data = NULL;
+    array->len = 0;
+    array->cap = 0;
+}
+
+int fy_array_reserve(fy_array_t* array, size_t cap) {
+    if (cap <= array->cap) {
+        return 0;
+    }
+    // geometric growth keeps repeated pushes amortized O(1)
+    size_t grown = too_large(array->cap * 2, array->elem_size) ? cap : array->cap * 2;
+    return reallocate(array, grown > cap ? grown : cap);
+}
+
+int fy_array_resize(fy_array_t* array, size_t len) {
+    if (too_large(len, array->elem_size) || fy_array_reserve(array, len) != 0) {
+        return -1;
+    }
+    if (len > array->len) {
+        memset(fy_array_at(array, array->len), 0, (len - array->len) * array->elem_size);
+    }
+    array->len = len;
+    return 0;
+}
+
+int fy_array_push(fy_array_t* array, const void* elem) {
+    if (fy_array_reserve(array, array->len + 1) != 0) {
+        return -1;
+    }
+    memcpy(fy_array_at(array, array->len), elem, array->elem_size);
+    array->len += 1;
+    return 0;
+}
+
+static void check_index(const fy_array_t* array, int64_t index) {
+    if (index < 0 || (uint64_t)index >= array->len) {
+        fprintf(
+            stderr,
+            "Array index %lld out of bounds for length %zu\n",
+            (long long)index,
+            array->len
+        );
+        abort();
+    }
+}
+
+void* fy_array_index(fy_array_t* array, int64_t index) {
+    check_index(array, index);
+    return fy_array_at(array, (size_t)index);
+}
+
+void fy_array_update(fy_array_t* array, int64_t index, const void* value) {
+    check_index(array, index);
+    memcpy(fy_array_at(array, (size_t)index), value, array->elem_size);
+}
+
+void fy_array_fill(fy_array_t* array, size_t start, size_t count, const void* value) {
+    if (count == 0) {
+        return;
+    }
+    unsigned char* dst = fy_array_at(array, start);
+    size_t elem_size = array->elem_size;
+    if (elem_size == 1) {
+        memset(dst, *(const unsigned char*)value, count);
+        return;
+    }
+#if defined(__SSE2__)
+    if (elem_size == 8) {
+        int64_t word;
+        memcpy(&word, value, 8);
+        __m128i pattern = _mm_set1_epi64x(word);
+        size_t i = 0;
+        for (; i + 2 <= count; i += 2) {
+            _mm_storeu_si128((__m128i*)(dst + i * 8), pattern);
+        }
+        if (i < count) {
+            memcpy(dst + i * 8, value, 8);
+        }
+        return;
+    }
+#endif
+    // doubling copies turn the fill into O(log n) wide memcpy calls
+    memcpy(dst, value, elem_size);
+    size_t filled = 1;
+    while (filled < count) {
+        size_t chunk = filled <= count - filled ? filled : count - filled;
+        memcpy(dst + filled * elem_size, dst, chunk * elem_size);
+        filled += chunk;
+    }
+}
+
+void fy_array_copy(
+    fy_array_t* dst,
+    size_t dst_start,
+    const fy_array_t* src,
+    size_t src_start,
+    size_t count
+) {
+    // memmove, since dst and src may be the same array
+    memmove(fy_array_at(dst, dst_start), fy_array_at(src, src_start), count * src->elem_size);
+}
+
+int fy_array_equal(const fy_array_t* left, const fy_array_t* right) {
+    if (left->elem_size != right->elem_size || left->len != right->len) {
+        return 0;
+    }
+    return memcmp(left->data, right->data, left->len * left->elem_size) == 0;
+}
+
+int64_t fy_array_search(const fy_array_t* array, const void* value) {
+    size_t len = array->len;
+    size_t elem_size = array->elem_size;
+    const unsigned char* data = array->data;
+    if (elem_size == 1) {
+        const unsigned char* found = memchr(data, *(const unsigned char*)value, len);
+        return found ? (int64_t)(found - data) : -1;
+    }
+    size_t i = 0;
+#if defined(__SSE2__)
+    if (elem_size == 8) {
+        int64_t word;
+        memcpy(&word, value, 8);
+        __m128i pattern = _mm_set1_epi64x(word);
+        for (; i + 2 <= len; i += 2) {
+            __m128i lanes = _mm_loadu_si128((const __m128i*)(data + i * 8));
+            // a 64-bit lane matches when both of its 32-bit halves do
+            __m128i eq32 = _mm_cmpeq_epi32(lanes, pattern);
+            __m128i eq64 = _mm_and_si128(eq32, _mm_shuffle_epi32(eq32, _MM_SHUFFLE(2, 3, 0, 1)));
+            int mask = _mm_movemask_epi8(eq64);
+            if (mask & 0x00ff) {
+                return (int64_t)i;
+            }
+            if (mask & 0xff00) {
+                return (int64_t)i + 1;
+            }
+        }
+    } else if (elem_size == 4) {
+        int32_t word;
+        memcpy(&word, value, 4);
+        __m128i pattern = _mm_set1_epi32(word);
+        for (; i + 4 <= len; i += 4) {
+            __m128i lanes = _mm_loadu_si128((const __m128i*)(data + i * 4));
+            int mask = _mm_movemask_epi8(_mm_cmpeq_epi32(lanes, pattern));
+            if (mask) {
+                return (int64_t)i + __builtin_ctz((unsigned)mask) / 4;
+            }
+        }
+    }
+#endif
+    for (; i < len; ++i) {
+        if (memcmp(data + i * elem_size, value, elem_size) == 0) {
+            return (int64_t)i;
+        }
+    }
+    return -1;
+}
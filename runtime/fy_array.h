@@ -0,0 +1,57 @@
+#ifndef FY_ARRAY_H
+#define FY_ARRAY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// storage is aligned to (and sized in multiples of) a cache line
+#define FY_CACHE_LINE 64
+
+// Contiguous array of fixed-size elements, the representation of Array<T>.
+typedef struct fy_array_t {
+    unsigned char* data;
+    size_t len;
+    size_t cap;
+    size_t elem_size;
+} fy_array_t;
+
+// All functions returning int return 0 on success and -1 when allocation fails.
+// fy_array_init also fails for an elem_size of 0.
+int fy_array_init(fy_array_t* array, size_t elem_size, size_t len);
+void fy_array_free(fy_array_t* array);
+int fy_array_reserve(fy_array_t* array, size_t cap);
+int fy_array_resize(fy_array_t* array, size_t len);
+int fy_array_push(fy_array_t* array, const void* elem);
+
+// Bounds-checked access used by @extern("fy_array_index") and
+// @extern("fy_array_update"), an out of range index aborts.
+void* fy_array_index(fy_array_t* array, int64_t index);
+void fy_array_update(fy_array_t* array, int64_t index, const void* value);
+
+// Unchecked access for callers that have already proven the index in range.
+static inline void* fy_array_at(const fy_array_t* array, size_t index) {
+    return array->data + index * array->elem_size;
+}
+
+void fy_array_fill(fy_array_t* array, size_t start, size_t count, const void* value);
+void fy_array_copy(
+    fy_array_t* dst,
+    size_t dst_start,
+    const fy_array_t* src,
+    size_t src_start,
+    size_t count
+);
+// Returns nonzero when both arrays hold the same elements bytewise.
+int fy_array_equal(const fy_array_t* left, const fy_array_t* right);
+// Returns the index of the first element equal to value, or -1.
+int64_t fy_array_search(const fy_array_t* array, const void* value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
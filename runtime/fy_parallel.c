@@ -0,0 +1,200 @@
+#define _DEFAULT_SOURCE
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "fy_array.h"
+#include "fy_parallel.h"
+
+typedef struct loop_state loop_state;
+
+// Each worker owns a slice of the iteration space. The owner claims chunks
+// from the front and thieves split off the back half, both under the lock.
+typedef struct worker {
+    _Alignas(FY_CACHE_LINE) pthread_mutex_t lock;
+    int64_t next;
+    int64_t end;
+    void* partial;
+    loop_state* state;
+    int index;
+    int started;
+    pthread_t thread;
+} worker;
+
+struct loop_state {
+    fy_loop_body body;
+    void* ctx;
+    int count;
+    worker* workers;
+};
+
+static atomic_int configured_workers;
+
+int fy_parallel_workers(void) {
+    int workers = atomic_load_explicit(&configured_workers, memory_order_relaxed);
+    if (workers > 0) {
+        return workers;
+    }
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    return online > 0 ? (int)online : 1;
+}
+
+void fy_parallel_set_workers(int workers) {
+    atomic_store_explicit(&configured_workers, workers > 0 ? workers : 0, memory_order_relaxed);
+}
+
+// Iterations in [begin, end). A range may hold more than INT64_MAX of them, so
+// widths and offsets are unsigned, and begin + an offset within the range wraps
+// back into it.
+static uint64_t width(int64_t begin, int64_t end) {
+    return end > begin ? (uint64_t)end - (uint64_t)begin : 0;
+}
+
+static int64_t advance(int64_t begin, uint64_t offset) {
+    return (int64_t)((uint64_t)begin + offset);
+}
+
+// Chunks are a quarter of what is left, so they start large enough to amortize
+// the lock and shrink towards single iterations as the slice drains.
+static int claim(worker* self, int64_t* begin, int64_t* end) {
+    pthread_mutex_lock(&self->lock);
+    uint64_t left = width(self->next, self->end);
+    if (left == 0) {
+        pthread_mutex_unlock(&self->lock);
+        return 0;
+    }
+    uint64_t chunk = left / 4 > 0 ? left / 4 : 1;
+    *begin = self->next;
+    *end = advance(self->next, chunk);
+    self->next = *end;
+    pthread_mutex_unlock(&self->lock);
+    return 1;
+}
+
+// Takes the back half of the first slice with work left, scanning from the
+// next worker on so thieves spread over the victims. Only one lock is held at
+// a time; a worker that finds nothing while a steal is in flight just retires.
+static int steal(worker* self) {
+    loop_state* l = self->state;
+    for (int i = 1; i < l->count; ++i) {
+        worker* victim = &l->workers[(self->index + i) % l->count];
+        pthread_mutex_lock(&victim->lock);
+        uint64_t left = width(victim->next, victim->end);
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        int64_t end = victim->end;
+        int64_t begin = advance(victim->next, left / 2);
+        victim->end = begin;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&self->lock);
+        self->next = begin;
+        self->end = end;
+        pthread_mutex_unlock(&self->lock);
+        return 1;
+    }
+    return 0;
+}
+
+static void run_worker(worker* self) {
+    loop_state* l = self->state;
+    int64_t begin;
+    int64_t end;
+    do {
+        while (claim(self, &begin, &end)) {
+            l->body(l->ctx, begin, end, self->partial);
+        }
+    } while (steal(self));
+}
+
+static void* worker_main(void* arg) {
+    run_worker((worker*)arg);
+    return NULL;
+}
+
+// Slices differ by at most one iteration.
+static int64_t slice_start(int64_t begin, uint64_t total, int count, int i) {
+    uint64_t extra = total % (uint64_t)count;
+    uint64_t before = (uint64_t)i < extra ? (uint64_t)i : extra;
+    return advance(begin, total / (uint64_t)count * (uint64_t)i + before);
+}
+
+static size_t round_to_line(size_t size) {
+    return (size + FY_CACHE_LINE - 1) / FY_CACHE_LINE * FY_CACHE_LINE;
+}
+
+int fy_parallel_for(
+    int64_t begin,
+    int64_t end,
+    fy_loop_body body,
+    void* ctx,
+    const fy_reducer_t* reducer,
+    void* result
+) {
+    uint64_t total = width(begin, end);
+    int count = fy_parallel_workers();
+    if (total < (uint64_t)count) {
+        count = total > 0 ? (int)total : 1;
+    }
+    if (reducer) {
+        reducer->identity(result);
+    }
+    if (count == 1) {
+        if (total > 0) {
+            body(ctx, begin, end, result);
+        }
+        return 0;
+    }
+
+    // partials get a cache line each so workers do not share them
+    size_t stride = reducer ? round_to_line(reducer->size) : 0;
+    worker* workers = aligned_alloc(FY_CACHE_LINE, sizeof(worker) * (size_t)count);
+    unsigned char* partials =
+        reducer ? aligned_alloc(FY_CACHE_LINE, stride * (size_t)count) : NULL;
+    if (!workers || (reducer && !partials)) {
+        free(workers);
+        free(partials);
+        return -1;
+    }
+
+    loop_state l = {body, ctx, count, workers};
+    memset(workers, 0, sizeof(worker) * (size_t)count);
+    for (int i = 0; i < count; ++i) {
+        worker* w = &workers[i];
+        pthread_mutex_init(&w->lock, NULL);
+        w->next = slice_start(begin, total, count, i);
+        w->end = slice_start(begin, total, count, i + 1);
+        w->state = &l;
+        w->index = i;
+        if (reducer) {
+            w->partial = partials + stride * (size_t)i;
+            reducer->identity(w->partial);
+        }
+    }
+    // a worker that fails to start leaves its slice to the thieves
+    for (int i = 1; i < count; ++i) {
+        worker* w = &workers[i];
+        w->started = pthread_create(&w->thread, NULL, worker_main, w) == 0;
+    }
+    run_worker(&workers[0]);
+    for (int i = 1; i < count; ++i) {
+        if (workers[i].started) {
+            pthread_join(workers[i].thread, NULL);
+        }
+    }
+
+    for (int i = 0; i < count; ++i) {
+        if (reducer) {
+            reducer->combine(result, workers[i].partial);
+        }
+        pthread_mutex_destroy(&workers[i].lock);
+    }
+    free(partials);
+    free(workers);
+    return 0;
+}
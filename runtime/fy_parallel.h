@@ -0,0 +1,46 @@
+#ifndef FY_PARALLEL_H
+#define FY_PARALLEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Runs the iterations [begin, end) of a @parallel loop body. partial is the
+// running worker's reduction accumulator, or NULL when the loop has no reducer.
+typedef void (*fy_loop_body)(void* ctx, int64_t begin, int64_t end, void* partial);
+
+// Reduction of a @parallel loop. Each worker folds into its own partial of size
+// bytes, which starts out as the identity, and the partials are combined into
+// the result at the end. Stolen chunks finish out of order, so combine must be
+// associative and commutative.
+typedef struct fy_reducer_t {
+    size_t size;
+    void (*identity)(void* partial);
+    void (*combine)(void* into, const void* from);
+} fy_reducer_t;
+
+// Workers a loop runs on, one per online processor unless overridden.
+int fy_parallel_workers(void);
+// A count below 1 restores the default.
+void fy_parallel_set_workers(int workers);
+
+// Runs body over [begin, end) on a work-stealing pool that includes the calling
+// thread, and stores the combined partials in result when reducer is not NULL.
+// Returns 0 on success and -1 when allocation fails, before any iteration ran.
+int fy_parallel_for(
+    int64_t begin,
+    int64_t end,
+    fy_loop_body body,
+    void* ctx,
+    const fy_reducer_t* reducer,
+    void* result
+);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,9 +1,25 @@
+#include <algorithm>
+#include <chrono>
 #include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
 #include <print>
 #include <sstream>
 
+#include "elaborate/attrs.hpp"
+#include "elaborate/bounds.hpp"
 #include "elaborate/elab.hpp"
+#include "elaborate/escape.hpp"
+#include "elaborate/eval.hpp"
+#include "elaborate/layout.hpp"
+#include "elaborate/reuse.hpp"
+#include "interp/compiler.hpp"
+#include "interp/mir.hpp"
+#include "interp/profile.hpp"
+#include "interp/vm.hpp"
 #include "parsing/parser.hpp"
+#include "llvm/ADT/Statistic.h"
 #include "llvm/Support/CommandLine.h"
 
 std::string read_file_to_string(const std::string& filename) {
@@ -30,6 +46,62 @@ int main(int argc, char** argv) {
         llvm::cl::cat(options),
         llvm::cl::init("output.o")
     );
+    llvm::cl::opt<bool> interp(
+        "interp",
+        llvm::cl::desc("Run the program with the bytecode interpreter"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<std::string> profile_generate(
+        "fprofile-generate",
+        llvm::cl::desc("Count calls and switch clauses, writing the profile on exit"),
+        llvm::cl::value_desc("filename"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<std::string> profile_use(
+        "fprofile-use",
+        llvm::cl::desc("Optimize with a profile written by -fprofile-generate"),
+        llvm::cl::value_desc("filename"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<std::string> sample_profile(
+        "fsample-profile",
+        llvm::cl::desc("Sample call stacks by function and source line, written as folded stacks"),
+        llvm::cl::value_desc("filename"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<std::string> instrument(
+        "finstrument",
+        llvm::cl::desc("Time every call with entry and exit probes, writing folded stacks"),
+        llvm::cl::value_desc("filename"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<bool> alloc_profile(
+        "falloc-profile",
+        llvm::cl::desc("Report the objects and bytes allocated at each allocation site"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<unsigned> alloc_sample(
+        "falloc-sample",
+        llvm::cl::desc("Record only one of every N allocations with -falloc-profile"),
+        llvm::cl::value_desc("N"),
+        llvm::cl::init(1),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<bool> dump_layout(
+        "dump-layout",
+        llvm::cl::desc("Print the field layout of classes and enum payloads"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<bool> report_escapes(
+        "report-escapes",
+        llvm::cl::desc("List the allocations kept on the heap and why they escape"),
+        llvm::cl::cat(options)
+    );
+    llvm::cl::opt<bool> emit_mir(
+        "emit-mir",
+        llvm::cl::desc("Print the optimized MIR of every function"),
+        llvm::cl::cat(options)
+    );
 
     llvm::cl::HideUnrelatedOptions(options);
     llvm::cl::ParseCommandLineOptions(argc, argv);
@@ -57,7 +129,144 @@ int main(int argc, char** argv) {
     elaborate::Elaborator elaborator(table);
     auto pkg_elab = elaborator.elab(pkg);
 
-    std::println("{}", pkg);
+    elaborate::Evaluator evaluator;
+    evaluator.eval_package(pkg_elab);
+
+    std::optional<interp::Profile> profile;
+    if (!profile_use.empty()) {
+        profile = interp::Profile::load(profile_use);
+    }
+
+    // "field <name>" counters make the hottest fields of a class come first
+    std::map<std::string, std::uint64_t> field_hotness;
+    if (profile.has_value()) {
+        for (const auto& [name, count]: profile->counts) {
+            if (name.starts_with("field ")) {
+                field_hotness[name.substr(6)] = count;
+            }
+        }
+    }
+    elaborate::LayoutPass layout_pass(&field_hotness);
+    layout_pass.run(pkg_elab);
+    if (dump_layout) {
+        std::println("/* Field layouts:");
+        std::print("{}", layout_pass.dump());
+        std::println("*/");
+    }
+
+    elaborate::NoallocChecker noalloc_checker;
+    noalloc_checker.run(pkg_elab);
+    elaborate::BoundsChecker bounds_checker;
+    bounds_checker.run(pkg_elab);
+    elaborate::ReuseAnalysis reuse_analysis;
+    reuse_analysis.run(pkg_elab);
+    elaborate::EscapeAnalysis escape_analysis;
+    escape_analysis.run(pkg_elab);
+    if (report_escapes) {
+        std::println("/* Escaping allocations:");
+        std::print("{}", escape_analysis.report());
+        std::println("*/");
+    }
+    // -stats is LLVM's own flag, shared with its pass statistics
+    if (llvm::AreStatisticsEnabled()) {
+        std::println(
+            "// bounds checks eliminated: {} of {}",
+            bounds_checker.get_eliminated(),
+            bounds_checker.get_total()
+        );
+        std::println("// reuse candidates: {}", reuse_analysis.get_candidates());
+        std::println("// layout bytes saved: {}", layout_pass.get_saved());
+        std::println(
+            "// allocations promoted to the stack: {} of {}",
+            escape_analysis.get_promoted(),
+            escape_analysis.get_total()
+        );
+    }
+
+    if (interp || emit_mir) {
+        interp::Compiler compiler(
+            !profile_generate.empty(),
+            profile.has_value() ? &*profile : nullptr
+        );
+        if (!instrument.empty()) {
+            compiler.enable_probes();
+        }
+        if (alloc_profile) {
+            compiler.enable_alloc_sites();
+        }
+        interp::Program program = compiler.compile(pkg_elab);
+        if (emit_mir) {
+            std::println("/* MIR:");
+            std::print("{}", interp::dump_mir(program));
+            std::println("*/");
+            if (!interp) {
+                return 0;
+            }
+        }
+        interp::VM vm(program, std::cout);
+        if (!sample_profile.empty()) {
+            vm.enable_sampling();
+        }
+        if (alloc_profile) {
+            vm.enable_alloc_profile(std::max(alloc_sample.getValue(), 1u));
+        }
+        auto result = vm.run();
+        if (!profile_generate.empty()) {
+            interp::make_profile(program, vm.get_profile_counts()).save(profile_generate);
+        }
+        if (!sample_profile.empty()) {
+            interp::save_samples(vm.get_samples(), sample_profile);
+        }
+        if (!instrument.empty()) {
+            std::println("/* Function probes:");
+            std::print("{}", interp::format_probes(program, vm.get_probe_stats()));
+            std::println("*/");
+            interp::save_samples(vm.get_probe_stacks(), instrument);
+        }
+        if (alloc_profile) {
+            std::println("/* Allocation sites:");
+            std::print("{}", interp::format_alloc_sites(program, vm.get_alloc_stats()));
+            std::println("*/");
+        }
+        if (result.tag != interp::Value::Tag::Unit) {
+            std::println("{}", interp::format_value(result, program));
+        }
+        if (llvm::AreStatisticsEnabled()) {
+            const auto& stats = vm.get_gc_stats();
+            std::println(
+                "// gc: {} minor, {} major, {} objects ({} bytes) allocated, {} promoted, {} freed",
+                stats.minor_collections,
+                stats.major_collections,
+                stats.objects_allocated,
+                stats.bytes_allocated,
+                stats.objects_promoted,
+                stats.objects_freed
+            );
+            std::println("// cells reused in place: {}", stats.objects_reused);
+            std::println(
+                "// method calls devirtualized: {} of {}",
+                compiler.get_devirtualized(),
+                compiler.get_method_calls()
+            );
+            std::println("// calls inlined: {}", compiler.get_inlined());
+            std::println("// switches reordered by profile: {}", compiler.get_reordered_switches());
+            std::println("// @soa column accesses: {}", compiler.get_soa_accesses());
+            std::println("// generator loops expanded: {}", compiler.get_generator_loops());
+            std::println("// tuple calls unboxed: {}", compiler.get_unboxed_calls());
+            for (const auto& [pass, changes]: compiler.get_mir_passes().get_changes()) {
+                std::println("// MIR pass {}: {} functions changed", pass, changes);
+            }
+            using std::chrono::duration_cast, std::chrono::microseconds;
+            std::println(
+                "// gc pause: {}us total, {}us max",
+                duration_cast<microseconds>(stats.total_pause).count(),
+                duration_cast<microseconds>(stats.max_pause).count()
+            );
+        }
+        return 0;
+    }
+
+    std::println("{}", pkg_elab);
 
     return 0;
 }
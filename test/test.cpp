@@ -1,6 +1,66 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
 #include "catch2/catch_test_macros.hpp"
+#include "elaborate/attrs.hpp"
+#include "elaborate/bounds.hpp"
+#include "elaborate/decls.hpp"
+#include "elaborate/elab.hpp"
+#include "elaborate/escape.hpp"
+#include "elaborate/eval.hpp"
+#include "elaborate/layout.hpp"
+#include "elaborate/reuse.hpp"
 #include "elaborate/table.hpp"
+#include "fy_alloc.h"
+#include "fy_array.h"
+#include "fy_parallel.h"
+#include "interp/compiler.hpp"
+#include "interp/mir.hpp"
+#include "interp/profile.hpp"
+#include "interp/vm.hpp"
 #include "parsing/lexer.hpp"
+#include "parsing/parser.hpp"
+
+namespace {
+
+elaborate::Package elab_source(const std::string& source) {
+    parsing::Parser parser("test.sf", source);
+    auto pkg = parser.parse_package();
+    elaborate::TableBuilder table_builder(pkg);
+    auto table = table_builder.build();
+    elaborate::Elaborator elaborator(table);
+    auto pkg_elab = elaborator.elab(pkg);
+    elaborate::Evaluator evaluator;
+    evaluator.eval_package(pkg_elab);
+    return pkg_elab;
+}
+
+std::string interp_run(const std::string& source) {
+    auto pkg_elab = elab_source(source);
+    elaborate::BoundsChecker bounds_checker;
+    bounds_checker.run(pkg_elab);
+    elaborate::ReuseAnalysis reuse_analysis;
+    reuse_analysis.run(pkg_elab);
+    elaborate::EscapeAnalysis escape_analysis;
+    escape_analysis.run(pkg_elab);
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg_elab);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    auto result = vm.run();
+    return out.str() + interp::format_value(result, program);
+}
+
+} // namespace
 
 TEST_CASE("test token formatter") {
     parsing::Span span { { 1, 2 }, { 3, 4 } };
@@ -31,4 +91,1402 @@ TEST_CASE("test table type symbol lookup with path") {
     table.exit_node();
     auto symbol = table.find_type_symbol("module1", { "MyEnum" });
     REQUIRE(symbol.get_kind() == elaborate::Symbol::Kind::Enum);
-}
\ No newline at end of file
+}
+
+TEST_CASE("test constant evaluation of let initializer") {
+    parsing::Span span {};
+    auto pat = std::make_shared<elaborate::VarPat>(
+        "x",
+        std::make_shared<elaborate::MetaType>(span),
+        false,
+        span
+    );
+    auto expr = std::make_shared<elaborate::TupleExpr>(
+        std::vector<std::shared_ptr<elaborate::Expr>> {
+            std::make_shared<elaborate::MulExpr>(
+                std::make_shared<elaborate::LitExpr>(
+                    std::make_shared<elaborate::IntLit>(6, span),
+                    span
+                ),
+                std::make_shared<elaborate::LitExpr>(
+                    std::make_shared<elaborate::IntLit>(7, span),
+                    span
+                ),
+                span
+            ),
+            std::make_shared<elaborate::CtorExpr>("pkg.Option.None", std::nullopt, span),
+        },
+        span
+    );
+    auto let_decl = std::make_shared<elaborate::LetDecl>(pat, expr, span);
+    elaborate::Package pkg("pkg", {}, { let_decl }, span);
+
+    elaborate::Evaluator evaluator;
+    evaluator.eval_package(pkg);
+    REQUIRE(let_decl->value != nullptr);
+    REQUIRE(std::format("{}", *let_decl->value) == "(42, pkg.Option.None)");
+
+    auto use = std::make_shared<elaborate::VarExpr>("pkg.x", span);
+    auto value = evaluator.eval(elaborate::ProjExpr(use, 0, span));
+    REQUIRE(value.has_value());
+    REQUIRE(static_cast<elaborate::IntValue&>(**value).value == 42);
+}
+
+TEST_CASE("test constant evaluation leaves effects to runtime") {
+    parsing::Span span {};
+    auto zero =
+        std::make_shared<elaborate::LitExpr>(std::make_shared<elaborate::IntLit>(0, span), span);
+    elaborate::Evaluator evaluator;
+    REQUIRE_FALSE(evaluator.eval(elaborate::DivExpr(zero, zero, span)).has_value());
+    REQUIRE_FALSE(evaluator.eval(elaborate::NewExpr(zero, span)).has_value());
+}
+
+TEST_CASE("test interpreter runs recursion and closures") {
+    auto result = interp_run(R"(
+        @extern("sf_println")
+        func println(s: String);
+        let base = 10;
+        func fact(n: Int) -> Int {
+            if n <= 1 { 1 } else { n * fact(n - 1) }
+        }
+        func main() -> (Int, Int) {
+            println("start");
+            let add = a => b => a + b + base;
+            let mut i = 0;
+            while i < 3 {
+                i = i + 1;
+            }
+            (fact(5), add(i)(4))
+        }
+    )");
+    REQUIRE(result == "start\n(120, 17)");
+}
+
+TEST_CASE("test interpreter dispatches extension methods") {
+    auto result = interp_run(R"(
+        interface Area {
+            type Self;
+            func area(self: Self) -> Int;
+        }
+        enum Shape {
+            case Square(Int)
+            case Rect(Int, Int)
+        }
+        extension Shape: Area {
+            type Self = Shape;
+            func area(self: Shape) -> Int {
+                switch self {
+                    case Shape.Square(s): s * s
+                    case Shape.Rect(w, h): w * h
+                }
+            }
+        }
+        func main() -> Int {
+            Shape.Square(3).area() + Shape.Rect(2, 5).area()
+        }
+    )");
+    REQUIRE(result == "19");
+    REQUIRE_THROWS(interp_run("func main() -> Int { 1 / 0 }"));
+
+    // only a top level main or a function marked @main is the entry
+    std::string nested = "module M { func main() -> Int { 1 } }";
+    REQUIRE(interp_run(nested + "func main() -> Int { 2 }") == "2");
+    REQUIRE(interp_run(nested) == "()");
+    REQUIRE(interp_run(nested + "@main func start() -> Int { 3 }") == "3");
+    REQUIRE_THROWS(interp_run("@main func start() -> Int { 3 } func main() -> Int { 2 }"));
+
+    // extensions of native classes and aliases extend that type, not every type
+    std::string area = R"(
+        interface Area {
+            type Self;
+            func area(self: Self) -> Int;
+        }
+        enum Shape {
+            case Square(Int)
+        }
+        func main() -> Int {
+            Shape.Square(3).area()
+        }
+    )";
+    REQUIRE_THROWS(interp_run(area + R"(
+        @extern("fy_handle_t")
+        class Handle;
+        extension Handle: Area {
+            type Self = Handle;
+            func area(self: Handle) -> Int { 7 }
+        }
+    )"));
+    result = interp_run(area + R"(
+        type Square = Shape;
+        extension Square: Area {
+            type Self = Square;
+            func area(self: Square) -> Int {
+                switch self {
+                    case Shape.Square(s): s * s
+                }
+            }
+        }
+    )");
+    REQUIRE(result == "9");
+}
+
+TEST_CASE("test integers are 64 bits wide and overflow is an error") {
+    std::string prelude = R"(
+        let half = 65536 * 65536 * 65536 * 16384;
+        let max = half - 1 + half;
+        let min = -max - 1;
+    )";
+    auto pkg_elab = elab_source(prelude);
+    auto max_decl = std::static_pointer_cast<elaborate::LetDecl>(pkg_elab.body[1]);
+    REQUIRE(max_decl->value != nullptr);
+    REQUIRE(std::format("{}", *max_decl->value) == "9223372036854775807");
+
+    auto result = interp_run(prelude + "func main() -> (Int, Int) { (min, min % -1) }");
+    REQUIRE(result == "(-9223372036854775808, 0)");
+    REQUIRE_THROWS(interp_run(prelude + "func main() -> Int { max + 1 }"));
+    REQUIRE_THROWS(interp_run(prelude + "func main() -> Int { min - 1 }"));
+    REQUIRE_THROWS(interp_run(prelude + "func main() -> Int { half * 2 }"));
+    REQUIRE_THROWS(interp_run(prelude + "func main() -> Int { min / -1 }"));
+    REQUIRE_THROWS(interp_run(prelude + "func main() -> Int { -min }"));
+}
+
+TEST_CASE("test runtime array growth and bulk operations") {
+    fy_array_t array;
+    REQUIRE(fy_array_init(&array, sizeof(std::int64_t), 3) == 0);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(array.data) % FY_CACHE_LINE == 0);
+    for (std::int64_t i = 0; i < 100; ++i) {
+        REQUIRE(fy_array_push(&array, &i) == 0);
+    }
+    REQUIRE(array.len == 103);
+    REQUIRE(array.cap >= 103);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(array.data) % FY_CACHE_LINE == 0);
+
+    std::int64_t needle = 42;
+    REQUIRE(fy_array_search(&array, &needle) == 45);
+    std::int64_t seven = 7;
+    fy_array_fill(&array, 0, array.len, &seven);
+    REQUIRE(fy_array_search(&array, &needle) == -1);
+    REQUIRE(*static_cast<std::int64_t*>(fy_array_index(&array, 102)) == 7);
+
+    fy_array_t copy;
+    REQUIRE(fy_array_init(&copy, sizeof(std::int64_t), array.len) == 0);
+    fy_array_copy(&copy, 0, &array, 0, array.len);
+    REQUIRE(fy_array_equal(&copy, &array));
+    fy_array_update(&copy, 5, &needle);
+    REQUIRE_FALSE(fy_array_equal(&copy, &array));
+    fy_array_free(&copy);
+
+    // lengths whose byte size wraps size_t fail instead of allocating a wrapped size
+    fy_array_t huge;
+    REQUIRE(fy_array_init(&huge, sizeof(std::int64_t), std::size_t(1) << 60) == -1);
+    REQUIRE(fy_array_resize(&array, SIZE_MAX / 4) == -1);
+    REQUIRE(array.len == 103);
+    REQUIRE(fy_array_reserve(&array, SIZE_MAX / 2) == -1);
+    fy_array_free(&array);
+    // a capacity counted in zero sized elements would divide by zero
+    fy_array_t empty;
+    REQUIRE(fy_array_init(&empty, 0, 4) == -1);
+}
+
+TEST_CASE("test runtime allocator size classes and remote frees") {
+    REQUIRE(fy_size_class(1, 8) == 0);
+    REQUIRE(fy_size_class(128, 8) == 7);
+    REQUIRE(fy_size_class(129, 8) == 8);
+    REQUIRE(fy_size_class(FY_ALLOC_SMALL_MAX, 8) == FY_ALLOC_CLASSES - 1);
+
+    std::vector<void*> blocks;
+    for (std::size_t size = 1; size <= FY_ALLOC_SMALL_MAX; size = size * 3 / 2 + 1) {
+        void* block = fy_alloc(size, 64);
+        REQUIRE(block != nullptr);
+        REQUIRE(reinterpret_cast<std::uintptr_t>(block) % 64 == 0);
+        std::memset(block, 0xab, size);
+        blocks.push_back(block);
+    }
+    for (void* block: blocks) {
+        fy_free(block);
+    }
+
+    // freed blocks are reused most recently freed first
+    void* first = fy_alloc(24, 8);
+    fy_free(first);
+    REQUIRE(fy_alloc(24, 8) == first);
+
+    void* huge = fy_alloc(1 << 20, 8);
+    REQUIRE(huge != nullptr);
+    std::memset(huge, 0, 1 << 20);
+    fy_free(huge);
+
+    // blocks freed on another thread come back once the batch is flushed
+    std::vector<void*> shared(100);
+    for (auto& block: shared) {
+        block = fy_alloc(40, 8);
+    }
+    std::thread([&] {
+        for (void* block: shared) {
+            fy_free(block);
+        }
+        fy_heap_release();
+    }).join();
+    std::vector<void*> reused;
+    for (std::size_t i = 0; i < 4096; ++i) {
+        void* block = fy_alloc(40, 8);
+        if (std::find(shared.begin(), shared.end(), block) != shared.end()) {
+            reused.push_back(block);
+        }
+    }
+    REQUIRE(reused.size() == shared.size());
+}
+
+TEST_CASE("test interpreter indexes runtime arrays") {
+    auto result = interp_run(R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        func main() -> Array<Int> {
+            let a = array_new(3);
+            a[0] = 5;
+            a[2] = a[0] * 2;
+            a
+        }
+    )");
+    REQUIRE(result == "[5, (), 10]");
+    REQUIRE_THROWS(interp_run(R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        func main() -> Int {
+            array_new(3)[3]
+        }
+    )"));
+}
+
+TEST_CASE("test collector keeps reachable objects across collections") {
+    auto pkg = elab_source(R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        enum List {
+            case Nil
+            case Cons(Int, List)
+        }
+        func build(n: Int, acc: List) -> List {
+            if n == 0 { acc } else { build(n - 1, List.Cons(n, acc)) }
+        }
+        func sum(list: List) -> Int {
+            switch list {
+                case List.Nil: 0
+                case List.Cons(x, rest): x + sum(rest)
+            }
+        }
+        let kept = build(10, List.Nil);
+        func main() -> (Int, Int, (Int, Int)) {
+            let slots = array_new(4);
+            let mut i = 0;
+            let mut garbage = 0;
+            while i < 200 {
+                garbage += sum(build(5, List.Nil));
+                slots[i % 4] = (i, sum(build(3, List.Nil)));
+                i += 1;
+            }
+            (sum(kept), garbage, slots[3])
+        }
+    )");
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    std::ostringstream out;
+    interp::VM vm(program, out, 1 << 12, 16);
+    REQUIRE(interp::format_value(vm.run(), program) == "(55, 3000, (199, 6))");
+    const auto& stats = vm.get_gc_stats();
+    REQUIRE(stats.minor_collections > 0);
+    REQUIRE(stats.major_collections > 0);
+    REQUIRE(stats.objects_freed > 0);
+    REQUIRE(stats.objects_freed < stats.objects_allocated);
+}
+
+TEST_CASE("test matched cells are reused only when unshared") {
+    auto pkg = elab_source(R"(
+        enum List {
+            case Nil
+            case Cons(Int, List)
+        }
+        func build(n: Int, acc: List) -> List {
+            if n == 0 { acc } else { build(n - 1, List.Cons(n, acc)) }
+        }
+        func inc(list: List) -> List {
+            switch list {
+                case List.Nil: List.Nil
+                case List.Cons(x, rest): List.Cons(x + 1, inc(rest))
+            }
+        }
+        func swap(pair: (List, List)) -> (List, List) {
+            switch pair {
+                case (a, b): (b, a)
+            }
+        }
+        func sum(list: List) -> Int {
+            switch list {
+                case List.Nil: 0
+                case List.Cons(x, rest): x + sum(rest)
+            }
+        }
+        func main() -> (Int, Int, Int) {
+            let kept = build(10, List.Nil);
+            let fresh = inc(build(10, List.Nil));
+            let (left, right) = swap((inc(kept), kept));
+            (sum(fresh), sum(left), sum(right))
+        }
+    )");
+    elaborate::ReuseAnalysis reuse_analysis;
+    reuse_analysis.run(pkg);
+    REQUIRE(reuse_analysis.get_candidates() == 2);
+
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "(65, 55, 65)");
+    // the fresh list is rebuilt in place, kept is not, and the swapped tuple is
+    // returned unboxed into left and right
+    REQUIRE(vm.get_gc_stats().objects_reused == 10);
+}
+
+TEST_CASE("test method calls on known receivers are devirtualized") {
+    auto pkg = elab_source(R"(
+        interface Area {
+            type Self;
+            func area(self: Self) -> Int;
+        }
+        enum Shape {
+            case Square(Int)
+            case Rect(Int, Int)
+        }
+        extension Shape: Area {
+            type Self = Shape;
+            func area(self: Shape) -> Int {
+                switch self {
+                    case Shape.Square(s): s * s
+                    case Shape.Rect(w, h): w * h
+                }
+            }
+        }
+        extension Int: Area {
+            type Self = Int;
+            func area(self: Int) -> Int {
+                self * self
+            }
+        }
+        @extern("fy_simd_splat")
+        func splat4(x: Int) -> Simd4<Int>;
+        @extern("fy_simd_reduce_add")
+        func sum(v: Simd4<Int>) -> Int;
+        extension Simd4<Int>: Area {
+            type Self = Simd4<Int>;
+            func area(self: Simd4<Int>) -> Int {
+                sum(self)
+            }
+        }
+        func measure<T>(x: T) -> Int {
+            x.area()
+        }
+        func main() -> (Int, Int, Int, Int) {
+            let s = Shape.Rect(2, 5);
+            let n: Int = 4;
+            let v: Simd4<Int> = splat4(1);
+            let w: Simd4<Int> = splat4(2);
+            (
+                Shape.Square(3).area() + s.area(),
+                n.area() + (n + 1).area(),
+                measure(s) + measure(2),
+                (v + w).area()
+            )
+        }
+    )");
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    // the generic parameter and the lane-wise sum go through the method table
+    REQUIRE(compiler.get_method_calls() == 6);
+    REQUIRE(compiler.get_devirtualized() == 4);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "(19, 41, 14, 12)");
+}
+
+TEST_CASE("test optimization hints are checked and inlined") {
+    auto pkg = elab_source(R"(
+        @inline
+        @noalloc
+        func clamp(x: Int, lo: Int, hi: Int) -> Int {
+            if x < lo { return lo; }
+            if x > hi { hi } else { x }
+        }
+        @inline
+        func fact(n: Int) -> Int {
+            if n <= 1 { 1 } else { n * fact(n - 1) }
+        }
+        @hot
+        @noalloc
+        func score(x: Int) -> Int {
+            clamp(x, 0, 10) + clamp(x * 2, 0, 10)
+        }
+        func main() -> (Int, Int, Int) {
+            (score(-3), score(4), fact(5))
+        }
+    )");
+    elaborate::NoallocChecker noalloc_checker;
+    noalloc_checker.run(pkg);
+    REQUIRE(noalloc_checker.get_checked() == 2);
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    // fact is expanded into main but not into itself
+    REQUIRE(compiler.get_inlined() == 3);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "(0, 12, 120)");
+
+    auto allocating = elab_source(R"(
+        func pair(x: Int) -> (Int, Int) { (x, x) }
+        @noalloc
+        func first(x: Int) -> Int {
+            let (a, b) = pair(x);
+            a
+        }
+    )");
+    REQUIRE_THROWS(noalloc_checker.run(allocating));
+    REQUIRE_THROWS(elab_source("@inline @noinline func f() -> Int { 1 }"));
+    REQUIRE_THROWS(elab_source("@noalloc(1) func f() -> Int { 1 }"));
+    REQUIRE_THROWS(elab_source("@inline enum E { case A }"));
+}
+
+TEST_CASE("test profile orders switch clauses and inlines hot functions") {
+    auto pkg = elab_source(R"(
+        enum Op {
+            case Add(Int)
+            case Mul(Int)
+            case Neg
+        }
+        func step(x: Int) -> Op {
+            if x % 10 == 0 { Op.Neg } else { if x % 3 == 0 { Op.Mul(2) } else { Op.Add(x) } }
+        }
+        @noinline
+        func apply(op: Op, acc: Int) -> Int {
+            switch op {
+                case Op.Neg: 0 - acc
+                case Op.Mul(k): (acc * k) % 1000
+                case Op.Add(k): acc + k
+            }
+        }
+        func twice(x: Int) -> Int { x + x }
+        func main() -> Int {
+            let mut i = 0;
+            let mut acc = 0;
+            while i < 1000 {
+                acc = apply(step(i), acc) + twice(1);
+                i += 1;
+            }
+            acc
+        }
+    )");
+    interp::Compiler instrumenting(true);
+    auto instrumented = instrumenting.compile(pkg);
+    std::ostringstream out;
+    interp::VM vm(instrumented, out);
+    REQUIRE(interp::format_value(vm.run(), instrumented) == "600");
+
+    auto path = std::filesystem::temp_directory_path() / "sf_test.prof";
+    interp::make_profile(instrumented, vm.get_profile_counts()).save(path.string());
+    auto profile = interp::Profile::load(path.string());
+    std::filesystem::remove(path);
+    REQUIRE(profile.count("call test.sf.apply") == 1000);
+    REQUIRE(profile.total_calls() == 3001);
+
+    interp::Compiler optimizing(false, &profile);
+    auto program = optimizing.compile(pkg);
+    // step and twice are inlined into main, apply is @noinline
+    REQUIRE(optimizing.get_inlined() == 2);
+    REQUIRE(optimizing.get_reordered_switches() == 1);
+    REQUIRE(program.counters.empty());
+    interp::VM optimized(program, out);
+    REQUIRE(interp::format_value(optimized.run(), program) == "600");
+}
+
+TEST_CASE("test bounds checks eliminated under loop conditions") {
+    auto pkg = elab_source(R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        @extern("fy_array_len")
+        func array_len<T>(a: Array<T>) -> Int;
+        func fill(a: Array<Int>) {
+            let n = array_len(a);
+            let mut i = 0;
+            while i < n {
+                a[i] = i;
+                i += 1;
+                a[i] = 0;
+            }
+        }
+        func sum(a: Array<Int>, start: Int) -> Int {
+            let mut i = start;
+            let mut total = 0;
+            while i < array_len(a) {
+                total += a[i];
+                i += 1;
+            }
+            total
+        }
+    )");
+    elaborate::BoundsChecker bounds_checker;
+    bounds_checker.run(pkg);
+    // a[i] after the increment and a[i] with a possibly negative start stay checked
+    REQUIRE(bounds_checker.get_total() == 3);
+    REQUIRE(bounds_checker.get_eliminated() == 1);
+}
+
+TEST_CASE("test bounds facts do not outlive writes in the condition") {
+    auto source = R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        @extern("fy_array_len")
+        func array_len<T>(a: Array<T>) -> Int;
+        func get(a: Array<Int>, start: Int) -> Int {
+            let mut i = start;
+            let mut r = 0;
+            if 0 <= i && i < array_len(a) && ({ i = 100000; true }) {
+                r = a[i];
+            }
+            r
+        }
+        func main() -> Int {
+            get(array_new(3), 1)
+        }
+    )";
+    auto pkg = elab_source(source);
+    elaborate::BoundsChecker bounds_checker;
+    bounds_checker.run(pkg);
+    REQUIRE(bounds_checker.get_total() == 1);
+    REQUIRE(bounds_checker.get_eliminated() == 0);
+    REQUIRE_THROWS(interp_run(source));
+}
+
+TEST_CASE("test for loops fuse ranges, arrays and adapters") {
+    auto pkg = elab_source(R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        @extern("fy_array_len")
+        func array_len<T>(a: Array<T>) -> Int;
+        func square(x: Int) -> Int { x * x }
+        @noalloc
+        func weighted(a: Array<Int>, k: Int) -> Int {
+            let mut total = 0;
+            for (i, x) in (0..4).zip(a.filter(x => x % k != 0)) {
+                total += i * x;
+            }
+            for y in (1..5).map(square) {
+                if y == 9 { continue; }
+                total += y;
+            }
+            total
+        }
+        func main() -> (Int, Int, Int) {
+            let a = array_new(10);
+            for i in 0..array_len(a) {
+                a[i] = i + 1;
+            }
+            let mut doubled = 0;
+            for x in a.map(x => x * 2).filter(x => x % 3 == 0) {
+                doubled += x;
+            }
+            (doubled, weighted(a, 3), array_len(a))
+        }
+    )");
+    elaborate::BoundsChecker bounds_checker;
+    bounds_checker.run(pkg);
+    REQUIRE(bounds_checker.get_eliminated() == 1);
+    elaborate::NoallocChecker noalloc_checker;
+    noalloc_checker.run(pkg);
+    REQUIRE(noalloc_checker.get_checked() == 1);
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "(36, 46, 10)");
+    // only the array and the result tuple are ever allocated
+    REQUIRE(vm.get_gc_stats().objects_allocated == 2);
+
+    REQUIRE_THROWS(noalloc_checker.run(elab_source(R"(
+        @noalloc
+        func count(n: Int) -> Int {
+            let mut total = 0;
+            for p in (0..n).zip(0..n) {
+                total += 1;
+            }
+            total
+        }
+    )")));
+    REQUIRE_THROWS(interp_run("func main() -> Int { let r = 0..3; 0 }"));
+}
+
+TEST_CASE("test soa arrays store class fields in columns") {
+    const std::string prelude = R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        @extern("fy_array_len")
+        @noalloc
+        func array_len<T>(a: Array<T>) -> Int;
+        @soa
+        class Particle {
+            let mut x: Int = x;
+            let mut vx: Int = vx;
+        }
+        class Point {
+            let x: Int = x;
+            let y: Int = y;
+        }
+    )";
+    auto pkg = elab_source(prelude + R"(
+        @noalloc
+        func step(ps: Array<Particle>) {
+            for i in 0..array_len(ps) {
+                ps[i].x += ps[i].vx;
+            }
+        }
+        func main() -> (Int, Particle, Particle, Array<Particle>) {
+            let ps: Array<Particle> = array_new(3);
+            for i in 0..3 {
+                ps[i] = Particle(i, 10);
+            }
+            step(ps);
+            let p = ps[2];
+            p.x = 0;
+            // an array without the annotation is not columnar, but holds values all the same
+            let plain = array_new(1);
+            plain[0] = p;
+            step(plain);
+            p.vx = 1;
+            (ps[2].x, p, plain[0], ps)
+        }
+    )");
+    elaborate::NoallocChecker noalloc_checker;
+    noalloc_checker.run(pkg);
+    REQUIRE(noalloc_checker.get_checked() == 2);
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    REQUIRE(compiler.get_soa_accesses() == 3);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    // elements are values in either array, so writing to p leaves both alone
+    REQUIRE(
+        interp::format_value(vm.run(), program)
+        == "(12, test.sf.Particle(0, 1), test.sf.Particle(10, 10), "
+           "[test.sf.Particle(10, 10), test.sf.Particle(11, 10), test.sf.Particle(12, 10)])"
+    );
+
+    REQUIRE_THROWS(noalloc_checker.run(elab_source(prelude + R"(
+        @noalloc
+        func first(ps: Array<Particle>) -> Int {
+            let p = ps[0];
+            p.x
+        }
+    )")));
+    REQUIRE_THROWS(interp_run(prelude + R"(
+        func main() -> Int {
+            let ps: Array<Particle> = array_new(1);
+            ps[0] = Point(1, 2);
+            0
+        }
+    )"));
+    REQUIRE_THROWS(interp_run(prelude + "func main() -> Int { Point(1, 2).z }"));
+    REQUIRE_THROWS(elab_source("@soa enum E { case A }"));
+    REQUIRE_THROWS(elab_source("@soa class C {}"));
+    REQUIRE_THROWS(elab_source("@soa(1) class C { let x: Int = x; }"));
+}
+
+TEST_CASE("test layout pass packs and reorders fields") {
+    auto source = R"(
+        class Record {
+            let alive: Bool = alive;
+            let id: Int = id;
+            let tag: Char = tag;
+            let seen: Bool = seen;
+            let hits: Int = hits;
+        }
+        @repr(C)
+        class Header {
+            let flag: Bool = flag;
+            let len: Int = len;
+        }
+        enum Shape {
+            case Dot(Bool, Int)
+            case Empty
+        }
+    )";
+    elaborate::LayoutPass layout_pass;
+    layout_pass.run(elab_source(source));
+    const auto& layouts = layout_pass.get_layouts();
+    REQUIRE(layouts.size() == 3);
+
+    const auto& record = layouts[0];
+    REQUIRE(record.path == "test.sf.Record");
+    REQUIRE(record.declared_size == 32);
+    REQUIRE(record.size == 24);
+    std::vector<std::string> order;
+    for (const auto& field: record.fields) {
+        order.push_back(field.ident);
+    }
+    REQUIRE(order == std::vector<std::string> {"id", "hits", "tag", "alive", "seen"});
+    REQUIRE(record.fields[3].offset == 17);
+    REQUIRE(record.fields[3].bit == 0);
+    REQUIRE(record.fields[4].bit == 1);
+
+    // @repr(C) keeps the declared order and padding
+    REQUIRE(layouts[1].repr_c);
+    REQUIRE(layouts[1].fields[0].ident == "flag");
+    REQUIRE(layouts[1].size == 16);
+    REQUIRE(layouts[2].path == "test.sf.Shape.Dot");
+    REQUIRE(layouts[2].size == 16);
+    REQUIRE(layout_pass.get_saved() == 8);
+
+    // hot fields come first among fields of the same alignment
+    std::map<std::string, std::uint64_t> hotness {{"hits", 100}, {"id", 1}};
+    elaborate::LayoutPass hot_pass(&hotness);
+    hot_pass.run(elab_source(source));
+    REQUIRE(hot_pass.get_layouts()[0].fields[0].ident == "hits");
+    REQUIRE(hot_pass.dump().starts_with("layout test.sf.Record: 24 bytes, align 8, declared 32\n"));
+
+    REQUIRE_THROWS(elab_source("@repr(Rust) class C { let x: Int = x; }"));
+    REQUIRE_THROWS(elab_source("@repr(C) func f() {}"));
+    REQUIRE_THROWS(elab_source("@extern(\"c_point\") class P { let x: Int = x; }"));
+    REQUIRE_NOTHROW(elab_source("@extern(\"c_point\") @repr(C) class P { let x: Int = x; }"));
+}
+
+TEST_CASE("test simd vectors work lane by lane") {
+    std::string prelude = R"(
+        @extern("fy_array_t")
+        class Array<T>;
+        @extern("fy_array_new")
+        func array_new<T>(len: Int) -> Array<T>;
+        @extern("fy_simd_splat")
+        func splat4(x: Int) -> Simd4<Int>;
+        @extern("fy_simd_load")
+        func load4(a: Array<Int>, start: Int) -> Simd4<Int>;
+        @extern("fy_simd_store")
+        func store4(a: Array<Int>, start: Int, v: Simd4<Int>);
+        @extern("fy_simd_shuffle")
+        func shuffle(v: Simd4<Int>, lanes: Simd4<Int>) -> Simd4<Int>;
+        @extern("fy_simd_select")
+        func select(mask: Simd4<Bool>, a: Simd4<Int>, b: Simd4<Int>) -> Simd4<Int>;
+        @extern("fy_simd_reduce_add")
+        func sum(v: Simd4<Int>) -> Int;
+        @extern("fy_simd_reduce_max")
+        func any(v: Simd4<Bool>) -> Bool;
+    )";
+    REQUIRE(
+        interp_run(prelude + R"(
+            func main() -> (Int, Simd4<Int>, Simd4<Bool>, Int, Bool, Array<Int>) {
+                let xs = array_new(8);
+                for i in 0..8 {
+                    xs[i] = i;
+                }
+                let mut acc: Simd4<Int> = splat4(0);
+                for i in 0..2 {
+                    let v: Simd4<Int> = load4(xs, i * 4);
+                    acc += v * v;
+                }
+                let m: Simd4<Bool> = acc > 30;
+                // an Int operand is broadcast to every lane
+                let r = shuffle(acc, load4(xs, 0) * -1 + 3);
+                store4(xs, 2, select(m, acc, splat4(-1)));
+                (sum(acc), r, m, acc[1], any(m), xs)
+            }
+        )")
+        == "(140, <58, 40, 26, 16>, <false, false, true, true>, 26, true, "
+           "[0, 1, -1, -1, 40, 58, 6, 7])"
+    );
+
+    auto pkg = elab_source(prelude + R"(
+        @noalloc
+        func double(v: Simd4<Int>) -> Simd4<Int> {
+            v + v
+        }
+    )");
+    elaborate::NoallocChecker noalloc_checker;
+    REQUIRE_THROWS(noalloc_checker.run(pkg));
+
+    REQUIRE_THROWS(interp_run(prelude + R"(
+        func main() -> Int {
+            let xs = array_new(6);
+            sum(load4(xs, 3))
+        }
+    )"));
+    REQUIRE_THROWS(interp_run(prelude + R"(
+        @extern("fy_simd_splat")
+        func splat(x: Int) -> Int;
+        func main() -> Int { splat(1) }
+    )"));
+    REQUIRE_THROWS(elab_source("func f(v: Simd4<Char>) {}"));
+    REQUIRE_THROWS(elab_source("func f(v: Simd3<Int>) {}"));
+}
+
+TEST_CASE("test parallel loops split work over stealing workers") {
+    fy_parallel_set_workers(4);
+    fy_reducer_t sum {
+        sizeof(std::int64_t),
+        [](void* partial) { *static_cast<std::int64_t*>(partial) = 0; },
+        [](void* into, const void* from) {
+            *static_cast<std::int64_t*>(into) += *static_cast<const std::int64_t*>(from);
+        },
+    };
+    // the first iterations are far slower, so the other workers must steal them
+    std::vector<std::atomic<int>> visits(10000);
+    auto body = [](void* ctx, std::int64_t begin, std::int64_t end, void* partial) {
+        auto& visits = *static_cast<std::vector<std::atomic<int>>*>(ctx);
+        for (auto i = begin; i < end; ++i) {
+            if (i < 100) {
+                std::this_thread::sleep_for(std::chrono::microseconds(200));
+            }
+            ++visits[i];
+            *static_cast<std::int64_t*>(partial) += i;
+        }
+    };
+    std::int64_t total = -1;
+    REQUIRE(fy_parallel_for(0, 10000, body, &visits, &sum, &total) == 0);
+    REQUIRE(total == 49995000);
+    REQUIRE(std::ranges::all_of(visits, [](const auto& count) { return count == 1; }));
+    REQUIRE(fy_parallel_for(5, 5, body, &visits, &sum, &total) == 0);
+    REQUIRE(total == 0);
+    // a range wider than INT64_MAX is still split into chunks that tile it
+    std::atomic<std::uint64_t> covered = 0;
+    auto cover = [](void* ctx, std::int64_t begin, std::int64_t end, void*) {
+        auto width = static_cast<std::uint64_t>(end) - static_cast<std::uint64_t>(begin);
+        *static_cast<std::atomic<std::uint64_t>*>(ctx) += width;
+    };
+    REQUIRE(fy_parallel_for(INT64_MIN, INT64_MAX, cover, &covered, nullptr, nullptr) == 0);
+    REQUIRE(covered == UINT64_MAX);
+    fy_parallel_set_workers(0);
+    REQUIRE(fy_parallel_workers() >= 1);
+
+    REQUIRE(
+        interp_run(R"(
+            @extern("fy_array_t")
+            class Array<T>;
+            @extern("fy_array_new")
+            func array_new<T>(len: Int) -> Array<T>;
+            func main() -> (Int, Array<Int>) {
+                let xs = array_new(4);
+                let mut total = 0;
+                @parallel
+                for i in 0..4 {
+                    let mut square = i * i;
+                    square += 1;
+                    xs[i] = square;
+                    total += square;
+                }
+                (total, xs)
+            }
+        )")
+        == "(18, [1, 2, 5, 10])"
+    );
+    auto loop = [](const std::string& body, const std::string& iter = "xs") {
+        return std::format(
+            "@extern(\"fy_array_t\") class Array<T>; "
+            "func f(xs: Array<Int>) -> Int {{ let mut n = 0; @parallel for i in {} {{ {} }} n }}",
+            iter,
+            body
+        );
+    };
+    REQUIRE_NOTHROW(elab_source(loop("n *= i;")));
+    REQUIRE_NOTHROW(elab_source(loop("let f = (x) => { return x; }; n += f(i);")));
+    REQUIRE_THROWS(elab_source(loop("n = i;")));
+    REQUIRE_THROWS(elab_source(loop("n += n;")));
+    // a binding counts only where it is in scope
+    REQUIRE_THROWS(elab_source(loop("let f = (n: Int) => n; n = f(i);")));
+    REQUIRE_NOTHROW(elab_source(loop("let f = (n: Int) => n; n += f(i);")));
+    REQUIRE_NOTHROW(elab_source(loop("{ let mut n = i; n = 2; }")));
+    REQUIRE_THROWS(elab_source(loop("{ let mut n = i; } n = 2;")));
+    REQUIRE_THROWS(elab_source(loop("if i > 3 { break; }")));
+    REQUIRE_THROWS(elab_source(loop("return i;")));
+    REQUIRE_THROWS(elab_source(loop("n += 1;", "xs.map((x) => x)")));
+    REQUIRE_THROWS(elab_source("@parallel func f() {}"));
+    REQUIRE_THROWS(elab_source("func f() { @parallel(4) for i in 0..4 {} }"));
+    REQUIRE_THROWS(elab_source("func f() { @parallel while true {} }"));
+}
+
+TEST_CASE("test generators run in place of for loops over them") {
+    REQUIRE(
+        interp_run(R"(
+            @extern("fy_array_t")
+            class Array<T>;
+            @extern("fy_array_len")
+            func len<T>(xs: Array<T>) -> Int;
+            func evens(n: Int) {
+                let mut i = 0;
+                while i < n {
+                    yield i;
+                    i += 2;
+                }
+            }
+            func squares(n: Int) {
+                for x in evens(n) {
+                    if x == 4 {
+                        continue;
+                    }
+                    yield (x, x * x);
+                }
+                yield (-1, 0);
+            }
+            func countdown(n: Int) {
+                if n == 0 {
+                    return;
+                }
+                yield n;
+                for m in countdown(n - 1) {
+                    yield m;
+                }
+            }
+            func main() -> (Int, Int, Array<Int>, Int) {
+                let mut total = 0;
+                for (x, square) in squares(8) {
+                    total += x + square;
+                }
+                let mut first = 0;
+                for x in evens(100) {
+                    if x > 10 {
+                        first = x;
+                        break;
+                    }
+                }
+                (total, first, countdown(4), len(evens(7)))
+            }
+        )")
+        == "(47, 12, [4, 3, 2, 1], 4)"
+    );
+    REQUIRE_THROWS(elab_source("func f() -> Int { yield 1; return 2; }"));
+    REQUIRE_THROWS(elab_source("func f() { let g = () => { yield 1; }; }"));
+    REQUIRE_THROWS(elab_source("let x = { yield 1; };"));
+    REQUIRE_THROWS(elab_source("func f(n: Int) { @parallel for i in 0..n { yield i; } }"));
+}
+
+TEST_CASE("test try operator returns early on failure") {
+    std::string prelude = R"(
+        enum Result<T, E> {
+            case Ok(T)
+            case Err(E)
+        }
+        enum Option<T> {
+            case Some(T)
+            case None
+        }
+        func digit(c: Int) -> Result<Int, Int> {
+            if c >= 0 && c < 10 { Result.Ok(c) } else { Result.Err(c) }
+        }
+    )";
+    REQUIRE(
+        interp_run(prelude + R"(
+            func sum3(a: Int, b: Int, c: Int) -> Result<Int, Int> {
+                let x = digit(a)?;
+                let y = digit(b)?;
+                Result.Ok(x + y + digit(c)?)
+            }
+            @inline
+            func twice(a: Int) -> Result<Int, Int> {
+                Result.Ok(digit(a)? * 2)
+            }
+            func half(n: Int) -> Option<Int> {
+                if n % 2 == 0 { Option.Some(n / 2) } else { Option.None }
+            }
+            func quarter(n: Int) -> Option<Int> {
+                Option.Some(half(half(n)?)?)
+            }
+            func main() {
+                (sum3(1, 2, 3), sum3(1, 42, 3), twice(11), quarter(12), quarter(6))
+            }
+        )")
+        == "(test.sf.Result.Ok(6), test.sf.Result.Err(42), test.sf.Result.Err(11), "
+           "test.sf.Option.Some(3), test.sf.Option.None)"
+    );
+    REQUIRE_THROWS(elab_source(prelude + "func f() { let x = digit(1)?; yield x; }"));
+    REQUIRE_THROWS(elab_source(prelude + "func f() { @parallel for i in 0..4 { digit(i)?; } }"));
+    REQUIRE_THROWS(interp_run(prelude + "let x = digit(1)?; func main() -> Int { x }"));
+    REQUIRE_THROWS(interp_run("func main() -> Int { let x = (1, 2)?; 0 }"));
+
+    // enums without a single Ok or Some payload next to failures are rejected
+    std::string rejected = prelude + R"(
+        enum Pair {
+            case Ok(Int, Int)
+            case Err(Int)
+        }
+        enum Outcome {
+            case Good(Int)
+            case Bad(Int)
+        }
+        func good(n: Int) -> Outcome {
+            Outcome.Good(n)
+        }
+    )";
+    REQUIRE_THROWS(interp_run(rejected + "func main() -> Pair { Pair.Ok(1, 2)?; Pair.Err(0) }"));
+    REQUIRE_THROWS(interp_run(rejected + "func main() -> Outcome { Outcome.Good(good(1)?) }"));
+    REQUIRE_THROWS(interp_run(rejected + R"(
+        func main() -> Outcome {
+            let bad = (n: Int) => Outcome.Bad(n);
+            Outcome.Good(bad(1)?)
+        }
+    )"));
+}
+
+TEST_CASE("test tuple returns travel unboxed") {
+    auto pkg = elab_source(R"(
+        func divmod(a: Int, b: Int) -> (Int, Int) {
+            (a / b, a % b)
+        }
+        func minmax(a: Int, b: Int) -> (Int, Int) {
+            if a < b { (a, b) } else { (b, a) }
+        }
+        func swap(t: (Int, Int)) -> (Int, Int) {
+            let (a, b) = t;
+            let r = (b, a);
+            r
+        }
+        func main() {
+            let mut total = 0;
+            let mut i = 0;
+            while i < 100 {
+                let (lo, hi) = minmax(i, 50);
+                let (q, r) = divmod(hi, 7);
+                total += lo + q + r;
+                i += 1;
+            };
+            let (x, y) = swap((1, 2));
+            (total, x, y, divmod(17, 5))
+        }
+    )");
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    REQUIRE(compiler.get_unboxed_calls() == 3);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "(4784, 2, 1, (3, 2))");
+    // the loop allocates nothing, only swap and the result need their tuples
+    REQUIRE(vm.get_gc_stats().objects_allocated == 4);
+
+    REQUIRE_THROWS(interp_run(R"(
+        func triple() -> (Int, Int, Int) {
+            let t = (1, 2, 3);
+            t
+        }
+        func main() -> Int {
+            let (a, b) = triple();
+            a + b
+        }
+    )"));
+}
+
+TEST_CASE("test closures that do not escape live in stack slots") {
+    auto pkg = elab_source(R"(
+        func apply(f, x: Int) -> Int {
+            f(x)
+        }
+        func twice(f, x: Int) -> Int {
+            apply(f, apply(f, x))
+        }
+        func keep(f) {
+            f
+        }
+        func churn(n: Int) -> Int {
+            let mut i = 0;
+            let mut sum = 0;
+            while i < n {
+                let pair = (i, i + 1);
+                sum += pair.1 - pair.0;
+                i += 1;
+            };
+            sum
+        }
+        func main() {
+            let mut total = 0;
+            let mut i = 0;
+            while i < 50 {
+                let pair = (i, 2);
+                let add = x => x + pair.0 * pair.1 + churn(20);
+                total += twice(add, 1);
+                func fact(n: Int) -> Int {
+                    if n <= 1 { 1 } else { n * fact(n - 1) }
+                }
+                total += fact(3);
+                i += 1;
+            };
+            let kept = keep(x => x * 2);
+            (total, kept(4))
+        }
+    )");
+    elaborate::EscapeAnalysis escape_analysis;
+    escape_analysis.run(pkg);
+    REQUIRE(escape_analysis.get_total() == 3);
+    REQUIRE(escape_analysis.get_promoted() == 2);
+    auto report = escape_analysis.report();
+    REQUIRE(report.starts_with("closure at "));
+    REQUIRE(report.contains(": passed to test.sf.keep at "));
+
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    std::ostringstream out;
+    // a small nursery collects while the stack closures hold young captures
+    interp::VM vm(program, out, 1 << 18, 64);
+    REQUIRE(interp::format_value(vm.run(), program) == "(7250, 8)");
+    const auto& stats = vm.get_gc_stats();
+    REQUIRE(stats.minor_collections > 0);
+    // the pairs, the escaping closure and the result, but no promoted closure
+    REQUIRE(stats.objects_allocated == 50 + 50 * 2 * 20 + 2);
+}
+
+TEST_CASE("test MIR splits functions into typed blocks") {
+    auto pkg = elab_source(R"(
+        func minmax(a: Int, b: Int) -> (Int, Int) {
+            if a < b { (a, b) } else { (b, a) }
+        }
+        func churn(n: Int) -> Int {
+            let mut i = 0;
+            let mut sum = 0;
+            while i < n {
+                let pair = (i, i + 1);
+                sum += pair.1 - pair.0;
+                i += 1;
+            };
+            sum
+        }
+        func main() {
+            let (lo, hi) = minmax(9, 3);
+            (lo, hi, churn(10))
+        }
+    )");
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    auto changes = compiler.get_mir_passes().get_changes();
+    REQUIRE(changes.size() == 3);
+    REQUIRE(changes[1] == std::pair<std::string, int> {"unbox-returns", 2});
+
+    // the bytecode is laid out from the MIR, so rebuilding it changes nothing
+    for (const auto& func: program.functions) {
+        auto copy = func;
+        interp::lower_mir(interp::build_mir(func), copy);
+        REQUIRE(copy.code.size() == func.code.size());
+    }
+    auto dump = interp::dump_mir(program);
+    REQUIRE(dump.contains("func test.sf.minmax(2 params, "));
+    REQUIRE(dump.contains(": Tuple = alloc MakeTuple "));
+    REQUIRE(dump.contains(": Int = LoadInt 1\n"));
+    // the pair dies after its last read
+    REQUIRE(dump.contains("    drop r"));
+
+    interp::MirPassManager passes;
+    std::size_t blocks = 0;
+    passes.add(
+        "count-blocks",
+        [&](interp::MirFunction& mir, const interp::Function&, const interp::Program&) {
+            blocks += mir.blocks.size();
+            return false;
+        }
+    );
+    passes.run(program);
+    REQUIRE(blocks >= 7);
+    REQUIRE(passes.get_changes().back() == std::pair<std::string, int> {"count-blocks", 0});
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "(3, 9, 10)");
+}
+
+TEST_CASE("test line tables attribute samples to source lines") {
+    auto pkg = elab_source(R"(func spin(n: Int) -> Int {
+    let mut i = 0;
+    let mut sum = 0;
+    while i < n {
+        sum += i % 7;
+        i += 1;
+    };
+    sum
+}
+func main() -> Int {
+    spin(1000000)
+}
+)");
+    interp::Compiler compiler;
+    auto program = compiler.compile(pkg);
+    const auto& spin = *std::ranges::find(program.functions, "test.sf.spin", &interp::Function::name);
+    auto mod = std::ranges::find(spin.code, interp::Op::Mod, &interp::Instr::op);
+    REQUIRE(mod != spin.code.end());
+    auto pos = interp::source_pos(spin, static_cast<int>(mod - spin.code.begin()));
+    REQUIRE(pos.line == 5);
+    REQUIRE(pos.column == 16);
+
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    vm.enable_sampling(std::chrono::microseconds(100));
+    REQUIRE(interp::format_value(vm.run(), program) == "2999997");
+    REQUIRE(!vm.get_samples().empty());
+    for (const auto& [stack, count]: vm.get_samples()) {
+        REQUIRE(stack.starts_with("test.sf.main:11;test.sf.spin:"));
+    }
+}
+
+TEST_CASE("test probes count every call and time it exclusively") {
+    auto pkg = elab_source(R"(@inline func add(a: Int, b: Int) -> Int { a + b }
+func fib(n: Int) -> Int {
+    if n < 2 { n } else { add(fib(n - 1), fib(n - 2)) }
+}
+func main() -> Int {
+    fib(15)
+}
+)");
+    interp::Compiler compiler;
+    compiler.enable_probes();
+    auto program = compiler.compile(pkg);
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    REQUIRE(interp::format_value(vm.run(), program) == "610");
+
+    auto stats_of = [&](const std::string& name) {
+        auto it = std::ranges::find(program.functions, name, &interp::Function::name);
+        return vm.get_probe_stats()[it - program.functions.begin()];
+    };
+    // the @inline function is called rather than inlined, so it is counted too
+    REQUIRE(stats_of("test.sf.fib").calls == 1973);
+    REQUIRE(stats_of("test.sf.add").calls == 986);
+    REQUIRE(stats_of("test.sf.main").calls == 1);
+    auto main = stats_of("test.sf.main");
+    auto fib = stats_of("test.sf.fib");
+    REQUIRE(main.inclusive >= fib.inclusive);
+    REQUIRE(fib.inclusive >= fib.exclusive);
+
+    auto stacks = vm.get_probe_stacks();
+    REQUIRE(stacks.contains("test.sf.main;test.sf.fib;test.sf.fib;test.sf.add"));
+    for (const auto& [stack, cycles]: stacks) {
+        REQUIRE(stack.starts_with("test.sf.main"));
+    }
+    REQUIRE(interp::format_probes(program, vm.get_probe_stats()).contains("test.sf.fib"));
+}
+
+TEST_CASE("test allocation sites attribute objects to source positions") {
+    auto source = R"(enum List {
+    case Nil
+    case Cons(Int, List)
+}
+func build(n: Int, acc: List) -> List {
+    if n == 0 { acc } else { build(n - 1, List.Cons(n, acc)) }
+}
+func main() -> Int {
+    let mut i = 0;
+    while i < 10 {
+        build(100, List.Nil);
+        i += 1;
+    };
+    i
+}
+)";
+    interp::Compiler compiler;
+    compiler.enable_alloc_sites();
+    auto program = compiler.compile(elab_source(source));
+    auto site = std::ranges::find_if(program.alloc_sites, [](const auto& name) {
+        return name.starts_with("test.sf.build at 6:");
+    });
+    REQUIRE(site != program.alloc_sites.end());
+
+    std::ostringstream out;
+    interp::VM vm(program, out);
+    vm.enable_alloc_profile();
+    REQUIRE(interp::format_value(vm.run(), program) == "10");
+    const auto& cons = vm.get_alloc_stats()[site - program.alloc_sites.begin()];
+    REQUIRE(cons.objects == 1000);
+    REQUIRE(cons.bytes >= 1000 * sizeof(interp::CtorObject));
+    auto report = interp::format_alloc_sites(program, vm.get_alloc_stats());
+    // the Nil built in main takes fewer bytes, if it allocates at all
+    REQUIRE(report.find(*site) < report.find("test.sf.main"));
+
+    interp::VM sampled(program, out);
+    sampled.enable_alloc_profile(10);
+    sampled.run();
+    std::uint64_t objects = 0;
+    for (const auto& stats: sampled.get_alloc_stats()) {
+        objects += stats.objects;
+    }
+    REQUIRE(objects % 10 == 0);
+    REQUIRE(objects > 0);
+    REQUIRE(objects <= 1010);
+}
+
+TEST_CASE("test elaborated names keep the declaration they resolved to") {
+    auto pkg = elab_source(R"(
+        module A {
+            enum Shape {
+                case Dot
+            }
+            func make() -> Shape { Shape.Dot }
+        }
+        module B {
+            enum Shape {
+                case Dot(Int)
+            }
+            func make() -> Shape { Shape.Dot(1) }
+            func other() -> A.Shape { A.make() }
+        }
+    )");
+    auto members = [&](std::size_t i) -> const std::vector<std::shared_ptr<elaborate::Decl>>& {
+        return static_cast<const elaborate::ModuleDecl&>(*pkg.body[i]).body;
+    };
+    const auto& a = members(0);
+    const auto& b = members(1);
+    auto ret_ref = [](const std::shared_ptr<elaborate::Decl>& decl) {
+        const auto& func = static_cast<const elaborate::FuncDecl&>(*decl);
+        return static_cast<const elaborate::EnumType&>(*func.ret_type).ref;
+    };
+    // both types are named Shape, the handles still tell them apart
+    REQUIRE(ret_ref(a[1]).decl == a[0].get());
+    REQUIRE(ret_ref(b[1]).decl == b[0].get());
+    REQUIRE(ret_ref(b[2]).decl == a[0].get());
+    REQUIRE(ret_ref(b[2]).symbol->get_path() == "test.sf.A.Shape");
+    // the table outlives the elaborator through the package
+    REQUIRE(ret_ref(b[2]).node->get_path() == "test.sf.A.Shape");
+    REQUIRE(ret_ref(a[1]).symbol->get_id() != ret_ref(b[1]).symbol->get_id());
+}
+
+TEST_CASE("test declaration store finds declarations by symbol") {
+    auto pkg = elab_source(R"(
+        interface Area {
+            type Self;
+            func area(self: Self) -> Int;
+        }
+        enum Shape {
+            case Square(Int)
+        }
+        extension Shape: Area {
+            type Self = Shape;
+            func area(self: Shape) -> Int {
+                switch self {
+                    case Shape.Square(s): s * s
+                }
+            }
+        }
+        func size(shape: Shape) -> Int { shape.area() }
+    )");
+    const auto& store = *pkg.decls;
+    const auto& ext = static_cast<const elaborate::ExtensionDecl&>(*pkg.body[2]);
+    const auto& area = static_cast<const elaborate::InterfaceType&>(*ext.interface).ref;
+    const auto& shape = static_cast<const elaborate::EnumType&>(*ext.base_type).ref;
+    REQUIRE(store.find(*area.symbol) == pkg.body[0].get());
+    REQUIRE(store.find(*shape.symbol) == pkg.body[1].get());
+    REQUIRE(store.find_implementations(*area.symbol).size() == 1);
+    REQUIRE(store.find_implementations(*area.symbol)[0] == &ext);
+    REQUIRE(store.find_extensions(*shape.symbol).size() == 1);
+    REQUIRE(store.find_extensions(*shape.symbol)[0] == &ext);
+    // an interface is not the base type of anything here
+    REQUIRE(store.find_extensions(*area.symbol).empty());
+    REQUIRE(store.get_decls().size() >= 4);
+}